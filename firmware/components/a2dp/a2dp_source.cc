@@ -0,0 +1,439 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+
+#include "include/a2dp_source.hpp"
+#include "telemetry.hpp"
+
+extern "C" {
+
+#include "esp_bt.h"
+#include "esp_bt_main.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+}
+
+namespace {
+
+constexpr const char* kComponentTag = "A2dpSourceObject";
+constexpr std::uint32_t kIdleWaitMs = 100;
+constexpr std::uint32_t kPcmWaitMs = 20;
+constexpr std::uint32_t kAdaptIntervalMs = 1000;
+
+/// @brief roughly the playback time of one block
+constexpr TickType_t kFullWaitTicks = std::max<TickType_t>(1, pdMS_TO_TICKS(JitterBuffer::kBlockFrames * 1000 / A2dpSourceObject::kSampleRate));
+
+/// @brief legacy pairing pin for sinks without SSP
+constexpr std::array<std::uint8_t, 4> kPinCode = {'0', '0', '0', '0'};
+
+bool succeeded(const esp_err_t result, const char* step) {
+  if (result != ESP_OK) {
+    ESP_LOGE(kComponentTag, "%s failed: %s", step, esp_err_to_name(result));
+  }
+  return result == ESP_OK;
+}
+
+}
+
+std::atomic<A2dpSourceObject*> A2dpSourceObject::instance_{nullptr};
+
+A2dpSourceObject::A2dpSourceObject(DspObject& dsp, StateStore& state, const Config& config, const Priority priority)
+  : StaticActiveObject("A2dpSourceObject", priority, std::nullopt, ActiveObject::Workload::kRadio),
+    dsp_(dsp),
+    state_(state),
+    config_(config) {}
+
+A2dpSourceObject::~A2dpSourceObject() {
+  // the stack must stop pulling audio before the buffer goes away
+  if (stack_ready_) {
+    esp_a2d_source_deinit();
+  }
+  instance_.store(nullptr);
+
+  mark_as_done();
+  join();
+
+  // committed blocks are freed along with the buffer
+  if (block_) {
+    buffer_.commit(block_);
+    block_ = nullptr;
+  }
+}
+
+bool A2dpSourceObject::set_peer(const Address& peer) {
+  portENTER_CRITICAL(&peer_lock_);
+  requested_peer_ = peer;
+  portEXIT_CRITICAL(&peer_lock_);
+
+  return post(Event{
+    .type = Event::Type::kControl,
+    .code = static_cast<std::uint16_t>(Control::kPeerChanged),
+    .value = 0,
+  });
+}
+
+bool A2dpSourceObject::set_link_enabled(const bool enabled) {
+  return post(Event{
+    .type = Event::Type::kControl,
+    .code = static_cast<std::uint16_t>(Control::kLinkEnabled),
+    .value = enabled,
+  });
+}
+
+JitterBuffer::Stats A2dpSourceObject::get_buffer_stats() const {
+  portENTER_CRITICAL(&buffer_stats_lock_);
+  const JitterBuffer::Stats stats = buffer_stats_;
+  portEXIT_CRITICAL(&buffer_stats_lock_);
+  return stats;
+}
+
+std::uint32_t A2dpSourceObject::get_buffer_fill_percent() const {
+  const std::size_t target = buffer_.get_target();
+  return target ? static_cast<std::uint32_t>(std::min<std::size_t>(buffer_.get_fill() * 100 / target, 100)) : 0;
+}
+
+void A2dpSourceObject::initialize() {
+  instance_.store(this);
+
+  // classic only; the BLE controller memory is handed back to the heap
+  esp_bt_controller_mem_release(ESP_BT_MODE_BLE);
+
+  esp_bt_controller_config_t controller_config = BT_CONTROLLER_INIT_CONFIG_DEFAULT();
+  esp_bluedroid_config_t bluedroid_config = BT_BLUEDROID_INIT_CONFIG_DEFAULT();
+
+  const bool stack_up =
+    succeeded(esp_bt_controller_init(&controller_config), "Controller init") &&
+    succeeded(esp_bt_controller_enable(ESP_BT_MODE_CLASSIC_BT), "Controller enable") &&
+    succeeded(esp_bluedroid_init_with_cfg(&bluedroid_config), "Bluedroid init") &&
+    succeeded(esp_bluedroid_enable(), "Bluedroid enable") &&
+    succeeded(esp_bt_gap_register_callback(gap_callback), "GAP callback") &&
+    succeeded(esp_bt_gap_set_device_name(config_.device_name), "Device name") &&
+    succeeded(esp_a2d_register_callback(a2d_callback), "A2DP callback") &&
+    succeeded(esp_a2d_source_register_data_callback(data_callback), "A2DP data callback") &&
+    succeeded(esp_a2d_source_init(), "A2DP source init");
+
+  if (!stack_up) {
+    // nothing to release later
+    link_released_.store(true);
+    instance_.store(nullptr);
+    mark_as_done();
+    return;
+  }
+  stack_ready_ = true;
+
+  // no display or keyboard: just works pairing, or a fixed pin for legacy sinks
+  esp_bt_io_cap_t io_capability = ESP_BT_IO_CAP_NONE;
+  esp_bt_gap_set_security_param(ESP_BT_SP_IOCAP_MODE, &io_capability, sizeof(io_capability));
+
+  esp_bt_pin_code_t pin_code{};
+  esp_bt_gap_set_pin(ESP_BT_PIN_TYPE_VARIABLE, 0, pin_code);
+
+  // a sink we were paired with can reconnect on its own
+  esp_bt_gap_set_scan_mode(ESP_BT_CONNECTABLE, ESP_BT_NON_DISCOVERABLE);
+
+  window_start_us_ = esp_timer_get_time();
+  ESP_LOGI(kComponentTag, "Bluetooth ready as '%s'", config_.device_name);
+}
+
+void A2dpSourceObject::task() {
+  const std::int64_t now_us = esp_timer_get_time();
+  window_idle_ = window_idle_ || !dsp_.is_playing() || !streaming_.load();
+
+  // underruns only say something about the link if audio was due all along
+  const auto elapsed_ms = static_cast<std::uint32_t>((now_us - window_start_us_) / 1000);
+  if (elapsed_ms >= kAdaptIntervalMs) {
+    buffer_.adapt(elapsed_ms, !window_idle_);
+    window_start_us_ = now_us;
+    window_idle_ = false;
+
+    portENTER_CRITICAL(&buffer_stats_lock_);
+    buffer_stats_ = buffer_.get_stats();
+    portEXIT_CRITICAL(&buffer_stats_lock_);
+  }
+
+  // start filling as soon as there is a link, so streaming starts primed
+  if (link_state_ != ESP_A2D_CONNECTION_STATE_CONNECTED) {
+    connect();
+    vTaskDelay(pdMS_TO_TICKS(kIdleWaitMs));
+    return;
+  }
+
+  if (!block_) {
+    block_ = buffer_.acquire();
+    block_samples_ = 0;
+
+    // at the target depth; the stack frees a block every few milliseconds
+    if (!block_) {
+      vTaskDelay(kFullWaitTicks);
+      return;
+    }
+  }
+
+  fill_block();
+  if (block_samples_ == JitterBuffer::kBlockSamples) {
+    buffer_.commit(block_);
+    block_ = nullptr;
+  }
+}
+
+void A2dpSourceObject::fill_block() {
+  const auto format = dsp_.get_format();
+  const std::size_t channels = format.channels == 1 ? 1 : 2;
+
+  // the SBC stream stays at kSampleRate, whatever the track
+  if (format.sample_rate != 0 && resampler_.configure(format.sample_rate, kSampleRate, channels)) {
+    pending_samples_ = 0;
+    if (!resampler_.is_passthrough()) {
+      LOGI(kComponentTag, "Resampling %" PRIu32 " Hz to %" PRIu32 " Hz", format.sample_rate, kSampleRate);
+    }
+  }
+
+  const std::size_t space = JitterBuffer::kBlockSamples - block_samples_;
+  std::int16_t* const output = block_->samples.data() + block_samples_;
+
+  std::size_t read = 0;
+  if (!resampler_.is_passthrough()) {
+    read = fill_resampled(channels);
+  } else if (channels != 1) {
+    read = dsp_.read_pcm(output, space, pdMS_TO_TICKS(kPcmWaitMs));
+    block_samples_ += read;
+  } else {
+    // the sink always gets stereo
+    read = dsp_.read_pcm(scratch_.data(), space / 2, pdMS_TO_TICKS(kPcmWaitMs));
+    for (std::size_t i = 0; i < read; i++) {
+      output[2 * i] = output[2 * i + 1] = scratch_[i];
+    }
+    block_samples_ += 2 * read;
+  }
+
+  if (read > 0) {
+    record_handoff(dsp_.get_producer());
+  } else if (dsp_.is_playing()) {
+    TELEMETRY_COUNT(kPcmUnderruns);
+  }
+}
+
+std::size_t A2dpSourceObject::fill_resampled(const std::size_t channels) {
+  const std::size_t space_frames = (JitterBuffer::kBlockSamples - block_samples_) / 2;
+  std::int16_t* const output = block_->samples.data() + block_samples_;
+
+  // read no more than the block has room for once converted
+  const std::size_t wanted = std::min(resampler_.input_frames_for(space_frames) * channels, scratch_.size());
+  std::size_t read = 0;
+  if (pending_samples_ < wanted) {
+    read = dsp_.read_pcm(scratch_.data() + pending_samples_, wanted - pending_samples_, pdMS_TO_TICKS(kPcmWaitMs));
+    pending_samples_ += read;
+  }
+
+  std::size_t written = 0;
+  std::int16_t* const target = channels == 1 ? resampled_.data() : output;
+  const std::size_t consumed = resampler_.process(scratch_.data(), pending_samples_ / channels, target,
+    space_frames, written) * channels;
+
+  // keep what was not consumed, including a split frame, for the next call
+  pending_samples_ -= consumed;
+  std::memmove(scratch_.data(), scratch_.data() + consumed, pending_samples_ * sizeof(std::int16_t));
+
+  // the sink always gets stereo
+  if (channels == 1) {
+    for (std::size_t i = 0; i < written; i++) {
+      output[2 * i] = output[2 * i + 1] = resampled_[i];
+    }
+  }
+
+  block_samples_ += 2 * written;
+  return read;
+}
+
+void A2dpSourceObject::connect() {
+  if (link_state_ != ESP_A2D_CONNECTION_STATE_DISCONNECTED || !link_enabled_) {
+    return;
+  }
+
+  const auto& peer = config_.peer;
+  if (std::all_of(peer.begin(), peer.end(), [](const std::uint8_t byte) { return byte == 0; })) {
+    return;
+  }
+
+  const std::int64_t now_us = esp_timer_get_time();
+  if (last_attempt_us_ != 0 && now_us - last_attempt_us_ < static_cast<std::int64_t>(config_.reconnect_interval_ms) * 1000) {
+    return;
+  }
+  last_attempt_us_ = now_us;
+
+  Address address = peer;
+  if (succeeded(esp_a2d_source_connect(address.data()), "Connect")) {
+    link_state_ = ESP_A2D_CONNECTION_STATE_CONNECTING;
+    LOGI(kComponentTag, "Connecting to %02x:%02x:%02x:%02x:%02x:%02x",
+      peer[0], peer[1], peer[2], peer[3], peer[4], peer[5]);
+  }
+}
+
+void A2dpSourceObject::on_event(const Event& event) {
+  switch (event.type) {
+    case Event::Type::kBluetooth:
+      handle_link_event(static_cast<LinkEvent>(event.code), event.value);
+      break;
+
+    case Event::Type::kControl:
+      if (static_cast<Control>(event.code) == Control::kPeerChanged) {
+        Address previous = config_.peer;
+        portENTER_CRITICAL(&peer_lock_);
+        config_.peer = requested_peer_;
+        portEXIT_CRITICAL(&peer_lock_);
+
+        // the disconnect event brings us back to connect() for the new peer
+        if (link_state_ != ESP_A2D_CONNECTION_STATE_DISCONNECTED && previous != config_.peer) {
+          esp_a2d_source_disconnect(previous.data());
+        }
+        last_attempt_us_ = 0;
+      } else if (static_cast<Control>(event.code) == Control::kLinkEnabled) {
+        link_enabled_ = event.value != 0;
+        esp_bt_gap_set_scan_mode(link_enabled_ ? ESP_BT_CONNECTABLE : ESP_BT_NON_CONNECTABLE, ESP_BT_NON_DISCOVERABLE);
+
+        if (link_enabled_) {
+          link_released_.store(false);
+          last_attempt_us_ = 0;
+        } else if (link_state_ == ESP_A2D_CONNECTION_STATE_DISCONNECTED) {
+          link_released_.store(true);
+        } else {
+          // released once the disconnect event arrives
+          portENTER_CRITICAL(&peer_lock_);
+          Address peer = connected_peer_;
+          portEXIT_CRITICAL(&peer_lock_);
+          esp_a2d_source_disconnect(peer.data());
+        }
+        LOGI(kComponentTag, "Link %s", link_enabled_ ? "enabled" : "disabled");
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+void A2dpSourceObject::handle_link_event(const LinkEvent code, const std::uint32_t value) {
+  switch (code) {
+    case LinkEvent::kConnection:
+      link_state_ = static_cast<esp_a2d_connection_state_t>(value);
+      if (link_state_ == ESP_A2D_CONNECTION_STATE_CONNECTED) {
+        portENTER_CRITICAL(&peer_lock_);
+        const Address peer = connected_peer_;
+        portEXIT_CRITICAL(&peer_lock_);
+
+        LOGI(kComponentTag, "Connected to %02x:%02x:%02x:%02x:%02x:%02x",
+          peer[0], peer[1], peer[2], peer[3], peer[4], peer[5]);
+        state_.set_peer(peer);
+
+        // an attempt that was under way when the link was disabled
+        if (!link_enabled_) {
+          Address address = peer;
+          esp_a2d_source_disconnect(address.data());
+          break;
+        }
+        esp_a2d_media_ctrl(ESP_A2D_MEDIA_CTRL_CHECK_SRC_RDY);
+      } else if (link_state_ == ESP_A2D_CONNECTION_STATE_DISCONNECTED) {
+        LOGI(kComponentTag, "Disconnected");
+        streaming_.store(false);
+        link_released_.store(!link_enabled_);
+      }
+      break;
+
+    case LinkEvent::kAudio:
+      streaming_.store(value == ESP_A2D_AUDIO_STATE_STARTED);
+      LOGI(kComponentTag, "Audio %s", streaming_.load() ? "started" : "suspended");
+      break;
+
+    case LinkEvent::kMediaAck: {
+      const auto command = static_cast<esp_a2d_media_ctrl_t>(value >> 8);
+      const auto status = static_cast<esp_a2d_media_ctrl_ack_t>(value & 0xff);
+      if (status != ESP_A2D_MEDIA_CTRL_ACK_SUCCESS) {
+        LOGW(kComponentTag, "Media command %d rejected (%d)", command, status);
+      } else if (command == ESP_A2D_MEDIA_CTRL_CHECK_SRC_RDY) {
+        esp_a2d_media_ctrl(ESP_A2D_MEDIA_CTRL_START);
+      }
+      break;
+    }
+  }
+}
+
+void A2dpSourceObject::gap_callback(esp_bt_gap_cb_event_t event, esp_bt_gap_cb_param_t* param) {
+  switch (event) {
+    case ESP_BT_GAP_AUTH_CMPL_EVT:
+      if (param->auth_cmpl.stat == ESP_BT_STATUS_SUCCESS) {
+        ESP_LOGI(kComponentTag, "Paired with '%s'", reinterpret_cast<const char*>(param->auth_cmpl.device_name));
+      } else {
+        LOGW(kComponentTag, "Pairing failed (%d)", param->auth_cmpl.stat);
+      }
+      break;
+
+    case ESP_BT_GAP_PIN_REQ_EVT: {
+      esp_bt_pin_code_t pin_code{};
+      std::copy(kPinCode.begin(), kPinCode.end(), pin_code);
+      esp_bt_gap_pin_reply(param->pin_req.bda, true, kPinCode.size(), pin_code);
+      break;
+    }
+
+    case ESP_BT_GAP_CFM_REQ_EVT:
+      esp_bt_gap_ssp_confirm_reply(param->cfm_req.bda, true);
+      break;
+
+    default:
+      break;
+  }
+}
+
+void A2dpSourceObject::a2d_callback(esp_a2d_cb_event_t event, esp_a2d_cb_param_t* param) {
+  auto* const self = instance_.load();
+  if (!self) {
+    return;
+  }
+
+  Event message{.type = Event::Type::kBluetooth, .code = 0, .value = 0};
+  switch (event) {
+    case ESP_A2D_CONNECTION_STATE_EVT:
+      message.code = static_cast<std::uint16_t>(LinkEvent::kConnection);
+      message.value = param->conn_stat.state;
+      portENTER_CRITICAL(&self->peer_lock_);
+      std::copy(std::begin(param->conn_stat.remote_bda), std::end(param->conn_stat.remote_bda), self->connected_peer_.begin());
+      portEXIT_CRITICAL(&self->peer_lock_);
+      break;
+
+    case ESP_A2D_AUDIO_STATE_EVT:
+      message.code = static_cast<std::uint16_t>(LinkEvent::kAudio);
+      message.value = param->audio_stat.state;
+      break;
+
+    case ESP_A2D_MEDIA_CTRL_ACK_EVT:
+      message.code = static_cast<std::uint16_t>(LinkEvent::kMediaAck);
+      message.value = static_cast<std::uint32_t>(param->media_ctrl_stat.cmd) << 8 | param->media_ctrl_stat.status;
+      break;
+
+    default:
+      return;
+  }
+
+  // the stack task must not block on us for long
+  if (!self->post(message, pdMS_TO_TICKS(kIdleWaitMs))) {
+    TELEMETRY_COUNT(kLinkEventsDropped);
+    LOGW(kComponentTag, "Mailbox full, dropped link event %u", message.code);
+  }
+}
+
+std::int32_t A2dpSourceObject::data_callback(std::uint8_t* data, std::int32_t size) {
+  if (!data || size <= 0) {
+    return 0;
+  }
+
+  // 16-bit stereo; SBC frames always ask for whole sample pairs
+  auto* const self = instance_.load();
+  const std::size_t samples = static_cast<std::size_t>(size) / sizeof(std::int16_t);
+  if (self) {
+    self->buffer_.read(reinterpret_cast<std::int16_t*>(data), samples);
+  } else {
+    std::memset(data, 0, static_cast<std::size_t>(size));
+  }
+
+  return size;
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+extern "C" {
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_a2dp_api.h"
+#include "esp_gap_bt_api.h"
+
+}
+
+#include "component.hpp"
+#include "dsp.hpp"
+#include "state_store.hpp"
+#include "jitter_buffer.hpp"
+
+/**
+ * @brief Bluetooth A2DP source streaming the pipeline output to a sink
+ * (headphones, speaker). The task moves PCM from the DSP stage into a
+ * JitterBuffer; the Bluetooth stack pulls from that buffer in its own task
+ * whenever the SBC encoder needs more audio. The buffer depth is adapted
+ * once a second from the underruns and request sizes seen on the link.
+ *
+ * Stack callbacks are forwarded to the mailbox as Event::Type::kBluetooth,
+ * so connection handling runs in this object's task rather than the
+ * Bluetooth task. The link is (re)connected to the configured peer
+ * whenever it drops. The sink that connected last is remembered in the
+ * state store, so it can be reconnected to after a reboot.
+ */
+class A2dpSourceObject : public StaticActiveObject<ActiveObject::MemoryLoad::kStandard> {
+public:
+  /// @brief the only PCM format the SBC encoder is fed with; tracks at
+  /// other rates are resampled on their way into the jitter buffer
+  static constexpr std::uint32_t kSampleRate = 44100;
+
+  using Address = std::array<std::uint8_t, ESP_BD_ADDR_LEN>;
+
+  /// @brief configuration for the Bluetooth link
+  struct Config {
+    /// @brief name shown to other devices
+    const char* device_name = "mp3";
+
+    /// @brief sink to connect to (all zero: only wait for incoming connections)
+    Address peer{};
+
+    /// @brief delay between connection attempts
+    std::uint32_t reconnect_interval_ms = 5000;
+  };
+
+  /// @brief A2DP source constructor
+  /// @param dsp processing stage to pull PCM from
+  /// @param state store the connected sink is remembered in
+  /// @param config link configuration
+  /// @param priority task priority; the stack's own tasks run at a high priority anyway
+  A2dpSourceObject(DspObject& dsp, StateStore& state, const Config& config, const Priority priority = Priority::kHigh);
+
+  /// @brief stop the stack from pulling audio on destruction
+  ~A2dpSourceObject();
+
+  /**
+   * @brief Switch to another sink, dropping the current link. Takes effect
+   * in this object's task.
+   * @param peer address of the new sink
+   * @return false if the request could not be queued
+   */
+  bool set_peer(const Address& peer);
+
+  /**
+   * @brief Drop the link and stop connecting and accepting connections, or
+   * allow them again, e.g. to keep the radio to WiFi while it is in use.
+   * The controller stays up. Takes effect in this object's task.
+   * @return false if the request could not be queued
+   */
+  bool set_link_enabled(const bool enabled);
+
+  /// @brief true once the link is disabled and down (or the stack never came up)
+  bool is_link_released() const { return link_released_.load(); }
+
+  /// @brief true while audio is being streamed to the sink
+  bool is_streaming() const { return streaming_.load(); }
+
+  /// @brief depth and link statistics as of the last adaptation
+  JitterBuffer::Stats get_buffer_stats() const;
+
+  /// @brief jitter buffer fill relative to its current target depth (0-100)
+  std::uint32_t get_buffer_fill_percent() const;
+
+protected:
+  void initialize() override;
+  void task() override;
+  void on_event(const Event& event) override;
+
+private:
+  /// @brief kBluetooth event codes
+  enum class LinkEvent : std::uint16_t {
+    kConnection,  ///< value: esp_a2d_connection_state_t
+    kAudio,       ///< value: esp_a2d_audio_state_t
+    kMediaAck     ///< value: esp_a2d_media_ctrl_t << 8 | esp_a2d_media_ctrl_ack_t
+  };
+
+  /// @brief kControl event codes
+  enum class Control : std::uint16_t {
+    kPeerChanged, ///< new peer is in requested_peer_
+    kLinkEnabled, ///< value: 1 to allow the link, 0 to release it
+  };
+
+  /// @brief stack callbacks (Bluetooth task)
+  static void gap_callback(esp_bt_gap_cb_event_t event, esp_bt_gap_cb_param_t* param);
+  static void a2d_callback(esp_a2d_cb_event_t event, esp_a2d_cb_param_t* param);
+  static std::int32_t data_callback(std::uint8_t* data, std::int32_t size);
+
+  /// @brief start a connection attempt if it is time for one
+  void connect();
+
+  /// @brief handle a kBluetooth event
+  void handle_link_event(const LinkEvent code, const std::uint32_t value);
+
+  /// @brief move decoded PCM into the block being filled
+  void fill_block();
+
+  /// @brief fill_block() for tracks that are not at kSampleRate
+  /// @return samples read from the pipeline
+  std::size_t fill_resampled(const std::size_t channels);
+
+  /// @brief the one instance the stack callbacks are routed to
+  static std::atomic<A2dpSourceObject*> instance_;
+
+  /// @brief PCM source
+  DspObject& dsp_;
+
+  /// @brief where the connected sink is remembered
+  StateStore& state_;
+
+  /// @brief link configuration (peer is replaced by set_peer())
+  Config config_;
+
+  /// @brief peer requested through set_peer(), guarded by peer_lock_
+  Address requested_peer_{};
+
+  /// @brief sink of the latest connection event, guarded by peer_lock_
+  Address connected_peer_{};
+  portMUX_TYPE peer_lock_ = portMUX_INITIALIZER_UNLOCKED;
+
+  /// @brief true once the stack is up and the data callback is registered
+  bool stack_ready_{false};
+
+  /// @brief link state (task only, except streaming_)
+  esp_a2d_connection_state_t link_state_{ESP_A2D_CONNECTION_STATE_DISCONNECTED};
+  std::int64_t last_attempt_us_{0};
+  std::atomic<bool> streaming_{false};
+
+  /// @brief see set_link_enabled() (task only, except link_released_)
+  bool link_enabled_{true};
+  std::atomic<bool> link_released_{false};
+
+  /// @brief buffer between this task and the stack
+  JitterBuffer buffer_;
+
+  /// @brief block being filled and the samples in it so far (task only)
+  JitterBuffer::Block* block_{nullptr};
+  std::size_t block_samples_{0};
+
+  /// @brief decoded samples, possibly mono, waiting to be expanded into block_
+  std::array<std::int16_t, JitterBuffer::kBlockSamples> scratch_{};
+
+  /// @brief conversion to kSampleRate, and the samples at the front of
+  /// scratch_ it has not consumed yet (task only)
+  Resampler resampler_;
+  std::size_t pending_samples_{0};
+
+  /// @brief resampled mono samples waiting to be expanded into block_
+  std::array<std::int16_t, JitterBuffer::kBlockFrames> resampled_{};
+
+  /// @brief start of the current adaptation window
+  std::int64_t window_start_us_{0};
+
+  /// @brief the decoder stopped at some point in the current window
+  bool window_idle_{false};
+
+  /// @brief copy of the last buffer statistics for other tasks, guarded by buffer_stats_lock_
+  JitterBuffer::Stats buffer_stats_{};
+  mutable portMUX_TYPE buffer_stats_lock_ = portMUX_INITIALIZER_UNLOCKED;
+};
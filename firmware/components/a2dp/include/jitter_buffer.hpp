@@ -0,0 +1,138 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "spsc_ring.hpp"
+
+/**
+ * @brief PCM buffer between a producer task and the Bluetooth stack whose
+ * depth follows the link quality. Audio is held in fixed-size blocks that
+ * are only allocated while the target depth needs them and freed again
+ * once it shrinks, so a clean link costs a few KB of SRAM and a congested
+ * one grows to ride out retransmission bursts. The blocks come from the
+ * heap rather than a MemoryPool, which never returns its slabs.
+ *
+ * The producer side (acquire, commit, adapt) belongs to one task and is the
+ * only side that allocates. The consumer side (read) is called from the
+ * Bluetooth stack and never blocks, locks or allocates; on underrun it
+ * outputs silence and holds back until the buffer has refilled to its
+ * target depth, so a stall sounds like one gap rather than stutter.
+ */
+class JitterBuffer {
+public:
+  /// @brief stereo frames per block (~5.8 ms at 44.1 kHz)
+  static constexpr std::size_t kBlockFrames = 256;
+
+  /// @brief interleaved 16-bit samples per block
+  static constexpr std::size_t kBlockSamples = kBlockFrames * 2;
+
+  /// @brief block handoff rings (must be a power of two)
+  static constexpr std::size_t kRingCapacity = 64;
+
+  /// @brief depth bounds in blocks; two more are in flight at either end
+  static constexpr std::size_t kMinBlocks = 4;
+  static constexpr std::size_t kMaxBlocks = kRingCapacity - 2;
+  static constexpr std::size_t kInitialBlocks = 16;
+
+  /// @brief clean adapt() windows before the depth may shrink by a block
+  static constexpr std::uint32_t kShrinkAfterWindows = 10;
+
+  /// @brief blocks that must have stayed unused in a window to shrink
+  static constexpr std::size_t kShrinkMargin = 2;
+
+  /// @brief a block of interleaved stereo PCM
+  struct Block {
+    std::array<std::int16_t, kBlockSamples> samples;
+  };
+
+  /// @brief statistics of the last adapt() window
+  struct Stats {
+    std::size_t target_blocks;     ///< current target depth
+    std::size_t allocated_blocks;  ///< blocks held in memory
+    std::size_t min_fill_blocks;   ///< lowest fill level seen by the consumer
+    std::uint32_t underruns;       ///< consumer requests that ran dry, in total
+    std::uint32_t consumed_fps;    ///< frames per second pulled by the sink
+    std::uint32_t max_request_frames; ///< largest single consumer request
+  };
+
+  JitterBuffer() = default;
+
+  /// @brief free all blocks on destruction (the consumer must be stopped)
+  ~JitterBuffer();
+
+  JitterBuffer(const JitterBuffer&) = delete;
+  JitterBuffer& operator=(const JitterBuffer&) = delete;
+
+  /**
+   * @brief Producer: get an empty block to fill.
+   * @return the block, or nullptr if the buffer is at its target depth
+   */
+  Block* acquire();
+
+  /// @brief producer: queue a block obtained from acquire() for playback
+  void commit(Block* block);
+
+  /**
+   * @brief Producer: resize the target depth from the window since the last
+   * call and free blocks the new depth does not need.
+   * @param elapsed_ms length of the window
+   * @param playing true if audio was expected throughout the window, so
+   * underruns are the link's fault rather than an empty playlist
+   */
+  void adapt(const std::uint32_t elapsed_ms, const bool playing);
+
+  /// @brief producer: statistics as of the last adapt()
+  const Stats& get_stats() const { return stats_; }
+
+  /// @brief blocks queued for playback right now (any task)
+  std::size_t get_fill() const { return filled_.size(); }
+
+  /// @brief current target depth in blocks (any task)
+  std::size_t get_target() const { return target_.load(); }
+
+  /**
+   * @brief Consumer: copy out interleaved stereo samples, padding with
+   * silence on underrun.
+   * @param samples destination
+   * @param count number of samples wanted (always fully written)
+   */
+  void read(std::int16_t* samples, const std::size_t count);
+
+private:
+  /// @brief blocks filled by the producer, in playback order
+  SpscRing<Block*, kRingCapacity> filled_;
+
+  /// @brief blocks the consumer has finished with
+  SpscRing<Block*, kRingCapacity> free_;
+
+  /// @brief target depth, written by the producer
+  std::atomic<std::size_t> target_{kInitialBlocks};
+
+  /// @brief blocks currently allocated (producer only)
+  std::size_t allocated_{0};
+
+  /// @brief consecutive adapt() windows without an underrun (producer only)
+  std::uint32_t quiet_windows_{0};
+
+  /// @brief underrun count at the last adapt() (producer only)
+  std::uint32_t last_underruns_{0};
+
+  /// @brief statistics published by adapt() (producer only)
+  Stats stats_{};
+
+  /// @brief block being read and position in it (consumer only)
+  Block* current_{nullptr};
+  std::size_t current_offset_{0};
+
+  /// @brief output silence until the buffer is back at its target (consumer only)
+  bool priming_{true};
+
+  /// @brief window measurements, written by the consumer and reset by adapt()
+  std::atomic<std::uint32_t> underruns_{0};
+  std::atomic<std::uint32_t> consumed_frames_{0};
+  std::atomic<std::uint32_t> max_request_frames_{0};
+  std::atomic<std::size_t> min_fill_{kMaxBlocks};
+};
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+
+#include "include/jitter_buffer.hpp"
+#include "telemetry.hpp"
+#include "util.hpp"
+
+extern "C" {
+
+#include "esp_heap_caps.h"
+
+}
+
+namespace {
+
+constexpr const char* kComponentTag = "JitterBuffer";
+
+/// @brief blocks held outside the filled ring: one being filled, one being read
+constexpr std::size_t kInFlightBlocks = 2;
+
+}
+
+JitterBuffer::~JitterBuffer() {
+  Block* block = current_;
+  current_ = nullptr;
+
+  do {
+    heap_caps_free(block);
+  } while (filled_.read(&block, 1) == 1 || free_.read(&block, 1) == 1);
+}
+
+JitterBuffer::Block* JitterBuffer::acquire() {
+  const std::size_t target = target_.load();
+  if (filled_.size() >= target) {
+    return nullptr;
+  }
+
+  Block* block = nullptr;
+  if (free_.read(&block, 1) == 1) {
+    return block;
+  }
+
+  if (allocated_ >= target + kInFlightBlocks) {
+    return nullptr;
+  }
+
+  block = static_cast<Block*>(heap_caps_malloc(sizeof(Block), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+  if (!block) {
+    // settle for what we have, otherwise the consumer would wait forever
+    // for a depth that can never be reached
+    const std::size_t reachable = std::max(kMinBlocks, allocated_ > kInFlightBlocks ? allocated_ - kInFlightBlocks : 0);
+    target_.store(std::min(target, reachable));
+    LOGW(kComponentTag, "Out of memory at %" PRIu32 " blocks", static_cast<std::uint32_t>(allocated_));
+    return nullptr;
+  }
+
+  allocated_++;
+  return block;
+}
+
+void JitterBuffer::commit(Block* block) {
+  // allocated_ never exceeds the ring capacity, so this always fits
+  filled_.write(&block, 1);
+}
+
+void JitterBuffer::adapt(const std::uint32_t elapsed_ms, const bool playing) {
+  const std::uint32_t underruns = underruns_.load();
+  const std::uint32_t new_underruns = underruns - last_underruns_;
+  last_underruns_ = underruns;
+
+  const std::uint32_t consumed = consumed_frames_.exchange(0);
+  const std::uint32_t max_request = max_request_frames_.exchange(0);
+  const std::size_t min_fill = min_fill_.exchange(kMaxBlocks);
+
+  // a sink that pulls in large bursts needs two of them queued at all times
+  const std::size_t burst_blocks = (max_request + kBlockFrames - 1) / kBlockFrames;
+  const std::size_t floor = std::clamp<std::size_t>(2 * burst_blocks, kMinBlocks, kMaxBlocks);
+
+  // grow quickly on trouble, give memory back slowly once the link calms down
+  std::size_t target = target_.load();
+  if (playing && new_underruns > 0) {
+    target += std::max<std::size_t>(2, target / 2);
+    quiet_windows_ = 0;
+  } else if (++quiet_windows_ >= kShrinkAfterWindows) {
+    quiet_windows_ = 0;
+    if (min_fill > kShrinkMargin) {
+      target--;
+    }
+  }
+
+  target = std::clamp(target, floor, kMaxBlocks);
+  target_.store(target);
+
+  while (allocated_ > target + kInFlightBlocks) {
+    Block* block = nullptr;
+    if (free_.read(&block, 1) == 0) {
+      break;
+    }
+
+    heap_caps_free(block);
+    allocated_--;
+  }
+
+  stats_ = Stats{
+    .target_blocks = target,
+    .allocated_blocks = allocated_,
+    .min_fill_blocks = min_fill,
+    .underruns = underruns,
+    .consumed_fps = elapsed_ms > 0 ? static_cast<std::uint32_t>(static_cast<std::uint64_t>(consumed) * 1000 / elapsed_ms) : 0,
+    .max_request_frames = max_request,
+  };
+}
+
+void JitterBuffer::read(std::int16_t* samples, const std::size_t count) {
+  const std::size_t fill = filled_.size();
+  if (fill < min_fill_.load()) {
+    min_fill_.store(fill);
+  }
+  TELEMETRY_LEVEL(kLinkFill, static_cast<std::uint32_t>(fill * 100 / std::max<std::size_t>(target_.load(), 1)));
+
+  const auto frames = static_cast<std::uint32_t>(count / 2);
+  consumed_frames_.fetch_add(frames);
+  if (frames > max_request_frames_.load()) {
+    max_request_frames_.store(frames);
+  }
+
+  if (priming_) {
+    if (fill < target_.load()) {
+      std::memset(samples, 0, count * sizeof(std::int16_t));
+      TELEMETRY_COUNT(kSilenceFrames, frames);
+      return;
+    }
+    priming_ = false;
+  }
+
+  std::size_t written = 0;
+  while (written < count) {
+    if (!current_) {
+      if (filled_.read(&current_, 1) == 0) {
+        // ran dry: fill with silence and rebuild the full depth first
+        std::memset(samples + written, 0, (count - written) * sizeof(std::int16_t));
+        underruns_.fetch_add(1);
+        TELEMETRY_COUNT(kLinkUnderruns);
+        TELEMETRY_COUNT(kSilenceFrames, static_cast<std::uint32_t>((count - written) / 2));
+        priming_ = true;
+        return;
+      }
+      current_offset_ = 0;
+    }
+
+    const std::size_t size = std::min(kBlockSamples - current_offset_, count - written);
+    std::memcpy(samples + written, current_->samples.data() + current_offset_, size * sizeof(std::int16_t));
+    current_offset_ += size;
+    written += size;
+
+    if (current_offset_ == kBlockSamples) {
+      free_.write(&current_, 1);
+      current_ = nullptr;
+    }
+  }
+}
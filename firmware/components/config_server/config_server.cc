@@ -0,0 +1,425 @@
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include "include/config_server.hpp"
+#include "button_input.hpp"
+#include "telemetry.hpp"
+
+extern "C" {
+
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+
+}
+
+/// @brief the gzipped UI, embedded by the component's CMakeLists
+extern const std::uint8_t index_html_gz_start[] asm("_binary_index_html_gz_start");
+extern const std::uint8_t index_html_gz_end[] asm("_binary_index_html_gz_end");
+
+namespace {
+
+constexpr const char* kComponentTag = "ConfigServerObject";
+
+/// @brief address of the access point interface (esp_netif default)
+constexpr const char* kAddress = "192.168.4.1";
+
+/// @brief receive timeouts (recv_wait_timeout each) tolerated while reading a body
+constexpr int kMaxReceiveTimeouts = 3;
+
+/// @brief "aabbccddeeff", with ':' or '-' allowed between the digits
+bool parse_address(const char* text, A2dpSourceObject::Address& address) {
+  std::size_t digits = 0;
+  for (const char* c = text; *c != '\0'; c++) {
+    if (*c == ':' || *c == '-') {
+      continue;
+    }
+
+    std::uint8_t nibble;
+    if (*c >= '0' && *c <= '9') {
+      nibble = *c - '0';
+    } else if (*c >= 'a' && *c <= 'f') {
+      nibble = *c - 'a' + 10;
+    } else if (*c >= 'A' && *c <= 'F') {
+      nibble = *c - 'A' + 10;
+    } else {
+      return false;
+    }
+
+    if (digits >= 2 * address.size()) {
+      return false;
+    }
+    auto& byte = address[digits / 2];
+    byte = digits % 2 == 0 ? nibble << 4 : byte | nibble;
+    digits++;
+  }
+  return digits == 2 * address.size();
+}
+
+/// @brief whole decimal number no larger than max
+bool parse_number(const char* text, const std::uint32_t max, std::uint32_t& value) {
+  if (*text == '\0') {
+    return false;
+  }
+
+  value = 0;
+  for (const char* c = text; *c != '\0'; c++) {
+    if (*c < '0' || *c > '9') {
+      return false;
+    }
+    value = value * 10 + (*c - '0');
+    if (value > max) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}
+
+ConfigServerObject::ConfigServerObject(PlayerObject& player, A2dpSourceObject& a2dp, DspObject& dsp,
+  StateStore& state, const Config& config)
+  : StaticActiveObject("ConfigServerObject", ActiveObject::Priority::kLow, 1000, ActiveObject::Workload::kRadio),
+    player_(player),
+    a2dp_(a2dp),
+    dsp_(dsp),
+    state_(state),
+    config_(config) {}
+
+ConfigServerObject::~ConfigServerObject() {
+  mark_as_done();
+  join();
+
+  if (mode_.load() != Mode::kIdle) {
+    stop();
+  }
+}
+
+bool ConfigServerObject::request_start() {
+  return post(Event{
+    .type = Event::Type::kControl,
+    .code = static_cast<std::uint16_t>(Control::kStart),
+    .value = 0,
+  });
+}
+
+bool ConfigServerObject::request_stop() {
+  return post(Event{
+    .type = Event::Type::kControl,
+    .code = static_cast<std::uint16_t>(Control::kStop),
+    .value = 0,
+  });
+}
+
+void ConfigServerObject::touch() {
+  last_request_us_.store(esp_timer_get_time());
+}
+
+void ConfigServerObject::on_event(const Event& event) {
+  Control control;
+  if (event.type == Event::Type::kControl) {
+    control = static_cast<Control>(event.code);
+  } else if (event.type == Event::Type::kButton) {
+    if (static_cast<ButtonInput::Press>(event.value) != ButtonInput::Press::kDown) {
+      return;
+    }
+    control = mode_.load() == Mode::kIdle ? Control::kStart : Control::kStop;
+  } else {
+    return;
+  }
+
+  switch (control) {
+    case Control::kStart:
+      if (mode_.load() != Mode::kIdle) {
+        return;
+      }
+      ESP_LOGI(kComponentTag, "Entering config mode, releasing the Bluetooth link");
+      player_.pause();
+      a2dp_.set_link_enabled(false);
+      mode_since_us_ = esp_timer_get_time();
+      mode_.store(Mode::kReleasingLink);
+      break;
+
+    case Control::kStop:
+      if (mode_.load() != Mode::kIdle) {
+        stop();
+      }
+      break;
+
+    default:
+      ESP_LOGW(kComponentTag, "Unknown control %u", static_cast<unsigned>(event.code));
+      break;
+  }
+}
+
+void ConfigServerObject::task() {
+  const std::int64_t now_us = esp_timer_get_time();
+
+  switch (mode_.load()) {
+    case Mode::kReleasingLink:
+      if (a2dp_.is_link_released()) {
+        start_access_point();
+      } else if (now_us - mode_since_us_ > static_cast<std::int64_t>(config_.link_release_timeout_ms) * 1000) {
+        ESP_LOGE(kComponentTag, "Bluetooth link did not go down, leaving config mode");
+        a2dp_.set_link_enabled(true);
+        mode_.store(Mode::kIdle);
+      }
+      break;
+
+    case Mode::kActive:
+      if (now_us - last_request_us_.load() > static_cast<std::int64_t>(config_.idle_timeout_ms) * 1000) {
+        ESP_LOGI(kComponentTag, "No requests for %" PRIu32 " ms", config_.idle_timeout_ms);
+        stop();
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+void ConfigServerObject::start_access_point() {
+  // both exist for the lifetime of the application once created
+  esp_err_t err = esp_netif_init();
+  if (err == ESP_OK) {
+    err = esp_event_loop_create_default();
+  }
+  if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+    ESP_LOGE(kComponentTag, "Network stack init failed: %s", esp_err_to_name(err));
+    stop();
+    return;
+  }
+
+  netif_ = esp_netif_create_default_wifi_ap();
+
+  // one client and small pages; the defaults are sized for throughput
+  wifi_init_config_t init = WIFI_INIT_CONFIG_DEFAULT();
+  init.static_rx_buf_num = 4;
+  init.dynamic_rx_buf_num = 8;
+  init.dynamic_tx_buf_num = 8;
+  init.cache_tx_buf_num = 0;
+  init.ampdu_rx_enable = 0;
+  init.ampdu_tx_enable = 0;
+  init.amsdu_tx_enable = 0;
+  init.nvs_enable = 0;
+
+  err = esp_wifi_init(&init);
+  if (err != ESP_OK) {
+    ESP_LOGE(kComponentTag, "WiFi init failed: %s", esp_err_to_name(err));
+    stop();
+    return;
+  }
+  wifi_initialized_ = true;
+
+  wifi_config_t wifi{};
+  auto& ap = wifi.ap;
+  snprintf(reinterpret_cast<char*>(ap.ssid), sizeof(ap.ssid), "%s", config_.ssid);
+  snprintf(reinterpret_cast<char*>(ap.password), sizeof(ap.password), "%s", config_.password);
+  ap.ssid_len = static_cast<std::uint8_t>(strlen(reinterpret_cast<const char*>(ap.ssid)));
+  ap.channel = config_.channel;
+  ap.authmode = strlen(config_.password) >= 8 ? WIFI_AUTH_WPA2_PSK : WIFI_AUTH_OPEN;
+  ap.max_connection = 1;
+
+  err = esp_wifi_set_storage(WIFI_STORAGE_RAM);
+  if (err == ESP_OK) {
+    err = esp_wifi_set_mode(WIFI_MODE_AP);
+  }
+  if (err == ESP_OK) {
+    err = esp_wifi_set_config(WIFI_IF_AP, &wifi);
+  }
+  if (err == ESP_OK) {
+    err = esp_wifi_start();
+  }
+  if (err != ESP_OK) {
+    ESP_LOGE(kComponentTag, "Access point start failed: %s", esp_err_to_name(err));
+    stop();
+    return;
+  }
+
+  httpd_config_t http = HTTPD_DEFAULT_CONFIG();
+  http.task_priority = static_cast<unsigned>(ActiveObject::Priority::kLow);
+  http.stack_size = 4096;
+  http.core_id = 0;
+  http.max_open_sockets = 2;
+  http.backlog_conn = 2;
+  http.max_uri_handlers = 5;
+  http.lru_purge_enable = true;
+
+  err = httpd_start(&server_, &http);
+  if (err != ESP_OK) {
+    ESP_LOGE(kComponentTag, "HTTP server start failed: %s", esp_err_to_name(err));
+    server_ = nullptr;
+    stop();
+    return;
+  }
+
+  const httpd_uri_t handlers[] = {
+    {.uri = "/", .method = HTTP_GET, .handler = serve_page, .user_ctx = this},
+    {.uri = "/api/settings", .method = HTTP_GET, .handler = get_settings, .user_ctx = this},
+    {.uri = "/api/settings", .method = HTTP_POST, .handler = post_settings, .user_ctx = this},
+    {.uri = "/api/exit", .method = HTTP_POST, .handler = post_exit, .user_ctx = this},
+  };
+  for (const auto& handler : handlers) {
+    httpd_register_uri_handler(server_, &handler);
+  }
+  if constexpr (Telemetry::kEnabled) {
+    const httpd_uri_t telemetry = {.uri = "/api/telemetry", .method = HTTP_GET, .handler = get_telemetry, .user_ctx = this};
+    httpd_register_uri_handler(server_, &telemetry);
+  }
+
+  touch();
+  mode_.store(Mode::kActive);
+  ESP_LOGI(kComponentTag, "Config mode: join '%s' and open http://%s/", config_.ssid, kAddress);
+}
+
+void ConfigServerObject::stop() {
+  if (server_) {
+    httpd_stop(server_);
+    server_ = nullptr;
+  }
+  if (wifi_initialized_) {
+    esp_wifi_stop();
+    esp_wifi_deinit();
+    wifi_initialized_ = false;
+  }
+  if (netif_) {
+    esp_netif_destroy_default_wifi(netif_);
+    netif_ = nullptr;
+  }
+
+  a2dp_.set_link_enabled(true);
+  mode_.store(Mode::kIdle);
+  ESP_LOGI(kComponentTag, "Config mode left");
+}
+
+esp_err_t ConfigServerObject::serve_page(httpd_req_t* request) {
+  auto& self = *static_cast<ConfigServerObject*>(request->user_ctx);
+  self.touch();
+
+  httpd_resp_set_type(request, "text/html");
+  httpd_resp_set_hdr(request, "Content-Encoding", "gzip");
+  return httpd_resp_send(request, reinterpret_cast<const char*>(index_html_gz_start),
+    index_html_gz_end - index_html_gz_start);
+}
+
+esp_err_t ConfigServerObject::get_settings(httpd_req_t* request) {
+  auto& self = *static_cast<ConfigServerObject*>(request->user_ctx);
+  self.touch();
+
+  const auto peer = self.state_.get_state().peer;
+  char body[96];
+  snprintf(body, sizeof(body),
+    "{\"peer\":\"%02x:%02x:%02x:%02x:%02x:%02x\",\"volume\":%u,\"shuffle\":%s}",
+    peer[0], peer[1], peer[2], peer[3], peer[4], peer[5],
+    static_cast<unsigned>(self.dsp_.get_volume()),
+    self.player_.is_shuffled() ? "true" : "false");
+
+  httpd_resp_set_type(request, "application/json");
+  return httpd_resp_send(request, body, HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t ConfigServerObject::post_settings(httpd_req_t* request) {
+  auto& self = *static_cast<ConfigServerObject*>(request->user_ctx);
+  self.touch();
+
+  if (request->content_len > kMaxBodyLength) {
+    return httpd_resp_send_err(request, HTTPD_400_BAD_REQUEST, "Body too long");
+  }
+
+  char body[kMaxBodyLength + 1];
+  std::size_t length = 0;
+  int timeouts = 0;
+  while (length < request->content_len) {
+    const int received = httpd_req_recv(request, body + length, request->content_len - length);
+    if (received == HTTPD_SOCK_ERR_TIMEOUT) {
+      // a client that stalls must not hold the only server task forever
+      if (++timeouts >= kMaxReceiveTimeouts) {
+        return httpd_resp_send_err(request, HTTPD_408_REQ_TIMEOUT, "Body not received");
+      }
+      continue;
+    }
+    if (received <= 0) {
+      return ESP_FAIL;
+    }
+    length += received;
+  }
+  body[length] = '\0';
+
+  // everything is checked before anything is applied
+  char value[24];
+  std::optional<A2dpSourceObject::Address> peer;
+  if (httpd_query_key_value(body, "peer", value, sizeof(value)) == ESP_OK) {
+    A2dpSourceObject::Address address{};
+    if (!parse_address(value, address)) {
+      return httpd_resp_send_err(request, HTTPD_400_BAD_REQUEST, "Invalid peer");
+    }
+    peer = address;
+  }
+
+  std::optional<std::uint8_t> volume;
+  if (httpd_query_key_value(body, "volume", value, sizeof(value)) == ESP_OK) {
+    std::uint32_t number;
+    if (!parse_number(value, DspObject::kMaxVolume, number)) {
+      return httpd_resp_send_err(request, HTTPD_400_BAD_REQUEST, "Invalid volume");
+    }
+    volume = static_cast<std::uint8_t>(number);
+  }
+
+  std::optional<bool> shuffle;
+  if (httpd_query_key_value(body, "shuffle", value, sizeof(value)) == ESP_OK) {
+    std::uint32_t number;
+    if (!parse_number(value, 1, number)) {
+      return httpd_resp_send_err(request, HTTPD_400_BAD_REQUEST, "Invalid shuffle");
+    }
+    shuffle = number == 1;
+  }
+
+  // the link is down while in config mode; the new sink is used once it is back
+  if (peer) {
+    self.a2dp_.set_peer(*peer);
+    self.state_.set_peer(*peer);
+  }
+  if (volume) {
+    self.dsp_.set_volume(*volume);
+    self.state_.set_volume(*volume);
+  }
+  if (shuffle && *shuffle != self.player_.is_shuffled()) {
+    self.player_.set_shuffle(*shuffle
+      ? std::optional<std::uint32_t>{static_cast<std::uint32_t>(esp_timer_get_time())}
+      : std::nullopt);
+  }
+  self.state_.request_flush();
+
+  return get_settings(request);
+}
+
+esp_err_t ConfigServerObject::post_exit(httpd_req_t* request) {
+  auto& self = *static_cast<ConfigServerObject*>(request->user_ctx);
+
+  // the server is stopped from this object's task, after the response is out
+  httpd_resp_send(request, nullptr, 0);
+  self.request_stop();
+  return ESP_OK;
+}
+
+esp_err_t ConfigServerObject::get_telemetry(httpd_req_t* request) {
+  auto& self = *static_cast<ConfigServerObject*>(request->user_ctx);
+  self.touch();
+
+  // not registered without telemetry; this keeps the counters out of the link
+  if constexpr (Telemetry::kEnabled) {
+    // only the server task formats into it
+    static char body[768];
+    const std::size_t length = Telemetry::format_json(Telemetry::snapshot(), body, sizeof(body));
+    if (length == 0) {
+      return httpd_resp_send_err(request, HTTPD_500_INTERNAL_SERVER_ERROR, "Telemetry too long");
+    }
+
+    httpd_resp_set_type(request, "application/json");
+    return httpd_resp_send(request, body, length);
+  } else {
+    return httpd_resp_send_err(request, HTTPD_404_NOT_FOUND, "Telemetry disabled");
+  }
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+extern "C" {
+
+#include "esp_http_server.h"
+#include "esp_netif.h"
+
+}
+
+#include "a2dp_source.hpp"
+#include "component.hpp"
+#include "dsp.hpp"
+#include "player.hpp"
+#include "state_store.hpp"
+
+/**
+ * @brief On-demand WiFi access point with a small web UI for the sink
+ * address, volume and shuffle.
+ *
+ * Nothing of WiFi exists until config mode is requested (request_start(),
+ * or any press of a button whose events go to this object). Playback is
+ * paused and the Bluetooth link released first, so WiFi and A2DP never
+ * share the radio; only then are the WiFi driver, the AP interface and the
+ * HTTP server created. Leaving config mode (request_stop(), another press,
+ * the exit button in the UI or the idle timeout) deletes them all again
+ * and hands the radio back to the link.
+ *
+ * The UI is one gzipped page embedded in flash at build time and sent
+ * straight from rodata with Content-Encoding: gzip, so serving it costs no
+ * heap. The server gets one task with a small stack on the radio core, two
+ * sockets, and request bodies of at most kMaxBodyLength bytes.
+ */
+class ConfigServerObject : public StaticActiveObject<ActiveObject::MemoryLoad::kStandard> {
+public:
+  /// @brief longest settings form accepted
+  static constexpr std::size_t kMaxBodyLength = 128;
+
+  /// @brief access point and timeouts
+  struct Config {
+    /// @brief network name
+    const char* ssid = "mp3-setup";
+
+    /// @brief WPA2 passphrase (8-63 characters), or empty for an open network
+    const char* password = "";
+
+    std::uint8_t channel = 1;
+
+    /// @brief config mode ends after this long without a request
+    std::uint32_t idle_timeout_ms = 5 * 60 * 1000;
+
+    /// @brief how long the Bluetooth link gets to go down before giving up
+    std::uint32_t link_release_timeout_ms = 5000;
+  };
+
+  /// @brief config server constructor
+  /// @param player player to pause and to set the shuffle on
+  /// @param a2dp link to release and to set the sink on
+  /// @param dsp processing stage owning the volume
+  /// @param state store the settings are persisted in
+  /// @param config access point and timeouts
+  ConfigServerObject(PlayerObject& player, A2dpSourceObject& a2dp, DspObject& dsp,
+    StateStore& state, const Config& config);
+
+  /// @brief leaves config mode on destruction
+  ~ConfigServerObject();
+
+  /// @brief enter config mode
+  /// @return false if the request could not be queued
+  bool request_start();
+
+  /// @brief leave config mode
+  /// @return false if the request could not be queued
+  bool request_stop();
+
+  /// @brief true while the access point is up
+  bool is_active() const { return mode_.load() == Mode::kActive; }
+
+protected:
+  void task() override;
+  void on_event(const Event& event) override;
+
+private:
+  /// @brief kControl event codes
+  enum class Control : std::uint16_t {
+    kStart,
+    kStop
+  };
+
+  enum class Mode : std::uint8_t {
+    kIdle,
+    kReleasingLink,   ///< waiting for the Bluetooth link to go down
+    kActive
+  };
+
+  /// @brief bring up WiFi and the server once the link is down
+  void start_access_point();
+
+  /// @brief tear both down and give the radio back to the link
+  void stop();
+
+  /// @brief request handlers (server task); user_ctx is this object
+  static esp_err_t serve_page(httpd_req_t* request);
+  static esp_err_t get_settings(httpd_req_t* request);
+  static esp_err_t post_settings(httpd_req_t* request);
+  static esp_err_t post_exit(httpd_req_t* request);
+  static esp_err_t get_telemetry(httpd_req_t* request);
+
+  /// @brief note a request for the idle timeout
+  void touch();
+
+  /// @brief collaborators
+  PlayerObject& player_;
+  A2dpSourceObject& a2dp_;
+  DspObject& dsp_;
+  StateStore& state_;
+
+  /// @brief access point and timeouts
+  const Config config_;
+
+  /// @brief see Mode (written by the task only)
+  std::atomic<Mode> mode_{Mode::kIdle};
+  std::int64_t mode_since_us_{0};
+
+  /// @brief last request served (server task)
+  std::atomic<std::int64_t> last_request_us_{0};
+
+  /// @brief created only while active
+  esp_netif_t* netif_{nullptr};
+  httpd_handle_t server_{nullptr};
+  bool wifi_initialized_{false};
+};
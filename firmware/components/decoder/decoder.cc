@@ -0,0 +1,650 @@
+#include <algorithm>
+#include <cstring>
+
+#include "include/decoder.hpp"
+#include "mp3_frame.hpp"
+#include "telemetry.hpp"
+
+extern "C" {
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "mp3dec.h"
+
+}
+
+namespace {
+
+constexpr const char* kComponentTag = "DecoderObject";
+constexpr std::uint32_t kIdleWaitMs = 100;
+constexpr std::uint32_t kStreamWaitMs = 50;
+
+static_assert(MAINBUF_SIZE <= 2048, "input buffer must hold a maximal frame");
+static_assert(MAX_NCHAN * MAX_NGRAN * MAX_NSAMP == DecoderObject::kFrameSamples * DecoderObject::kMaxChannels,
+  "frame buffer must hold a full decoder output");
+
+}
+
+DecoderObject::DecoderObject(const SdCardObject& card, SdStreamObject& stream)
+  : StaticActiveObject("DecoderObject", ActiveObject::Priority::kHigh, std::nullopt, ActiveObject::Workload::kAudio),
+    card_(card),
+    stream_(stream) {
+  request_mutex_ = xSemaphoreCreateMutexStatic(&request_mutex_buffer_);
+  wake_sem_ = xSemaphoreCreateBinaryStatic(&wake_sem_buffer_);
+  space_sem_ = xSemaphoreCreateBinaryStatic(&space_sem_buffer_);
+  data_sem_ = xSemaphoreCreateBinaryStatic(&data_sem_buffer_);
+}
+
+DecoderObject::~DecoderObject() {
+  // the decode task must be stopped before its state goes away
+  mark_as_done();
+  join();
+
+  if (decoder_) {
+    MP3FreeDecoder(static_cast<HMP3Decoder>(decoder_));
+    decoder_ = nullptr;
+  }
+}
+
+bool DecoderObject::play(const std::string_view path, const std::uint32_t start_ms) {
+  if (path.size() >= requested_path_.size()) {
+    ESP_LOGE(kComponentTag, "Path too long: '%.*s'", static_cast<int>(path.size()), path.data());
+    return false;
+  }
+
+  // an explicit play replaces whatever was queued
+  xSemaphoreTake(request_mutex_, portMAX_DELAY);
+  next_pending_.store(false);
+  stream_.set_next({});
+  std::memcpy(requested_path_.data(), path.data(), path.size());
+  requested_path_[path.size()] = '\0';
+  requested_start_ms_ = start_ms;
+  requested_generation_.fetch_add(1);
+  xSemaphoreGive(request_mutex_);
+
+  xSemaphoreGive(wake_sem_);
+  return true;
+}
+
+void DecoderObject::stop() {
+  xSemaphoreTake(request_mutex_, portMAX_DELAY);
+  next_pending_.store(false);
+  stream_.set_next({});
+  requested_path_[0] = '\0';
+  requested_generation_.fetch_add(1);
+  xSemaphoreGive(request_mutex_);
+
+  xSemaphoreGive(wake_sem_);
+}
+
+void DecoderObject::seek(const std::uint32_t position_ms) {
+  requested_seek_ms_.store(position_ms);
+  requested_seek_sequence_.fetch_add(1);
+  xSemaphoreGive(wake_sem_);
+}
+
+bool DecoderObject::enqueue(const std::string_view path) {
+  if (path.size() >= requested_next_path_.size()) {
+    ESP_LOGE(kComponentTag, "Path too long: '%.*s'", static_cast<int>(path.size()), path.data());
+    return false;
+  }
+
+  // path, flag and stream request change together, so the decode task
+  // never sees a track_start chunk paired with the previous path
+  xSemaphoreTake(request_mutex_, portMAX_DELAY);
+  std::memcpy(requested_next_path_.data(), path.data(), path.size());
+  requested_next_path_[path.size()] = '\0';
+  const bool queued = stream_.set_next(path);
+  next_pending_.store(queued);
+  xSemaphoreGive(request_mutex_);
+
+  xSemaphoreGive(wake_sem_);
+  return queued;
+}
+
+void DecoderObject::cancel_next() {
+  xSemaphoreTake(request_mutex_, portMAX_DELAY);
+  next_pending_.store(false);
+  stream_.set_next({});
+  xSemaphoreGive(request_mutex_);
+}
+
+std::size_t DecoderObject::read_pcm(std::int16_t* samples, const std::size_t count, const TickType_t timeout) {
+  // skip audio left over from a track that has been replaced
+  if (flush_pending_.exchange(false)) {
+    pcm_.discard_until(flush_position_.load());
+  }
+
+  std::size_t read = pcm_.read(samples, count);
+  if (read == 0 && timeout > 0) {
+    // re-check after announcing ourselves so a concurrent commit is not missed
+    consumer_waiting_.store(true);
+    if (pcm_.empty()) {
+      xSemaphoreTake(data_sem_, timeout);
+    }
+    consumer_waiting_.store(false);
+    read = pcm_.read(samples, count);
+  }
+
+  if (read > 0 && producer_waiting_.exchange(false)) {
+    xSemaphoreGive(space_sem_);
+  }
+
+  return read;
+}
+
+DecoderObject::Format DecoderObject::get_format() const {
+  return Format{
+    .sample_rate = sample_rate_.load(),
+    .channels = channels_.load(),
+    .bitrate = bitrate_.load(),
+  };
+}
+
+void DecoderObject::initialize() {
+  decoder_ = MP3InitDecoder();
+  if (!decoder_) {
+    ESP_LOGE(kComponentTag, "Could not allocate MP3 decoder");
+    mark_as_done();
+  }
+}
+
+void DecoderObject::task() {
+  apply_request();
+  apply_seek_request();
+
+  // finish handing over the previous frame before decoding another
+  if (pcm_offset_ < pcm_size_) {
+    flush_pcm();
+    return;
+  }
+
+  if (!decoder_ || !(playing_.load() || next_pending_.load())) {
+    save_seek_table();
+    xSemaphoreTake(wake_sem_, pdMS_TO_TICKS(kIdleWaitMs));
+    return;
+  }
+
+  // idle with a queued track: the stream starts it without an open()
+  playing_.store(true);
+
+  if (fill_input()) {
+    decode_frame();
+  }
+}
+
+void DecoderObject::apply_request() {
+  if (requested_generation_.load() == generation_) {
+    return;
+  }
+
+  xSemaphoreTake(request_mutex_, portMAX_DELAY);
+  current_path_ = requested_path_;
+  const std::uint32_t start_ms = requested_start_ms_;
+  generation_ = requested_generation_.load();
+  xSemaphoreGive(request_mutex_);
+
+  // opening from this task guarantees no chunk of the old file is mixed in
+  input_start_ = input_end_ = 0;
+  pcm_offset_ = pcm_size_ = 0;
+  begin_track();
+  flush_position_.store(pcm_.write_position());
+  flush_pending_.store(true);
+
+  if (current_path_[0] == '\0') {
+    stream_.close();
+    playing_.store(false);
+    return;
+  }
+
+  playing_.store(stream_.open(current_path_.data()));
+  if (start_ms > 0) {
+    pending_seek_ms_ = start_ms;
+  }
+}
+
+void DecoderObject::apply_seek_request() {
+  const std::uint32_t sequence = requested_seek_sequence_.load();
+  if (sequence == seek_sequence_) {
+    return;
+  }
+
+  seek_sequence_ = sequence;
+  if (!playing_.load()) {
+    return;
+  }
+
+  // a position can only be mapped to a frame once the format is known
+  pending_seek_ms_ = requested_seek_ms_.load();
+  if (track_header_) {
+    seek_to(*pending_seek_ms_);
+  }
+}
+
+void DecoderObject::begin_track() {
+  input_base_ = 0;
+  skip_bytes_ = 0;
+  stream_start_ = true;
+  end_of_stream_ = false;
+  first_frame_ = true;
+  track_header_ = std::nullopt;
+  info_tag_ = std::nullopt;
+  audio_start_ = 0;
+  frame_index_ = 0;
+  start_trim_ = 0;
+  total_samples_ = std::nullopt;
+  skip_samples_ = 0;
+  remaining_samples_ = std::nullopt;
+  pending_seek_ms_ = std::nullopt;
+  position_ms_.store(0);
+  seek_boost_.release();
+
+  seek_table_.clear();
+  building_ = true;
+}
+
+void DecoderObject::finish_track() {
+  if (!building_ || seek_table_.empty() || save_pending_) {
+    return;
+  }
+
+  // saved later, when waiting on the output anyway
+  seek_table_.finish();
+  completed_table_ = std::move(seek_table_);
+  completed_path_ = current_path_;
+  save_pending_ = true;
+  building_ = false;
+}
+
+void DecoderObject::seek_to(const std::uint32_t position_ms) {
+  pending_seek_ms_ = std::nullopt;
+  seek_boost_.acquire();
+  const auto& header = *track_header_;
+  const auto target = static_cast<std::uint32_t>(
+    static_cast<std::uint64_t>(position_ms) * header.sample_rate / (1000ull * header.samples_per_frame));
+
+  // the user is waiting on a seek, so its lookups are playback I/O
+  auto grant = card_.get_io().acquire(IoScheduler::Class::kPlayback);
+
+  // a table for the whole file is the only exact source
+  if (!seek_table_.is_complete()) {
+    const auto source = SeekTable::stat_source(current_path_.data());
+    SeekTable table;
+    if (source && table.load(card_.get_seek_table_path(current_path_.data()).data(), *source)) {
+      seek_table_ = std::move(table);
+      building_ = false;
+    }
+  }
+
+  SeekTable::Point point{};
+  const auto found = seek_table_.find_frame(target);
+  if (found && (seek_table_.is_complete() || target < seek_table_.get_frame_count())) {
+    point = *found;
+  } else if (info_tag_ && info_tag_->has_toc && info_tag_->frames > 0) {
+    // Xing TOC: byte position (in 1/256ths) for every percent of the track
+    const auto source = SeekTable::stat_source(current_path_.data());
+    const std::uint32_t bytes = info_tag_->bytes ? info_tag_->bytes : (source ? source->size - audio_start_ : 0);
+    const std::uint32_t percent = std::min<std::uint32_t>(99, static_cast<std::uint32_t>(
+      static_cast<std::uint64_t>(target) * 100 / info_tag_->frames));
+    point.frame = static_cast<std::uint32_t>(static_cast<std::uint64_t>(percent) * info_tag_->frames / 100);
+    point.offset = audio_start_ + static_cast<std::uint32_t>(static_cast<std::uint64_t>(info_tag_->toc[percent]) * bytes / 256);
+  } else {
+    // assume a constant bitrate
+    point.frame = target;
+    point.offset = audio_start_ + target * header.frame_bytes;
+  }
+
+  // only a table built from the very first frame is any use
+  building_ = building_ && point.frame == seek_table_.get_frame_count();
+  grant.release();
+
+  const std::uint32_t aligned = point.offset - point.offset % SdStreamObject::kBufferSize;
+  if (!stream_.open(current_path_.data(), aligned)) {
+    seek_boost_.release();
+    playing_.store(false);
+    return;
+  }
+
+  input_start_ = input_end_ = 0;
+  pcm_offset_ = pcm_size_ = 0;
+  flush_position_.store(pcm_.write_position());
+  flush_pending_.store(true);
+
+  input_base_ = aligned;
+  skip_bytes_ = point.offset - aligned;
+  stream_start_ = false;
+  end_of_stream_ = false;
+  frame_index_ = point.frame;
+  position_ms_.store(seek_table_.frame_to_ms(point.frame));
+
+  // delay and padding trimming relative to the new position
+  const std::uint32_t position = point.frame * header.samples_per_frame;
+  skip_samples_ = start_trim_ > position ? start_trim_ - position : 0;
+  if (total_samples_) {
+    const std::uint32_t played = position > start_trim_ ? position - start_trim_ : 0;
+    remaining_samples_ = *total_samples_ > played ? *total_samples_ - played : 0;
+  }
+}
+
+void DecoderObject::save_seek_table() {
+  if (!save_pending_) {
+    return;
+  }
+
+  // best-effort; stays pending while the card is busy with playback
+  auto grant = card_.get_io().acquire(IoScheduler::Class::kBackground, 0);
+  if (!grant) {
+    return;
+  }
+
+  save_pending_ = false;
+  const auto source = SeekTable::stat_source(completed_path_.data());
+  if (!source) {
+    return;
+  }
+
+  const auto path = card_.get_seek_table_path(completed_path_.data());
+  SeekTable existing;
+  if (!existing.load(path.data(), *source)) {
+    completed_table_.set_source(*source);
+    if (completed_table_.save(path.data(), grant)) {
+      LOGI(kComponentTag, "Seek table saved");
+    }
+  }
+
+  completed_table_.clear();
+}
+
+bool DecoderObject::fill_input() {
+  const std::size_t buffered = input_end_ - input_start_;
+
+  // the stream carries straight on with the queued track
+  if (end_of_stream_ && buffered == 0 && next_pending_.load()) {
+    end_of_stream_ = false;
+  }
+  if (buffered >= MAINBUF_SIZE || end_of_stream_) {
+    if (buffered == 0) {
+      LOGI(kComponentTag, "End of track");
+      finish_track();
+      playing_.store(false);
+    }
+    return buffered > 0;
+  }
+
+  const auto chunk = stream_.acquire(pdMS_TO_TICKS(kStreamWaitMs));
+  if (!chunk) {
+    TELEMETRY_COUNT(kStreamUnderruns);
+    return false;
+  }
+  record_handoff(stream_);
+
+  if (chunk->track_start) {
+    finish_track();
+    begin_track();
+
+    // enqueue() writes the path, the flag and the stream's sequence under
+    // request_mutex_, so here all three describe the same request
+    xSemaphoreTake(request_mutex_, portMAX_DELAY);
+    const bool replaced = chunk->next_sequence != stream_.get_next_sequence();
+    const bool pending = next_pending_.exchange(false);
+    if (pending) {
+      current_path_ = requested_next_path_;
+    }
+    if (replaced) {
+      stream_.set_next({});
+    }
+    xSemaphoreGive(request_mutex_);
+
+    // the stream had already moved on to a queued track that was replaced or
+    // cancelled since; open the replacement instead, keeping the PCM ring
+    if (replaced) {
+      stream_.release();
+      if (!pending) {
+        LOGI(kComponentTag, "End of track");
+        stream_.close();
+        playing_.store(false);
+        return false;
+      }
+
+      LOGI(kComponentTag, "Next track (replaced)");
+      playing_.store(stream_.open(current_path_.data()));
+      return false;
+    }
+    LOGI(kComponentTag, "Next track");
+  }
+
+  // compact, then append the chunk
+  std::memmove(input_.data(), input_.data() + input_start_, buffered);
+  input_base_ += static_cast<std::uint32_t>(input_start_);
+  input_start_ = 0;
+  input_end_ = buffered;
+
+  if (chunk->track_start) {
+    // gapless transition: the PCM ring and decoder state were kept; the
+    // stream already stepped over the tag and the info frame
+    input_base_ = chunk->track_offset;
+    stream_start_ = chunk->track_offset == 0;
+    if (chunk->info_tag) {
+      info_tag_ = *chunk->info_tag;
+      apply_info_tag();
+    }
+  }
+
+  const std::uint8_t* data = chunk->data;
+  std::size_t size = chunk->size;
+
+  if (stream_start_) {
+    stream_start_ = false;
+    skip_bytes_ = id3v2_tag_size(data, size);
+  }
+
+  // skipping only ever happens with an empty input buffer
+  const std::size_t skipped = std::min(skip_bytes_, size);
+  skip_bytes_ -= skipped;
+  input_base_ += static_cast<std::uint32_t>(skipped);
+  data += skipped;
+  size -= skipped;
+
+  std::memcpy(input_.data() + input_end_, data, size);
+  input_end_ += size;
+  end_of_stream_ = chunk->end_of_stream;
+  stream_.release();
+
+  return input_end_ - input_start_ >= MAINBUF_SIZE || end_of_stream_;
+}
+
+void DecoderObject::decode_frame() {
+  auto* const start = input_.data() + input_start_;
+  const int buffered = static_cast<int>(input_end_ - input_start_);
+
+  const int sync = MP3FindSyncWord(start, buffered);
+  if (sync < 0) {
+    // keep a possible partial sync word at the end
+    input_start_ = input_end_ - std::min<std::size_t>(buffered, 1);
+    if (end_of_stream_) {
+      input_start_ = input_end_;
+    }
+    return;
+  }
+
+  const std::size_t sync_position = input_start_ + static_cast<std::size_t>(sync);
+  unsigned char* frame = start + sync;
+  int remaining = buffered - sync;
+
+  if (first_frame_) {
+    first_frame_ = false;
+    const bool tag_frame = parse_first_frame(frame, static_cast<std::size_t>(remaining), sync_position);
+
+    // e.g. resume: the position could not be mapped before the format was known
+    if (pending_seek_ms_ && track_header_) {
+      seek_to(*pending_seek_ms_);
+      return;
+    }
+
+    if (tag_frame) {
+      return;
+    }
+  }
+
+  const std::uint32_t frame_offset = input_base_ + static_cast<std::uint32_t>(sync_position);
+
+  // decode in place when a whole frame fits before the wrap point
+  const auto span = pcm_.reserve(pcm_frame_.size());
+  const bool in_place = span.size == pcm_frame_.size();
+  std::int16_t* const output = in_place ? span.data : pcm_frame_.data();
+
+  const std::int64_t begin_us = esp_timer_get_time();
+  const int err = MP3Decode(static_cast<HMP3Decoder>(decoder_), &frame, &remaining, output, 0);
+  const auto elapsed_us = static_cast<std::uint32_t>(esp_timer_get_time() - begin_us);
+
+  input_start_ = input_end_ - static_cast<std::size_t>(remaining);
+
+  switch (err) {
+    case ERR_MP3_NONE: {
+      seek_boost_.release();
+
+      MP3FrameInfo info;
+      MP3GetLastFrameInfo(static_cast<HMP3Decoder>(decoder_), &info);
+
+      sample_rate_.store(info.samprate);
+      channels_.store(info.nChans);
+      bitrate_.store(info.bitrate);
+
+      if (elapsed_us > peak_decode_us_.load()) {
+        peak_decode_us_.store(elapsed_us);
+      }
+      TELEMETRY_LATENCY(kDecodeFrame, elapsed_us);
+
+      // trim encoder delay and padding (gapless playback)
+      const std::size_t channels = std::max(info.nChans, 1);
+      const std::uint32_t frame_samples = static_cast<std::uint32_t>(info.outputSamps) / channels;
+      const std::uint32_t skip = std::min(skip_samples_, frame_samples);
+      std::uint32_t keep = frame_samples - skip;
+      skip_samples_ -= skip;
+      if (remaining_samples_) {
+        keep = std::min(keep, *remaining_samples_);
+        *remaining_samples_ -= keep;
+      }
+
+      const std::size_t begin = skip * channels;
+      const std::size_t end = (skip + keep) * channels;
+
+      // volume: a pass over the frame just synthesized, before it is copied
+      // into the ring
+      gain_.set_target(target_gain_.load());
+      gain_.process(output + begin, keep, channels);
+
+      if (in_place) {
+        if (begin > 0 && end > begin) {
+          std::memmove(output, output + begin, (end - begin) * sizeof(std::int16_t));
+        }
+        if (end > begin) {
+          pcm_.commit(end - begin);
+          notify_consumer();
+        }
+      } else if (end > begin) {
+        pcm_offset_ = begin;
+        pcm_size_ = end;
+      }
+
+      if (building_) {
+        seek_table_.add_frame(frame_offset);
+      }
+      position_ms_.store(seek_table_.frame_to_ms(frame_index_++));
+
+      if (pcm_offset_ < pcm_size_) {
+        flush_pcm();
+      }
+      TELEMETRY_LEVEL(kPcmFill, get_pcm_fill_percent());
+      break;
+    }
+
+    case ERR_MP3_MAINDATA_UNDERFLOW:
+      // bit reservoir not yet filled (e.g. first frames after a seek)
+      if (building_) {
+        seek_table_.add_frame(frame_offset);
+      }
+      frame_index_++;
+      break;
+
+    case ERR_MP3_INDATA_UNDERFLOW:
+      // truncated last frame
+      if (end_of_stream_) {
+        input_start_ = input_end_;
+        break;
+      }
+      [[fallthrough]];
+
+    default:
+      // corrupt or false sync; step past it and resync (a table with a
+      // missing or bogus frame would be worse than none)
+      TELEMETRY_COUNT(kDecodeErrors);
+      building_ = false;
+      input_start_ = std::min(input_end_, std::max(input_start_, sync_position + 1));
+      break;
+  }
+}
+
+bool DecoderObject::parse_first_frame(const std::uint8_t* frame, const std::size_t size, const std::size_t position) {
+  track_header_ = Mp3FrameHeader::parse(frame, size);
+  if (!track_header_) {
+    building_ = false;
+    return false;
+  }
+
+  seek_table_.reset(SeekTable::Source{}, track_header_->sample_rate, track_header_->samples_per_frame);
+  audio_start_ = input_base_ + static_cast<std::uint32_t>(position);
+
+  // handed over by the stream, which started the track past the tag frame
+  if (info_tag_) {
+    return false;
+  }
+
+  info_tag_ = Mp3InfoTag::parse(frame, size);
+  if (!info_tag_) {
+    return false;
+  }
+  apply_info_tag();
+
+  // the tag frame decodes to silence; step over it
+  audio_start_ += info_tag_->header.frame_bytes;
+  input_start_ = position + info_tag_->header.frame_bytes;
+  return true;
+}
+
+void DecoderObject::apply_info_tag() {
+  if (info_tag_->has_lame) {
+    start_trim_ = info_tag_->encoder_delay + Mp3InfoTag::kDecoderDelay;
+    skip_samples_ = start_trim_;
+
+    if (info_tag_->frames > 0) {
+      const std::uint32_t total = info_tag_->frames * info_tag_->header.samples_per_frame;
+      const std::uint32_t added = info_tag_->encoder_delay + info_tag_->encoder_padding;
+      total_samples_ = total > added ? total - added : 0;
+      remaining_samples_ = total_samples_;
+    }
+  }
+}
+
+void DecoderObject::flush_pcm() {
+  pcm_offset_ += pcm_.write(pcm_frame_.data() + pcm_offset_, pcm_size_ - pcm_offset_);
+  notify_consumer();
+
+  if (pcm_offset_ < pcm_size_) {
+    // the ring is full, so there is time for a pending table write
+    save_seek_table();
+
+    // sleep until the consumer frees some space
+    producer_waiting_.store(true);
+    if (pcm_.available() == 0) {
+      xSemaphoreTake(space_sem_, pdMS_TO_TICKS(kIdleWaitMs));
+    }
+    producer_waiting_.store(false);
+  }
+}
+
+void DecoderObject::notify_consumer() {
+  if (consumer_waiting_.exchange(false)) {
+    xSemaphoreGive(data_sem_);
+  }
+}
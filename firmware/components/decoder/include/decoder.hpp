@@ -0,0 +1,319 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+extern "C" {
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+}
+
+#include "component.hpp"
+#include "mp3_frame.hpp"
+#include "pcm_kernels.hpp"
+#include "pm_lock.hpp"
+#include "sd_card.hpp"
+#include "sd_stream.hpp"
+#include "seek_table.hpp"
+#include "spsc_ring.hpp"
+
+/**
+ * @brief Streaming MP3 decoder. Frames are pulled from the SD stream
+ * reader, decoded with a fixed-point decoder and written as interleaved
+ * 16-bit PCM into a ring that the audio output drains.
+ *
+ * Tracks queued with enqueue() follow the current one without a gap: the
+ * stream has them prefetched, the PCM ring is not flushed and the encoder
+ * delay/padding from the LAME tag is trimmed away.
+ *
+ * While a track plays from its start, every frame offset goes into a seek
+ * table that is saved to the card once the track has been decoded to the
+ * end, so later seeks (and resume from a position) are a direct lookup.
+ * Until then, seeks fall back to the Xing TOC or a constant bitrate guess.
+ */
+class DecoderObject : public StaticActiveObject<ActiveObject::MemoryLoad::kHeavy> {
+public:
+  /// @brief samples per channel in an MPEG-1 layer III frame
+  static constexpr std::size_t kFrameSamples = 1152;
+
+  /// @brief maximum number of output channels
+  static constexpr std::size_t kMaxChannels = 2;
+
+  /// @brief PCM ring size in samples (~3.5 stereo frames)
+  static constexpr std::size_t kPcmRingSamples = 8192;
+
+  /// @brief format of the PCM currently in the ring
+  struct Format {
+    std::uint32_t sample_rate;
+    std::uint8_t channels;
+    std::uint32_t bitrate;
+  };
+
+  /// @brief decoder constructor
+  /// @param card card holding the tracks and their seek tables
+  /// @param stream stream reader to pull encoded data from
+  DecoderObject(const SdCardObject& card, SdStreamObject& stream);
+
+  /// @brief release the decoder on destruction
+  ~DecoderObject();
+
+  /// @brief start decoding a file, replacing the current one
+  /// @param path absolute path of the file to decode
+  /// @param start_ms position to start at (e.g. to resume a track)
+  /// @return false if the path is too long
+  bool play(const std::string_view path, const std::uint32_t start_ms = 0);
+
+  /// @brief stop decoding
+  void stop();
+
+  /// @brief jump to a position in the current track
+  void seek(const std::uint32_t position_ms);
+
+  /**
+   * @brief Queue the track to play once the current one ends, replacing a
+   * previously queued one. If nothing is playing, it starts right away.
+   * @param path absolute path of the file to decode next
+   * @return false if the path is too long
+   */
+  bool enqueue(const std::string_view path);
+
+  /// @brief drop the track queued with enqueue(), if it has not started yet
+  void cancel_next();
+
+  /// @brief true while a track queued with enqueue() has not started yet
+  bool is_next_pending() const { return next_pending_.load(); }
+
+  /**
+   * @brief Read decoded PCM. Only one task may consume the PCM ring.
+   * @param samples destination for interleaved samples
+   * @param count maximum number of samples to read
+   * @param timeout ticks to wait for the first sample
+   * @return number of samples read
+   */
+  std::size_t read_pcm(std::int16_t* samples, const std::size_t count, const TickType_t timeout);
+
+  /// @brief format of the most recently decoded frame
+  Format get_format() const;
+
+  /// @brief PCM ring fill (0-100), e.g. to scale the clock with the headroom
+  std::uint32_t get_pcm_fill_percent() const {
+    return static_cast<std::uint32_t>(pcm_.size() * 100 / pcm_.capacity());
+  }
+
+  /// @brief position of the most recently decoded frame in the current track
+  std::uint32_t get_position_ms() const { return position_ms_.load(); }
+
+  /// @brief true while a track is being decoded
+  bool is_playing() const { return playing_.load(); }
+
+  /**
+   * @brief Output gain, applied in a separate pass over each frame right
+   * after synthesis, while the frame is still in cache (skipped at unity
+   * gain). Changes are ramped across the next frame.
+   * @param gain Q15 gain (GainRamp::kUnity is 0 dB)
+   */
+  void set_gain(const std::int32_t gain) { target_gain_.store(gain); }
+
+  /// @brief output gain most recently requested
+  std::int32_t get_gain() const { return target_gain_.load(); }
+
+  /// @brief longest single frame decode seen so far (microseconds)
+  std::uint32_t get_peak_decode_us() const { return peak_decode_us_.load(); }
+
+protected:
+  void initialize() override;
+  void task() override;
+
+private:
+  /// @brief input buffer holds one maximal frame plus one stream chunk
+  static constexpr std::size_t kInputCapacity = 2048 + SdStreamObject::kBufferSize;
+
+  /// @brief pick up a pending play()/stop() request inside the decode task
+  void apply_request();
+
+  /// @brief pick up a pending seek() request inside the decode task
+  void apply_seek_request();
+
+  /// @brief reset per-track state at the start of a new track
+  void begin_track();
+
+  /// @brief hand a fully built seek table over to be saved
+  void finish_track();
+
+  /// @brief restart the stream at a position (format must be known)
+  void seek_to(const std::uint32_t position_ms);
+
+  /// @brief write a completed seek table unless the card already has it
+  void save_seek_table();
+
+  /// @brief top up the input buffer from the stream
+  /// @return true if there is enough data to attempt a frame decode
+  bool fill_input();
+
+  /// @brief decode a single frame into the PCM ring
+  void decode_frame();
+
+  /// @brief learn the track format from its first frame
+  /// @return true if the frame was a Xing/Info tag frame and has been skipped
+  bool parse_first_frame(const std::uint8_t* frame, const std::size_t size, const std::size_t position);
+
+  /// @brief take the encoder delay and padding from info_tag_ for gapless trimming
+  void apply_info_tag();
+
+  /// @brief push the pending decoded frame into the PCM ring
+  void flush_pcm();
+
+  /// @brief wake the consumer if it is waiting for PCM
+  void notify_consumer();
+
+  /// @brief card the tracks are read from
+  const SdCardObject& card_;
+
+  /// @brief encoded data source
+  SdStreamObject& stream_;
+
+  /// @brief opaque decoder state
+  void* decoder_{nullptr};
+
+  /// @brief encoded input, valid between input_start_ and input_end_
+  std::array<std::uint8_t, kInputCapacity> input_{};
+  std::size_t input_start_{0};
+  std::size_t input_end_{0};
+
+  /// @brief file offset of input_[0]
+  std::uint32_t input_base_{0};
+
+  /// @brief bytes still to skip (e.g. an ID3v2 tag) before frame data
+  std::size_t skip_bytes_{0};
+
+  /// @brief true until the first chunk of a stream has been seen
+  bool stream_start_{false};
+
+  /// @brief true once the stream has delivered its last chunk
+  bool end_of_stream_{false};
+
+  /// @brief true until the first frame of a track has been looked at
+  bool first_frame_{false};
+
+  /// @brief header of the first audio frame, once seen
+  std::optional<Mp3FrameHeader> track_header_{std::nullopt};
+
+  /// @brief Xing/Info tag of the current track, if it has one
+  std::optional<Mp3InfoTag> info_tag_{std::nullopt};
+
+  /// @brief file offset of the first audio frame
+  std::uint32_t audio_start_{0};
+
+  /// @brief frame number of the next frame to decode
+  std::uint32_t frame_index_{0};
+
+  /// @brief samples per channel trimmed from the start (encoder + decoder delay)
+  std::uint32_t start_trim_{0};
+
+  /// @brief samples per channel of actual audio, if known from the LAME tag
+  std::optional<std::uint32_t> total_samples_{std::nullopt};
+
+  /// @brief samples per channel still to drop at the current position
+  std::uint32_t skip_samples_{0};
+
+  /// @brief samples per channel left before the end padding, if known
+  std::optional<std::uint32_t> remaining_samples_{std::nullopt};
+
+  /// @brief seek held back until the track format is known
+  std::optional<std::uint32_t> pending_seek_ms_{std::nullopt};
+
+  /// @brief path of the track being decoded (decode task only)
+  std::array<char, SdCardObject::kMaxPathLength> current_path_{'\0'};
+
+  /// @brief seek table of the current track, built while it plays from the start
+  SeekTable seek_table_;
+  bool building_{false};
+
+  /// @brief full clock from a seek until the first frame after it has decoded
+  PmLock seek_boost_{ESP_PM_CPU_FREQ_MAX, "decoder_seek"};
+
+  /// @brief table of a finished track waiting for an idle moment to be saved
+  SeekTable completed_table_;
+  std::array<char, SdCardObject::kMaxPathLength> completed_path_{'\0'};
+  bool save_pending_{false};
+
+  /**
+   * @brief Frames are decoded straight into the ring when a full frame fits
+   * contiguously; otherwise they are staged here and copied in.
+   */
+  std::array<std::int16_t, kFrameSamples * kMaxChannels> pcm_frame_{};
+  std::size_t pcm_offset_{0};
+  std::size_t pcm_size_{0};
+
+  /// @brief output gain (decode task only) and the value it is heading for
+  GainRamp gain_;
+  std::atomic<std::int32_t> target_gain_{GainRamp::kUnity};
+
+  /// @brief decoded PCM handed to the audio output
+  SpscRing<std::int16_t, kPcmRingSamples> pcm_;
+
+  /// @brief ring position before which PCM belongs to a replaced track
+  std::atomic<std::size_t> flush_position_{0};
+  std::atomic<bool> flush_pending_{false};
+
+  /// @brief set by a side that is about to block on the ring
+  std::atomic<bool> producer_waiting_{false};
+  std::atomic<bool> consumer_waiting_{false};
+
+  /// @brief last decoded format
+  std::atomic<std::uint32_t> sample_rate_{0};
+  std::atomic<std::uint8_t> channels_{0};
+  std::atomic<std::uint32_t> bitrate_{0};
+
+  /// @brief position visible to other tasks
+  std::atomic<std::uint32_t> position_ms_{0};
+
+  /// @brief timing of decode calls
+  std::atomic<std::uint32_t> peak_decode_us_{0};
+
+  /// @brief decode state visible to other tasks
+  std::atomic<bool> playing_{false};
+
+  /// @brief a track has been queued with enqueue() and not started yet
+  std::atomic<bool> next_pending_{false};
+
+  /// @brief generation of the request currently being decoded (decode task only)
+  std::uint32_t generation_{0};
+
+  /// @brief generation most recently requested through play()/stop()
+  std::atomic<std::uint32_t> requested_generation_{0};
+
+  /// @brief seek request sequence, applied and most recently requested
+  std::uint32_t seek_sequence_{0};
+  std::atomic<std::uint32_t> requested_seek_sequence_{0};
+  std::atomic<std::uint32_t> requested_seek_ms_{0};
+
+  /// @brief paths requested through play() and enqueue(), guarded by request_mutex_
+  std::array<char, SdCardObject::kMaxPathLength> requested_path_{'\0'};
+  std::array<char, SdCardObject::kMaxPathLength> requested_next_path_{'\0'};
+  std::uint32_t requested_start_ms_{0};
+
+  /// @brief buffers to store the semaphores without heap allocation
+  StaticSemaphore_t request_mutex_buffer_{};
+  StaticSemaphore_t wake_sem_buffer_{};
+  StaticSemaphore_t space_sem_buffer_{};
+  StaticSemaphore_t data_sem_buffer_{};
+
+  /// @brief guards the requested paths, and keeps next_pending_ in step with the stream's next request
+  SemaphoreHandle_t request_mutex_{nullptr};
+
+  /// @brief wakes an idle decoder when a new request arrives
+  SemaphoreHandle_t wake_sem_{nullptr};
+
+  /// @brief PCM ring full -> not full (only given if producer_waiting_)
+  SemaphoreHandle_t space_sem_{nullptr};
+
+  /// @brief PCM ring empty -> not empty (only given if consumer_waiting_)
+  SemaphoreHandle_t data_sem_{nullptr};
+};
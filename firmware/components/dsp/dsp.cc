@@ -0,0 +1,234 @@
+#include <algorithm>
+#include <cstring>
+
+#include "include/dsp.hpp"
+
+extern "C" {
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+}
+
+namespace {
+
+constexpr const char* kComponentTag = "DspObject";
+constexpr std::uint32_t kIdleWaitMs = 100;
+constexpr std::uint32_t kPcmWaitMs = 20;
+
+}
+
+DspObject::DspObject(DecoderObject& decoder, const Config& config)
+  : StaticActiveObject("DspObject", ActiveObject::Priority::kHigh, std::nullopt, ActiveObject::Workload::kAudio),
+    decoder_(decoder),
+    limiter_enabled_(config.limiter) {
+  wake_sem_ = xSemaphoreCreateBinaryStatic(&wake_sem_buffer_);
+  space_sem_ = xSemaphoreCreateBinaryStatic(&space_sem_buffer_);
+  data_sem_ = xSemaphoreCreateBinaryStatic(&data_sem_buffer_);
+
+  for (std::size_t band = 0; band < kBandCount; band++) {
+    set_band_gain(band, config.band_gains_db[band]);
+  }
+  set_eq_enabled(config.eq_enabled);
+  set_volume(config.volume);
+}
+
+std::int32_t DspObject::volume_to_gain(const std::uint8_t volume) {
+  if (volume == 0) {
+    return 0;
+  }
+
+  // equal steps in dB sound like equal steps in loudness
+  const float attenuation_db = kVolumeRangeDb * static_cast<float>(kMaxVolume - volume) / kMaxVolume;
+  return GainRamp::from_db(-attenuation_db);
+}
+
+void DspObject::set_volume(const std::uint8_t volume) {
+  const std::uint8_t clamped = std::min(volume, kMaxVolume);
+  volume_.store(clamped);
+  decoder_.set_gain(volume_to_gain(clamped));
+}
+
+void DspObject::adjust_volume(const int delta) {
+  set_volume(static_cast<std::uint8_t>(std::clamp<int>(volume_.load() + delta, 0, kMaxVolume)));
+}
+
+void DspObject::set_eq_enabled(const bool enabled) {
+  eq_enabled_.store(enabled);
+  settings_version_.fetch_add(1);
+}
+
+void DspObject::set_band_gain(const std::size_t band, const std::int8_t gain_db) {
+  if (band >= kBandCount) {
+    return;
+  }
+
+  band_gains_db_[band].store(std::clamp<std::int8_t>(gain_db, -kMaxBandGainDb, kMaxBandGainDb));
+  settings_version_.fetch_add(1);
+}
+
+const ActiveObject& DspObject::get_producer() const {
+  if (state_.load() == State::kBypass) {
+    return decoder_;
+  }
+  return *this;
+}
+
+std::size_t DspObject::read_pcm(std::int16_t* samples, const std::size_t count, const TickType_t timeout) {
+  if (state_.load() == State::kBypass) {
+    if (!eq_enabled_.load()) {
+      return decoder_.read_pcm(samples, count, timeout);
+    }
+
+    // we are not reading the decoder now, so it is ours to hand over
+    state_.store(State::kActive);
+    xSemaphoreGive(wake_sem_);
+  }
+
+  std::size_t read = ring_.read(samples, count);
+  if (read == 0 && state_.load() == State::kDraining) {
+    // the stage writes nothing after it starts draining, so empty is final
+    read = ring_.read(samples, count);
+    if (read == 0) {
+      state_.store(State::kBypass);
+      return decoder_.read_pcm(samples, count, timeout);
+    }
+  }
+
+  if (read == 0 && timeout > 0) {
+    // re-check after announcing ourselves so a concurrent commit is not missed
+    consumer_waiting_.store(true);
+    if (ring_.empty()) {
+      xSemaphoreTake(data_sem_, timeout);
+    }
+    consumer_waiting_.store(false);
+    read = ring_.read(samples, count);
+  }
+
+  if (read > 0 && producer_waiting_.exchange(false)) {
+    xSemaphoreGive(space_sem_);
+  }
+
+  return read;
+}
+
+void DspObject::task() {
+  if (state_.load() != State::kActive) {
+    xSemaphoreTake(wake_sem_, pdMS_TO_TICKS(kIdleWaitMs));
+    return;
+  }
+
+  // a block that did not fit goes out before anything else is processed
+  if (output_offset_ < output_size_ && !flush_output()) {
+    return;
+  }
+
+  if (!eq_enabled_.load()) {
+    // a partial frame cannot be handed back, so it is dropped with the history
+    carry_ = 0;
+    preamp_ = GainRamp{};
+    limiter_.reset();
+    for (auto& filter : filters_) {
+      filter.reset();
+    }
+
+    state_.store(State::kDraining);
+    notify_consumer();
+    LOGI(kComponentTag, "EQ off, bypassing");
+    return;
+  }
+
+  process_block();
+}
+
+void DspObject::update_filters(const std::uint32_t sample_rate) {
+  applied_version_ = settings_version_.load();
+  sample_rate_ = sample_rate;
+
+  std::int8_t max_boost = 0;
+  for (std::size_t band = 0; band < kBandCount; band++) {
+    const std::int8_t gain_db = band_gains_db_[band].load();
+    const auto& layout = kBands[band];
+
+    filters_[band].set(Biquad::design(layout.shape, layout.frequency_hz, layout.q, gain_db, sample_rate));
+    flat_[band] = gain_db == 0;
+    max_boost = std::max(max_boost, gain_db);
+  }
+
+  // headroom for the largest boost, so the limiter only catches what stacks up
+  preamp_.set_target(GainRamp::from_db(-static_cast<float>(max_boost)));
+}
+
+void DspObject::process_block() {
+  const auto format = decoder_.get_format();
+  const std::size_t channels = std::clamp<std::size_t>(format.channels, 1, kPcmMaxChannels);
+
+  if (settings_version_.load() != applied_version_ || (format.sample_rate != 0 && format.sample_rate != sample_rate_)) {
+    update_filters(format.sample_rate != 0 ? format.sample_rate : sample_rate_);
+  }
+
+  const std::size_t wanted = kBlockFrames * channels - std::min(carry_, kBlockFrames * channels);
+  const std::size_t read = decoder_.read_pcm(input_.data() + carry_, wanted, pdMS_TO_TICKS(kPcmWaitMs));
+  if (read == 0) {
+    return;
+  }
+  record_handoff(decoder_);
+
+  // only whole frames are processed; a split one waits for its other half
+  const std::size_t available = carry_ + read;
+  const std::size_t frames = available / channels;
+  const std::size_t samples = frames * channels;
+
+  const std::int64_t begin_us = esp_timer_get_time();
+
+  pcm_widen(input_.data(), work_.data(), samples);
+  preamp_.process(work_.data(), frames, channels);
+  for (std::size_t band = 0; band < kBandCount; band++) {
+    if (!flat_[band]) {
+      filters_[band].process(work_.data(), frames, channels);
+    }
+  }
+
+  if (limiter_enabled_) {
+    limiter_.process(work_.data(), output_.data(), frames, channels);
+  } else {
+    pcm_saturate(work_.data(), output_.data(), samples);
+  }
+
+  const auto elapsed_us = static_cast<std::uint32_t>(esp_timer_get_time() - begin_us);
+  if (elapsed_us > peak_block_us_.load()) {
+    peak_block_us_.store(elapsed_us);
+  }
+
+  carry_ = available - samples;
+  if (carry_ > 0) {
+    std::memmove(input_.data(), input_.data() + samples, carry_ * sizeof(std::int16_t));
+  }
+
+  output_offset_ = 0;
+  output_size_ = samples;
+  flush_output();
+}
+
+bool DspObject::flush_output() {
+  output_offset_ += ring_.write(output_.data() + output_offset_, output_size_ - output_offset_);
+  notify_consumer();
+
+  if (output_offset_ < output_size_) {
+    // sleep until the consumer frees some space
+    producer_waiting_.store(true);
+    if (ring_.available() == 0) {
+      xSemaphoreTake(space_sem_, pdMS_TO_TICKS(kIdleWaitMs));
+    }
+    producer_waiting_.store(false);
+    return false;
+  }
+
+  return true;
+}
+
+void DspObject::notify_consumer() {
+  if (consumer_waiting_.exchange(false)) {
+    xSemaphoreGive(data_sem_);
+  }
+}
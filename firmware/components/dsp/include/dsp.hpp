@@ -0,0 +1,218 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+extern "C" {
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+}
+
+#include "component.hpp"
+#include "decoder.hpp"
+#include "pcm_kernels.hpp"
+#include "spsc_ring.hpp"
+
+/**
+ * @brief Audio processing between the decoder and the audio output: a
+ * five-band EQ of shelf and peaking biquads with headroom, followed by a
+ * peak limiter, run in fixed-size blocks on the fixed-point kernels.
+ *
+ * Volume never needs this stage: it is handed to the decoder, which applies
+ * it in a pass over each frame right after decoding it. While the EQ is
+ * off the stage is bypassed entirely and read_pcm() reads the decoder ring
+ * directly, so the task sleeps and the audio is not copied an extra time.
+ *
+ * Only one task may read the decoder ring at a time, so the handover
+ * happens on the side that gives it up: the consumer starts the stage from
+ * read_pcm() when the EQ is turned on, and the stage stops itself when it
+ * is turned off, after which the consumer reads out what was already
+ * processed before going back to the decoder.
+ */
+class DspObject : public StaticActiveObject<ActiveObject::MemoryLoad::kStandard> {
+public:
+  /// @brief frames processed per block (~5.8 ms at 44.1 kHz)
+  static constexpr std::size_t kBlockFrames = 256;
+
+  /// @brief processed PCM ring size in samples (four stereo blocks)
+  static constexpr std::size_t kRingSamples = 2048;
+
+  /// @brief number of EQ bands
+  static constexpr std::size_t kBandCount = 5;
+
+  /// @brief band gain limit in either direction (dB)
+  static constexpr std::int8_t kMaxBandGainDb = 12;
+
+  /// @brief volume scale, and the attenuation at the lowest audible step (dB)
+  static constexpr std::uint8_t kMaxVolume = 100;
+  static constexpr float kVolumeRangeDb = 50.0f;
+
+  /// @brief shape and placement of an EQ band
+  struct Band {
+    Biquad::Shape shape;
+    float frequency_hz;
+    float q;
+  };
+
+  /// @brief fixed band layout
+  static constexpr std::array<Band, kBandCount> kBands = {{
+    {Biquad::Shape::kLowShelf, 60.0f, 0.707f},
+    {Biquad::Shape::kPeaking, 250.0f, 1.0f},
+    {Biquad::Shape::kPeaking, 1000.0f, 1.0f},
+    {Biquad::Shape::kPeaking, 4000.0f, 1.0f},
+    {Biquad::Shape::kHighShelf, 12000.0f, 0.707f},
+  }};
+
+  /// @brief initial settings
+  struct Config {
+    /// @brief volume on the 0-kMaxVolume scale
+    std::uint8_t volume = 70;
+
+    /// @brief process the EQ (otherwise the stage is bypassed)
+    bool eq_enabled = false;
+
+    /// @brief gain per band (dB)
+    std::array<std::int8_t, kBandCount> band_gains_db{};
+
+    /// @brief catch peaks from EQ boosts instead of clipping them
+    bool limiter = true;
+  };
+
+  /// @brief signal processing constructor
+  /// @param decoder decoder to pull PCM from and hand the volume to
+  /// @param config initial settings
+  DspObject(DecoderObject& decoder, const Config& config);
+
+  /// @brief set the volume (0 mutes)
+  void set_volume(const std::uint8_t volume);
+
+  /// @brief raise or lower the volume by a number of steps
+  void adjust_volume(const int delta);
+
+  /// @brief current volume
+  std::uint8_t get_volume() const { return volume_.load(); }
+
+  /// @brief turn the EQ on or off; takes effect at the next block
+  void set_eq_enabled(const bool enabled);
+
+  /// @brief true if the EQ has been turned on
+  bool is_eq_enabled() const { return eq_enabled_.load(); }
+
+  /// @brief set the gain of a band (dB, clamped to +-kMaxBandGainDb)
+  void set_band_gain(const std::size_t band, const std::int8_t gain_db);
+
+  /// @brief gain of a band (dB)
+  std::int8_t get_band_gain(const std::size_t band) const { return band_gains_db_[band].load(); }
+
+  /**
+   * @brief Read processed PCM. Only one task may consume the output.
+   * @param samples destination for interleaved samples
+   * @param count maximum number of samples to read
+   * @param timeout ticks to wait for the first sample
+   * @return number of samples read
+   */
+  std::size_t read_pcm(std::int16_t* samples, const std::size_t count, const TickType_t timeout);
+
+  /// @brief format of the PCM coming out of the pipeline
+  DecoderObject::Format get_format() const { return decoder_.get_format(); }
+
+  /// @brief true while a track is being decoded
+  bool is_playing() const { return decoder_.is_playing(); }
+
+  /// @brief true while audio goes through the stage rather than around it
+  bool is_processing() const { return state_.load() != State::kBypass; }
+
+  /// @brief object that produced the PCM handed out by read_pcm()
+  const ActiveObject& get_producer() const;
+
+  /// @brief longest single block seen so far (microseconds)
+  std::uint32_t get_peak_block_us() const { return peak_block_us_.load(); }
+
+protected:
+  void task() override;
+
+private:
+  /// @brief who reads the decoder ring
+  enum class State : std::uint8_t {
+    kBypass,   ///< the consumer, directly
+    kActive,   ///< the stage task
+    kDraining  ///< nobody; the consumer is reading out the stage's ring
+  };
+
+  /// @brief Q15 gain the decoder applies for a volume step
+  static std::int32_t volume_to_gain(const std::uint8_t volume);
+
+  /// @brief redesign the filters for changed settings or sample rate
+  void update_filters(const std::uint32_t sample_rate);
+
+  /// @brief pull, process and queue one block
+  void process_block();
+
+  /// @brief push the pending processed block into the ring
+  /// @return true once all of it has been queued
+  bool flush_output();
+
+  /// @brief wake the consumer if it is waiting for PCM
+  void notify_consumer();
+
+  /// @brief PCM source and volume sink
+  DecoderObject& decoder_;
+
+  /// @brief settings, written by any task
+  std::atomic<std::uint8_t> volume_{0};
+  std::atomic<bool> eq_enabled_{false};
+  std::array<std::atomic<std::int8_t>, kBandCount> band_gains_db_{};
+  const bool limiter_enabled_;
+
+  /// @brief bumped on every EQ change so the task redesigns the filters
+  std::atomic<std::uint32_t> settings_version_{0};
+
+  /// @brief settings and sample rate the filters were designed for (task only)
+  std::uint32_t applied_version_{0};
+  std::uint32_t sample_rate_{0};
+
+  /// @brief processing chain (task only)
+  GainRamp preamp_;
+  std::array<Biquad, kBandCount> filters_{};
+  std::array<bool, kBandCount> flat_{};
+  Limiter limiter_;
+
+  /// @brief block buffers; input_ may start with a partial frame from the last read
+  std::array<std::int16_t, kBlockFrames * kPcmMaxChannels> input_{};
+  std::array<std::int32_t, kBlockFrames * kPcmMaxChannels> work_{};
+  std::array<std::int16_t, kBlockFrames * kPcmMaxChannels> output_{};
+  std::size_t carry_{0};
+  std::size_t output_offset_{0};
+  std::size_t output_size_{0};
+
+  /// @brief processed PCM handed to the audio output
+  SpscRing<std::int16_t, kRingSamples> ring_;
+
+  /// @brief current owner of the decoder ring
+  std::atomic<State> state_{State::kBypass};
+
+  /// @brief set by a side that is about to block on the ring
+  std::atomic<bool> producer_waiting_{false};
+  std::atomic<bool> consumer_waiting_{false};
+
+  /// @brief timing of process_block()
+  std::atomic<std::uint32_t> peak_block_us_{0};
+
+  /// @brief buffers to store the semaphores without heap allocation
+  StaticSemaphore_t wake_sem_buffer_{};
+  StaticSemaphore_t space_sem_buffer_{};
+  StaticSemaphore_t data_sem_buffer_{};
+
+  /// @brief wakes the idle stage when the consumer hands it the decoder ring
+  SemaphoreHandle_t wake_sem_{nullptr};
+
+  /// @brief ring full -> not full (only given if producer_waiting_)
+  SemaphoreHandle_t space_sem_{nullptr};
+
+  /// @brief ring empty -> not empty (only given if consumer_waiting_)
+  SemaphoreHandle_t data_sem_{nullptr};
+};
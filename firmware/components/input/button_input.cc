@@ -0,0 +1,188 @@
+#include "include/button_input.hpp"
+
+extern "C" {
+
+#include "esp_attr.h"
+#include "esp_log.h"
+
+}
+
+namespace {
+
+constexpr const char* kComponentTag = "ButtonInput";
+
+}
+
+ButtonInput::~ButtonInput() {
+  for (std::size_t i = 0; i < count_; i++) {
+    auto& slot = slots_[i];
+    if (started_) {
+      gpio_intr_disable(slot.button.pin);
+      gpio_isr_handler_remove(slot.button.pin);
+    }
+    if (slot.timer) {
+      esp_timer_stop(slot.timer);
+      esp_timer_delete(slot.timer);
+    }
+  }
+}
+
+bool ButtonInput::add(const Button& button) {
+  if (started_ || count_ == slots_.size() || !button.target) {
+    return false;
+  }
+
+  slots_[count_++] = Slot{.owner = this, .button = button};
+  return true;
+}
+
+bool ButtonInput::start() {
+  if (started_) {
+    return true;
+  }
+
+  // another driver may have installed the shared GPIO ISR service already
+  const esp_err_t service = gpio_install_isr_service(0);
+  if (service != ESP_OK && service != ESP_ERR_INVALID_STATE) {
+    ESP_LOGE(kComponentTag, "GPIO ISR service: %s", esp_err_to_name(service));
+    return false;
+  }
+
+  for (std::size_t i = 0; i < count_; i++) {
+    auto& slot = slots_[i];
+    const auto& button = slot.button;
+
+    const gpio_config_t config = {
+      .pin_bit_mask = 1ULL << button.pin,
+      .mode = GPIO_MODE_INPUT,
+      .pull_up_en = button.active_low ? GPIO_PULLUP_ENABLE : GPIO_PULLUP_DISABLE,
+      .pull_down_en = button.active_low ? GPIO_PULLDOWN_DISABLE : GPIO_PULLDOWN_ENABLE,
+      .intr_type = GPIO_INTR_ANYEDGE,
+    };
+
+    // the esp_timer task runs above every pipeline task, so dispatching
+    // there costs no latency and allows the regular mailbox post()
+    const esp_timer_create_args_t timer_args = {
+      .callback = on_timer,
+      .arg = &slot,
+      .dispatch_method = ESP_TIMER_TASK,
+      .name = "button",
+      .skip_unhandled_events = true,
+    };
+
+    if (gpio_config(&config) != ESP_OK ||
+        esp_timer_create(&timer_args, &slot.timer) != ESP_OK ||
+        gpio_isr_handler_add(button.pin, on_edge, &slot) != ESP_OK) {
+      ESP_LOGE(kComponentTag, "Could not set up button on GPIO %d", static_cast<int>(button.pin));
+      return false;
+    }
+  }
+
+  started_ = true;
+  ESP_LOGI(kComponentTag, "%zu buttons armed", count_);
+  return true;
+}
+
+bool IRAM_ATTR ButtonInput::is_active(const Slot& slot) {
+  return (gpio_get_level(slot.button.pin) == 0) == slot.button.active_low;
+}
+
+void IRAM_ATTR ButtonInput::on_edge(void* arg) {
+  auto& slot = *static_cast<Slot*>(arg);
+  auto& self = *slot.owner;
+
+  // bounces are ignored until the settle timer has looked at the pin
+  gpio_intr_disable(slot.button.pin);
+
+  const bool active = is_active(slot);
+  bool down = false;
+
+  portENTER_CRITICAL_ISR(&self.lock_);
+  if (!slot.pressed && active) {
+    slot.pressed = true;
+    slot.long_sent = false;
+    slot.press_us = esp_timer_get_time();
+    down = true;
+  }
+  portEXIT_CRITICAL_ISR(&self.lock_);
+
+  // restarts a pending hold timer, which recomputes its deadline on expiry
+  esp_timer_stop(slot.timer);
+  esp_timer_start_once(slot.timer, static_cast<std::uint64_t>(self.timing_.debounce_ms) * 1000);
+
+  if (down) {
+    self.post(slot, Press::kDown, true);
+  }
+}
+
+void ButtonInput::on_timer(void* arg) {
+  auto& slot = *static_cast<Slot*>(arg);
+  auto& self = *slot.owner;
+
+  const std::int64_t now_us = esp_timer_get_time();
+  const std::int64_t long_press_us = static_cast<std::int64_t>(self.timing_.long_press_ms) * 1000;
+  const std::int64_t repeat_us = static_cast<std::int64_t>(self.timing_.repeat_ms) * 1000;
+  const bool active = is_active(slot);
+
+  bool report = false;
+  Press press = Press::kDown;
+  std::int64_t next_us = 0;
+
+  portENTER_CRITICAL(&self.lock_);
+  if (slot.pressed && !active) {
+    // a short press is only known to be short once it is over
+    report = !slot.long_sent;
+    press = Press::kShort;
+    slot.pressed = false;
+  } else if (!slot.pressed && active) {
+    // the edge came in while the contacts still read released
+    report = true;
+    press = Press::kDown;
+    slot.pressed = true;
+    slot.long_sent = false;
+    slot.press_us = now_us;
+    next_us = long_press_us;
+  } else if (slot.pressed) {
+    const std::int64_t held_us = now_us - slot.press_us;
+    if (!slot.long_sent && held_us >= long_press_us) {
+      report = true;
+      press = Press::kLong;
+      slot.long_sent = true;
+      slot.last_event_us = now_us;
+      next_us = repeat_us;
+    } else if (!slot.long_sent) {
+      next_us = long_press_us - held_us;
+    } else if (now_us - slot.last_event_us >= repeat_us) {
+      report = true;
+      press = Press::kRepeat;
+      slot.last_event_us = now_us;
+      next_us = repeat_us;
+    } else {
+      next_us = repeat_us - (now_us - slot.last_event_us);
+    }
+  }
+  portEXIT_CRITICAL(&self.lock_);
+
+  if (next_us > 0) {
+    esp_timer_start_once(slot.timer, static_cast<std::uint64_t>(next_us));
+  }
+
+  // the next edge (release, or a new press) cuts a hold timer short
+  gpio_intr_enable(slot.button.pin);
+
+  if (report) {
+    self.post(slot, press, false);
+  }
+}
+
+void IRAM_ATTR ButtonInput::post(const Slot& slot, const Press press, const bool from_isr) {
+  const ActiveObject::Event event{
+    .type = ActiveObject::Event::Type::kButton,
+    .code = slot.button.code,
+    .value = static_cast<std::uint32_t>(press),
+  };
+
+  auto* target = slot.button.target;
+  const bool posted = from_isr ? target->post_from_isr(event) : target->post(event);
+  (posted ? posted_ : dropped_).fetch_add(1);
+}
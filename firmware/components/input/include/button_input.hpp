@@ -0,0 +1,124 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+extern "C" {
+
+#include "driver/gpio.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+}
+
+#include "component.hpp"
+
+/**
+ * @brief Interrupt-driven push buttons. There is no polling task: an edge
+ * interrupt wakes the state machine, a one-shot esp_timer per button
+ * confirms the level once the contacts have settled and times long presses
+ * and repeats, and every decision is posted straight into the mailbox of
+ * the button's target as an Event::Type::kButton (code: button code,
+ * value: Press). While no button is held nothing runs at all.
+ *
+ * Debouncing is leading-edge: the first edge out of the idle state is a
+ * press right away (kDown is posted from the ISR), and the pin interrupt
+ * stays masked until the settle timer has seen a stable level, so the
+ * press reaches the target within a scheduler tick.
+ */
+class ButtonInput {
+public:
+  /// @brief Event::value of a button event
+  enum class Press : std::uint32_t {
+    kDown,       ///< pressed (posted immediately)
+    kShort,      ///< released before the long press time
+    kLong,       ///< held for the long press time
+    kRepeat      ///< still held, every repeat interval after kLong
+  };
+
+  /// @brief number of buttons one input can handle
+  static constexpr std::size_t kMaxButtons = 6;
+
+  /// @brief one button
+  struct Button {
+    gpio_num_t pin;
+    std::uint16_t code;         ///< Event::code posted for this button
+    ActiveObject* target;       ///< mailbox the events go to
+    bool active_low = true;     ///< wired to ground with the internal pull-up
+  };
+
+  /// @brief timing shared by all buttons
+  struct Timing {
+    std::uint32_t debounce_ms = 15;
+    std::uint32_t long_press_ms = 600;
+    std::uint32_t repeat_ms = 150;
+  };
+
+  /// @brief event counters
+  struct Stats {
+    std::uint32_t posted;   ///< events delivered
+    std::uint32_t dropped;  ///< events lost to a full mailbox
+  };
+
+  explicit ButtonInput(const Timing& timing) : timing_(timing) {}
+
+  /// @brief remove the interrupt handlers and timers
+  ~ButtonInput();
+
+  ButtonInput(const ButtonInput&) = delete;
+  ButtonInput& operator=(const ButtonInput&) = delete;
+
+  /// @brief register a button; must be called before start()
+  /// @return false if all slots are taken or the input is running
+  bool add(const Button& button);
+
+  /**
+   * @brief Configure the pins and arm the interrupts.
+   * @return false if a pin or timer could not be set up
+   */
+  bool start();
+
+  /// @brief event counters
+  Stats get_stats() const { return Stats{.posted = posted_.load(), .dropped = dropped_.load()}; }
+
+private:
+  /// @brief state of one button, guarded by lock_
+  struct Slot {
+    ButtonInput* owner{nullptr};
+    Button button{};
+    esp_timer_handle_t timer{nullptr};
+    bool pressed{false};
+    bool long_sent{false};
+    std::int64_t press_us{0};
+    std::int64_t last_event_us{0};
+  };
+
+  /// @brief pin edge: mask the pin, report a press, start the settle timer
+  static void on_edge(void* arg);
+
+  /// @brief settle/hold timer: confirm the level and time long presses
+  static void on_timer(void* arg);
+
+  /// @brief true if the button is held right now
+  static bool is_active(const Slot& slot);
+
+  /// @brief deliver an event to a button's target
+  void post(const Slot& slot, const Press press, const bool from_isr);
+
+  /// @brief timing shared by all buttons
+  const Timing timing_;
+
+  /// @brief registered buttons
+  std::array<Slot, kMaxButtons> slots_{};
+  std::size_t count_{0};
+  bool started_{false};
+
+  /// @brief event counters
+  std::atomic<std::uint32_t> posted_{0};
+  std::atomic<std::uint32_t> dropped_{0};
+
+  /// @brief shared between the GPIO ISR and the esp_timer task
+  portMUX_TYPE lock_ = portMUX_INITIALIZER_UNLOCKED;
+};
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+extern "C" {
+
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+
+}
+
+#include "component.hpp"
+
+/**
+ * @brief Playback state that survives a reboot, plus a small ring of crash
+ * reports, kept in NVS.
+ *
+ * Setters only update a copy in RAM, so they are cheap enough to call every
+ * period from anywhere. This object's own low-priority task writes the copy
+ * out when it has changed, at most once per flush interval, or right away
+ * on request_flush() (e.g. when playback stops) and from the shutdown
+ * handler on esp_restart(). Flash writes stall both cores' caches, so none
+ * ever happens on the audio path, and batching keeps the stalls and the
+ * wear negligible: a few dozen bytes a minute while playing.
+ *
+ * The state is one blob with a checksum; NVS replaces the entry only once
+ * the new one is complete, so a power cut during a flush leaves the
+ * previous state intact.
+ *
+ * record_crash() may be called from any context, including the stack
+ * overflow hook. It leaves the report in RTC memory, which survives the
+ * software reset, and load() moves it into the ring on the next boot along
+ * with resets caused by panics, watchdogs and brownouts.
+ */
+class StateStore : public StaticActiveObject<ActiveObject::MemoryLoad::kStandard> {
+public:
+  /// @brief number of crash reports kept (oldest dropped first)
+  static constexpr std::size_t kCrashSlots = 4;
+
+  /// @brief task name length kept in a report, including the terminator
+  static constexpr std::size_t kTaskNameLength = 16;
+
+  /// @brief what is restored at boot
+  struct State {
+    std::uint32_t boot_count;
+    std::uint32_t queue_position;   ///< entry of the playback queue
+    std::uint32_t position_ms;      ///< position within that track
+    std::array<std::uint8_t, 6> peer; ///< last connected sink (all zero: none)
+    std::uint8_t volume;
+    std::uint8_t reserved;
+  };
+
+  static_assert(sizeof(State) == 20, "the state is persisted verbatim");
+
+  /// @brief one crash
+  struct CrashReport {
+    std::uint32_t boot;             ///< boot_count of the boot that crashed
+    esp_reset_reason_t reason;      ///< reset reason seen on the following boot
+    std::array<char, kTaskNameLength> task; ///< task whose stack overflowed, or empty
+  };
+
+  /// @brief flush scheduling
+  struct Config {
+    /// @brief shortest time between two writes of a changing state
+    std::uint32_t flush_interval_ms = 60 * 1000;
+  };
+
+  /// @brief state store constructor
+  /// @param config flush scheduling
+  explicit StateStore(const Config& config);
+
+  /**
+   * @brief Read the persisted state and file any crash of the previous boot.
+   * Must be called once after nvs_flash_init() and before start().
+   * @return false if there was no valid state (defaults are kept)
+   */
+  bool load();
+
+  /// @brief current state (RAM copy)
+  State get_state() const;
+
+  /// @brief crash reports, oldest first
+  /// @param reports filled with up to kCrashSlots reports
+  /// @return number of reports
+  std::size_t get_crash_reports(std::array<CrashReport, kCrashSlots>& reports) const;
+
+  /// @brief remember the playback position
+  void set_position(const std::uint32_t queue_position, const std::uint32_t position_ms);
+
+  /// @brief remember the volume
+  void set_volume(const std::uint8_t volume);
+
+  /// @brief remember the sink that was connected last
+  void set_peer(const std::array<std::uint8_t, 6>& peer);
+
+  /// @brief write pending changes now rather than at the next interval
+  /// @return false if the request could not be queued
+  bool request_flush();
+
+  /// @brief note a fatal error for the next boot; safe from any context (IRAM)
+  /// @param task_name task that failed, or nullptr
+  static void record_crash(const char* task_name);
+
+protected:
+  void task() override;
+  void on_event(const Event& event) override;
+
+private:
+  /// @brief kControl event codes
+  enum class Control : std::uint16_t {
+    kFlush
+  };
+
+  /// @brief persisted ring of crash reports
+  struct CrashRing {
+    std::uint32_t head;   ///< slot the next report goes to
+    std::uint32_t count;
+    std::array<CrashReport, kCrashSlots> slots;
+  };
+
+  /// @brief state blob as stored
+  struct Record {
+    std::uint32_t magic;
+    std::uint16_t version;
+    std::uint16_t size;
+    State state;
+    std::uint32_t checksum;
+  };
+
+  /// @brief report left in RTC memory by record_crash()
+  struct PendingCrash {
+    std::uint32_t magic;
+    std::array<char, kTaskNameLength> task;
+  };
+
+  /// @brief write the state if it differs from what is stored
+  void flush();
+
+  /// @brief shutdown handler registered by load()
+  static void on_shutdown();
+
+  /// @brief add a report to the ring and write it
+  void file_crash(const CrashReport& report);
+
+  /// @brief checksum over a state
+  static std::uint32_t checksum(const State& state);
+
+  /// @brief flush scheduling
+  const Config config_;
+
+  /// @brief RAM copy and the copy last written, guarded by lock_
+  State state_{};
+  State stored_{};
+  CrashRing crashes_{};
+  mutable portMUX_TYPE lock_ = portMUX_INITIALIZER_UNLOCKED;
+
+  /// @brief when the state was last written (task only)
+  std::int64_t last_flush_us_{0};
+
+  /// @brief the one instance the shutdown handler flushes
+  static std::atomic<StateStore*> instance_;
+
+  /// @brief survives software resets, not power cycles
+  static PendingCrash pending_crash_;
+};
@@ -0,0 +1,274 @@
+#include <cinttypes>
+#include <cstring>
+
+#include "include/state_store.hpp"
+
+extern "C" {
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+}
+
+namespace {
+
+constexpr const char* kComponentTag = "StateStore";
+constexpr const char* kNamespace = "state";
+constexpr const char* kStateKey = "state";
+constexpr const char* kCrashKey = "crashes";
+
+/// @brief how often the task checks for changes
+constexpr std::uint32_t kCheckPeriodMs = 1000;
+
+constexpr std::uint32_t kStateMagic = 0x53544154; // "STAT"
+constexpr std::uint16_t kStateVersion = 1;
+constexpr std::uint32_t kCrashMagic = 0x43525348; // "CRSH"
+
+/// @brief resets that only happen when something went wrong
+bool is_crash(const esp_reset_reason_t reason) {
+  switch (reason) {
+    case ESP_RST_PANIC:
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT:
+    case ESP_RST_BROWNOUT:
+      return true;
+    default:
+      return false;
+  }
+}
+
+const char* reason_name(const esp_reset_reason_t reason) {
+  switch (reason) {
+    case ESP_RST_SW:
+      return "software reset";
+    case ESP_RST_PANIC:
+      return "panic";
+    case ESP_RST_INT_WDT:
+      return "interrupt watchdog";
+    case ESP_RST_TASK_WDT:
+      return "task watchdog";
+    case ESP_RST_WDT:
+      return "watchdog";
+    case ESP_RST_BROWNOUT:
+      return "brownout";
+    default:
+      return "reset";
+  }
+}
+
+/// @brief write one blob and commit it
+bool write_blob(const char* key, const void* data, const std::size_t size) {
+  nvs_handle_t handle;
+  esp_err_t err = nvs_open(kNamespace, NVS_READWRITE, &handle);
+  if (err == ESP_OK) {
+    err = nvs_set_blob(handle, key, data, size);
+    if (err == ESP_OK) {
+      err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+  }
+
+  if (err != ESP_OK) {
+    ESP_LOGE(kComponentTag, "Could not write '%s': %s", key, esp_err_to_name(err));
+  }
+  return err == ESP_OK;
+}
+
+/// @brief read a blob of exactly the given size
+bool read_blob(const char* key, void* data, const std::size_t size) {
+  nvs_handle_t handle;
+  if (nvs_open(kNamespace, NVS_READONLY, &handle) != ESP_OK) {
+    return false;
+  }
+
+  std::size_t length = size;
+  const esp_err_t err = nvs_get_blob(handle, key, data, &length);
+  nvs_close(handle);
+
+  if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+    ESP_LOGW(kComponentTag, "Could not read '%s': %s", key, esp_err_to_name(err));
+  }
+  return err == ESP_OK && length == size;
+}
+
+}
+
+std::atomic<StateStore*> StateStore::instance_{nullptr};
+
+RTC_NOINIT_ATTR StateStore::PendingCrash StateStore::pending_crash_;
+
+StateStore::StateStore(const Config& config)
+  : StaticActiveObject("StateStore", ActiveObject::Priority::kLow, kCheckPeriodMs, ActiveObject::Workload::kBackground),
+    config_(config) {}
+
+bool StateStore::load() {
+  Record record{};
+  const bool valid = read_blob(kStateKey, &record, sizeof(record)) &&
+    record.magic == kStateMagic && record.version == kStateVersion &&
+    record.size == sizeof(State) && record.checksum == checksum(record.state);
+  if (valid) {
+    state_ = record.state;
+    stored_ = record.state;
+  }
+
+  if (!read_blob(kCrashKey, &crashes_, sizeof(crashes_)) ||
+      crashes_.head >= kCrashSlots || crashes_.count > kCrashSlots) {
+    crashes_ = {};
+  }
+
+  // a crash belongs to the boot before this one; RTC memory holds noise after power-on
+  const esp_reset_reason_t reason = esp_reset_reason();
+  const bool recorded = reason != ESP_RST_POWERON && pending_crash_.magic == kCrashMagic;
+  if (recorded || is_crash(reason)) {
+    CrashReport report{.boot = state_.boot_count, .reason = reason, .task = {'\0'}};
+    if (recorded) {
+      std::memcpy(report.task.data(), pending_crash_.task.data(), report.task.size());
+      report.task.back() = '\0';
+    }
+    file_crash(report);
+  }
+  pending_crash_.magic = 0;
+
+  std::array<CrashReport, kCrashSlots> reports;
+  const std::size_t count = get_crash_reports(reports);
+  for (std::size_t i = 0; i < count; i++) {
+    ESP_LOGW(kComponentTag, "Crash in boot %" PRIu32 ": %s%s%s", reports[i].boot, reason_name(reports[i].reason),
+      reports[i].task[0] ? " in " : "", reports[i].task.data());
+  }
+
+  // counted right away, so that reports of this boot are told apart from the last
+  state_.boot_count++;
+  flush();
+
+  instance_.store(this);
+  esp_register_shutdown_handler(on_shutdown);
+
+  ESP_LOGI(kComponentTag, "Boot %" PRIu32 ", %s", state_.boot_count, valid ? "state restored" : "no saved state");
+  return valid;
+}
+
+StateStore::State StateStore::get_state() const {
+  portENTER_CRITICAL(&lock_);
+  const State state = state_;
+  portEXIT_CRITICAL(&lock_);
+  return state;
+}
+
+std::size_t StateStore::get_crash_reports(std::array<CrashReport, kCrashSlots>& reports) const {
+  portENTER_CRITICAL(&lock_);
+  const CrashRing ring = crashes_;
+  portEXIT_CRITICAL(&lock_);
+
+  for (std::size_t i = 0; i < ring.count; i++) {
+    reports[i] = ring.slots[(ring.head + kCrashSlots - ring.count + i) % kCrashSlots];
+  }
+  return ring.count;
+}
+
+void StateStore::set_position(const std::uint32_t queue_position, const std::uint32_t position_ms) {
+  portENTER_CRITICAL(&lock_);
+  state_.queue_position = queue_position;
+  state_.position_ms = position_ms;
+  portEXIT_CRITICAL(&lock_);
+}
+
+void StateStore::set_volume(const std::uint8_t volume) {
+  portENTER_CRITICAL(&lock_);
+  state_.volume = volume;
+  portEXIT_CRITICAL(&lock_);
+}
+
+void StateStore::set_peer(const std::array<std::uint8_t, 6>& peer) {
+  portENTER_CRITICAL(&lock_);
+  state_.peer = peer;
+  portEXIT_CRITICAL(&lock_);
+}
+
+bool StateStore::request_flush() {
+  return post(Event{
+    .type = Event::Type::kControl,
+    .code = static_cast<std::uint16_t>(Control::kFlush),
+    .value = 0,
+  });
+}
+
+void IRAM_ATTR StateStore::record_crash(const char* task_name) {
+  // no library calls: this may run on an overflowed stack
+  std::size_t i = 0;
+  for (; task_name && task_name[i] != '\0' && i + 1 < kTaskNameLength; i++) {
+    pending_crash_.task[i] = task_name[i];
+  }
+  for (; i < kTaskNameLength; i++) {
+    pending_crash_.task[i] = '\0';
+  }
+  pending_crash_.magic = kCrashMagic;
+}
+
+void StateStore::task() {
+  // the position changes every period while playing, so this is what
+  // bounds the writes: one per interval instead of several a second
+  if (esp_timer_get_time() - last_flush_us_ >= static_cast<std::int64_t>(config_.flush_interval_ms) * 1000) {
+    flush();
+  }
+}
+
+void StateStore::on_event(const Event& event) {
+  if (event.type == Event::Type::kControl && static_cast<Control>(event.code) == Control::kFlush) {
+    flush();
+  }
+}
+
+void StateStore::flush() {
+  const State state = get_state();
+  if (std::memcmp(&state, &stored_, sizeof(State)) == 0) {
+    return;
+  }
+
+  const Record record{
+    .magic = kStateMagic,
+    .version = kStateVersion,
+    .size = sizeof(State),
+    .state = state,
+    .checksum = checksum(state),
+  };
+
+  if (write_blob(kStateKey, &record, sizeof(record))) {
+    stored_ = state;
+    last_flush_us_ = esp_timer_get_time();
+  }
+}
+
+void StateStore::on_shutdown() {
+  // after a crash the stack or the heap may be what broke; the state of
+  // the last flush is good enough then
+  StateStore* store = instance_.load();
+  if (store && pending_crash_.magic != kCrashMagic) {
+    store->flush();
+  }
+}
+
+void StateStore::file_crash(const CrashReport& report) {
+  portENTER_CRITICAL(&lock_);
+  crashes_.slots[crashes_.head] = report;
+  crashes_.head = (crashes_.head + 1) % kCrashSlots;
+  if (crashes_.count < kCrashSlots) {
+    crashes_.count++;
+  }
+  const CrashRing ring = crashes_;
+  portEXIT_CRITICAL(&lock_);
+
+  write_blob(kCrashKey, &ring, sizeof(ring));
+}
+
+std::uint32_t StateStore::checksum(const State& state) {
+  // FNV-1a
+  const auto bytes = reinterpret_cast<const std::uint8_t*>(&state);
+  std::uint32_t hash = 2166136261u;
+  for (std::size_t i = 0; i < sizeof(State); i++) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  return hash;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+/**
+ * @brief Walks the playback queue in order or shuffled, and remembers the
+ * entries that were played so previous goes back to them.
+ *
+ * The shuffle is a keyed permutation of the queue positions rather than a
+ * shuffled copy: step i of the walk plays position encrypt(i + offset), where
+ * encrypt is a small Feistel network over the next power of four at or
+ * above the queue size, cycle-walked until the result is a valid position.
+ * The same seed always gives the same order, the walk can be entered at
+ * any position (decrypt gives its step) and nothing is allocated, however
+ * long the queue. Every operation is O(1); cycle walking takes fewer than
+ * four rounds on average.
+ *
+ * The history ring holds the last kHistoryDepth positions played, so
+ * previous retraces jumps and shuffle changes as well as plain steps.
+ */
+class PlayQueue {
+public:
+  /// @brief positions kept for previous()
+  static constexpr std::size_t kHistoryDepth = 32;
+
+  /**
+   * @brief Set the number of queue entries, e.g. after a rescan. The current
+   * position is kept if it still exists; history entries past the end are
+   * skipped when reached.
+   */
+  void resize(const std::size_t size);
+
+  /**
+   * @brief Shuffle with a seed, or play in order without one. The current
+   * position is kept; a shuffled walk starts over from it, so every other
+   * entry follows before the walk ends.
+   */
+  void set_shuffle(const std::optional<std::uint32_t> seed);
+
+  /// @brief true while shuffled
+  bool is_shuffled() const { return shuffled_; }
+
+  /// @brief number of queue entries
+  std::size_t size() const { return size_; }
+
+  /// @brief position being played (0 for an empty queue)
+  std::size_t current() const { return current_; }
+
+  /// @brief play a position directly, e.g. to resume; not recorded in the history
+  void set_current(const std::size_t position);
+
+  /// @brief forget the positions played, e.g. once they name other tracks
+  void clear_history();
+
+  /// @brief position next() moves to, or nothing at the end of the walk
+  std::optional<std::size_t> peek_next() const;
+
+  /// @brief position previous() moves to, or nothing at the start of the walk
+  std::optional<std::size_t> peek_previous() const;
+
+  /// @brief move to peek_next(), remembering the current position
+  /// @return false at the end of the walk
+  bool next();
+
+  /// @brief move to peek_previous()
+  /// @return false at the start of the walk
+  bool previous();
+
+private:
+  /// @brief Feistel rounds; four make the halves depend on every key bit
+  static constexpr std::size_t kRounds = 4;
+
+  /// @brief position played at a step of the walk
+  std::size_t position_of(const std::size_t step) const;
+
+  /// @brief step of the walk a position is played at
+  std::size_t step_of(const std::size_t position) const;
+
+  /// @brief one pass of the network over the whole domain
+  std::uint32_t encrypt(const std::uint32_t value) const;
+  std::uint32_t decrypt(const std::uint32_t value) const;
+
+  /// @brief depth of the most recent valid history entry (1 = newest), or 0
+  std::size_t find_history() const;
+
+  std::size_t size_{0};
+
+  /// @brief current position and its step in the walk
+  std::size_t current_{0};
+  std::size_t step_{0};
+
+  /// @brief permutation; the domain is 1 << (2 * half_bits_)
+  bool shuffled_{false};
+  std::uint32_t half_bits_{1};
+  std::array<std::uint32_t, kRounds> keys_{};
+
+  /// @brief permuted step the walk started at (see set_shuffle())
+  std::size_t offset_{0};
+
+  /// @brief positions played before the current one; the newest is before head
+  std::array<std::uint32_t, kHistoryDepth> history_{};
+  std::size_t history_head_{0};
+  std::size_t history_count_{0};
+};
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#include "component.hpp"
+#include "decoder.hpp"
+#include "dsp.hpp"
+#include "play_queue.hpp"
+#include "sd_card.hpp"
+#include "state_store.hpp"
+
+/**
+ * @brief Playback control. Walks the queue read by the card through a
+ * PlayQueue (in order or shuffled), keeps the following track enqueued on
+ * the decoder so every transition is gapless, and turns button events into
+ * transport and volume actions.
+ *
+ * The paths of the next and previous entries are looked up ahead of time
+ * by the periodic task, so next and previous presses start the track right
+ * away without a queue lookup on the card.
+ *
+ * Button events are Event::Type::kButton with a Button code and a
+ * ButtonInput::Press value. Play/pause and volume act on the press itself;
+ * next and previous act on release so that holding them can seek instead.
+ * Events are handled while the task waits for its next period, so they
+ * are acted on as soon as they arrive.
+ *
+ * The queue position and volume are handed to the state store as they
+ * change, and playback resumes from the stored position at boot.
+ */
+class PlayerObject : public StaticActiveObject<ActiveObject::MemoryLoad::kStandard> {
+public:
+  /// @brief Event::code of the buttons this object understands
+  enum class Button : std::uint16_t {
+    kPlayPause,
+    kNext,
+    kPrevious,
+    kVolumeUp,
+    kVolumeDown
+  };
+
+  /// @brief previous restarts the current track if it has played this long
+  static constexpr std::uint32_t kRestartThresholdMs = 3000;
+
+  /// @brief seek distance per long-press step on next/previous
+  static constexpr std::uint32_t kSeekStepMs = 10000;
+
+  /// @brief volume change per press or repeat
+  static constexpr int kVolumeStep = 5;
+
+  /// @brief player constructor
+  /// @param card card holding the library and the playback queue
+  /// @param decoder decoder to drive
+  /// @param dsp processing stage owning the volume
+  /// @param state store to remember the position and volume in
+  PlayerObject(const SdCardObject& card, DecoderObject& decoder, DspObject& dsp, StateStore& state);
+
+  /// @brief true while playback is paused
+  bool is_paused() const { return paused_.load(); }
+
+  /// @brief position of the current track in the queue
+  std::size_t get_queue_position() const { return current_.load(); }
+
+  /**
+   * @brief Shuffle the rest of the queue, or go back to queue order.
+   * @param seed shuffle seed (the same seed gives the same order), or nothing for queue order
+   * @return false if the request could not be queued
+   */
+  bool set_shuffle(const std::optional<std::uint32_t> seed);
+
+  /// @brief true while the queue is shuffled
+  bool is_shuffled() const { return shuffled_.load(); }
+
+  /// @brief pause if playing (unlike the button, never resumes)
+  /// @return false if the request could not be queued
+  bool pause();
+
+protected:
+  void initialize() override;
+  void task() override;
+  void on_event(const Event& event) override;
+
+private:
+  /// @brief kControl event codes; the value is the seed for kShuffleOn
+  enum class Control : std::uint16_t {
+    kShuffleOff,
+    kShuffleOn,
+    kPause
+  };
+
+  /// @brief a queue entry and its path, looked up ahead of time
+  struct Track {
+    std::optional<std::size_t> position;  ///< nothing: not looked up
+    std::array<char, SdCardObject::kMaxPathLength> path;  ///< empty if the lookup failed
+  };
+
+  /// @brief look a queue entry up into a slot, unless it already holds it
+  /// @return true if the slot holds a playable path for the position
+  bool fetch(Track& track, const std::optional<std::size_t> position);
+
+  /// @brief start a looked-up track, dropping whatever was enqueued
+  void play(const Track& track, const std::uint32_t start_ms = 0);
+
+  /// @brief start a queue entry directly
+  void play_index(const std::size_t index, const std::uint32_t start_ms = 0);
+
+  /// @brief follow a re-read queue
+  void sync_queue();
+
+  /// @brief take over the queued track once the decoder has started it
+  void adopt_started_next();
+
+  /// @brief queue the decoder's next again after the walk changed
+  void replace_next();
+
+  /// @brief pause, resume, or restart after the queue ran out
+  void toggle_pause();
+
+  /// @brief skip to the following track, if any
+  void next();
+
+  /// @brief restart the current track, or go back to the previous entry if it just started
+  void previous();
+
+  /// @brief seek within the current track
+  void seek_by(const std::int32_t delta_ms);
+
+  /// @brief step the volume and remember it
+  void adjust_volume(const int delta);
+
+  /// @brief card holding the queue
+  const SdCardObject& card_;
+
+  /// @brief pipeline being controlled
+  DecoderObject& decoder_;
+  DspObject& dsp_;
+
+  /// @brief where the position and volume are remembered
+  StateStore& state_;
+
+  /// @brief walk over the queue (task only)
+  PlayQueue queue_;
+  std::uint32_t queue_generation_{0};
+
+  /// @brief current, next and previous entries (task only)
+  Track current_track_{};
+  Track next_track_{};
+  Track previous_track_{};
+
+  /// @brief queue entry being played, or paused at, for other tasks
+  std::atomic<std::size_t> current_{0};
+
+  /// @brief the following entry has been handed to decoder_.enqueue() (task only)
+  bool next_queued_{false};
+
+  /// @brief paused, and the position to resume from
+  std::atomic<bool> paused_{false};
+  std::uint32_t paused_at_ms_{0};
+
+  /// @brief mirrors queue_.is_shuffled() for other tasks
+  std::atomic<bool> shuffled_{false};
+};
@@ -0,0 +1,180 @@
+#include "include/play_queue.hpp"
+
+namespace {
+
+/// @brief round function: a 32-bit integer hash (murmur3 finalizer) of the half block
+std::uint32_t mix(std::uint32_t value, const std::uint32_t key) {
+  value ^= key;
+  value ^= value >> 16;
+  value *= 0x85ebca6bu;
+  value ^= value >> 13;
+  value *= 0xc2b2ae35u;
+  value ^= value >> 16;
+  return value;
+}
+
+/// @brief splitmix32 step, spreading the seed over the round keys
+std::uint32_t next_key(std::uint32_t& state) {
+  state += 0x9e3779b9u;
+  return mix(state, 0);
+}
+
+}
+
+void PlayQueue::resize(const std::size_t size) {
+  size_ = size;
+
+  // halves of equal width, so the domain is at most four times the queue
+  half_bits_ = 1;
+  while (half_bits_ < 16 && (std::uint64_t{1} << (2 * half_bits_)) < size_) {
+    half_bits_++;
+  }
+
+  if (current_ >= size_) {
+    current_ = 0;
+  }
+  offset_ = size_ ? offset_ % size_ : 0;
+  step_ = size_ ? step_of(current_) : 0;
+}
+
+void PlayQueue::set_shuffle(const std::optional<std::uint32_t> seed) {
+  shuffled_ = seed.has_value();
+  if (seed) {
+    std::uint32_t state = *seed;
+    for (auto& key : keys_) {
+      key = next_key(state);
+    }
+  }
+
+  // a shuffled walk starts over at the current position, so all the others follow it
+  offset_ = 0;
+  if (shuffled_ && size_ > 0) {
+    offset_ = step_of(current_);
+    step_ = 0;
+  } else {
+    step_ = current_;
+  }
+}
+
+void PlayQueue::set_current(const std::size_t position) {
+  if (position < size_) {
+    current_ = position;
+    step_ = step_of(position);
+  }
+}
+
+void PlayQueue::clear_history() {
+  history_head_ = 0;
+  history_count_ = 0;
+}
+
+std::optional<std::size_t> PlayQueue::peek_next() const {
+  if (step_ + 1 >= size_) {
+    return std::nullopt;
+  }
+  return position_of(step_ + 1);
+}
+
+std::optional<std::size_t> PlayQueue::peek_previous() const {
+  const std::size_t depth = find_history();
+  if (depth > 0) {
+    return history_[(history_head_ + kHistoryDepth - depth) % kHistoryDepth];
+  }
+  if (step_ == 0 || size_ == 0) {
+    return std::nullopt;
+  }
+  return position_of(step_ - 1);
+}
+
+bool PlayQueue::next() {
+  const auto position = peek_next();
+  if (!position) {
+    return false;
+  }
+
+  history_[history_head_] = static_cast<std::uint32_t>(current_);
+  history_head_ = (history_head_ + 1) % kHistoryDepth;
+  if (history_count_ < kHistoryDepth) {
+    history_count_++;
+  }
+
+  current_ = *position;
+  step_++;
+  return true;
+}
+
+bool PlayQueue::previous() {
+  const auto position = peek_previous();
+  if (!position) {
+    return false;
+  }
+
+  // entries passed over by find_history() no longer exist
+  const std::size_t depth = find_history();
+  history_head_ = (history_head_ + kHistoryDepth - depth) % kHistoryDepth;
+  history_count_ = depth > 0 ? history_count_ - depth : 0;
+
+  current_ = *position;
+  step_ = depth > 0 ? step_of(current_) : step_ - 1;
+  return true;
+}
+
+std::size_t PlayQueue::position_of(const std::size_t step) const {
+  if (!shuffled_) {
+    return step;
+  }
+
+  // cycle walking: the permutation of the domain, restricted to the queue
+  std::uint32_t value = static_cast<std::uint32_t>((step + offset_) % size_);
+  do {
+    value = encrypt(value);
+  } while (value >= size_);
+  return value;
+}
+
+std::size_t PlayQueue::step_of(const std::size_t position) const {
+  if (!shuffled_) {
+    return position;
+  }
+
+  std::uint32_t value = static_cast<std::uint32_t>(position);
+  do {
+    value = decrypt(value);
+  } while (value >= size_);
+  return (value + size_ - offset_) % size_;
+}
+
+std::uint32_t PlayQueue::encrypt(const std::uint32_t value) const {
+  const std::uint32_t mask = (std::uint32_t{1} << half_bits_) - 1;
+  std::uint32_t left = (value >> half_bits_) & mask;
+  std::uint32_t right = value & mask;
+
+  for (std::size_t round = 0; round < kRounds; round++) {
+    const std::uint32_t next = left ^ (mix(right, keys_[round]) & mask);
+    left = right;
+    right = next;
+  }
+  return (left << half_bits_) | right;
+}
+
+std::uint32_t PlayQueue::decrypt(const std::uint32_t value) const {
+  const std::uint32_t mask = (std::uint32_t{1} << half_bits_) - 1;
+  std::uint32_t left = (value >> half_bits_) & mask;
+  std::uint32_t right = value & mask;
+
+  for (std::size_t round = kRounds; round-- > 0;) {
+    const std::uint32_t previous = right ^ (mix(left, keys_[round]) & mask);
+    right = left;
+    left = previous;
+  }
+  return (left << half_bits_) | right;
+}
+
+std::size_t PlayQueue::find_history() const {
+  for (std::size_t depth = 1; depth <= history_count_; depth++) {
+    if (history_[(history_head_ + kHistoryDepth - depth) % kHistoryDepth] < size_) {
+      return depth;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <cinttypes>
+
+#include "include/player.hpp"
+#include "button_input.hpp"
+
+extern "C" {
+
+#include "esp_log.h"
+
+}
+
+namespace {
+
+constexpr const char* kComponentTag = "PlayerObject";
+
+/// @brief how often the queue is checked for the next track to enqueue
+constexpr std::uint32_t kQueuePollMs = 100;
+
+}
+
+PlayerObject::PlayerObject(const SdCardObject& card, DecoderObject& decoder, DspObject& dsp, StateStore& state)
+  : StaticActiveObject("PlayerObject", ActiveObject::Priority::kMedium, kQueuePollMs, ActiveObject::Workload::kBackground),
+    card_(card),
+    decoder_(decoder),
+    dsp_(dsp),
+    state_(state) {}
+
+bool PlayerObject::set_shuffle(const std::optional<std::uint32_t> seed) {
+  return post(Event{
+    .type = Event::Type::kControl,
+    .code = static_cast<std::uint16_t>(seed ? Control::kShuffleOn : Control::kShuffleOff),
+    .value = seed.value_or(0),
+  });
+}
+
+bool PlayerObject::pause() {
+  return post(Event{
+    .type = Event::Type::kControl,
+    .code = static_cast<std::uint16_t>(Control::kPause),
+    .value = 0,
+  });
+}
+
+void PlayerObject::initialize() {
+  queue_generation_ = card_.get_queue_generation();
+  const std::size_t queued = card_.get_queue_size();
+  queue_.resize(queued);
+  ESP_LOGI(kComponentTag, "%zu tracks queued", queued);
+
+  if (queued == 0) {
+    return;
+  }
+
+  // a queue that shrank since the last boot starts over
+  const StateStore::State saved = state_.get_state();
+  if (saved.queue_position < queued) {
+    ESP_LOGI(kComponentTag, "Resuming entry %" PRIu32 " at %" PRIu32 " ms", saved.queue_position, saved.position_ms);
+    play_index(saved.queue_position, saved.position_ms);
+  } else {
+    play_index(0);
+  }
+}
+
+void PlayerObject::task() {
+  sync_queue();
+
+  if (paused_.load()) {
+    return;
+  }
+
+  adopt_started_next();
+
+  // keep the following track queued so every transition is gapless
+  if (!next_queued_ && fetch(next_track_, queue_.peek_next())) {
+    next_queued_ = decoder_.enqueue(next_track_.path.data());
+  }
+
+  // ready for a previous press; this and the above are the only queue lookups
+  fetch(previous_track_, queue_.peek_previous());
+
+  // RAM only; the store decides when it is worth a flash write
+  state_.set_position(static_cast<std::uint32_t>(current_.load()), decoder_.get_position_ms());
+}
+
+void PlayerObject::on_event(const Event& event) {
+  if (event.type == Event::Type::kControl) {
+    const auto control = static_cast<Control>(event.code);
+    if (control == Control::kPause) {
+      if (!paused_.load() && decoder_.is_playing()) {
+        toggle_pause();
+      }
+      return;
+    }
+
+    const bool shuffle = control == Control::kShuffleOn;
+    adopt_started_next();
+    queue_.set_shuffle(shuffle ? std::optional<std::uint32_t>{event.value} : std::nullopt);
+    shuffled_.store(shuffle);
+
+    // the walk changed around the current track
+    replace_next();
+    LOGI(kComponentTag, "Shuffle %s", shuffle ? "on" : "off");
+    return;
+  }
+
+  if (event.type != Event::Type::kButton) {
+    return;
+  }
+
+  const auto button = static_cast<Button>(event.code);
+  const auto press = static_cast<ButtonInput::Press>(event.value);
+  const bool step = press == ButtonInput::Press::kDown || press == ButtonInput::Press::kRepeat;
+  const bool hold = press == ButtonInput::Press::kLong || press == ButtonInput::Press::kRepeat;
+
+  switch (button) {
+    case Button::kPlayPause:
+      if (press == ButtonInput::Press::kDown) {
+        toggle_pause();
+      }
+      break;
+
+    case Button::kNext:
+      if (press == ButtonInput::Press::kShort) {
+        next();
+      } else if (hold) {
+        seek_by(static_cast<std::int32_t>(kSeekStepMs));
+      }
+      break;
+
+    case Button::kPrevious:
+      if (press == ButtonInput::Press::kShort) {
+        previous();
+      } else if (hold) {
+        seek_by(-static_cast<std::int32_t>(kSeekStepMs));
+      }
+      break;
+
+    case Button::kVolumeUp:
+      if (step) {
+        adjust_volume(kVolumeStep);
+      }
+      break;
+
+    case Button::kVolumeDown:
+      if (step) {
+        adjust_volume(-kVolumeStep);
+      }
+      break;
+
+    default:
+      LOGW(kComponentTag, "Unknown button %u", static_cast<unsigned>(event.code));
+      break;
+  }
+}
+
+bool PlayerObject::fetch(Track& track, const std::optional<std::size_t> position) {
+  if (track.position == position) {
+    return position && track.path[0] != '\0';
+  }
+
+  // a failed lookup is remembered too, so it is not retried every period
+  track.position = position;
+  track.path[0] = '\0';
+  if (!position) {
+    return false;
+  }
+
+  const auto path = card_.get_queue_track_path(*position);
+  if (path) {
+    track.path = *path;
+  }
+  return track.path[0] != '\0';
+}
+
+void PlayerObject::play(const Track& track, const std::uint32_t start_ms) {
+  if (!track.position || track.path[0] == '\0') {
+    return;
+  }
+
+  decoder_.play(track.path.data(), start_ms);
+  current_track_ = track;
+  current_.store(*track.position);
+  next_queued_ = false;
+  paused_.store(false);
+}
+
+void PlayerObject::play_index(const std::size_t index, const std::uint32_t start_ms) {
+  queue_.set_current(index);
+  if (fetch(current_track_, queue_.current())) {
+    play(current_track_, start_ms);
+  }
+}
+
+void PlayerObject::sync_queue() {
+  const std::uint32_t generation = card_.get_queue_generation();
+  if (generation == queue_generation_) {
+    return;
+  }
+  queue_generation_ = generation;
+
+  // positions may now name other tracks; the one playing carries on
+  adopt_started_next();
+  queue_.resize(card_.get_queue_size());
+  queue_.clear_history();
+
+  if (current_track_.position) {
+    const auto position = card_.find_queue_position(current_track_.path.data(), *current_track_.position);
+    if (position) {
+      queue_.set_current(*position);
+    } else {
+      // no longer queued: it plays out and the walk goes on from its old
+      // position, or from the start if the queue is now shorter than that
+      LOGW(kComponentTag, "Playing track left the queue");
+    }
+    current_track_.position = queue_.current();
+    current_.store(queue_.current());
+  }
+  replace_next();
+}
+
+void PlayerObject::adopt_started_next() {
+  // the enqueued track has started, so it is the current one now
+  if (next_queued_ && !decoder_.is_next_pending()) {
+    queue_.next();
+    current_track_ = next_track_;
+    current_.store(queue_.current());
+    next_queued_ = false;
+  }
+}
+
+void PlayerObject::replace_next() {
+  next_track_.position.reset();
+  previous_track_.position.reset();
+  if (!next_queued_) {
+    return;
+  }
+
+  // swap the decoder's next right away, so the old pick cannot start in the meantime
+  next_queued_ = false;
+  if (fetch(next_track_, queue_.peek_next())) {
+    next_queued_ = decoder_.enqueue(next_track_.path.data());
+  }
+  if (!next_queued_) {
+    decoder_.cancel_next();
+  }
+}
+
+void PlayerObject::toggle_pause() {
+  if (paused_.load()) {
+    play(current_track_, paused_at_ms_);
+    LOGI(kComponentTag, "Resumed at %" PRIu32 " ms", paused_at_ms_);
+    return;
+  }
+
+  if (!decoder_.is_playing()) {
+    // the queue ran out (or never started): play from where it stopped
+    play_index(queue_.current());
+    return;
+  }
+
+  paused_at_ms_ = decoder_.get_position_ms();
+  decoder_.stop();
+  next_queued_ = false;
+  paused_.store(true);
+  LOGI(kComponentTag, "Paused at %" PRIu32 " ms", paused_at_ms_);
+
+  // pausing is often followed by a power-off
+  state_.set_position(static_cast<std::uint32_t>(current_.load()), paused_at_ms_);
+  state_.request_flush();
+}
+
+void PlayerObject::next() {
+  // normally looked up by task() already
+  if (!fetch(next_track_, queue_.peek_next())) {
+    return;
+  }
+
+  queue_.next();
+  play(next_track_);
+}
+
+void PlayerObject::previous() {
+  const auto target = queue_.peek_previous();
+  if (!target || decoder_.get_position_ms() >= kRestartThresholdMs) {
+    play(current_track_);
+    return;
+  }
+
+  if (!fetch(previous_track_, target)) {
+    return;
+  }
+
+  queue_.previous();
+  play(previous_track_);
+}
+
+void PlayerObject::seek_by(const std::int32_t delta_ms) {
+  if (paused_.load() || !decoder_.is_playing()) {
+    return;
+  }
+
+  const std::int64_t target = static_cast<std::int64_t>(decoder_.get_position_ms()) + delta_ms;
+  decoder_.seek(static_cast<std::uint32_t>(std::max<std::int64_t>(target, 0)));
+}
+
+void PlayerObject::adjust_volume(const int delta) {
+  dsp_.adjust_volume(delta);
+  state_.set_volume(dsp_.get_volume());
+}
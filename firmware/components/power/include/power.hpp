@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "a2dp_source.hpp"
+#include "component.hpp"
+#include "decoder.hpp"
+#include "pm_lock.hpp"
+
+/**
+ * @brief Dynamic frequency scaling for the audio pipeline. The clock idles
+ * at the minimum frequency with automatic light sleep; this object holds
+ * the esp_pm locks that raise it, based on how much audio is buffered
+ * ahead of the sink:
+ *  - below the low watermark (or for high-bitrate tracks) the CPU runs at
+ *    the maximum frequency until the buffers are back above the high one,
+ *  - while playing with less than the high watermark buffered, light sleep
+ *    is held off so wakeups from the decoder/stream semaphores stay cheap,
+ *  - with full buffers both are released and the idle task may sleep
+ *    between the sink's requests.
+ * Components boost on their own for short bursts (seek, boot scan) with a
+ * PmLock of their own.
+ */
+class PowerObject : public StaticActiveObject<ActiveObject::MemoryLoad::kStandard> {
+public:
+  /// @brief frequency limits and thresholds
+  struct Config {
+    /// @brief clock range handed to esp_pm_configure()
+    int max_freq_mhz = 240;
+    int min_freq_mhz = 80;
+
+    /// @brief allow automatic light sleep when nothing holds it off
+    bool light_sleep = true;
+
+    /// @brief buffer fill levels (percent) that raise and relax the clock
+    std::uint32_t low_fill_percent = 25;
+    std::uint32_t high_fill_percent = 75;
+
+    /// @brief tracks at or above this bitrate are always decoded at full clock
+    std::uint32_t high_bitrate_kbps = 256;
+  };
+
+  /// @brief power manager constructor
+  /// @param decoder decoder whose PCM ring and bitrate are watched
+  /// @param a2dp source whose jitter buffer is watched
+  /// @param config frequency limits and thresholds
+  PowerObject(const DecoderObject& decoder, const A2dpSourceObject& a2dp, const Config& config);
+
+  /// @brief true while the maximum frequency is requested
+  bool is_boosted() const { return boosted_.load(); }
+
+protected:
+  void initialize() override;
+  void task() override;
+
+private:
+  /// @brief pipeline being watched
+  const DecoderObject& decoder_;
+  const A2dpSourceObject& a2dp_;
+
+  /// @brief frequency limits and thresholds
+  const Config config_;
+
+  /// @brief full clock while buffers refill or a heavy track decodes
+  PmLock cpu_lock_{ESP_PM_CPU_FREQ_MAX, "power_cpu"};
+
+  /// @brief no light sleep while buffers are below the high watermark
+  PmLock sleep_lock_{ESP_PM_NO_LIGHT_SLEEP, "power_awake"};
+
+  /// @brief current decision (written by the task)
+  std::atomic<bool> boosted_{false};
+};
@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <cinttypes>
+
+#include "include/power.hpp"
+
+extern "C" {
+
+#include "esp_log.h"
+
+}
+
+namespace {
+
+constexpr const char* kComponentTag = "PowerObject";
+
+/// @brief how often the buffer levels are sampled
+constexpr std::uint32_t kPollPeriodMs = 100;
+
+}
+
+PowerObject::PowerObject(const DecoderObject& decoder, const A2dpSourceObject& a2dp, const Config& config)
+  : StaticActiveObject("PowerObject", ActiveObject::Priority::kMedium, kPollPeriodMs, ActiveObject::Workload::kBackground),
+    decoder_(decoder),
+    a2dp_(a2dp),
+    config_(config) {}
+
+void PowerObject::initialize() {
+  const esp_pm_config_t pm_config = {
+    .max_freq_mhz = config_.max_freq_mhz,
+    .min_freq_mhz = config_.min_freq_mhz,
+    .light_sleep_enable = config_.light_sleep,
+  };
+
+  // without CONFIG_PM_ENABLE the clock simply stays at its default
+  const esp_err_t err = esp_pm_configure(&pm_config);
+  if (err != ESP_OK) {
+    ESP_LOGW(kComponentTag, "Frequency scaling unavailable: %s", esp_err_to_name(err));
+    mark_as_done();
+    return;
+  }
+
+  ESP_LOGI(kComponentTag, "Frequency scaling %d-%d MHz, light sleep %s",
+    config_.min_freq_mhz, config_.max_freq_mhz, config_.light_sleep ? "on" : "off");
+}
+
+void PowerObject::task() {
+  const bool playing = decoder_.is_playing();
+
+  // the emptier of the two buffers decides; the link one only counts while streaming
+  std::uint32_t fill = decoder_.get_pcm_fill_percent();
+  if (a2dp_.is_streaming()) {
+    fill = std::min(fill, a2dp_.get_buffer_fill_percent());
+  }
+
+  const bool heavy = decoder_.get_format().bitrate >= config_.high_bitrate_kbps * 1000;
+
+  // hysteresis between the watermarks so the clock does not flap
+  bool boosted = boosted_.load();
+  if (!playing) {
+    boosted = false;
+  } else if (fill < config_.low_fill_percent || heavy) {
+    boosted = true;
+  } else if (fill >= config_.high_fill_percent) {
+    boosted = false;
+  }
+
+  if (boosted != boosted_.load()) {
+    LOGI(kComponentTag, "%s clock at %" PRIu32 "%% buffered", boosted ? "Raising" : "Lowering", fill);
+  }
+
+  boosted_.store(boosted);
+  cpu_lock_.set(boosted);
+  sleep_lock_.set(playing && fill < config_.high_fill_percent);
+}
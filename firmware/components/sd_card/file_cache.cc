@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+
+#include "include/file_cache.hpp"
+
+extern "C" {
+
+#include "esp_log.h"
+
+}
+
+namespace {
+
+constexpr const char* kComponentTag = "FileCache";
+
+bool matches(const std::array<char, FileCache::kMaxPathLength>& stored, const std::string_view path) {
+  return std::strncmp(stored.data(), path.data(), path.size()) == 0 && stored[path.size()] == '\0';
+}
+
+}
+
+FileCache::FileCache(const std::size_t capacity)
+  : capacity_(std::clamp<std::size_t>(capacity, 1, kMaxEntries)) {
+  mutex_ = xSemaphoreCreateMutexStatic(&mutex_buffer_);
+}
+
+FileCache::~FileCache() {
+  for (auto& entry : entries_) {
+    release(entry);
+  }
+}
+
+FILE* FileCache::open(const std::string_view path, const std::uint32_t offset) {
+  if (path.size() >= kMaxPathLength) {
+    ESP_LOGE(kComponentTag, "Path too long: '%.*s'", static_cast<int>(path.size()), path.data());
+    return nullptr;
+  }
+
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  clock_++;
+
+  // a cached handle only needs to be repositioned; with fastseek this is
+  // resolved from the cluster link map without reading the FAT
+  Entry* entry = nullptr;
+  for (std::size_t i = 0; i < capacity_; i++) {
+    auto& candidate = entries_[i];
+    if (candidate.file && !candidate.pinned && matches(candidate.path, path)) {
+      entry = &candidate;
+      break;
+    }
+  }
+
+  if (entry) {
+    clearerr(entry->file);
+    if (fseek(entry->file, static_cast<long>(offset), SEEK_SET) == 0) {
+      entry->pinned = true;
+      entry->last_used = clock_;
+      stats_.hits++;
+      xSemaphoreGive(mutex_);
+      return entry->file;
+    }
+
+    // a handle that cannot seek is not worth keeping
+    release(*entry);
+  } else {
+    // prefer a free slot, otherwise the least recently used unpinned one
+    for (std::size_t i = 0; i < capacity_; i++) {
+      auto& candidate = entries_[i];
+      if (candidate.pinned) {
+        continue;
+      }
+      if (!entry || !candidate.file || (entry->file && candidate.last_used < entry->last_used)) {
+        entry = &candidate;
+      }
+    }
+
+    if (!entry) {
+      xSemaphoreGive(mutex_);
+      ESP_LOGE(kComponentTag, "All %zu handles in use, cannot open '%.*s'", capacity_, static_cast<int>(path.size()), path.data());
+      return nullptr;
+    }
+
+    if (entry->file) {
+      stats_.evictions++;
+      release(*entry);
+    }
+  }
+
+  stats_.misses++;
+  std::memcpy(entry->path.data(), path.data(), path.size());
+  entry->path[path.size()] = '\0';
+  entry->file = fopen(entry->path.data(), "rb");
+  if (!entry->file) {
+    xSemaphoreGive(mutex_);
+    ESP_LOGE(kComponentTag, "Could not open '%.*s'", static_cast<int>(path.size()), path.data());
+    return nullptr;
+  }
+
+  // stdio buffering would add a copy on top of the caller's buffers
+  setvbuf(entry->file, nullptr, _IONBF, 0);
+
+  if (offset > 0 && fseek(entry->file, static_cast<long>(offset), SEEK_SET) != 0) {
+    release(*entry);
+    xSemaphoreGive(mutex_);
+    ESP_LOGE(kComponentTag, "Could not seek '%.*s' to %" PRIu32, static_cast<int>(path.size()), path.data(), offset);
+    return nullptr;
+  }
+
+  entry->pinned = true;
+  entry->last_used = clock_;
+  FILE* const file = entry->file;
+  xSemaphoreGive(mutex_);
+  return file;
+}
+
+void FileCache::close(FILE* file) {
+  if (!file) {
+    return;
+  }
+
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  for (std::size_t i = 0; i < capacity_; i++) {
+    if (entries_[i].file == file) {
+      entries_[i].pinned = false;
+      break;
+    }
+  }
+  xSemaphoreGive(mutex_);
+}
+
+void FileCache::invalidate(const std::string_view path) {
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  for (std::size_t i = 0; i < capacity_; i++) {
+    auto& entry = entries_[i];
+    if (entry.file && !entry.pinned && matches(entry.path, path)) {
+      release(entry);
+    }
+  }
+  xSemaphoreGive(mutex_);
+}
+
+void FileCache::clear() {
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  for (std::size_t i = 0; i < capacity_; i++) {
+    if (!entries_[i].pinned) {
+      release(entries_[i]);
+    }
+  }
+  xSemaphoreGive(mutex_);
+}
+
+FileCache::Stats FileCache::get_stats() const {
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  const Stats stats = stats_;
+  xSemaphoreGive(mutex_);
+  return stats;
+}
+
+void FileCache::release(Entry& entry) {
+  if (entry.file) {
+    fclose(entry.file);
+  }
+
+  entry.file = nullptr;
+  entry.pinned = false;
+  entry.path[0] = '\0';
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string_view>
+
+extern "C" {
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+}
+
+/**
+ * @brief Least-recently-used cache of open read-only file handles. Opening
+ * a file walks its directory clusters and allocates LFN buffers, and with
+ * fastseek enabled the VFS also builds the cluster link map of the file; a
+ * cached handle keeps all of that, so reopening a recent track is a seek.
+ *
+ * Handles are lent out by open() and pinned until close(), after which they
+ * stay open until evicted. A pinned handle is never shared, so the same path
+ * may be cached more than once if it is opened twice.
+ */
+class FileCache {
+public:
+  /// @brief maximum length for cached file paths (matches the card's)
+  static constexpr std::size_t kMaxPathLength = 300;
+
+  /// @brief upper bound for the capacity
+  static constexpr std::size_t kMaxEntries = 4;
+
+  /// @brief counters since construction
+  struct Stats {
+    std::uint32_t hits;
+    std::uint32_t misses;
+    std::uint32_t evictions;
+  };
+
+  /// @brief file cache constructor
+  /// @param capacity handles kept open at most, including pinned ones
+  FileCache(const std::size_t capacity);
+
+  /// @brief close all handles on destruction
+  ~FileCache();
+
+  FileCache(const FileCache&) = delete;
+  FileCache& operator=(const FileCache&) = delete;
+
+  /**
+   * @brief Borrow an unbuffered, read-only handle for a file.
+   * @param path absolute path of the file
+   * @param offset position to seek the handle to
+   * @return the handle, or nullptr if the file could not be opened or every
+   * cached handle is pinned
+   */
+  FILE* open(const std::string_view path, const std::uint32_t offset = 0);
+
+  /// @brief return a handle obtained from open(); it stays cached
+  void close(FILE* file);
+
+  /// @brief close all cached handles of a file (e.g. after writing to it)
+  void invalidate(const std::string_view path);
+
+  /// @brief close every handle that is not pinned
+  void clear();
+
+  /// @brief snapshot of the hit/miss counters
+  Stats get_stats() const;
+
+private:
+  struct Entry {
+    FILE* file{nullptr};
+    std::uint32_t last_used{0};
+    bool pinned{false};
+    std::array<char, kMaxPathLength> path{'\0'};
+  };
+
+  /// @brief close the handle of an entry and mark it free
+  void release(Entry& entry);
+
+  /// @brief handles kept open at most
+  const std::size_t capacity_;
+
+  /// @brief cache slots, only the first capacity_ are used
+  std::array<Entry, kMaxEntries> entries_{};
+
+  /// @brief use counter for the LRU order
+  std::uint32_t clock_{0};
+
+  /// @brief counters reported by get_stats()
+  Stats stats_{};
+
+  /// @brief buffer to store the mutex without heap allocation
+  StaticSemaphore_t mutex_buffer_{};
+
+  /// @brief guards the entries and counters
+  SemaphoreHandle_t mutex_{nullptr};
+};
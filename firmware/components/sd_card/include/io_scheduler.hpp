@@ -0,0 +1,167 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <utility>
+
+extern "C" {
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "ff.h"
+
+}
+
+/**
+ * @brief Arbitrates the card between the tasks sharing it. Card I/O happens
+ * under a Grant of one of two classes:
+ *
+ * - kPlayback: stream refills, track opens and seeks. Deadline-critical;
+ *   waits at most for the background slice in progress.
+ * - kBackground: library scans, tag reads, index and seek table writes.
+ *   Best-effort; only granted while no playback I/O waits and the stream
+ *   reader has not flagged demand (set_playback_demand()).
+ *
+ * Every grant carries a byte budget. Long background transfers go through
+ * Grant::write(), which cuts them into slices of at most the budget that
+ * end on sector boundaries, and steps aside between slices whenever
+ * playback wants the card. A playback holder uses its budget to batch the refill of several
+ * ring slots back to back, and gives the card up once it is spent so that
+ * background work is not starved for long.
+ *
+ * The grant is a mutex with priority inheritance, so a low-priority
+ * background holder runs at the reader's priority until its slice is done.
+ */
+class IoScheduler {
+public:
+  /// @brief priority classes, most urgent first
+  enum class Class : std::uint8_t {
+    kPlayback,
+    kBackground
+  };
+
+  /// @brief bytes a background holder may move before stepping aside
+  static constexpr std::size_t kBackgroundSliceBytes = 4 * 1024;
+
+  /// @brief bytes a playback holder may read in one burst: a refill of the
+  /// whole stream ring at the default 4 KB sectors (checked by SdStreamObject)
+  static constexpr std::size_t kPlaybackBurstBytes = 16 * 1024;
+
+  static_assert(kBackgroundSliceBytes >= FF_MAX_SS && kBackgroundSliceBytes % FF_MAX_SS == 0,
+    "slices must cover whole sectors");
+
+  /// @brief arbitration counters
+  struct Stats {
+    std::uint32_t playback_grants;
+    std::uint32_t background_grants;
+    std::uint32_t background_yields;    ///< slices cut short for playback
+    std::uint32_t playback_wait_max_us; ///< longest a playback request waited
+  };
+
+  /// @brief exclusive use of the card, released on destruction
+  class Grant {
+  public:
+    Grant() = default;
+    Grant(Grant&& other) noexcept { *this = std::move(other); }
+    Grant& operator=(Grant&& other) noexcept;
+    ~Grant() { release(); }
+
+    Grant(const Grant&) = delete;
+    Grant& operator=(const Grant&) = delete;
+
+    /// @brief true if the card was granted
+    explicit operator bool() const { return scheduler_ != nullptr; }
+
+    /// @brief account bytes moved under this grant
+    void consume(const std::size_t bytes) { used_ += bytes; }
+
+    /// @brief true once the budget is used up, or (background) playback wants the card
+    bool should_yield() const;
+
+    /**
+     * @brief Hand the card over to waiting playback I/O and take it back
+     * afterwards with a fresh budget. Blocks until the card is granted again.
+     */
+    void yield();
+
+    /// @brief give up the card early
+    void release();
+
+    /**
+     * @brief fwrite() in slices of at most the budget, yielding between
+     * slices when should_yield() says so. A write that starts mid-sector
+     * first runs to the sector boundary, so the slices after it are
+     * whole-sector transfers.
+     * @return bytes written
+     */
+    std::size_t write(FILE* file, const void* data, const std::size_t size);
+
+  private:
+    friend class IoScheduler;
+
+    Grant(IoScheduler& scheduler, const Class io_class) : scheduler_(&scheduler), class_(io_class) {}
+
+    IoScheduler* scheduler_{nullptr};
+    Class class_{Class::kBackground};
+    std::size_t used_{0};
+  };
+
+  IoScheduler();
+
+  IoScheduler(const IoScheduler&) = delete;
+  IoScheduler& operator=(const IoScheduler&) = delete;
+
+  /**
+   * @brief Ask for the card.
+   * @param io_class priority class of the I/O to perform
+   * @param timeout ticks to wait; background requests keep waiting while
+   * playback has demand, so 0 means "only if the card is idle"
+   * @return the grant, or an empty one on timeout
+   */
+  Grant acquire(const Class io_class, const TickType_t timeout = portMAX_DELAY);
+
+  /// @brief set by the streaming reader while its ring runs low; background
+  /// requests are not granted until it is cleared
+  void set_playback_demand(const bool hungry);
+
+  /// @brief true while playback I/O waits or the reader has flagged demand
+  bool is_playback_pending() const { return playback_demand_.load() || playback_waiting_.load() > 0; }
+
+  /// @brief snapshot of the arbitration counters
+  Stats get_stats() const;
+
+private:
+  /// @brief budget of a grant of the given class
+  static constexpr std::size_t budget(const Class io_class) {
+    return io_class == Class::kPlayback ? kPlaybackBurstBytes : kBackgroundSliceBytes;
+  }
+
+  /// @brief take the mutex for a background request, deferring to playback
+  bool take_background(const TickType_t timeout);
+
+  /// @brief let a background request blocked in take_background() check again
+  void wake_background();
+
+  /// @brief the card; a mutex for its priority inheritance
+  StaticSemaphore_t mutex_buffer_{};
+  SemaphoreHandle_t mutex_{nullptr};
+
+  /// @brief given whenever a background request may now succeed; one wait
+  /// per wake-up, and a waiter that loses the race just waits again
+  StaticSemaphore_t idle_sem_buffer_{};
+  SemaphoreHandle_t idle_sem_{nullptr};
+
+  /// @brief playback requests blocked on mutex_
+  std::atomic<std::uint32_t> playback_waiting_{0};
+
+  /// @brief see set_playback_demand()
+  std::atomic<bool> playback_demand_{false};
+
+  /// @brief counters
+  std::atomic<std::uint32_t> playback_grants_{0};
+  std::atomic<std::uint32_t> background_grants_{0};
+  std::atomic<std::uint32_t> background_yields_{0};
+  std::atomic<std::uint32_t> playback_wait_max_us_{0};
+};
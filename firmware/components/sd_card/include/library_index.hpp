@@ -0,0 +1,173 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+#include "io_scheduler.hpp"
+#include "memory_pool.hpp"
+#include "string_arena.hpp"
+#include "tag_reader.hpp"
+
+/**
+ * @brief Compact, persistent index of the tracks under the music folder.
+ * Entries are fixed-size records whose strings live in one packed table,
+ * so the whole library costs two allocations regardless of track count.
+ * The index is written to the card and rebuilt in the background by a
+ * LibraryScanner (add_track(), then seal()); only entries whose size or
+ * timestamp changed lose their metadata and need to be parsed again
+ * (set_metadata()).
+ */
+class LibraryIndex {
+public:
+  /// @brief stable position of a track in the index
+  using TrackId = std::uint32_t;
+
+  /// @brief ordered list of tracks, e.g. a playback queue
+  using TrackList = ExternalVector<TrackId>;
+
+  /// @brief offset of a null-terminated string in the string table
+  using StringOffset = StringArena::Offset;
+
+  /// @brief offset of the empty string, used for missing fields
+  static constexpr StringOffset kEmptyString = 0;
+
+  /// @brief index file format identifiers
+  static constexpr std::uint32_t kMagic = 0x4933504d;  // "MP3I"
+  static constexpr std::uint16_t kVersion = 1;
+
+  /// @brief Entry::flags bits
+  static constexpr std::uint16_t kMetadataValid = 1 << 0;
+
+  /// @brief one track, stored verbatim in the index file
+  struct Entry {
+    StringOffset path;          ///< path relative to the music folder
+    std::uint32_t size;         ///< file size in bytes
+    std::uint32_t mtime;        ///< FAT date << 16 | FAT time
+    std::uint32_t duration_ms;  ///< 0 if unknown
+    StringOffset title;
+    StringOffset artist;
+    StringOffset album;
+    std::uint16_t track_number; ///< 0 if unknown
+    std::uint16_t flags;
+  };
+
+  static_assert(sizeof(Entry) == 32, "index entries are persisted verbatim");
+
+  /// @brief track records; cold data, so kept out of internal SRAM
+  using Entries = ExternalVector<Entry>;
+
+  /// @brief how add_track() found a file compared to the previous index
+  enum class Change : std::uint8_t {
+    kUnchanged,
+    kChanged,
+    kAdded
+  };
+
+  /// @brief create an empty index
+  /// @param placement memory the string table should be placed in
+  explicit LibraryIndex(const StringArena::Placement placement = StringArena::Placement::kInternal);
+
+  /// @brief load a previously saved index, replacing the current contents
+  /// @param path index file path (VFS)
+  /// @return false if the file is missing, corrupt or from another version
+  bool load(const char* path);
+
+  /// @brief write the index atomically (temp file + rename)
+  /// @param path index file path (VFS)
+  /// @param grant card grant to write under; large tables yield to playback in between
+  /// @return boolean indicating success
+  bool save(const char* path, IoScheduler::Grant& grant);
+
+  /**
+   * @brief Append a track while building an index, carrying its metadata
+   * over from previous if its size and timestamp are unchanged. find() and
+   * the track order are only valid again once seal() has been called.
+   * @param path path relative to the music folder
+   * @param mtime FAT date << 16 | FAT time
+   * @return how the track compares to previous, or nothing if out of memory
+   */
+  std::optional<Change> add_track(const std::string_view path, const std::uint32_t size,
+    const std::uint32_t mtime, const LibraryIndex& previous);
+
+  /// @brief sort the tracks by path and rebuild the lookup after add_track()
+  void seal();
+
+  /// @brief number of tracks
+  std::size_t size() const { return entries_.size(); }
+
+  /// @brief true if the index has no tracks
+  bool empty() const { return entries_.empty(); }
+
+  /// @brief true if the contents differ from what was last loaded/saved
+  bool is_dirty() const { return dirty_; }
+
+  /// @brief access a track entry
+  const Entry& entry(const TrackId id) const { return entries_[id]; }
+
+  /// @brief resolve a string table offset
+  std::string_view string(const StringOffset offset) const { return strings_.get(offset); }
+
+  /// @brief path of a track relative to the music folder
+  std::string_view path(const TrackId id) const { return string(entries_[id].path); }
+
+  /// @brief look up a track by its path relative to the music folder
+  std::optional<TrackId> find(const std::string_view path) const;
+
+  /// @brief stable identity of a track: the FNV-1a hash of its path
+  std::uint32_t path_hash(const TrackId id) const;
+
+  /// @brief the same hash, for a path relative to the music folder
+  static std::uint32_t path_hash(const std::string_view path);
+
+  /// @brief look up a track by path_hash(); nothing if no track or several have it
+  std::optional<TrackId> find_hash(const std::uint32_t hash) const;
+
+  /// @brief true if the tags of a track have been read since it last changed
+  bool has_metadata(const TrackId id) const { return entries_[id].flags & kMetadataValid; }
+
+  /**
+   * @brief Store the tags read from a track and mark its metadata valid.
+   * Replaced strings stay in the table until the next scan rebuilds it.
+   * @return false if the string table is out of memory
+   */
+  bool set_metadata(const TrackId id, const TagReader::Metadata& metadata);
+
+private:
+  /// @brief index file header
+  struct Header {
+    std::uint32_t magic;
+    std::uint16_t version;
+    std::uint16_t entry_size;
+    std::uint32_t entry_count;
+    std::uint32_t string_bytes;
+    std::uint32_t checksum;
+  };
+
+  /// @brief (path hash, track) pairs sorted by hash for find()
+  using Lookup = ExternalVector<std::pair<std::uint32_t, TrackId>>;
+
+  /// @brief append a string to a table, sharing the empty string
+  /// @return offset of the string, or nothing if out of memory
+  static std::optional<StringOffset> add_string(StringArena& strings, const std::string_view value);
+
+  /// @brief rebuild lookup_ from entries_
+  void build_lookup();
+
+  /// @brief checksum over the entries and string table
+  std::uint32_t checksum() const;
+
+  /// @brief track records
+  Entries entries_;
+
+  /// @brief packed, null-terminated strings; always begins with '\0'
+  StringArena strings_;
+
+  /// @brief sorted path hashes used by find()
+  Lookup lookup_;
+
+  /// @brief true if entries_ changed since the last load/save
+  bool dirty_{false};
+};
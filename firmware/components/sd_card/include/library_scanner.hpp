@@ -0,0 +1,127 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+extern "C" {
+
+#include "ff.h"
+
+}
+
+#include "library_index.hpp"
+#include "memory_pool.hpp"
+
+/**
+ * @brief Resumable walk of the music folder and its subfolders that builds
+ * a new LibraryIndex a bounded number of directory entries at a time, so
+ * it can run in the background between other card I/O. Metadata is carried
+ * over from the previous index for unchanged files.
+ *
+ * Folders are visited from a worklist, and prioritize() moves a pending
+ * folder to the front, e.g. the one a track is playing from. The finished
+ * index is sorted by path, so its order does not depend on the visit order.
+ */
+class LibraryScanner {
+public:
+  /// @brief longest path (relative to the music folder, or FatFs) the scanner builds
+  static constexpr std::size_t kMaxPathLength = 300;
+
+  /// @brief deepest folder level below the music folder that is visited
+  static constexpr std::size_t kMaxDepth = 8;
+
+  /// @brief outcome of a finished scan, compared to the previous index
+  struct Result {
+    std::size_t total;
+    std::size_t added;
+    std::size_t changed;
+    std::size_t removed;
+  };
+
+  /// @brief create an idle scanner
+  /// @param placement memory the string table of the new index goes to
+  explicit LibraryScanner(const StringArena::Placement placement);
+
+  /// @brief closes the directory being read, if any
+  ~LibraryScanner();
+
+  LibraryScanner(const LibraryScanner&) = delete;
+  LibraryScanner& operator=(const LibraryScanner&) = delete;
+
+  /**
+   * @brief Start a scan, abandoning any scan in progress.
+   * @param fatfs_root music folder as a FatFs path (e.g. "0:/music")
+   * @return false if the path is too long
+   */
+  bool begin(const char* fatfs_root);
+
+  /**
+   * @brief Continue the scan.
+   * @param previous index to carry metadata over from; must not change while the scan runs
+   * @param max_entries directory entries to read at most
+   * @return true while there is more to scan
+   */
+  bool step(const LibraryIndex& previous, const std::size_t max_entries);
+
+  /// @brief visit a folder (relative to the music folder) next, if it is still pending
+  void prioritize(const std::string_view directory);
+
+  /// @brief true between begin() and the end of the scan
+  bool is_running() const { return running_; }
+
+  /// @brief true if the last scan stopped early (a card read error or out of memory)
+  bool has_failed() const { return failed_; }
+
+  /// @brief summary of the last finished scan
+  const Result& get_result() const { return result_; }
+
+  /// @brief hand over the index built by the last finished scan
+  LibraryIndex take_index();
+
+private:
+  /// @brief folder names relative to the music folder
+  using Directories = ExternalVector<ExternalString>;
+
+  /// @brief open the next pending folder
+  /// @return false if there is none left, or a folder failed to open (see read_error_)
+  bool open_next();
+
+  /// @brief close the directory being read
+  void close_directory();
+
+  /// @brief stop the scan, sealing the index on success
+  void finish(const LibraryIndex& previous, const bool failed);
+
+  /// @brief memory the new index is placed in
+  const StringArena::Placement placement_;
+
+  /// @brief music folder as a FatFs path
+  std::array<char, kMaxPathLength> root_{'\0'};
+
+  /// @brief index under construction
+  LibraryIndex index_;
+
+  /// @brief folders still to visit; the next one is at the back
+  Directories pending_;
+
+  /// @brief folder being read and its handle
+  ExternalString directory_;
+  DIR dir_{};
+  bool dir_open_{false};
+
+  /// @brief the music folder is read first and must exist
+  bool root_opened_{false};
+
+  /// @brief a folder other than the music folder could not be opened
+  bool read_error_{false};
+
+  bool running_{false};
+  bool failed_{false};
+
+  /// @brief tracks found that were also in the previous index
+  std::size_t retained_{0};
+
+  Result result_{};
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+/// @brief size of an ID3v2 tag at data (including header/footer), or 0 if there is none
+std::size_t id3v2_tag_size(const std::uint8_t* data, const std::size_t size);
+
+/// @brief fields of an MPEG-1/2/2.5 layer III frame header
+struct Mp3FrameHeader {
+  std::uint32_t sample_rate;
+  std::uint16_t bitrate_kbps;
+  std::uint16_t samples_per_frame;  ///< per channel (1152 or 576)
+  std::uint16_t frame_bytes;        ///< including the header
+  std::uint8_t side_info_bytes;
+  std::uint8_t channels;
+
+  /// @brief parse the 4-byte header at data (free-format streams are rejected)
+  static std::optional<Mp3FrameHeader> parse(const std::uint8_t* data, const std::size_t size);
+};
+
+/**
+ * @brief Xing/Info tag found in place of audio in the first frame of VBR
+ * (Xing) and CBR (Info) encodes, including the LAME extension that holds
+ * the encoder delay and padding needed for gapless playback.
+ */
+struct Mp3InfoTag {
+  /// @brief samples the decoder itself adds in front of the first frame
+  static constexpr std::uint32_t kDecoderDelay = 529;
+
+  Mp3FrameHeader header;            ///< header of the tag frame itself
+  std::uint32_t frames;             ///< audio frames after the tag frame (0 if unknown)
+  std::uint32_t bytes;              ///< audio bytes (0 if unknown)
+  std::uint16_t encoder_delay;      ///< samples added at the start by the encoder
+  std::uint16_t encoder_padding;    ///< samples added at the end by the encoder
+  bool has_lame;                    ///< encoder_delay/encoder_padding are valid
+  bool has_toc;
+  std::array<std::uint8_t, 100> toc;  ///< seek table: byte position (/256) per percent
+
+  /**
+   * @brief Parse the tag, if the frame starting at data carries one
+   * @param data start of the first frame (at its sync word)
+   * @param size bytes available from data
+   */
+  static std::optional<Mp3InfoTag> parse(const std::uint8_t* data, const std::size_t size);
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <string_view>
+
+#include "library_index.hpp"
+#include "memory_pool.hpp"
+
+/**
+ * @brief The playback queue, read lazily from a playlist file on the card.
+ *
+ * Each line names a track by its path relative to the music folder, or by
+ * the hash of that path as "#<hex>" (LibraryIndex::path_hash()). Unlike an
+ * index position, the hash survives rescans that add or remove other
+ * files; a hash shared by two tracks names neither. Empty lines and tracks
+ * not in the library are skipped.
+ *
+ * open() reads the file once to count the playable entries and keeps the
+ * file offset of every kCheckpointInterval-th one, about a kilobyte for a
+ * 10k-entry playlist. resolve() seeks to the nearest checkpoint (or the
+ * entry after the last one resolved, which is where the next track is) and
+ * reads forward, so a line is only turned into a track when it is about to
+ * play.
+ *
+ * Without a playlist the queue is every library track in index order and
+ * nothing is read.
+ */
+class PlaybackOrder {
+public:
+  /// @brief longest line that is considered; longer ones are skipped
+  static constexpr std::size_t kMaxLineLength = 300;
+
+  /// @brief entries between two remembered file offsets
+  static constexpr std::size_t kCheckpointInterval = 64;
+
+  /// @brief marks a line holding a path hash
+  static constexpr char kIdPrefix = '#';
+
+  /// @brief queue every track of a library of the given size, in index order
+  void reset(const std::size_t library_size);
+
+  /**
+   * @brief Index a playlist file, replacing the current queue.
+   * @param path playlist path (VFS)
+   * @param library index the entries are checked against
+   * @return false if the file could not be opened (the queue is left empty)
+   */
+  bool open(const char* path, const LibraryIndex& library);
+
+  /// @brief number of playable entries
+  std::size_t size() const { return size_; }
+
+  /// @brief true if the queue comes from a playlist file
+  bool is_playlist() const { return playlist_; }
+
+  /**
+   * @brief Look up the track of a queue entry, reading the playlist as needed.
+   * @param library the index open() was called with
+   * @return the track, or nothing past the end (or if the file changed since open())
+   */
+  std::optional<LibraryIndex::TrackId> resolve(const std::size_t position, const LibraryIndex& library);
+
+  /**
+   * @brief Find the entry that plays a track. A playlist is read through
+   * once, so this is for rare events such as a rescan, not every track.
+   * @param near preferred position; of several entries for the track the
+   * first one at or after it wins, otherwise the first one
+   * @return the position, or nothing if no entry plays the track
+   */
+  std::optional<std::size_t> find(const LibraryIndex::TrackId id, const std::size_t near, const LibraryIndex& library);
+
+private:
+  /// @brief read the line starting at offset, advancing offset past it
+  /// @return the line without its terminator (empty if too long), or nothing at the end
+  std::optional<std::string_view> read_line(FILE* file, std::uint32_t& offset);
+
+  /// @brief track a line refers to, if any
+  static std::optional<LibraryIndex::TrackId> parse(const std::string_view line, const LibraryIndex& library);
+
+  /// @brief playlist path; empty without one
+  std::array<char, kMaxLineLength> path_{'\0'};
+  bool playlist_{false};
+
+  /// @brief playable entries
+  std::size_t size_{0};
+
+  /// @brief file offset of entry i * kCheckpointInterval
+  ExternalVector<std::uint32_t> checkpoints_;
+
+  /// @brief entry following the last resolved one, and its file offset
+  std::size_t cursor_position_{0};
+  std::uint32_t cursor_offset_{0};
+
+  /// @brief line being read (with room for the terminator and "\r\n")
+  std::array<char, kMaxLineLength + 3> line_{'\0'};
+};
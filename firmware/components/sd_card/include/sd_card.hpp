@@ -1,11 +1,11 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <optional>
 #include <string_view>
-#include <vector>
-#include <string>
 
 extern "C" {
 
@@ -16,12 +16,48 @@ extern "C" {
 }
 
 #include "component.hpp"
+#include "file_cache.hpp"
+#include "io_scheduler.hpp"
+#include "library_index.hpp"
+#include "library_scanner.hpp"
+#include "playback_order.hpp"
+#include "pm_lock.hpp"
+#include "seek_table.hpp"
+#include "tag_reader.hpp"
 #include "util.hpp"
 
-class SdCardObject : public ActiveObject {
+/**
+ * @brief Owns the card: mounts it, keeps the library index and the playback
+ * queue, and lends file handles to the streaming reader.
+ *
+ * Boot only loads the cached index, so playback can start right away; the
+ * music folder is rescanned afterwards by task(), a few directory entries
+ * per period at background priority, followed by the tags of new and
+ * changed tracks. Every step is a best-effort request to the IoScheduler,
+ * so it is skipped while the streaming reader is short of data. A finished
+ * scan that changed anything replaces the index and the queue at once,
+ * under the library lock the accessors take.
+ */
+class SdCardObject : public StaticActiveObject<ActiveObject::MemoryLoad::kStandard> {
 public:
   /// @brief maximum length for file paths and mount points
   static constexpr std::size_t kMaxPathLength = 300;
+
+  static_assert(kMaxPathLength == FileCache::kMaxPathLength, "cached paths must fit any card path");
+  static_assert(kMaxPathLength == LibraryScanner::kMaxPathLength, "scanned paths must fit any card path");
+
+  /// @brief period of the background scan
+  static constexpr std::uint32_t kScanPeriodMs = 50;
+
+  /// @brief directory entries read per scan period
+  static constexpr std::size_t kScanEntriesPerStep = 16;
+
+  /// @brief tracks whose tags are read per scan period
+  static constexpr std::size_t kMetadataTracksPerStep = 2;
+
+  /// @brief open files kept for the library index, config and seek tables;
+  /// the rest of max_open_files is left to the track handle cache
+  static constexpr std::uint8_t kReservedOpenFiles = 2;
   
   /// @brief SD card interface type
   enum class Interface : std::uint8_t {
@@ -36,6 +72,12 @@ public:
     
     /// @brief SPI configuration
     gpio_num_t miso, mosi, sck, cs;
+
+    /// @brief SDMMC configuration (data lines, 1 or 4)
+    std::uint8_t bus_width = 4;
+
+    /// @brief SDMMC high-speed mode (overrides max_frequency_khz)
+    bool high_speed = false;
     
     /// @brief common configuration
     std::uint32_t max_frequency_khz = 20000;
@@ -43,6 +85,22 @@ public:
 
     /// @brief flags
     bool format_if_mount_failed = false;
+    bool run_benchmark = false;
+  };
+
+  /// @brief sustained read throughput measured by benchmark()
+  struct BenchmarkResult {
+    std::uint32_t sequential_kbps;
+    std::uint32_t random_kbps;
+  };
+
+  /// @brief library operations timed by benchmark_library()
+  struct LibraryBenchmarkResult {
+    std::uint32_t index_load_ms;    ///< reading the persisted index (0 if there is none)
+    std::uint32_t scan_ms;          ///< walking the music folder, tags carried over
+    std::size_t scanned_tracks;
+    std::uint32_t playlist_ms;      ///< indexing the playlist (0 if there is none)
+    std::size_t playlist_entries;
   };
 
   /// @brief SD constructor
@@ -53,19 +111,94 @@ public:
   ~SdCardObject();
 
   /// @brief check if SD card is mounted
-  bool mount();
+  bool mount() const;
   
   /// @brief unmount the SD card
   void unmount();
   
-  /// @brief get list of discovered MP3 files
-  /// @return vector of MP3 file paths
-  std::vector<std::string> get_mp3_files();
-  
-  /// @brief read playback order from config file
-  /// @return vector of file names in playback order
-  std::vector<std::string> read_playback_order();
+  /// @brief get the library index; it is replaced when a rescan finishes, so
+  /// only the card's own task may hold on to it (other tasks use the queue)
+  const LibraryIndex& get_library() const { return library_; }
+
+  /// @brief get the absolute path of a track in the library
+  std::array<char, kMaxPathLength> get_track_path(const LibraryIndex::TrackId id) const;
+
+  /// @brief where the seek table of a track is persisted
+  /// @param track_path absolute path of the track
+  std::array<char, 64> get_seek_table_path(const std::string_view track_path) const;
+
+  /// @brief cache of open track handles (current, next and recent tracks)
+  FileCache& get_file_cache() { return file_cache_; }
+
+  /// @brief number of tracks in the playback queue
+  std::size_t get_queue_size() const;
+
+  /**
+   * @brief Absolute path of a queue entry. Playlist entries are resolved
+   * here, a few lines of card I/O under a playback grant.
+   * @return the path, or nothing past the end of the queue
+   */
+  std::optional<std::array<char, kMaxPathLength>> get_queue_track_path(const std::size_t position) const;
+
+  /**
+   * @brief Queue position of a track, e.g. to follow the one playing across
+   * a rescan. A playlist is read through once under a background grant.
+   * @param track_path absolute path of the track
+   * @param near preferred position if the queue holds the track more than once
+   * @return the position, or nothing if the track is not in the queue
+   */
+  std::optional<std::size_t> find_queue_position(const std::string_view track_path, const std::size_t near) const;
+
+  /// @brief changes whenever the queue is re-read, e.g. after a rescan
+  std::uint32_t get_queue_generation() const { return queue_generation_.load(); }
+
+  /**
+   * @brief Tell the background scan which track is being read, so that its
+   * folder is scanned first.
+   * @param track_path absolute path of the track
+   */
+  void hint_playing(const std::string_view track_path);
+
+  /**
+   * @brief LibraryIndex::path_hash() of a track, the "#<hex>" a playlist
+   * names it by. Log it rather than the path where the message is deferred.
+   * @param track_path absolute path of the track
+   */
+  std::uint32_t get_path_hash(const std::string_view track_path) const;
+
+  /// @brief arbiter every task performs its card I/O through
+  IoScheduler& get_io() const { return io_; }
   
+  /**
+   * @brief Halve the bus clock after a CRC or timeout error, never going
+   * below the identification frequency. Must be called from the task
+   * performing the failed card I/O, under the grant it was performed with,
+   * so no other task has a transfer in flight while the clock changes.
+   * @param grant the caller's card grant
+   * @return false if the clock could not be lowered any further
+   */
+  bool reduce_bus_frequency(const IoScheduler::Grant& grant);
+
+  /// @brief current bus clock in kHz (0 if not mounted)
+  std::uint32_t get_bus_frequency_khz() const { return bus_frequency_khz_.load(); }
+
+  /**
+   * @brief Measure sustained sequential and random (sector-aligned) read
+   * throughput for a file. Blocks the caller for the duration of the run.
+   * @param path absolute path of the file to read
+   * @return throughput in KB/s, or nothing if the file could not be read
+   */
+  std::optional<BenchmarkResult> benchmark(const std::string_view path);
+
+  /**
+   * @brief Time loading the persisted index, a full walk of the music
+   * folder and indexing the playlist, each into a scratch copy so the
+   * library and queue in use are left alone. Only the card's own task may
+   * call this; it blocks for the duration of the run.
+   * @return the timings, or nothing if the folder could not be walked
+   */
+  std::optional<LibraryBenchmarkResult> benchmark_library();
+
   /// @brief get mount point path
   std::string_view get_mount_point() const { return mount_point_.data(); }
 
@@ -74,6 +207,66 @@ protected:
   void task() override;
 
 private:
+  /// @brief mount the card through the configured interface
+  /// @param frequency_khz bus clock to request after identification
+  /// @param mount_config FAT mount config
+  /// @return result of the VFS mount
+  esp_err_t mount_card(const std::uint32_t frequency_khz, const esp_vfs_fat_sdmmc_mount_config_t& mount_config);
+
+  /// @brief index the playlist in the config folder, or queue the whole
+  /// library without one; the caller holds library_mutex_ or is the card task
+  void read_playback_order();
+
+  /// @brief stages of the background rescan
+  enum class ScanPhase : std::uint8_t {
+    kDirectories,   ///< walking the music folder
+    kMetadata,      ///< reading the tags of new and changed tracks
+    kSeekTables,    ///< removing the seek tables of tracks no longer in the library
+    kDone           ///< saving the index
+  };
+
+  /// @brief load the persisted library index and start the rescan; without
+  /// a usable index the folder is scanned right away instead
+  void load_library();
+
+  /// @brief replace the index and queue with the scan result, if it changed anything
+  void install_library();
+
+  /**
+   * @brief Read the tags of tracks whose metadata is missing or stale,
+   * continuing where the previous call stopped.
+   * @param max_tracks files to read at most
+   * @param grant background grant the reads are made under; stops early when it should yield
+   * @return false once every track has been looked at
+   */
+  bool read_missing_metadata(const std::size_t max_tracks, const IoScheduler::Grant& grant);
+
+  /// @brief fill seek_keys_ from the library for remove_stale_seek_tables()
+  void collect_seek_keys();
+
+  /**
+   * @brief Delete seek tables, and temp files left by an interrupted save,
+   * whose track is no longer in the library, continuing where the previous
+   * call stopped. Tables are only ever written for played tracks, but
+   * without this every track that has left the card keeps its table.
+   * @param max_entries directory entries to read at most
+   * @param grant background grant the deletes are made under; stops early when it should yield
+   * @return false once the whole folder has been looked at
+   */
+  bool remove_stale_seek_tables(const std::size_t max_entries, const IoScheduler::Grant& grant);
+
+  /// @brief pass the folder from hint_playing() on to the scanner
+  void apply_playing_hint();
+
+  /// @brief path relative to the music folder of an absolute track path, or empty
+  std::string_view relative_path(const std::string_view track_path) const;
+
+  /// @brief the music folder as a FatFs path on this card's drive
+  std::array<char, kMaxPathLength> format_music_root() const;
+
+  /// @brief absolute path of a track; the caller holds library_mutex_ or is the card task
+  std::array<char, kMaxPathLength> format_track_path(const LibraryIndex::TrackId id) const;
+
   /// @brief create required directories
   /// @return boolean indicating success
   bool create_directories();
@@ -84,12 +277,52 @@ private:
   /// @brief handle for SD card
   sdmmc_card_t* card_{nullptr};
 
+  /// @brief negotiated bus clock in kHz
+  std::atomic<std::uint32_t> bus_frequency_khz_{0};
+
   /// @brief mount point path
   std::array<char, kMaxPathLength> mount_point_{"/sdcard\0"};
 
-  /// @brief vector of file paths under the music folder
-  std::vector<std::string> file_paths_;
+  /// @brief track handles kept open across track changes
+  FileCache file_cache_;
+
+  /// @brief index of the tracks under the music folder
+  LibraryIndex library_;
+
+  /// @brief streaming tag parser (owns its scratch buffer)
+  TagReader tag_reader_;
+
+  /// @brief library tracks in the order listed in the playback config;
+  /// resolving an entry moves its read cursor, hence mutable
+  mutable PlaybackOrder queue_;
+  std::atomic<std::uint32_t> queue_generation_{0};
+
+  /// @brief background rescan (card task only)
+  LibraryScanner scanner_;
+  ScanPhase scan_phase_{ScanPhase::kDone};
+  LibraryIndex::TrackId metadata_cursor_{0};
+  std::size_t metadata_read_{0};
+  std::int64_t scan_start_us_{0};
+
+  /// @brief seek table sweep: sorted keys of the library tracks and the
+  /// folder being read (card task only)
+  ExternalVector<std::uint32_t> seek_keys_;
+  DIR seek_dir_{};
+  bool seek_dir_open_{false};
+  std::size_t seek_tables_removed_{0};
+
+  /// @brief full CPU clock from mount until the rescan is done
+  PmLock scan_boost_{ESP_PM_CPU_FREQ_MAX, "sd_scan"};
+
+  /// @brief guards library_ and queue_ for readers outside the card task,
+  /// and playing_hint_; the card task takes it only to modify them
+  StaticSemaphore_t library_mutex_buffer_{};
+  SemaphoreHandle_t library_mutex_{nullptr};
+
+  /// @brief folder of the track being read, relative to the music folder
+  std::array<char, kMaxPathLength> playing_hint_{'\0'};
+  bool hint_pending_{false};
 
-  /// @brief vector of mp3 names as listed in the playback config
-  std::vector<std::string> queue_;
+  /// @brief card access arbitration; thread-safe, hence usable through const
+  mutable IoScheduler io_;
 };
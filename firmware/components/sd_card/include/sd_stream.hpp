@@ -0,0 +1,248 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <string_view>
+
+extern "C" {
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "ff.h"
+
+}
+
+#include "component.hpp"
+#include "mp3_frame.hpp"
+#include "sd_card.hpp"
+
+/**
+ * @brief Double-buffered (or deeper) streaming reader for track data.
+ * A dedicated RTOS task fills a fixed ring of DMA-capable, sector-sized
+ * buffers ahead of the consumer, so the decoder only ever blocks when
+ * the card has fallen behind by the full depth of the ring.
+ *
+ * A next track can be queued with set_next(): it is opened and its first
+ * sectors are read ahead into spare buffers while the current track is
+ * still streaming, and the ring continues straight into it at the end of
+ * the current file, so track transitions cost no card access. The read
+ * ahead starts past the ID3v2 tag and the Xing/LAME frame, whose contents
+ * go to the decoder with the first chunk, so the spare buffers hold audio
+ * rather than cover art.
+ *
+ * Files are borrowed from the card's handle cache, so going back to a
+ * recent track (or restarting the current one) does not reopen it.
+ */
+class SdStreamObject : public StaticActiveObject<ActiveObject::MemoryLoad::kStandard> {
+public:
+  /// @brief size of each ring buffer, matches the FATFS sector size
+  static constexpr std::size_t kBufferSize = FF_MAX_SS;
+
+  /// @brief number of buffers in the ring (must be at least 2)
+  static constexpr std::size_t kBufferCount = 4;
+
+  static_assert(kBufferCount >= 2, "streaming requires at least two buffers");
+  static_assert(IoScheduler::kPlaybackBurstBytes >= kBufferCount * kBufferSize,
+    "one playback grant refills the whole ring");
+
+  /// @brief number of buffers read ahead from the next track
+  static constexpr std::size_t kPrefetchCount = 2;
+
+  /// @brief a filled buffer lent to the consumer until release()
+  struct Chunk {
+    const std::uint8_t* data;
+    std::size_t size;
+    bool end_of_stream;   ///< last chunk of the current track
+    bool track_start;     ///< first chunk of a track queued with set_next()
+    std::uint32_t track_offset;   ///< file position of data, for track_start chunks
+    const Mp3InfoTag* info_tag;   ///< info frame skipped before data, if any (until release())
+    std::uint32_t next_sequence;  ///< set_next() call that queued the track, for track_start chunks
+  };
+
+  /// @brief stream reader constructor
+  /// @param card mounted SD card to stream from
+  SdStreamObject(SdCardObject& card);
+
+  /// @brief close any open file on destruction
+  ~SdStreamObject();
+
+  /**
+   * @brief Request a new file to be streamed, replacing the current one.
+   * Buffers still queued for the previous file are discarded by acquire().
+   * @param path absolute path of the file to stream
+   * @param offset byte position to start at; sector-aligned offsets avoid
+   * partial sector copies in FATFS
+   * @return false if the path is too long or buffers could not be allocated
+   */
+  bool open(const std::string_view path, const std::uint32_t offset = 0);
+
+  /// @brief stop streaming the current file
+  void close();
+
+  /**
+   * @brief Queue the track that follows the current one, replacing any
+   * previously queued track. Its first chunk is flagged track_start and is
+   * delivered right after the current track's end_of_stream chunk; if it
+   * cannot be opened, an empty end_of_stream chunk is delivered instead.
+   * @param path absolute path of the next file, or empty to clear it
+   * @return false if the path is too long
+   */
+  bool set_next(const std::string_view path);
+
+  /// @brief number of set_next() calls so far; a track_start chunk carrying
+  /// an older one belongs to a track that has been replaced since
+  std::uint32_t get_next_sequence() const { return requested_next_sequence_.load(); }
+
+  /**
+   * @brief Borrow the next filled buffer. Only one chunk may be held at a
+   * time and it must be returned via release() before the next acquire().
+   * @param timeout ticks to wait for data
+   * @return the chunk, or nothing if no data arrived in time
+   */
+  std::optional<Chunk> acquire(const TickType_t timeout);
+
+  /// @brief return the chunk obtained from acquire() to the ring
+  void release();
+
+protected:
+  void task() override;
+
+private:
+  struct PoolGuard {
+    void operator()(std::uint8_t* buffer) const noexcept;
+  };
+
+  using Buffer = std::unique_ptr<std::uint8_t, PoolGuard>;
+
+  /// @brief ring slot metadata, only written by the side that owns the slot
+  struct Slot {
+    Buffer data;
+    std::size_t start{0};   ///< bytes at the front of data that are not part of the stream
+    std::size_t size{0};    ///< stream bytes after start
+    std::uint32_t generation{0};
+    bool end_of_stream{false};
+    bool track_start{false};
+    std::uint32_t track_offset{0};
+    std::optional<Mp3InfoTag> info_tag{std::nullopt};
+    std::uint32_t next_sequence{0};
+  };
+
+  /// @brief sector-sized buffer the SD driver can DMA into without bouncing
+  static Buffer allocate_buffer();
+
+  /// @brief pick up a pending open()/close() request inside the reader task
+  void apply_request();
+
+  /// @brief pick up a pending set_next() request: open and prefetch the file
+  void apply_next_request();
+
+  /**
+   * @brief Find the first audio frame of the next track, leaving the sector
+   * that holds it in the first prefetch buffer.
+   * @return false on a read error
+   */
+  bool locate_audio();
+
+  /// @brief read the sector holding offset into the first prefetch buffer, unless it is there already
+  bool load_first_sector(const std::uint32_t offset);
+
+  /// @brief true while the promoted track still has prefetched sectors to hand out
+  bool current_uses_prefetch() const;
+
+  /// @brief continue with the prefetched next track after the current one
+  void promote_next();
+
+  /// @brief hand a file back to the card's handle cache
+  void close_file(FILE*& file);
+
+  /// @brief fill a free slot from the prefetch buffers or the file
+  /// @param grant the refill's card grant, under which the clock may be lowered
+  /// @return false if the read failed and should be retried
+  bool fill_slot(Slot& slot, const IoScheduler::Grant& grant);
+
+  /// @brief card the stream reads from
+  SdCardObject& card_;
+
+  /// @brief ring of DMA-capable buffers
+  std::array<Slot, kBufferCount> slots_{};
+
+  /// @brief next slot the reader fills (reader task only)
+  std::size_t write_index_{0};
+
+  /// @brief next slot the consumer drains (consumer task only)
+  std::size_t read_index_{0};
+
+  /// @brief currently streamed file, borrowed from the cache (reader task only)
+  FILE* file_{nullptr};
+
+  /// @brief true once the current file has been read to its end
+  bool end_of_file_{true};
+
+  /// @brief the next track (reader task only)
+  FILE* next_file_{nullptr};
+  bool has_next_{false};
+
+  /// @brief first sectors of the next track, swapped into the ring on use;
+  /// they belong to the current track after promote_next() until handed out
+  std::array<Buffer, kPrefetchCount> prefetch_{};
+  std::array<std::size_t, kPrefetchCount> prefetch_size_{};
+  std::size_t prefetch_count_{0};
+  std::size_t prefetch_index_{0};
+
+  /// @brief file position of the first prefetch buffer
+  std::uint32_t prefetch_sector_{0};
+
+  /// @brief where the audio of the next track starts, and its info frame
+  std::uint32_t next_offset_{0};
+  std::optional<Mp3InfoTag> next_info_tag_{std::nullopt};
+
+  /// @brief the same for the promoted track, for its first slot
+  std::uint32_t track_offset_{0};
+  std::optional<Mp3InfoTag> track_info_tag_{std::nullopt};
+  std::uint32_t track_sequence_{0};
+
+  /// @brief the next filled slot is the first of a queued track
+  bool track_start_{false};
+
+  /// @brief sequence of the next-track request applied by the reader
+  std::uint32_t next_sequence_{0};
+
+  /// @brief sequence most recently requested through set_next()
+  std::atomic<std::uint32_t> requested_next_sequence_{0};
+
+  /// @brief path requested through set_next(), guarded by request_mutex_
+  std::array<char, SdCardObject::kMaxPathLength> requested_next_path_{'\0'};
+
+  /// @brief generation of the file currently being read (reader task only)
+  std::uint32_t generation_{0};
+
+  /// @brief generation most recently requested through open()/close()
+  std::atomic<std::uint32_t> requested_generation_{0};
+
+  /// @brief path and start offset requested through open(), guarded by request_mutex_
+  std::array<char, SdCardObject::kMaxPathLength> requested_path_{'\0'};
+  std::uint32_t requested_offset_{0};
+
+  /// @brief buffers to store the semaphores without heap allocation
+  StaticSemaphore_t request_mutex_buffer_{};
+  StaticSemaphore_t free_sem_buffer_{};
+  StaticSemaphore_t filled_sem_buffer_{};
+  StaticSemaphore_t wake_sem_buffer_{};
+
+  /// @brief guards requested_path_ and requested_next_path_
+  SemaphoreHandle_t request_mutex_{nullptr};
+
+  /// @brief counts slots available to the reader
+  SemaphoreHandle_t free_sem_{nullptr};
+
+  /// @brief counts slots available to the consumer
+  SemaphoreHandle_t filled_sem_{nullptr};
+
+  /// @brief wakes an idle reader when a new request arrives
+  SemaphoreHandle_t wake_sem_{nullptr};
+};
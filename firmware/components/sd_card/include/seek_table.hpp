@@ -0,0 +1,139 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include "io_scheduler.hpp"
+#include "memory_pool.hpp"
+
+/**
+ * @brief Frame-accurate seek index for one MP3 file. Byte offsets of every
+ * frames_per_entry-th audio frame are kept; since every frame of a file has
+ * the same duration, time -> offset is a direct lookup and offset -> time a
+ * binary search. The table is bounded to kMaxEntries by doubling the
+ * spacing as it grows, and is persisted next to the library index so it
+ * only has to be built once per file.
+ */
+class SeekTable {
+public:
+  /// @brief file format identifiers
+  static constexpr std::uint32_t kMagic = 0x4b454553;  // "SEEK"
+  static constexpr std::uint16_t kVersion = 1;
+
+  /// @brief entries kept at most (4 bytes each)
+  static constexpr std::size_t kMaxEntries = 2048;
+
+  /// @brief densest spacing, ~0.2 s at 44.1 kHz
+  static constexpr std::uint32_t kMinFramesPerEntry = 8;
+
+  /// @brief identity of the file the table was built from
+  struct Source {
+    std::uint32_t size;
+    std::uint32_t mtime;
+
+    bool operator==(const Source&) const = default;
+  };
+
+  /// @brief a frame and the byte offset of its header
+  struct Point {
+    std::uint32_t frame;
+    std::uint32_t offset;
+  };
+
+  /// @brief identity of a file as reported by stat()
+  static std::optional<Source> stat_source(const char* path);
+
+  /// @brief path of the table for a track inside a directory
+  static std::array<char, 64> path_for(const std::string_view directory, const std::string_view track_path);
+
+  /// @brief the part of a table's file name that identifies its track
+  static std::uint32_t key_for(const std::string_view track_path);
+
+  /// @brief key of a table file name, including a leftover temp file
+  /// @return nothing if the name is not one path_for() produces
+  static std::optional<std::uint32_t> parse_key(const std::string_view file_name);
+
+  /// @brief start an empty table for a new file
+  void reset(const Source& source, const std::uint32_t sample_rate, const std::uint16_t samples_per_frame);
+
+  /// @brief record the next audio frame; frames must be added in order from the first
+  void add_frame(const std::uint32_t offset);
+
+  /// @brief set the identity of the file (e.g. once it is cheap to stat it)
+  void set_source(const Source& source) { source_ = source; }
+
+  /// @brief mark the table as covering the whole file
+  void finish() { complete_ = true; }
+
+  /// @brief forget any contents
+  void clear();
+
+  /// @brief load a saved table
+  /// @param path table file path (VFS)
+  /// @param source expected identity of the track; stale tables are rejected
+  bool load(const char* path, const Source& source);
+
+  /// @brief write the table atomically (temp file + rename)
+  /// @param grant card grant to write under; yields to playback between slices
+  bool save(const char* path, IoScheduler::Grant& grant) const;
+
+  /// @brief true if every frame of the file has been added
+  bool is_complete() const { return complete_; }
+
+  /// @brief true if no frame has been added
+  bool empty() const { return frame_count_ == 0; }
+
+  const Source& get_source() const { return source_; }
+  std::uint32_t get_sample_rate() const { return sample_rate_; }
+  std::uint16_t get_samples_per_frame() const { return samples_per_frame_; }
+  std::uint32_t get_frame_count() const { return frame_count_; }
+
+  /// @brief duration covered by the table
+  std::uint32_t get_duration_ms() const { return frame_to_ms(frame_count_); }
+
+  /// @brief closest indexed frame at or before a frame (O(1))
+  std::optional<Point> find_frame(const std::uint32_t frame) const;
+
+  /// @brief closest indexed frame at or before a time (O(1))
+  std::optional<Point> find_time(const std::uint32_t position_ms) const;
+
+  /// @brief closest indexed frame at or before a byte offset (O(log n))
+  std::optional<Point> find_offset(const std::uint32_t offset) const;
+
+  /// @brief time at which a frame starts
+  std::uint32_t frame_to_ms(const std::uint32_t frame) const;
+
+private:
+  /// @brief table file header
+  struct Header {
+    std::uint32_t magic;
+    std::uint16_t version;
+    std::uint16_t frames_per_entry;
+    Source source;
+    std::uint32_t sample_rate;
+    std::uint32_t samples_per_frame;
+    std::uint32_t frame_count;
+    std::uint32_t entry_count;
+    std::uint32_t checksum;
+  };
+
+  /// @brief file the table belongs to
+  Source source_{};
+
+  /// @brief timing of every frame
+  std::uint32_t sample_rate_{0};
+  std::uint16_t samples_per_frame_{0};
+
+  /// @brief offsets_[i] is the offset of frame i * frames_per_entry_
+  std::uint16_t frames_per_entry_{kMinFramesPerEntry};
+  ExternalVector<std::uint32_t> offsets_;
+
+  /// @brief frames added so far
+  std::uint32_t frame_count_{0};
+
+  /// @brief true once the end of the file was reached
+  bool complete_{false};
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+
+/**
+ * @brief Streaming reader for the metadata of an MP3 file. The ID3v2 tag is
+ * walked frame header by frame header straight from the file: only the
+ * title, artist, album and track number frames are read into small fixed
+ * buffers, everything else (cover art, lyrics, padding) is skipped with a
+ * seek, and the walk stops as soon as all four fields have been found.
+ * The duration comes from the Xing/Info or VBRI header of the first audio
+ * frame, or from the bitrate for CBR files without one, so a file costs a
+ * handful of sector reads no matter how large its tag is.
+ */
+class TagReader {
+public:
+  /// @brief longest text field kept, in bytes of UTF-8 (including the terminator)
+  static constexpr std::size_t kMaxFieldLength = 96;
+
+  /// @brief bytes probed after the tag for the first frame (fits a whole 320 kbps frame)
+  static constexpr std::size_t kProbeBytes = 2048;
+
+  /// @brief null-terminated UTF-8 text, truncated on a character boundary
+  using Field = std::array<char, kMaxFieldLength>;
+
+  /// @brief what a file says about itself; missing fields are empty or 0
+  struct Metadata {
+    Field title;
+    Field artist;
+    Field album;
+    std::uint16_t track_number;
+    std::uint32_t duration_ms;
+  };
+
+  /**
+   * @brief Read the metadata of a file.
+   * @param path absolute path (VFS)
+   * @return metadata, or nothing if the file could not be read or holds no MP3 audio
+   */
+  std::optional<Metadata> read(const char* path);
+
+  /**
+   * @brief Read the metadata of an open file, starting at its beginning.
+   * @param file file to read; its position is left unspecified
+   * @param file_size size of the file in bytes
+   */
+  std::optional<Metadata> read(FILE* file, const std::uint32_t file_size);
+
+private:
+  /// @brief version and layout of the tag being walked
+  struct Tag {
+    std::uint8_t version;       ///< ID3v2 major version (2, 3 or 4)
+    std::uint8_t flags;         ///< header flags
+    std::uint32_t frames_begin; ///< file offset of the first frame header
+    std::uint32_t frames_end;   ///< file offset just past the frames and padding
+    std::uint32_t end;          ///< file offset just past the tag (and its footer)
+  };
+
+  /// @brief parse the ID3v2 header at offset
+  /// @return tag layout, or nothing if there is no tag there
+  std::optional<Tag> read_tag_header(FILE* file, const std::uint32_t offset);
+
+  /// @brief walk the frames of a tag, filling the wanted fields
+  void read_frames(FILE* file, const Tag& tag, Metadata& metadata);
+
+  /// @brief find the first audio frame at or after offset and derive the duration
+  /// @return duration in ms, or nothing if no frame was found
+  std::optional<std::uint32_t> read_duration(FILE* file, const std::uint32_t offset, const std::uint32_t file_size);
+
+  /// @brief scratch for text frames and the first audio frame
+  std::array<std::uint8_t, kProbeBytes> buffer_{};
+};
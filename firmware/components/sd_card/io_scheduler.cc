@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <utility>
+
+#include "include/io_scheduler.hpp"
+
+extern "C" {
+
+#include "esp_timer.h"
+#include "freertos/task.h"
+
+}
+
+IoScheduler::IoScheduler() {
+  mutex_ = xSemaphoreCreateMutexStatic(&mutex_buffer_);
+  idle_sem_ = xSemaphoreCreateBinaryStatic(&idle_sem_buffer_);
+}
+
+IoScheduler::Grant& IoScheduler::Grant::operator=(Grant&& other) noexcept {
+  if (this != &other) {
+    release();
+    scheduler_ = std::exchange(other.scheduler_, nullptr);
+    class_ = other.class_;
+    used_ = other.used_;
+  }
+  return *this;
+}
+
+bool IoScheduler::Grant::should_yield() const {
+  return used_ >= budget(class_) || (class_ == Class::kBackground && scheduler_->is_playback_pending());
+}
+
+void IoScheduler::Grant::yield() {
+  if (!scheduler_) {
+    return;
+  }
+
+  // a waiting reader has the higher priority and takes the card right away
+  if (class_ == Class::kBackground && scheduler_->is_playback_pending()) {
+    scheduler_->background_yields_.fetch_add(1);
+  }
+
+  xSemaphoreGive(scheduler_->mutex_);
+  scheduler_->wake_background();
+  if (class_ == Class::kBackground) {
+    scheduler_->take_background(portMAX_DELAY);
+  } else {
+    xSemaphoreTake(scheduler_->mutex_, portMAX_DELAY);
+  }
+  used_ = 0;
+}
+
+void IoScheduler::Grant::release() {
+  if (scheduler_) {
+    auto* const scheduler = std::exchange(scheduler_, nullptr);
+    xSemaphoreGive(scheduler->mutex_);
+    scheduler->wake_background();
+  }
+}
+
+std::size_t IoScheduler::Grant::write(FILE* file, const void* data, const std::size_t size) {
+  const auto bytes = static_cast<const std::uint8_t*>(data);
+  const long start = ftell(file);
+  std::size_t position = start < 0 ? 0 : static_cast<std::size_t>(start);
+  std::size_t written = 0;
+
+  while (written < size) {
+    if (should_yield()) {
+      yield();
+    }
+
+    // a slice that starts mid-sector runs to the boundary; the rest are as
+    // many whole sectors as the budget holds
+    const std::size_t offset = position % FF_MAX_SS;
+    const std::size_t limit = offset != 0 ? FF_MAX_SS - offset : budget(class_);
+    const std::size_t slice = std::min(size - written, limit);
+    const std::size_t count = fwrite(bytes + written, 1, slice, file);
+    written += count;
+    position += count;
+    consume(count);
+
+    if (count < slice) {
+      break;
+    }
+  }
+
+  return written;
+}
+
+IoScheduler::Grant IoScheduler::acquire(const Class io_class, const TickType_t timeout) {
+  if (io_class == Class::kBackground) {
+    if (!take_background(timeout)) {
+      return Grant{};
+    }
+    background_grants_.fetch_add(1);
+    return Grant{*this, io_class};
+  }
+
+  const std::int64_t begin_us = esp_timer_get_time();
+  playback_waiting_.fetch_add(1);
+  const bool taken = xSemaphoreTake(mutex_, timeout) == pdTRUE;
+  playback_waiting_.fetch_sub(1);
+  if (!taken) {
+    wake_background();
+    return Grant{};
+  }
+
+  const auto waited_us = static_cast<std::uint32_t>(esp_timer_get_time() - begin_us);
+  std::uint32_t max_us = playback_wait_max_us_.load();
+  while (waited_us > max_us && !playback_wait_max_us_.compare_exchange_weak(max_us, waited_us)) {}
+
+  playback_grants_.fetch_add(1);
+  return Grant{*this, io_class};
+}
+
+void IoScheduler::set_playback_demand(const bool hungry) {
+  if (playback_demand_.exchange(hungry) && !hungry) {
+    wake_background();
+  }
+}
+
+IoScheduler::Stats IoScheduler::get_stats() const {
+  return Stats{
+    .playback_grants = playback_grants_.load(),
+    .background_grants = background_grants_.load(),
+    .background_yields = background_yields_.load(),
+    .playback_wait_max_us = playback_wait_max_us_.load(),
+  };
+}
+
+bool IoScheduler::take_background(const TickType_t timeout) {
+  const TickType_t start = xTaskGetTickCount();
+
+  while (true) {
+    if (!is_playback_pending() && xSemaphoreTake(mutex_, 0) == pdTRUE) {
+      // playback may have queued up while we took it
+      if (playback_waiting_.load() == 0) {
+        return true;
+      }
+      xSemaphoreGive(mutex_);
+    }
+
+    const TickType_t elapsed = xTaskGetTickCount() - start;
+    if (elapsed >= timeout) {
+      return false;
+    }
+
+    // woken whenever the card is released or playback stops wanting it
+    xSemaphoreTake(idle_sem_, timeout == portMAX_DELAY ? portMAX_DELAY : timeout - elapsed);
+  }
+}
+
+void IoScheduler::wake_background() {
+  xSemaphoreGive(idle_sem_);
+}
@@ -0,0 +1,277 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <string>
+
+#include "include/library_index.hpp"
+
+extern "C" {
+
+#include "esp_log.h"
+
+}
+
+namespace {
+
+constexpr const char* kComponentTag = "LibraryIndex";
+constexpr std::string_view kTempSuffix = ".tmp";
+
+constexpr std::uint32_t kFnvOffset = 2166136261u;
+constexpr std::uint32_t kFnvPrime = 16777619u;
+
+struct FileGuard {
+  void operator()(FILE* file) const noexcept {
+    if (file) fclose(file);
+  }
+};
+
+/// @brief 32-bit FNV-1a, continuing from a previous hash value
+std::uint32_t fnv1a(const void* data, const std::size_t size, std::uint32_t hash = kFnvOffset) {
+  const auto bytes = static_cast<const std::uint8_t*>(data);
+  for (std::size_t i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * kFnvPrime;
+  }
+  return hash;
+}
+
+std::uint32_t hash_path(const std::string_view path) {
+  return fnv1a(path.data(), path.size());
+}
+
+std::uint32_t compute_checksum(const LibraryIndex::Entries& entries, const StringArena& strings) {
+  const std::uint32_t hash = fnv1a(entries.data(), entries.size() * sizeof(LibraryIndex::Entry));
+  return fnv1a(strings.data(), strings.size(), hash);
+}
+
+}
+
+LibraryIndex::LibraryIndex(const StringArena::Placement placement) : strings_(placement) {
+  // offset 0 is the shared empty string
+  strings_.add({});
+}
+
+bool LibraryIndex::load(const char* path) {
+  std::unique_ptr<FILE, FileGuard> file{fopen(path, "rb")};
+  if (!file) {
+    return false;
+  }
+
+  // sizes must add up exactly before anything is allocated
+  fseek(file.get(), 0, SEEK_END);
+  const long file_size = ftell(file.get());
+  fseek(file.get(), 0, SEEK_SET);
+
+  Header header{};
+  if (fread(&header, sizeof(header), 1, file.get()) != 1 ||
+      header.magic != kMagic ||
+      header.version != kVersion ||
+      header.entry_size != sizeof(Entry) ||
+      header.string_bytes == 0 ||
+      static_cast<std::uint64_t>(file_size) != sizeof(Header) +
+        static_cast<std::uint64_t>(header.entry_count) * sizeof(Entry) + header.string_bytes) {
+    ESP_LOGW(kComponentTag, "Index '%s' has an unexpected layout", path);
+    return false;
+  }
+
+  Entries entries(header.entry_count);
+  StringArena strings(strings_.placement());
+  char* table = strings.extend(header.string_bytes);
+  if (!table) {
+    ESP_LOGE(kComponentTag, "No memory for %" PRIu32 " byte string table", header.string_bytes);
+    return false;
+  }
+
+  if (fread(entries.data(), sizeof(Entry), entries.size(), file.get()) != entries.size() ||
+      fread(table, 1, header.string_bytes, file.get()) != header.string_bytes) {
+    ESP_LOGW(kComponentTag, "Index '%s' is truncated", path);
+    return false;
+  }
+
+  if (compute_checksum(entries, strings) != header.checksum || table[0] != '\0' || table[header.string_bytes - 1] != '\0') {
+    ESP_LOGW(kComponentTag, "Index '%s' is corrupt", path);
+    return false;
+  }
+
+  const auto in_table = [&strings](const StringOffset offset) { return offset < strings.size(); };
+  for (const auto& entry : entries) {
+    if (!in_table(entry.path) || !in_table(entry.title) || !in_table(entry.artist) || !in_table(entry.album)) {
+      ESP_LOGW(kComponentTag, "Index '%s' has out of range strings", path);
+      return false;
+    }
+  }
+
+  entries_ = std::move(entries);
+  strings_ = std::move(strings);
+  dirty_ = false;
+  build_lookup();
+  return true;
+}
+
+bool LibraryIndex::save(const char* path, IoScheduler::Grant& grant) {
+  const std::string temp_path = std::string(path) + std::string(kTempSuffix);
+
+  {
+    std::unique_ptr<FILE, FileGuard> file{fopen(temp_path.c_str(), "wb")};
+    if (!file) {
+      ESP_LOGE(kComponentTag, "Could not create '%s'", temp_path.c_str());
+      return false;
+    }
+
+    const Header header = {
+      .magic = kMagic,
+      .version = kVersion,
+      .entry_size = sizeof(Entry),
+      .entry_count = static_cast<std::uint32_t>(entries_.size()),
+      .string_bytes = static_cast<std::uint32_t>(strings_.size()),
+      .checksum = checksum(),
+    };
+
+    // the grant sizes the writes; a stdio buffer would only split them again
+    setvbuf(file.get(), nullptr, _IONBF, 0);
+
+    const std::size_t entry_bytes = entries_.size() * sizeof(Entry);
+    const bool written =
+      fwrite(&header, sizeof(header), 1, file.get()) == 1 &&
+      grant.write(file.get(), entries_.data(), entry_bytes) == entry_bytes &&
+      grant.write(file.get(), strings_.data(), strings_.size()) == strings_.size();
+
+    if (!written || fclose(file.release()) != 0) {
+      ESP_LOGE(kComponentTag, "Could not write '%s'", temp_path.c_str());
+      remove(temp_path.c_str());
+      return false;
+    }
+  }
+
+  // FAT rename does not replace an existing file
+  remove(path);
+  if (rename(temp_path.c_str(), path) != 0) {
+    ESP_LOGE(kComponentTag, "Could not replace '%s'", path);
+    return false;
+  }
+
+  dirty_ = false;
+  return true;
+}
+
+std::optional<LibraryIndex::Change> LibraryIndex::add_track(const std::string_view path, const std::uint32_t size,
+    const std::uint32_t mtime, const LibraryIndex& previous) {
+  Entry entry{};
+  entry.size = size;
+  entry.mtime = mtime;
+  Change change = Change::kAdded;
+
+  const auto existing = previous.find(path);
+  if (existing) {
+    const auto& old = previous.entry(*existing);
+    change = Change::kChanged;
+
+    // unchanged file, keep its metadata
+    if (old.size == size && old.mtime == mtime) {
+      change = Change::kUnchanged;
+      entry = old;
+      entry.title = add_string(strings_, previous.string(old.title)).value_or(kEmptyString);
+      entry.artist = add_string(strings_, previous.string(old.artist)).value_or(kEmptyString);
+      entry.album = add_string(strings_, previous.string(old.album)).value_or(kEmptyString);
+    }
+  }
+
+  const auto offset = add_string(strings_, path);
+  if (!offset) {
+    return std::nullopt;
+  }
+
+  entry.path = *offset;
+  entries_.push_back(entry);
+
+  // a built index has never been saved
+  dirty_ = true;
+  return change;
+}
+
+void LibraryIndex::seal() {
+  std::sort(entries_.begin(), entries_.end(),
+    [this](const Entry& a, const Entry& b) { return string(a.path) < string(b.path); });
+  build_lookup();
+}
+
+std::optional<LibraryIndex::TrackId> LibraryIndex::find(const std::string_view path) const {
+  const std::uint32_t hash = hash_path(path);
+  auto it = std::lower_bound(lookup_.begin(), lookup_.end(), hash,
+    [](const auto& item, const std::uint32_t value) { return item.first < value; });
+
+  // walk hash collisions
+  for (; it != lookup_.end() && it->first == hash; ++it) {
+    if (this->path(it->second) == path) {
+      return it->second;
+    }
+  }
+
+  return std::nullopt;
+}
+
+std::uint32_t LibraryIndex::path_hash(const TrackId id) const {
+  return hash_path(path(id));
+}
+
+std::uint32_t LibraryIndex::path_hash(const std::string_view path) {
+  return hash_path(path);
+}
+
+std::optional<LibraryIndex::TrackId> LibraryIndex::find_hash(const std::uint32_t hash) const {
+  const auto it = std::lower_bound(lookup_.begin(), lookup_.end(), hash,
+    [](const auto& item, const std::uint32_t value) { return item.first < value; });
+  if (it == lookup_.end() || it->first != hash) {
+    return std::nullopt;
+  }
+
+  // a collision makes the hash ambiguous; the path has to be spelled out
+  if (std::next(it) != lookup_.end() && std::next(it)->first == hash) {
+    return std::nullopt;
+  }
+  return it->second;
+}
+
+bool LibraryIndex::set_metadata(const TrackId id, const TagReader::Metadata& metadata) {
+  const auto title = add_string(strings_, metadata.title.data());
+  const auto artist = add_string(strings_, metadata.artist.data());
+  const auto album = add_string(strings_, metadata.album.data());
+  if (!title || !artist || !album) {
+    return false;
+  }
+
+  auto& entry = entries_[id];
+  entry.title = *title;
+  entry.artist = *artist;
+  entry.album = *album;
+  entry.track_number = metadata.track_number;
+  entry.duration_ms = metadata.duration_ms;
+  entry.flags |= kMetadataValid;
+  dirty_ = true;
+  return true;
+}
+
+std::optional<LibraryIndex::StringOffset> LibraryIndex::add_string(StringArena& strings, const std::string_view value) {
+  if (value.empty() && strings.size() > 0) {
+    return kEmptyString;
+  }
+
+  return strings.add(value);
+}
+
+void LibraryIndex::build_lookup() {
+  lookup_.clear();
+  lookup_.reserve(entries_.size());
+
+  for (TrackId id = 0; id < entries_.size(); id++) {
+    lookup_.emplace_back(hash_path(path(id)), id);
+  }
+
+  std::sort(lookup_.begin(), lookup_.end());
+}
+
+std::uint32_t LibraryIndex::checksum() const {
+  return compute_checksum(entries_, strings_);
+}
@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <utility>
+
+#include "include/library_scanner.hpp"
+
+extern "C" {
+
+#include "esp_log.h"
+
+}
+
+namespace {
+
+constexpr const char* kComponentTag = "LibraryScanner";
+constexpr std::string_view kTrackExtension = ".mp3";
+
+/// @brief case-insensitive extension check (FAT names are case-insensitive)
+bool is_track(const std::string_view name) {
+  if (name.size() <= kTrackExtension.size()) {
+    return false;
+  }
+
+  const auto extension = name.substr(name.size() - kTrackExtension.size());
+  return std::equal(extension.begin(), extension.end(), kTrackExtension.begin(),
+    [](const char a, const char b) { return std::tolower(static_cast<unsigned char>(a)) == b; });
+}
+
+/// @brief folder level of a path relative to the music folder (0 for the folder itself)
+std::size_t depth_of(const std::string_view directory) {
+  return directory.empty() ? 0 : std::count(directory.begin(), directory.end(), '/') + 1;
+}
+
+}
+
+LibraryScanner::LibraryScanner(const StringArena::Placement placement)
+  : placement_(placement),
+    index_(placement) {}
+
+LibraryScanner::~LibraryScanner() {
+  close_directory();
+}
+
+bool LibraryScanner::begin(const char* fatfs_root) {
+  close_directory();
+
+  const int length = snprintf(root_.data(), root_.size(), "%s", fatfs_root);
+  if (length < 0 || static_cast<std::size_t>(length) >= root_.size()) {
+    ESP_LOGE(kComponentTag, "Path too long: '%s'", fatfs_root);
+    return false;
+  }
+
+  index_ = LibraryIndex(placement_);
+  pending_.clear();
+  pending_.emplace_back();
+  root_opened_ = false;
+  read_error_ = false;
+  running_ = true;
+  failed_ = false;
+  retained_ = 0;
+  result_ = {};
+  return true;
+}
+
+bool LibraryScanner::step(const LibraryIndex& previous, const std::size_t max_entries) {
+  if (!running_) {
+    return false;
+  }
+
+  // sizes and timestamps come straight from the directory entries; going
+  // through VFS stat() would walk the directory again for every file
+  FILINFO info;
+  for (std::size_t entries = 0; entries < max_entries; entries++) {
+    if (!dir_open_ && !open_next()) {
+      finish(previous, !root_opened_ || read_error_);
+      return false;
+    }
+
+    // a read error is not the end of the folder: everything after it
+    // would count as removed, so the scan is abandoned instead
+    const FRESULT result = f_readdir(&dir_, &info);
+    if (result != FR_OK) {
+      ESP_LOGE(kComponentTag, "Could not read directory '%s' (%d)", directory_.c_str(), result);
+      finish(previous, true);
+      return false;
+    }
+
+    if (info.fname[0] == '\0') {
+      close_directory();
+      continue;
+    }
+
+    const std::string_view name{info.fname};
+    if (info.fattrib & (AM_HID | AM_SYS)) {
+      continue;
+    }
+
+    std::array<char, kMaxPathLength> path{'\0'};
+    const int length = directory_.empty() ?
+      snprintf(path.data(), path.size(), "%s", info.fname) :
+      snprintf(path.data(), path.size(), "%s/%s", directory_.c_str(), info.fname);
+    if (length < 0 || static_cast<std::size_t>(length) >= path.size()) {
+      ESP_LOGW(kComponentTag, "Skipping '%s': path too long", info.fname);
+      continue;
+    }
+
+    if (info.fattrib & AM_DIR) {
+      if (depth_of(directory_) < kMaxDepth) {
+        pending_.emplace_back(path.data(), static_cast<std::size_t>(length));
+      }
+      continue;
+    }
+
+    if (!is_track(name)) {
+      continue;
+    }
+
+    const auto change = index_.add_track({path.data(), static_cast<std::size_t>(length)},
+      static_cast<std::uint32_t>(info.fsize), (static_cast<std::uint32_t>(info.fdate) << 16) | info.ftime, previous);
+    if (!change) {
+      ESP_LOGE(kComponentTag, "Out of memory after %zu tracks", index_.size());
+      finish(previous, true);
+      return false;
+    }
+
+    switch (*change) {
+      case LibraryIndex::Change::kAdded:
+        result_.added++;
+        break;
+      case LibraryIndex::Change::kChanged:
+        result_.changed++;
+        retained_++;
+        break;
+      case LibraryIndex::Change::kUnchanged:
+        retained_++;
+        break;
+    }
+  }
+
+  return true;
+}
+
+void LibraryScanner::prioritize(const std::string_view directory) {
+  const auto it = std::find(pending_.begin(), pending_.end(), directory);
+  if (it != pending_.end()) {
+    std::rotate(it, it + 1, pending_.end());
+  }
+}
+
+LibraryIndex LibraryScanner::take_index() {
+  return std::exchange(index_, LibraryIndex(placement_));
+}
+
+bool LibraryScanner::open_next() {
+  while (!pending_.empty()) {
+    directory_ = std::move(pending_.back());
+    pending_.pop_back();
+
+    std::array<char, kMaxPathLength> path{'\0'};
+    const int length = directory_.empty() ?
+      snprintf(path.data(), path.size(), "%s", root_.data()) :
+      snprintf(path.data(), path.size(), "%s/%s", root_.data(), directory_.c_str());
+
+    if (length < 0 || static_cast<std::size_t>(length) >= path.size()) {
+      ESP_LOGW(kComponentTag, "Skipping '%s': path too long", directory_.c_str());
+      continue;
+    }
+
+    const FRESULT result = f_opendir(&dir_, path.data());
+    if (result == FR_OK) {
+      dir_open_ = true;
+      root_opened_ = true;
+      return true;
+    }
+
+    // the music folder is always visited first
+    if (!root_opened_) {
+      ESP_LOGE(kComponentTag, "Could not open directory '%s'", path.data());
+      return false;
+    }
+
+    // a folder removed since its parent was read is skipped, but one that
+    // would not open must not have its tracks counted as removed
+    if (result != FR_NO_PATH && result != FR_NO_FILE) {
+      ESP_LOGE(kComponentTag, "Could not open directory '%s' (%d)", path.data(), result);
+      read_error_ = true;
+      return false;
+    }
+
+    ESP_LOGW(kComponentTag, "Skipping vanished directory '%s'", path.data());
+  }
+
+  return false;
+}
+
+void LibraryScanner::close_directory() {
+  if (dir_open_) {
+    f_closedir(&dir_);
+    dir_open_ = false;
+  }
+}
+
+void LibraryScanner::finish(const LibraryIndex& previous, const bool failed) {
+  close_directory();
+  pending_.clear();
+  running_ = false;
+  failed_ = failed;
+
+  if (!failed) {
+    index_.seal();
+    result_.total = index_.size();
+    result_.removed = previous.size() - retained_;
+  }
+}
@@ -0,0 +1,128 @@
+#include <cstring>
+
+#include "include/mp3_frame.hpp"
+
+namespace {
+
+constexpr std::size_t kHeaderSize = 4;
+constexpr std::size_t kId3HeaderSize = 10;
+constexpr std::uint8_t kId3FooterFlag = 0x10;
+constexpr std::size_t kLameDelayOffset = 21;
+
+constexpr std::uint32_t kXingFrames = 1 << 0;
+constexpr std::uint32_t kXingBytes = 1 << 1;
+constexpr std::uint32_t kXingToc = 1 << 2;
+constexpr std::uint32_t kXingQuality = 1 << 3;
+
+/// @brief layer III bitrates (kbps) by index, MPEG-1 and MPEG-2/2.5
+constexpr std::array<std::uint16_t, 15> kBitratesV1 = {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320};
+constexpr std::array<std::uint16_t, 15> kBitratesV2 = {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160};
+
+/// @brief MPEG-1 sample rates; MPEG-2 halves and MPEG-2.5 quarters them
+constexpr std::array<std::uint32_t, 3> kSampleRates = {44100, 48000, 32000};
+
+std::uint32_t read_be32(const std::uint8_t* data) {
+  return (static_cast<std::uint32_t>(data[0]) << 24) | (static_cast<std::uint32_t>(data[1]) << 16) |
+    (static_cast<std::uint32_t>(data[2]) << 8) | data[3];
+}
+
+}
+
+std::size_t id3v2_tag_size(const std::uint8_t* data, const std::size_t size) {
+  if (size < kId3HeaderSize || std::memcmp(data, "ID3", 3) != 0) {
+    return 0;
+  }
+
+  // syncsafe integer: 7 bits per byte
+  const std::size_t tag_size =
+    (static_cast<std::size_t>(data[6] & 0x7f) << 21) |
+    (static_cast<std::size_t>(data[7] & 0x7f) << 14) |
+    (static_cast<std::size_t>(data[8] & 0x7f) << 7) |
+    static_cast<std::size_t>(data[9] & 0x7f);
+
+  const std::size_t footer = (data[5] & kId3FooterFlag) ? kId3HeaderSize : 0;
+  return kId3HeaderSize + tag_size + footer;
+}
+
+std::optional<Mp3FrameHeader> Mp3FrameHeader::parse(const std::uint8_t* data, const std::size_t size) {
+  if (size < kHeaderSize || data[0] != 0xff || (data[1] & 0xe0) != 0xe0) {
+    return std::nullopt;
+  }
+
+  const std::uint8_t version = (data[1] >> 3) & 0x03;   // 3: MPEG-1, 2: MPEG-2, 0: MPEG-2.5
+  const std::uint8_t layer = (data[1] >> 1) & 0x03;     // 1: layer III
+  const std::uint8_t bitrate_index = data[2] >> 4;
+  const std::uint8_t rate_index = (data[2] >> 2) & 0x03;
+  const bool padding = data[2] & 0x02;
+  const bool mono = (data[3] >> 6) == 0x03;
+
+  if (version == 1 || layer != 1 || bitrate_index == 0 || bitrate_index == 15 || rate_index == 3) {
+    return std::nullopt;
+  }
+
+  const bool mpeg1 = version == 3;
+  Mp3FrameHeader header{};
+  header.bitrate_kbps = mpeg1 ? kBitratesV1[bitrate_index] : kBitratesV2[bitrate_index];
+  header.sample_rate = kSampleRates[rate_index] >> (mpeg1 ? 0 : (version == 2 ? 1 : 2));
+  header.samples_per_frame = mpeg1 ? 1152 : 576;
+  header.channels = mono ? 1 : 2;
+  header.side_info_bytes = mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17);
+
+  // bytes = samples / 8 * bitrate / sample rate
+  header.frame_bytes = static_cast<std::uint16_t>(
+    header.samples_per_frame / 8 * header.bitrate_kbps * 1000 / header.sample_rate + (padding ? 1 : 0));
+  return header;
+}
+
+std::optional<Mp3InfoTag> Mp3InfoTag::parse(const std::uint8_t* data, const std::size_t size) {
+  const auto header = Mp3FrameHeader::parse(data, size);
+  if (!header || header->frame_bytes > size) {
+    return std::nullopt;
+  }
+
+  // the tag is confined to its own frame
+  const std::uint8_t* const end = data + header->frame_bytes;
+  const std::uint8_t* tag = data + kHeaderSize + header->side_info_bytes;
+  if (tag + 8 > end || (std::memcmp(tag, "Xing", 4) != 0 && std::memcmp(tag, "Info", 4) != 0)) {
+    return std::nullopt;
+  }
+
+  Mp3InfoTag info{};
+  info.header = *header;
+
+  const std::uint32_t flags = read_be32(tag + 4);
+  tag += 8;
+
+  if (flags & kXingFrames) {
+    if (tag + 4 > end) return std::nullopt;
+    info.frames = read_be32(tag);
+    tag += 4;
+  }
+
+  if (flags & kXingBytes) {
+    if (tag + 4 > end) return std::nullopt;
+    info.bytes = read_be32(tag);
+    tag += 4;
+  }
+
+  if (flags & kXingToc) {
+    if (tag + info.toc.size() > end) return std::nullopt;
+    std::memcpy(info.toc.data(), tag, info.toc.size());
+    info.has_toc = true;
+    tag += info.toc.size();
+  }
+
+  if (flags & kXingQuality) {
+    tag += 4;
+  }
+
+  // LAME extension: 9 byte encoder string, then 12-bit delay and padding
+  if (tag + kLameDelayOffset + 3 <= end && (std::memcmp(tag, "LAME", 4) == 0 || std::memcmp(tag, "Lavc", 4) == 0)) {
+    const std::uint8_t* const delay = tag + kLameDelayOffset;
+    info.encoder_delay = static_cast<std::uint16_t>((delay[0] << 4) | (delay[1] >> 4));
+    info.encoder_padding = static_cast<std::uint16_t>(((delay[1] & 0x0f) << 8) | delay[2]);
+    info.has_lame = true;
+  }
+
+  return info;
+}
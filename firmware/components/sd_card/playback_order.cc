@@ -0,0 +1,197 @@
+#include <charconv>
+#include <cstring>
+#include <memory>
+
+#include "include/playback_order.hpp"
+
+extern "C" {
+
+#include "esp_log.h"
+
+}
+
+namespace {
+
+constexpr const char* kComponentTag = "PlaybackOrder";
+
+struct FileGuard {
+  void operator()(FILE* file) const noexcept {
+    if (file) fclose(file);
+  }
+};
+
+}
+
+void PlaybackOrder::reset(const std::size_t library_size) {
+  path_[0] = '\0';
+  playlist_ = false;
+  size_ = library_size;
+  checkpoints_.clear();
+  checkpoints_.shrink_to_fit();
+  cursor_position_ = 0;
+  cursor_offset_ = 0;
+}
+
+bool PlaybackOrder::open(const char* path, const LibraryIndex& library) {
+  reset(0);
+
+  const int length = snprintf(path_.data(), path_.size(), "%s", path);
+  if (length < 0 || static_cast<std::size_t>(length) >= path_.size()) {
+    ESP_LOGE(kComponentTag, "Path too long: '%s'", path);
+    path_[0] = '\0';
+    return false;
+  }
+
+  std::unique_ptr<FILE, FileGuard> file{fopen(path_.data(), "r")};
+  if (!file) {
+    path_[0] = '\0';
+    return false;
+  }
+  playlist_ = true;
+
+  std::size_t skipped = 0;
+  std::uint32_t offset = 0;
+  while (true) {
+    const std::uint32_t line_offset = offset;
+    const auto line = read_line(file.get(), offset);
+    if (!line) {
+      break;
+    }
+    if (line->empty()) {
+      continue;
+    }
+
+    // only checked here, not kept: the entry is parsed again when it plays
+    if (!parse(*line, library)) {
+      ESP_LOGD(kComponentTag, "Not in library: '%.*s'", static_cast<int>(line->size()), line->data());
+      skipped++;
+      continue;
+    }
+
+    if (size_ % kCheckpointInterval == 0) {
+      checkpoints_.push_back(line_offset);
+    }
+    size_++;
+  }
+
+  if (skipped > 0) {
+    ESP_LOGW(kComponentTag, "Skipped %zu playlist entries not in the library", skipped);
+  }
+  return true;
+}
+
+std::optional<LibraryIndex::TrackId> PlaybackOrder::resolve(const std::size_t position, const LibraryIndex& library) {
+  if (position >= size_) {
+    return std::nullopt;
+  }
+  if (!playlist_) {
+    return static_cast<LibraryIndex::TrackId>(position);
+  }
+
+  // continue from the last lookup when it is on the way, as it is for the next track
+  const std::size_t checkpoint = position / kCheckpointInterval;
+  std::size_t current = checkpoint * kCheckpointInterval;
+  std::uint32_t offset = checkpoints_[checkpoint];
+  if (cursor_position_ <= position && cursor_position_ > current) {
+    current = cursor_position_;
+    offset = cursor_offset_;
+  }
+
+  std::unique_ptr<FILE, FileGuard> file{fopen(path_.data(), "r")};
+  if (!file || fseek(file.get(), static_cast<long>(offset), SEEK_SET) != 0) {
+    ESP_LOGE(kComponentTag, "Could not read '%s'", path_.data());
+    return std::nullopt;
+  }
+
+  while (const auto line = read_line(file.get(), offset)) {
+    const auto id = line->empty() ? std::nullopt : parse(*line, library);
+    if (!id) {
+      continue;
+    }
+
+    if (current == position) {
+      cursor_position_ = position + 1;
+      cursor_offset_ = offset;
+      return id;
+    }
+    current++;
+  }
+
+  ESP_LOGW(kComponentTag, "'%s' changed since it was read", path_.data());
+  return std::nullopt;
+}
+
+std::optional<std::size_t> PlaybackOrder::find(const LibraryIndex::TrackId id, const std::size_t near,
+  const LibraryIndex& library) {
+  if (!playlist_) {
+    return id < size_ ? std::optional<std::size_t>{id} : std::nullopt;
+  }
+
+  std::unique_ptr<FILE, FileGuard> file{fopen(path_.data(), "r")};
+  if (!file) {
+    ESP_LOGE(kComponentTag, "Could not read '%s'", path_.data());
+    return std::nullopt;
+  }
+
+  std::optional<std::size_t> first;
+  std::size_t position = 0;
+  std::uint32_t offset = 0;
+  while (const auto line = read_line(file.get(), offset)) {
+    const auto entry = line->empty() ? std::nullopt : parse(*line, library);
+    if (!entry) {
+      continue;
+    }
+
+    if (*entry == id) {
+      if (position >= near) {
+        return position;
+      }
+      if (!first) {
+        first = position;
+      }
+    }
+    position++;
+  }
+
+  return first;
+}
+
+std::optional<std::string_view> PlaybackOrder::read_line(FILE* file, std::uint32_t& offset) {
+  if (!fgets(line_.data(), line_.size(), file)) {
+    return std::nullopt;
+  }
+
+  std::size_t length = strlen(line_.data());
+  offset += length;
+
+  if (length > 0 && line_[length - 1] != '\n' && !feof(file)) {
+    // too long: skip the rest of it
+    int c;
+    while ((c = fgetc(file)) != EOF) {
+      offset++;
+      if (c == '\n') {
+        break;
+      }
+    }
+    return std::string_view{};
+  }
+
+  while (length > 0 && (line_[length - 1] == '\n' || line_[length - 1] == '\r')) {
+    length--;
+  }
+  return std::string_view{line_.data(), length};
+}
+
+std::optional<LibraryIndex::TrackId> PlaybackOrder::parse(const std::string_view line, const LibraryIndex& library) {
+  if (line.front() != kIdPrefix) {
+    return library.find(line);
+  }
+
+  std::uint32_t hash = 0;
+  const auto digits = line.substr(1);
+  const auto [end, error] = std::from_chars(digits.data(), digits.data() + digits.size(), hash, 16);
+  if (error != std::errc{} || end != digits.data() + digits.size()) {
+    return std::nullopt;
+  }
+  return library.find_hash(hash);
+}
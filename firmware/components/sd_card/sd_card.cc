@@ -1,16 +1,37 @@
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <cinttypes>
 #include <cstring>
 #include <filesystem>
+#include <limits>
+#include <memory>
+#include <random>
 #include <system_error>
 #include <string_view>
+#include <utility>
 
 #include "include/sd_card.hpp"
 
+extern "C" {
+
+#include "diskio_sdmmc.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+}
+
 namespace {
 
 constexpr const char* kComponentTag = "SdCardObject";
-constexpr std::string_view kConfigPath = "/config/playback_order.txt";
+constexpr std::string_view kConfigPath = "config/playback_order.txt";
+constexpr std::string_view kLibraryIndexPath = "config/library.idx";
+constexpr std::string_view kMusicDirectory = "music";
+constexpr std::string_view kSeekDirectory = "config/seek";
+
+constexpr std::size_t kBenchmarkBlockSize = 4096;
+constexpr std::size_t kBenchmarkMaxBytes = 4 * 1024 * 1024;
+constexpr std::size_t kBenchmarkRandomReads = 128;
 
 struct FileGuard {
   void operator()(FILE* file) const noexcept {
@@ -18,42 +39,69 @@ struct FileGuard {
   }
 };
 
+struct HeapCapsGuard {
+  void operator()(std::uint8_t* buffer) const noexcept {
+    heap_caps_free(buffer);
+  }
+};
+
+/// @brief errors that indicate signal integrity problems at the current clock
+bool is_link_error(const esp_err_t err) {
+  return err == ESP_ERR_INVALID_CRC || err == ESP_ERR_TIMEOUT || err == ESP_ERR_INVALID_RESPONSE;
+}
+
+/// @brief mount errors worth retrying at a lower clock: link errors during
+/// identification, and ESP_FAIL, which is what a FAT read that failed at the
+/// negotiated clock surfaces as
+bool is_mount_retryable(const esp_err_t err) {
+  return is_link_error(err) || err == ESP_FAIL;
+}
+
+/// @brief convert bytes read over an interval to KB/s
+std::uint32_t to_kbps(const std::size_t bytes, const std::int64_t elapsed_us) {
+  return elapsed_us > 0 ? static_cast<std::uint32_t>((bytes * 1000000ull) / (1024ull * elapsed_us)) : 0;
+}
+
 }
 
 SdCardObject::SdCardObject(const Config& config)
-  : ActiveObject("SdCardObject", ActiveObject::MemoryLoad::kStandard, ActiveObject::Priority::kHigh, 1000),
-    config_(config) {}
+  : StaticActiveObject("SdCardObject", ActiveObject::Priority::kHigh, kScanPeriodMs, ActiveObject::Workload::kStorage),
+    config_(config),
+    file_cache_(config.max_open_files > kReservedOpenFiles ? config.max_open_files - kReservedOpenFiles : 1),
+    library_(StringArena::Placement::kPreferExternal),
+    scanner_(StringArena::Placement::kPreferExternal) {
+  library_mutex_ = xSemaphoreCreateMutexStatic(&library_mutex_buffer_);
+}
 
 SdCardObject::~SdCardObject() {
   unmount();
 }
 
 void SdCardObject::initialize() {
-  // Initialize SPI bus
-  spi_bus_config_t bus_config;
-  std::memset(&bus_config, 0, sizeof(bus_config));
-
-  // copy config values
-  bus_config.mosi_io_num = config_.mosi;
-  bus_config.miso_io_num = config_.miso;
-  bus_config.sclk_io_num = config_.sck;
-  bus_config.quadwp_io_num = -1;
-  bus_config.quadhd_io_num = -1;
-  bus_config.max_transfer_sz = 4000;
-
-  // try to initialize SPI bus
-  ESP_ERROR_CHECK(spi_bus_initialize(
-    SDSPI_DEFAULT_HOST, 
-    &bus_config, 
-    SDSPI_DEFAULT_DMA
-  ));
-
-  // try to initialize SD card
-  sdmmc_host_t host = SDSPI_HOST_DEFAULT();
-  sdspi_device_config_t slot_config = SDSPI_DEVICE_CONFIG_DEFAULT();
-  
-  slot_config.gpio_cs = config_.cs;
-  slot_config.host_id = SDSPI_DEFAULT_HOST;
+  // mounting and the library scan are on the boot critical path; the boost
+  // is held until task() has finished the rescan
+  scan_boost_.acquire();
+
+  if (config_.interface == Interface::SPI) {
+    // Initialize SPI bus
+    spi_bus_config_t bus_config;
+    std::memset(&bus_config, 0, sizeof(bus_config));
+
+    // copy config values
+    bus_config.mosi_io_num = config_.mosi;
+    bus_config.miso_io_num = config_.miso;
+    bus_config.sclk_io_num = config_.sck;
+    bus_config.quadwp_io_num = -1;
+    bus_config.quadhd_io_num = -1;
+    bus_config.max_transfer_sz = 4000;
+
+    // try to initialize SPI bus
+    ESP_ERROR_CHECK(spi_bus_initialize(
+      SDSPI_DEFAULT_HOST, 
+      &bus_config, 
+      SDSPI_DEFAULT_DMA
+    ));
+  }
 
   // FAT mount config
   esp_vfs_fat_sdmmc_mount_config_t mount_config = {
@@ -64,117 +112,577 @@ void SdCardObject::initialize() {
     .use_one_fat = false
   };
   
-  ESP_ERROR_CHECK(esp_vfs_fat_sdspi_mount(
-    mount_point_.data(), 
-    &host, 
-    &slot_config, 
-    &mount_config, 
-    &card_
-  ));
+  // identification always runs at the probing clock; the driver then
+  // switches to max_freq_khz, so step down if the card cannot keep up
+  std::uint32_t frequency_khz = std::max<std::uint32_t>(
+    config_.interface == Interface::SDMMC && config_.high_speed ? SDMMC_FREQ_HIGHSPEED : config_.max_frequency_khz,
+    SDMMC_FREQ_PROBING);
+  esp_err_t err = ESP_FAIL;
+
+  while (true) {
+    err = mount_card(frequency_khz, mount_config);
+
+    if (err == ESP_OK || !is_mount_retryable(err) || frequency_khz <= SDMMC_FREQ_PROBING) {
+      break;
+    }
+
+    frequency_khz = std::max<std::uint32_t>(frequency_khz / 2, SDMMC_FREQ_PROBING);
+    ESP_LOGW(kComponentTag, "Mount failed (%s), retrying at %" PRIu32 " kHz", esp_err_to_name(err), frequency_khz);
+  }
+
+  ESP_ERROR_CHECK(err);
+  bus_frequency_khz_.store(card_->max_freq_khz);
   
-  ESP_LOGI(kComponentTag, "SD card mount was successful");
+  ESP_LOGI(kComponentTag, "SD card mount was successful (%s, %d-bit, %" PRIu32 " kHz)",
+    config_.interface == Interface::SDMMC ? "SDMMC" : "SPI", 1 << card_->log_bus_width, bus_frequency_khz_.load());
   
   // Create required directories
   assert(create_directories());
   
-  // Get and display all discovered MP3 files
-  file_paths_ = get_mp3_files();
-  ESP_LOGI(kComponentTag, "MP3 files on SD card:");
-  for (const auto& file : file_paths_) {
-    ESP_LOGI(kComponentTag, "\t%s", file.c_str());
+  // Load the cached library index; the rescan runs in task()
+  load_library();
+  ESP_LOGI(kComponentTag, "%zu MP3 files on SD card", library_.size());
+  for (LibraryIndex::TrackId id = 0; id < library_.size(); id++) {
+    ESP_LOGD(kComponentTag, "\t%s", library_.path(id).data());
   }
   
   // Read playback order
-  queue_ = read_playback_order();
-  ESP_LOGI(kComponentTag, "Found %zu files in playback order:", queue_.size());
-  for (const auto& file : queue_) {
-    ESP_LOGI(kComponentTag, "\t%s", file.c_str());
-  }
+  read_playback_order();
   
+  // qualify the card against the first track found
+  if (config_.run_benchmark && !library_.empty()) {
+    const auto result = benchmark(get_track_path(0).data());
+    if (result) {
+      ESP_LOGI(kComponentTag, "Benchmark at %" PRIu32 " kHz: sequential %" PRIu32 " KB/s, random %" PRIu32 " KB/s",
+        bus_frequency_khz_.load(), result->sequential_kbps, result->random_kbps);
+    }
+  }
+  if (config_.run_benchmark) {
+    const auto result = benchmark_library();
+    if (result) {
+      ESP_LOGI(kComponentTag, "Benchmark: index load %" PRIu32 " ms, scan %" PRIu32 " ms (%zu tracks), "
+        "playlist %" PRIu32 " ms (%zu entries)", result->index_load_ms, result->scan_ms, result->scanned_tracks,
+        result->playlist_ms, result->playlist_entries);
+    }
+  }
+
+  // boot needed the card at full speed; the rescan must not compete with
+  // the pipeline tasks sharing this core
+  vTaskPrioritySet(nullptr, static_cast<UBaseType_t>(ActiveObject::Priority::kLow));
+  scan_start_us_ = esp_timer_get_time();
+  if (scan_phase_ == ScanPhase::kDone) {
+    scan_boost_.release();
+  }
+
   ESP_LOGI(kComponentTag, "SD card initialization complete");
 }
 
 void SdCardObject::task() {
-  // Periodic SD card monitoring (no infinite loop - framework handles timing)
-  // Could check card status, file system health, etc.
-  // For now, just a placeholder
-  mark_as_done();
+  // playback refills come first; try again next period
+  auto grant = io_.acquire(IoScheduler::Class::kBackground, 0);
+  if (!grant) {
+    return;
+  }
+
+  switch (scan_phase_) {
+    case ScanPhase::kDirectories:
+      apply_playing_hint();
+      if (!scanner_.step(library_, kScanEntriesPerStep)) {
+        install_library();
+        scan_phase_ = ScanPhase::kMetadata;
+      }
+      break;
+
+    case ScanPhase::kMetadata:
+      if (!read_missing_metadata(kMetadataTracksPerStep, grant)) {
+        // after a failed scan the library may be missing tracks whose tables are still good
+        if (scanner_.has_failed()) {
+          scan_phase_ = ScanPhase::kDone;
+          break;
+        }
+
+        // no card I/O in there, so playback need not wait for it
+        grant.release();
+        collect_seek_keys();
+        scan_phase_ = ScanPhase::kSeekTables;
+      }
+      break;
+
+    case ScanPhase::kSeekTables:
+      if (!remove_stale_seek_tables(kScanEntriesPerStep, grant)) {
+        scan_phase_ = ScanPhase::kDone;
+      }
+      break;
+
+    case ScanPhase::kDone: {
+      const auto index_path = std::filesystem::path(mount_point_.data()) / kLibraryIndexPath;
+      if (library_.is_dirty() && !library_.save(index_path.c_str(), grant)) {
+        ESP_LOGE(kComponentTag, "Could not save library index");
+      }
+      grant.release();
+
+      const auto io = io_.get_stats();
+      ESP_LOGI(kComponentTag, "Library rescan finished in %" PRId64 " ms (%zu tracks, tags read for %zu)",
+        (esp_timer_get_time() - scan_start_us_) / 1000, library_.size(), metadata_read_);
+      ESP_LOGI(kComponentTag, "Card I/O: %" PRIu32 " playback / %" PRIu32 " background grants, %" PRIu32
+        " yields, playback waited up to %" PRIu32 " us", io.playback_grants, io.background_grants,
+        io.background_yields, io.playback_wait_max_us);
+      scan_boost_.release();
+      mark_as_done();
+      break;
+    }
+  }
 }
 
-bool SdCardObject::mount() {
+bool SdCardObject::mount() const {
   // Mount is handled in initialize()
   return card_ != nullptr;
 }
 
 void SdCardObject::unmount() {
   if (card_) {
+    // handles still lent out are the caller's problem, as with any open file
+    file_cache_.clear();
     ESP_ERROR_CHECK(esp_vfs_fat_sdcard_unmount(mount_point_.data(), card_));
     card_ = nullptr;
+    bus_frequency_khz_.store(0);
   }
 }
 
-std::vector<std::string> SdCardObject::get_mp3_files() {
-  std::vector<std::string> files;
-  std::error_code ec;
+esp_err_t SdCardObject::mount_card(const std::uint32_t frequency_khz, const esp_vfs_fat_sdmmc_mount_config_t& mount_config) {
+  if (config_.interface == Interface::SDMMC) {
+    sdmmc_host_t host = SDMMC_HOST_DEFAULT();
+    host.max_freq_khz = frequency_khz;
+
+    // slot 1 uses the IOMUX pins (CLK 14, CMD 15, D0 2, D1 4, D2 12, D3 13)
+    sdmmc_slot_config_t slot_config = SDMMC_SLOT_CONFIG_DEFAULT();
+    slot_config.width = config_.bus_width;
+    slot_config.flags |= SDMMC_SLOT_FLAG_INTERNAL_PULLUP;
+
+    return esp_vfs_fat_sdmmc_mount(
+      mount_point_.data(), 
+      &host, 
+      &slot_config, 
+      &mount_config, 
+      &card_
+    );
+  }
+
+  sdmmc_host_t host = SDSPI_HOST_DEFAULT();
+  host.max_freq_khz = frequency_khz;
+
+  sdspi_device_config_t slot_config = SDSPI_DEVICE_CONFIG_DEFAULT();
+  slot_config.gpio_cs = config_.cs;
+  slot_config.host_id = SDSPI_DEFAULT_HOST;
+
+  return esp_vfs_fat_sdspi_mount(
+    mount_point_.data(), 
+    &host, 
+    &slot_config, 
+    &mount_config, 
+    &card_
+  );
+}
+
+bool SdCardObject::reduce_bus_frequency(const IoScheduler::Grant& grant) {
+  // the clock must not change under a transfer of another task
+  if (!grant) {
+    LOGE(kComponentTag, "Bus clock change without a card grant");
+    return false;
+  }
+
+  const std::uint32_t current_khz = bus_frequency_khz_.load();
+  if (!card_ || current_khz <= SDMMC_FREQ_PROBING) {
+    return false;
+  }
+
+  const std::uint32_t frequency_khz = std::max<std::uint32_t>(current_khz / 2, SDMMC_FREQ_PROBING);
+  const esp_err_t err = card_->host.set_card_clk(card_->host.slot, frequency_khz);
+  if (err != ESP_OK) {
+    LOGE(kComponentTag, "Could not lower bus clock: %s", esp_err_to_name(err));
+    return false;
+  }
+
+  LOGW(kComponentTag, "Bus clock lowered from %" PRIu32 " to %" PRIu32 " kHz", current_khz, frequency_khz);
+  bus_frequency_khz_.store(frequency_khz);
+  card_->max_freq_khz = frequency_khz;
+  return true;
+}
 
-  const auto music_path = std::filesystem::path(mount_point_.data()) / "music";
-  std::filesystem::directory_iterator music_iter(music_path, ec), end{};
+std::optional<SdCardObject::BenchmarkResult> SdCardObject::benchmark(const std::string_view path) {
+  std::unique_ptr<FILE, FileGuard> file{fopen(std::string(path).c_str(), "rb")};
+  std::unique_ptr<std::uint8_t, HeapCapsGuard> buffer{static_cast<std::uint8_t*>(
+    heap_caps_malloc(kBenchmarkBlockSize, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL))};
 
-  if (ec) {
-    ESP_LOGE(kComponentTag, "Could not initialize directory_iterator: '%s'", music_path.c_str());
-    return {};
+  if (!file || !buffer) {
+    ESP_LOGE(kComponentTag, "Benchmark could not open '%.*s'", static_cast<int>(path.size()), path.data());
+    return std::nullopt;
   }
 
-  while (music_iter != end) {
-    const auto& entry = *music_iter;
+  // measure the card, not stdio
+  setvbuf(file.get(), nullptr, _IONBF, 0);
 
-    if (entry.is_regular_file() && entry.path().extension() == ".mp3") {
-      files.push_back(entry.path());
+  // sequential pass over (at most) the first few MB
+  std::size_t sequential_bytes = 0;
+  const std::int64_t sequential_start = esp_timer_get_time();
+  while (sequential_bytes < kBenchmarkMaxBytes) {
+    const std::size_t count = fread(buffer.get(), 1, kBenchmarkBlockSize, file.get());
+    sequential_bytes += count;
+    if (count < kBenchmarkBlockSize) {
+      break;
     }
+  }
+  const std::int64_t sequential_us = esp_timer_get_time() - sequential_start;
 
-    // move to next entry
-    music_iter.increment(ec);
-    if (ec) {
-      ESP_LOGE(kComponentTag, "Increment error: %s", ec.message().c_str());
+  const std::size_t blocks = sequential_bytes / kBenchmarkBlockSize;
+  if (blocks == 0) {
+    ESP_LOGE(kComponentTag, "Benchmark file is smaller than one block");
+    return std::nullopt;
+  }
+
+  // block-aligned reads at reproducible pseudo-random offsets
+  std::minstd_rand rng{blocks};
+  std::uniform_int_distribution<std::size_t> block_dist{0, blocks - 1};
+  std::size_t random_bytes = 0;
+  const std::int64_t random_start = esp_timer_get_time();
+  for (std::size_t i = 0; i < kBenchmarkRandomReads; i++) {
+    const long offset = static_cast<long>(block_dist(rng) * kBenchmarkBlockSize);
+    if (fseek(file.get(), offset, SEEK_SET) != 0) {
+      break;
     }
+    random_bytes += fread(buffer.get(), 1, kBenchmarkBlockSize, file.get());
   }
+  const std::int64_t random_us = esp_timer_get_time() - random_start;
 
-  return files;
+  return BenchmarkResult{
+    .sequential_kbps = to_kbps(sequential_bytes, sequential_us),
+    .random_kbps = to_kbps(random_bytes, random_us),
+  };
 }
 
-std::vector<std::string> SdCardObject::read_playback_order() {
-  std::vector<std::string> order;
+std::optional<SdCardObject::LibraryBenchmarkResult> SdCardObject::benchmark_library() {
+  const auto elapsed_ms = [](const std::int64_t start_us) {
+    return static_cast<std::uint32_t>((esp_timer_get_time() - start_us) / 1000);
+  };
+  LibraryBenchmarkResult result{};
+
+  // boot path: the index as persisted by the last scan
+  const auto index_path = std::filesystem::path(mount_point_.data()) / kLibraryIndexPath;
+  {
+    LibraryIndex index{StringArena::Placement::kPreferExternal};
+    const std::int64_t start_us = esp_timer_get_time();
+    if (index.load(index_path.c_str())) {
+      result.index_load_ms = elapsed_ms(start_us);
+    }
+  }
+
+  // rescan path: folders walked in one go, with the tags of unchanged files
+  // carried over from the current index, and the result sorted
+  {
+    const auto scanner = std::make_unique<LibraryScanner>(StringArena::Placement::kPreferExternal);
+    const std::int64_t start_us = esp_timer_get_time();
+    if (!scanner->begin(format_music_root().data())) {
+      return std::nullopt;
+    }
+    while (scanner->step(library_, std::numeric_limits<std::size_t>::max())) {}
+    result.scan_ms = elapsed_ms(start_us);
+
+    if (scanner->has_failed()) {
+      ESP_LOGE(kComponentTag, "Benchmark could not walk the music folder");
+      return std::nullopt;
+    }
+    result.scanned_tracks = scanner->get_result().total;
+  }
 
   const auto order_path = std::filesystem::path(mount_point_.data()) / kConfigPath;
   if (std::filesystem::exists(order_path)) {
-    // open the file
-    std::unique_ptr<FILE, FileGuard> file{fopen(order_path.c_str(), "r")};
-    
-    if (!file.get()) {
-      ESP_LOGE(kComponentTag, "Playback order file could not be opened, defaulting to filesystem order");
-      return get_mp3_files();
-    }
-
-    // Read file names from the order file
-    std::array<char, kMaxPathLength> line{'\0'};
-    while (fgets(line.data(), line.size(), file.get())) {
-      // Remove newline
-      line.at(strcspn(line.data(), "\n")) = '\0';
-      
-      if (strlen(line.data()) > 0) {
-        order.emplace_back(line.data());
-      }
+    const auto order = std::make_unique<PlaybackOrder>();
+    const std::int64_t start_us = esp_timer_get_time();
+    if (order->open(order_path.c_str(), library_)) {
+      result.playlist_ms = elapsed_ms(start_us);
+      result.playlist_entries = order->size();
     }
-    
-    return order;
-  } else {
+  }
+
+  return result;
+}
+
+std::array<char, SdCardObject::kMaxPathLength> SdCardObject::get_track_path(const LibraryIndex::TrackId id) const {
+  xSemaphoreTake(library_mutex_, portMAX_DELAY);
+  const auto path = format_track_path(id);
+  xSemaphoreGive(library_mutex_);
+  return path;
+}
+
+std::size_t SdCardObject::get_queue_size() const {
+  xSemaphoreTake(library_mutex_, portMAX_DELAY);
+  const std::size_t size = queue_.size();
+  xSemaphoreGive(library_mutex_);
+  return size;
+}
+
+std::optional<std::array<char, SdCardObject::kMaxPathLength>> SdCardObject::get_queue_track_path(const std::size_t position) const {
+  std::optional<std::array<char, kMaxPathLength>> path;
+
+  // only playlist entries need the card; a track is about to open, so
+  // that is playback I/O (the grant is always taken before the lock)
+  xSemaphoreTake(library_mutex_, portMAX_DELAY);
+  const bool reads_card = queue_.is_playlist() && position < queue_.size();
+  xSemaphoreGive(library_mutex_);
+
+  IoScheduler::Grant grant;
+  if (reads_card) {
+    grant = io_.acquire(IoScheduler::Class::kPlayback);
+  }
+
+  xSemaphoreTake(library_mutex_, portMAX_DELAY);
+  const auto id = queue_.resolve(position, library_);
+  if (id) {
+    path = format_track_path(*id);
+  }
+  xSemaphoreGive(library_mutex_);
+  return path;
+}
+
+std::optional<std::size_t> SdCardObject::find_queue_position(const std::string_view track_path,
+  const std::size_t near) const {
+  xSemaphoreTake(library_mutex_, portMAX_DELAY);
+  const bool reads_card = queue_.is_playlist();
+  xSemaphoreGive(library_mutex_);
+
+  IoScheduler::Grant grant;
+  if (reads_card) {
+    grant = io_.acquire(IoScheduler::Class::kBackground);
+  }
+
+  std::optional<std::size_t> position;
+  xSemaphoreTake(library_mutex_, portMAX_DELAY);
+  const auto id = library_.find(relative_path(track_path));
+  if (id) {
+    position = queue_.find(*id, near, library_);
+  }
+  xSemaphoreGive(library_mutex_);
+  return position;
+}
+
+void SdCardObject::hint_playing(const std::string_view track_path) {
+  // /sdcard/music/<folder>/<file> -> <folder>
+  auto relative = relative_path(track_path);
+  if (relative.empty()) {
+    return;
+  }
+
+  const std::size_t slash = relative.rfind('/');
+  relative = slash == std::string_view::npos ? std::string_view{} : relative.substr(0, slash);
+
+  xSemaphoreTake(library_mutex_, portMAX_DELAY);
+  const std::size_t length = std::min(relative.size(), playing_hint_.size() - 1);
+  std::memcpy(playing_hint_.data(), relative.data(), length);
+  playing_hint_[length] = '\0';
+  hint_pending_ = true;
+  xSemaphoreGive(library_mutex_);
+}
+
+std::uint32_t SdCardObject::get_path_hash(const std::string_view track_path) const {
+  return LibraryIndex::path_hash(relative_path(track_path));
+}
+
+std::string_view SdCardObject::relative_path(const std::string_view track_path) const {
+  // /sdcard/music/<folder>/<file> -> <folder>/<file>
+  const std::size_t root_length = strlen(mount_point_.data()) + 1 + kMusicDirectory.size() + 1;
+  return track_path.size() > root_length ? track_path.substr(root_length) : std::string_view{};
+}
+
+std::array<char, SdCardObject::kMaxPathLength> SdCardObject::format_music_root() const {
+  std::array<char, kMaxPathLength> root{'\0'};
+  snprintf(root.data(), root.size(), "%u:/%.*s",
+    static_cast<unsigned>(ff_diskio_get_pdrv_card(card_)),
+    static_cast<int>(kMusicDirectory.size()), kMusicDirectory.data());
+  return root;
+}
+
+std::array<char, SdCardObject::kMaxPathLength> SdCardObject::format_track_path(const LibraryIndex::TrackId id) const {
+  std::array<char, kMaxPathLength> path{'\0'};
+  const auto name = library_.path(id);
+  snprintf(path.data(), path.size(), "%s/%.*s/%.*s", mount_point_.data(),
+    static_cast<int>(kMusicDirectory.size()), kMusicDirectory.data(),
+    static_cast<int>(name.size()), name.data());
+  return path;
+}
+
+std::array<char, 64> SdCardObject::get_seek_table_path(const std::string_view track_path) const {
+  std::array<char, kMaxPathLength> directory{'\0'};
+  snprintf(directory.data(), directory.size(), "%s/%.*s", mount_point_.data(),
+    static_cast<int>(kSeekDirectory.size()), kSeekDirectory.data());
+  return SeekTable::path_for(directory.data(), track_path);
+}
+
+void SdCardObject::read_playback_order() {
+  queue_generation_.fetch_add(1);
+
+  const auto order_path = std::filesystem::path(mount_point_.data()) / kConfigPath;
+  if (!std::filesystem::exists(order_path)) {
     ESP_LOGI(kComponentTag, "No playback order specified, defaulting to filesystem order");
-    return get_mp3_files();
+    queue_.reset(library_.size());
+    return;
+  }
+
+  const std::int64_t start_us = esp_timer_get_time();
+  if (!queue_.open(order_path.c_str(), library_)) {
+    ESP_LOGE(kComponentTag, "Playback order file could not be opened, defaulting to filesystem order");
+    queue_.reset(library_.size());
+    return;
+  }
+
+  ESP_LOGI(kComponentTag, "Found %zu files in playback order (indexed in %" PRId64 " ms)",
+    queue_.size(), (esp_timer_get_time() - start_us) / 1000);
+}
+
+void SdCardObject::load_library() {
+  const auto index_path = std::filesystem::path(mount_point_.data()) / kLibraryIndexPath;
+  const bool cached = library_.load(index_path.c_str());
+  if (!cached) {
+    ESP_LOGI(kComponentTag, "No usable library index, rebuilding");
+  }
+
+  if (!scanner_.begin(format_music_root().data())) {
+    return;
+  }
+  scan_phase_ = ScanPhase::kDirectories;
+
+  // without an index there is nothing to play until the folder has been read
+  if (!cached) {
+    scanner_.step(library_, std::numeric_limits<std::size_t>::max());
+    install_library();
+    scan_phase_ = ScanPhase::kMetadata;
+  }
+}
+
+void SdCardObject::install_library() {
+  if (scanner_.has_failed()) {
+    ESP_LOGE(kComponentTag, "Library scan failed, keeping the cached index");
+    return;
+  }
+
+  const auto& result = scanner_.get_result();
+  ESP_LOGI(kComponentTag, "Library: %zu tracks (%zu added, %zu changed, %zu removed)",
+    result.total, result.added, result.changed, result.removed);
+
+  // an unchanged library keeps its index, and with it the queue positions
+  if (result.added == 0 && result.changed == 0 && result.removed == 0) {
+    return;
+  }
+
+  auto index = scanner_.take_index();
+  xSemaphoreTake(library_mutex_, portMAX_DELAY);
+  library_ = std::move(index);
+  read_playback_order();
+  xSemaphoreGive(library_mutex_);
+  metadata_cursor_ = 0;
+}
+
+bool SdCardObject::read_missing_metadata(const std::size_t max_tracks, const IoScheduler::Grant& grant) {
+  std::size_t read = 0;
+
+  for (; metadata_cursor_ < library_.size() && read < max_tracks && !grant.should_yield(); metadata_cursor_++) {
+    const LibraryIndex::TrackId id = metadata_cursor_;
+    if (library_.has_metadata(id)) {
+      continue;
+    }
+
+    // unreadable files are stored with empty metadata so they are not retried every boot
+    const auto path = format_track_path(id);
+    const auto metadata = tag_reader_.read(path.data());
+    if (!metadata) {
+      ESP_LOGW(kComponentTag, "No MP3 audio found in '%s'", path.data());
+    }
+    read++;
+
+    xSemaphoreTake(library_mutex_, portMAX_DELAY);
+    const bool stored = library_.set_metadata(id, metadata.value_or(TagReader::Metadata{}));
+    xSemaphoreGive(library_mutex_);
+
+    if (!stored) {
+      ESP_LOGE(kComponentTag, "Out of memory for track metadata");
+      return false;
+    }
+  }
+
+  metadata_read_ += read;
+  return metadata_cursor_ < library_.size();
+}
+
+void SdCardObject::collect_seek_keys() {
+  // tables are named after the absolute path the decoder opens
+  seek_keys_.clear();
+  seek_keys_.reserve(library_.size());
+  for (LibraryIndex::TrackId id = 0; id < library_.size(); id++) {
+    const auto path = format_track_path(id);
+    seek_keys_.push_back(SeekTable::key_for(path.data()));
+  }
+  std::sort(seek_keys_.begin(), seek_keys_.end());
+}
+
+bool SdCardObject::remove_stale_seek_tables(const std::size_t max_entries, const IoScheduler::Grant& grant) {
+  std::array<char, kMaxPathLength> directory{'\0'};
+  snprintf(directory.data(), directory.size(), "%u:/%.*s",
+    static_cast<unsigned>(ff_diskio_get_pdrv_card(card_)),
+    static_cast<int>(kSeekDirectory.size()), kSeekDirectory.data());
+
+  if (!seek_dir_open_) {
+    if (f_opendir(&seek_dir_, directory.data()) != FR_OK) {
+      ESP_LOGW(kComponentTag, "Could not open '%s'", directory.data());
+      seek_keys_.clear();
+      seek_keys_.shrink_to_fit();
+      return false;
+    }
+    seek_dir_open_ = true;
+    seek_tables_removed_ = 0;
+  }
+
+  FILINFO info;
+  for (std::size_t entries = 0; entries < max_entries && !grant.should_yield(); entries++) {
+    if (f_readdir(&seek_dir_, &info) != FR_OK || info.fname[0] == '\0') {
+      f_closedir(&seek_dir_);
+      seek_dir_open_ = false;
+      seek_keys_.clear();
+      seek_keys_.shrink_to_fit();
+      if (seek_tables_removed_ > 0) {
+        ESP_LOGI(kComponentTag, "Removed %zu stale seek tables", seek_tables_removed_);
+      }
+      return false;
+    }
+
+    // anything that is not a table name is left alone
+    const auto key = SeekTable::parse_key(info.fname);
+    if ((info.fattrib & AM_DIR) || !key || std::binary_search(seek_keys_.begin(), seek_keys_.end(), *key)) {
+      continue;
+    }
+
+    std::array<char, kMaxPathLength> path{'\0'};
+    const int length = snprintf(path.data(), path.size(), "%s/%s", directory.data(), info.fname);
+    if (length >= 0 && static_cast<std::size_t>(length) < path.size() && f_unlink(path.data()) == FR_OK) {
+      seek_tables_removed_++;
+    }
+  }
+
+  return true;
+}
+
+void SdCardObject::apply_playing_hint() {
+  std::array<char, kMaxPathLength> directory{'\0'};
+  xSemaphoreTake(library_mutex_, portMAX_DELAY);
+  const bool pending = std::exchange(hint_pending_, false);
+  directory = playing_hint_;
+  xSemaphoreGive(library_mutex_);
+
+  if (pending) {
+    scanner_.prioritize(directory.data());
   }
 }
 
 bool SdCardObject::create_directories() {
-  for (const auto& name : {"music", "config"}) {
+  for (const auto& name : {kMusicDirectory.data(), "config", kSeekDirectory.data()}) {
     const auto path = std::filesystem::path(mount_point_.data()) / name;
     
     std::error_code ec;
@@ -0,0 +1,403 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+#include <utility>
+
+#include "include/sd_stream.hpp"
+#include "telemetry.hpp"
+
+extern "C" {
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+}
+
+namespace {
+
+constexpr const char* kComponentTag = "SdStreamObject";
+constexpr std::uint32_t kIdleWaitMs = 100;
+
+}
+
+void SdStreamObject::PoolGuard::operator()(std::uint8_t* buffer) const noexcept {
+  MemoryPool::get(MemoryPool::Tier::kInternal).deallocate(buffer, kBufferSize);
+}
+
+SdStreamObject::Buffer SdStreamObject::allocate_buffer() {
+  Buffer buffer{static_cast<std::uint8_t*>(MemoryPool::get(MemoryPool::Tier::kInternal).allocate(kBufferSize))};
+  if (!buffer) {
+    ESP_LOGE(kComponentTag, "Could not allocate %zu byte DMA buffer", kBufferSize);
+  }
+  return buffer;
+}
+
+SdStreamObject::SdStreamObject(SdCardObject& card)
+  : StaticActiveObject("SdStreamObject", ActiveObject::Priority::kHigh, std::nullopt, ActiveObject::Workload::kStorage),
+    card_(card) {
+  request_mutex_ = xSemaphoreCreateMutexStatic(&request_mutex_buffer_);
+  free_sem_ = xSemaphoreCreateCountingStatic(kBufferCount, kBufferCount, &free_sem_buffer_);
+  filled_sem_ = xSemaphoreCreateCountingStatic(kBufferCount, 0, &filled_sem_buffer_);
+  wake_sem_ = xSemaphoreCreateBinaryStatic(&wake_sem_buffer_);
+
+  for (auto& slot : slots_) {
+    slot.data = allocate_buffer();
+  }
+
+  for (auto& buffer : prefetch_) {
+    buffer = allocate_buffer();
+  }
+}
+
+SdStreamObject::~SdStreamObject() {
+  // the reader must be stopped before the file and buffers go away
+  mark_as_done();
+  join();
+  close_file(file_);
+  close_file(next_file_);
+}
+
+bool SdStreamObject::open(const std::string_view path, const std::uint32_t offset) {
+  if (path.size() >= requested_path_.size()) {
+    ESP_LOGE(kComponentTag, "Path too long: '%.*s'", static_cast<int>(path.size()), path.data());
+    return false;
+  }
+
+  for (const auto& slot : slots_) {
+    if (!slot.data) {
+      return false;
+    }
+  }
+
+  if (!card_.mount()) {
+    ESP_LOGE(kComponentTag, "SD card is not mounted");
+    return false;
+  }
+
+  xSemaphoreTake(request_mutex_, portMAX_DELAY);
+  std::memcpy(requested_path_.data(), path.data(), path.size());
+  requested_path_[path.size()] = '\0';
+  requested_offset_ = offset;
+  requested_generation_.fetch_add(1);
+  xSemaphoreGive(request_mutex_);
+
+  xSemaphoreGive(wake_sem_);
+  return true;
+}
+
+void SdStreamObject::close() {
+  xSemaphoreTake(request_mutex_, portMAX_DELAY);
+  requested_path_[0] = '\0';
+  requested_generation_.fetch_add(1);
+  xSemaphoreGive(request_mutex_);
+
+  xSemaphoreGive(wake_sem_);
+}
+
+bool SdStreamObject::set_next(const std::string_view path) {
+  if (path.size() >= requested_next_path_.size()) {
+    ESP_LOGE(kComponentTag, "Path too long: '%.*s'", static_cast<int>(path.size()), path.data());
+    return false;
+  }
+
+  xSemaphoreTake(request_mutex_, portMAX_DELAY);
+  std::memcpy(requested_next_path_.data(), path.data(), path.size());
+  requested_next_path_[path.size()] = '\0';
+  requested_next_sequence_.fetch_add(1);
+  xSemaphoreGive(request_mutex_);
+
+  xSemaphoreGive(wake_sem_);
+  return true;
+}
+
+std::optional<SdStreamObject::Chunk> SdStreamObject::acquire(const TickType_t timeout) {
+  while (xSemaphoreTake(filled_sem_, timeout)) {
+    const auto& slot = slots_[read_index_];
+
+    // drop buffers queued for a file that has since been replaced
+    if (slot.generation != requested_generation_.load()) {
+      release();
+      continue;
+    }
+
+    const Mp3InfoTag* const info_tag = slot.track_start && slot.info_tag ? &*slot.info_tag : nullptr;
+    return Chunk{slot.data.get() + slot.start, slot.size, slot.end_of_stream, slot.track_start, slot.track_offset,
+      info_tag, slot.next_sequence};
+  }
+
+  return std::nullopt;
+}
+
+void SdStreamObject::release() {
+  read_index_ = (read_index_ + 1) % kBufferCount;
+  xSemaphoreGive(free_sem_);
+}
+
+void SdStreamObject::task() {
+  apply_request();
+  apply_next_request();
+
+  // background card work waits while half the ring or more is empty
+  auto& io = card_.get_io();
+  io.set_playback_demand((!end_of_file_ || has_next_) && uxSemaphoreGetCount(free_sem_) >= kBufferCount / 2);
+
+  if (end_of_file_) {
+    if (!has_next_) {
+      // nothing to read; sleep until open() or set_next() is called
+      xSemaphoreTake(wake_sem_, pdMS_TO_TICKS(kIdleWaitMs));
+      return;
+    }
+
+    promote_next();
+  }
+
+  TELEMETRY_LEVEL(kStreamFill, (kBufferCount - uxSemaphoreGetCount(free_sem_)) * 100 / kBufferCount);
+
+  // wait for the consumer to hand back a buffer
+  if (!xSemaphoreTake(free_sem_, pdMS_TO_TICKS(kIdleWaitMs))) {
+    return;
+  }
+
+  // refill every free slot under one grant, so the sector reads go out
+  // back to back instead of interleaving with background I/O
+  auto grant = io.acquire(IoScheduler::Class::kPlayback);
+  do {
+    auto& slot = slots_[write_index_];
+    if (!fill_slot(slot, grant)) {
+      xSemaphoreGive(free_sem_);
+      return;
+    }
+
+    slot.track_start = track_start_;
+    slot.generation = generation_;
+    if (track_start_) {
+      slot.track_offset = track_offset_;
+      slot.info_tag = track_info_tag_;
+      slot.next_sequence = track_sequence_;
+    }
+    track_start_ = false;
+    grant.consume(slot.size);
+
+    end_of_file_ = slot.end_of_stream;
+    write_index_ = (write_index_ + 1) % kBufferCount;
+    xSemaphoreGive(filled_sem_);
+  } while (!end_of_file_ && !grant.should_yield() && requested_generation_.load() == generation_ &&
+    xSemaphoreTake(free_sem_, 0));
+}
+
+bool SdStreamObject::fill_slot(Slot& slot, const IoScheduler::Grant& grant) {
+  // prefetched sectors are swapped in rather than copied; the first one
+  // may start with the end of a tag
+  if (current_uses_prefetch()) {
+    const std::size_t size = prefetch_size_[prefetch_index_];
+    const std::size_t start = prefetch_index_ == 0 ? std::min<std::size_t>(track_offset_ - prefetch_sector_, size) : 0;
+    std::swap(slot.data, prefetch_[prefetch_index_]);
+    slot.start = start;
+    slot.size = size - start;
+    slot.end_of_stream = size < kBufferSize;
+    prefetch_index_++;
+    return true;
+  }
+
+  slot.start = 0;
+
+  // the next track could not be opened; end it straight away
+  if (!file_) {
+    slot.size = 0;
+    slot.end_of_stream = true;
+    return true;
+  }
+
+  // full-sector, unbuffered reads go straight from FATFS into the DMA buffer
+  const long position = ftell(file_);
+  const std::int64_t begin_us = TELEMETRY_NOW();
+  slot.size = fread(slot.data.get(), 1, kBufferSize, file_);
+  slot.end_of_stream = slot.size < kBufferSize;
+  TELEMETRY_LATENCY(kCardRead, static_cast<std::uint32_t>(TELEMETRY_NOW() - begin_us));
+
+  if (ferror(file_)) {
+    clearerr(file_);
+
+    // most read errors on a marginal card are CRC errors; retry slower
+    if (card_.reduce_bus_frequency(grant) && fseek(file_, position, SEEK_SET) == 0) {
+      return false;
+    }
+
+    LOGE(kComponentTag, "Read error, ending stream early");
+    slot.end_of_stream = true;
+  }
+
+  return true;
+}
+
+void SdStreamObject::apply_request() {
+  if (requested_generation_.load() == generation_) {
+    return;
+  }
+
+  std::array<char, SdCardObject::kMaxPathLength> path{'\0'};
+  xSemaphoreTake(request_mutex_, portMAX_DELAY);
+  path = requested_path_;
+  const std::uint32_t offset = requested_offset_;
+  generation_ = requested_generation_.load();
+  xSemaphoreGive(request_mutex_);
+
+  close_file(file_);
+  end_of_file_ = true;
+  prefetch_index_ = prefetch_count_;
+  track_start_ = false;
+
+  if (path[0] == '\0') {
+    return;
+  }
+
+  // unbuffered, so full-sector reads go straight into our own buffers
+  auto grant = card_.get_io().acquire(IoScheduler::Class::kPlayback);
+  file_ = card_.get_file_cache().open(path.data(), offset);
+  if (!file_) {
+    return;
+  }
+
+  end_of_file_ = false;
+  card_.hint_playing(path.data());
+  LOGI(kComponentTag, "Streaming %c%08" PRIx32 " from byte %" PRIu32, PlaybackOrder::kIdPrefix,
+    card_.get_path_hash(path.data()), offset);
+}
+
+void SdStreamObject::apply_next_request() {
+  if (requested_next_sequence_.load() == next_sequence_) {
+    return;
+  }
+
+  // the buffers are still lent to the track that was just promoted; the
+  // request is picked up once the ring has taken them over
+  if (current_uses_prefetch()) {
+    return;
+  }
+
+  std::array<char, SdCardObject::kMaxPathLength> path{'\0'};
+  xSemaphoreTake(request_mutex_, portMAX_DELAY);
+  path = requested_next_path_;
+  next_sequence_ = requested_next_sequence_.load();
+  xSemaphoreGive(request_mutex_);
+
+  close_file(next_file_);
+  has_next_ = path[0] != '\0';
+  prefetch_count_ = 0;
+  next_offset_ = 0;
+  next_info_tag_ = std::nullopt;
+
+  if (!has_next_) {
+    return;
+  }
+
+  // do the open, directory lookup and first reads now rather than at the
+  // moment of the transition
+  auto grant = card_.get_io().acquire(IoScheduler::Class::kPlayback);
+  next_file_ = card_.get_file_cache().open(path.data());
+  if (!next_file_) {
+    return;
+  }
+  card_.hint_playing(path.data());
+
+  // leave it all to the regular read path, which knows how to retry
+  if (!prefetch_[0] || !locate_audio()) {
+    clearerr(next_file_);
+    fseek(next_file_, 0, SEEK_SET);
+    prefetch_count_ = 0;
+    next_offset_ = 0;
+    next_info_tag_ = std::nullopt;
+    LOGW(kComponentTag, "Could not prefetch %c%08" PRIx32, PlaybackOrder::kIdPrefix, card_.get_path_hash(path.data()));
+    return;
+  }
+
+  while (prefetch_count_ < kPrefetchCount && prefetch_[prefetch_count_] &&
+    prefetch_size_[prefetch_count_ - 1] == kBufferSize) {
+    const long position = ftell(next_file_);
+    const std::size_t size = fread(prefetch_[prefetch_count_].get(), 1, kBufferSize, next_file_);
+
+    if (ferror(next_file_)) {
+      clearerr(next_file_);
+      fseek(next_file_, position, SEEK_SET);
+      break;
+    }
+
+    prefetch_size_[prefetch_count_++] = size;
+  }
+
+  LOGD(kComponentTag, "Prefetched %" PRIu32 " sectors of %c%08" PRIx32 " from byte %" PRIu32 "%s",
+    static_cast<std::uint32_t>(prefetch_count_), PlaybackOrder::kIdPrefix, card_.get_path_hash(path.data()),
+    next_offset_, next_info_tag_ ? " (info frame parsed)" : "");
+}
+
+bool SdStreamObject::locate_audio() {
+  if (!load_first_sector(0)) {
+    return false;
+  }
+
+  // with a large tag (cover art) the first frame is in a later sector
+  std::uint32_t offset = static_cast<std::uint32_t>(id3v2_tag_size(prefetch_[0].get(), prefetch_size_[0]));
+  if (!load_first_sector(offset)) {
+    return false;
+  }
+
+  // a Xing/Info frame decodes to silence, so the decoder gets it parsed
+  // instead; one cut at the sector end is left for the decoder to parse
+  const std::size_t within = offset - prefetch_sector_;
+  if (within < prefetch_size_[0]) {
+    next_info_tag_ = Mp3InfoTag::parse(prefetch_[0].get() + within, prefetch_size_[0] - within);
+  }
+  if (next_info_tag_) {
+    offset += next_info_tag_->header.frame_bytes;
+    if (!load_first_sector(offset)) {
+      return false;
+    }
+  }
+
+  next_offset_ = offset;
+  return true;
+}
+
+bool SdStreamObject::load_first_sector(const std::uint32_t offset) {
+  const std::uint32_t sector = offset - offset % kBufferSize;
+  if (prefetch_count_ > 0 && sector == prefetch_sector_) {
+    return true;
+  }
+
+  prefetch_count_ = 0;
+  if (fseek(next_file_, sector, SEEK_SET) != 0) {
+    return false;
+  }
+
+  const std::size_t size = fread(prefetch_[0].get(), 1, kBufferSize, next_file_);
+  if (ferror(next_file_)) {
+    return false;
+  }
+
+  prefetch_sector_ = sector;
+  prefetch_size_[0] = size;
+  prefetch_count_ = 1;
+  return true;
+}
+
+bool SdStreamObject::current_uses_prefetch() const {
+  // before promote_next() the buffers hold the next track, not this one
+  return !has_next_ && prefetch_index_ < prefetch_count_;
+}
+
+void SdStreamObject::promote_next() {
+  // the finished track stays cached in case it is played again
+  close_file(file_);
+  file_ = std::exchange(next_file_, nullptr);
+  has_next_ = false;
+  prefetch_index_ = 0;
+  track_offset_ = next_offset_;
+  track_info_tag_ = std::exchange(next_info_tag_, std::nullopt);
+  track_sequence_ = next_sequence_;
+  track_start_ = true;
+  end_of_file_ = false;
+}
+
+void SdStreamObject::close_file(FILE*& file) {
+  card_.get_file_cache().close(std::exchange(file, nullptr));
+}
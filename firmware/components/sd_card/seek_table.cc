@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "include/seek_table.hpp"
+
+extern "C" {
+
+#include <sys/stat.h>
+
+#include "esp_log.h"
+
+}
+
+namespace {
+
+constexpr const char* kComponentTag = "SeekTable";
+constexpr std::string_view kTableSuffix = ".sk";
+constexpr std::string_view kTempSuffix = ".tmp";
+constexpr std::size_t kKeyDigits = 8;
+
+constexpr std::uint32_t kFnvOffset = 2166136261u;
+constexpr std::uint32_t kFnvPrime = 16777619u;
+
+struct FileGuard {
+  void operator()(FILE* file) const noexcept {
+    if (file) fclose(file);
+  }
+};
+
+std::uint32_t fnv1a(const void* data, const std::size_t size, std::uint32_t hash = kFnvOffset) {
+  const auto bytes = static_cast<const std::uint8_t*>(data);
+  for (std::size_t i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * kFnvPrime;
+  }
+  return hash;
+}
+
+/// @brief case-insensitive suffix check (FAT names are case-insensitive)
+bool ends_with(const std::string_view name, const std::string_view suffix) {
+  return name.size() >= suffix.size() && std::equal(suffix.begin(), suffix.end(), name.end() - suffix.size(),
+    [](const char a, const char b) { return a == std::tolower(static_cast<unsigned char>(b)); });
+}
+
+}
+
+std::optional<SeekTable::Source> SeekTable::stat_source(const char* path) {
+  struct stat info;
+  if (stat(path, &info) != 0) {
+    return std::nullopt;
+  }
+
+  return Source{static_cast<std::uint32_t>(info.st_size), static_cast<std::uint32_t>(info.st_mtime)};
+}
+
+std::array<char, 64> SeekTable::path_for(const std::string_view directory, const std::string_view track_path) {
+  std::array<char, 64> path{'\0'};
+  std::snprintf(path.data(), path.size(), "%.*s/%08" PRIx32 "%.*s",
+    static_cast<int>(directory.size()), directory.data(), key_for(track_path),
+    static_cast<int>(kTableSuffix.size()), kTableSuffix.data());
+  return path;
+}
+
+std::uint32_t SeekTable::key_for(const std::string_view track_path) {
+  return fnv1a(track_path.data(), track_path.size());
+}
+
+std::optional<std::uint32_t> SeekTable::parse_key(const std::string_view file_name) {
+  auto suffix = file_name.size() > kKeyDigits ? file_name.substr(kKeyDigits) : std::string_view{};
+  if (ends_with(suffix, kTempSuffix)) {
+    suffix.remove_suffix(kTempSuffix.size());
+  }
+  if (suffix.size() != kTableSuffix.size() || !ends_with(suffix, kTableSuffix)) {
+    return std::nullopt;
+  }
+
+  std::uint32_t key = 0;
+  const auto [end, error] = std::from_chars(file_name.data(), file_name.data() + kKeyDigits, key, 16);
+  if (error != std::errc{} || end != file_name.data() + kKeyDigits) {
+    return std::nullopt;
+  }
+  return key;
+}
+
+void SeekTable::reset(const Source& source, const std::uint32_t sample_rate, const std::uint16_t samples_per_frame) {
+  clear();
+  source_ = source;
+  sample_rate_ = sample_rate;
+  samples_per_frame_ = samples_per_frame;
+}
+
+void SeekTable::add_frame(const std::uint32_t offset) {
+  if (complete_) {
+    return;
+  }
+
+  if (frame_count_ % frames_per_entry_ == 0) {
+    // full: keep every other entry and double the spacing
+    if (offsets_.size() == kMaxEntries) {
+      for (std::size_t i = 0; i < kMaxEntries / 2; i++) {
+        offsets_[i] = offsets_[i * 2];
+      }
+      offsets_.resize(kMaxEntries / 2);
+      frames_per_entry_ *= 2;
+    }
+
+    if (frame_count_ % frames_per_entry_ == 0) {
+      offsets_.push_back(offset);
+    }
+  }
+
+  frame_count_++;
+}
+
+void SeekTable::clear() {
+  source_ = Source{};
+  sample_rate_ = 0;
+  samples_per_frame_ = 0;
+  frames_per_entry_ = kMinFramesPerEntry;
+  offsets_.clear();
+  frame_count_ = 0;
+  complete_ = false;
+}
+
+bool SeekTable::load(const char* path, const Source& source) {
+  std::unique_ptr<FILE, FileGuard> file{fopen(path, "rb")};
+  if (!file) {
+    return false;
+  }
+
+  Header header{};
+  if (fread(&header, sizeof(header), 1, file.get()) != 1 ||
+      header.magic != kMagic ||
+      header.version != kVersion ||
+      !(header.source == source) ||
+      header.frames_per_entry == 0 ||
+      header.sample_rate == 0 ||
+      header.entry_count == 0 ||
+      header.entry_count > kMaxEntries ||
+      (header.frame_count + header.frames_per_entry - 1) / header.frames_per_entry != header.entry_count) {
+    return false;
+  }
+
+  ExternalVector<std::uint32_t> offsets(header.entry_count);
+  if (fread(offsets.data(), sizeof(std::uint32_t), offsets.size(), file.get()) != offsets.size() ||
+      fnv1a(offsets.data(), offsets.size() * sizeof(std::uint32_t)) != header.checksum) {
+    ESP_LOGW(kComponentTag, "Table '%s' is corrupt", path);
+    return false;
+  }
+
+  source_ = header.source;
+  sample_rate_ = header.sample_rate;
+  samples_per_frame_ = static_cast<std::uint16_t>(header.samples_per_frame);
+  frames_per_entry_ = header.frames_per_entry;
+  offsets_ = std::move(offsets);
+  frame_count_ = header.frame_count;
+  complete_ = true;
+  return true;
+}
+
+bool SeekTable::save(const char* path, IoScheduler::Grant& grant) const {
+  if (!complete_ || offsets_.empty()) {
+    return false;
+  }
+
+  const std::string temp_path = std::string(path) + std::string(kTempSuffix);
+
+  {
+    std::unique_ptr<FILE, FileGuard> file{fopen(temp_path.c_str(), "wb")};
+    if (!file) {
+      ESP_LOGE(kComponentTag, "Could not create '%s'", temp_path.c_str());
+      return false;
+    }
+
+    const Header header = {
+      .magic = kMagic,
+      .version = kVersion,
+      .frames_per_entry = frames_per_entry_,
+      .source = source_,
+      .sample_rate = sample_rate_,
+      .samples_per_frame = samples_per_frame_,
+      .frame_count = frame_count_,
+      .entry_count = static_cast<std::uint32_t>(offsets_.size()),
+      .checksum = fnv1a(offsets_.data(), offsets_.size() * sizeof(std::uint32_t)),
+    };
+
+    // the grant sizes the writes; a stdio buffer would only split them again
+    setvbuf(file.get(), nullptr, _IONBF, 0);
+
+    const std::size_t offset_bytes = offsets_.size() * sizeof(std::uint32_t);
+    const bool written =
+      fwrite(&header, sizeof(header), 1, file.get()) == 1 &&
+      grant.write(file.get(), offsets_.data(), offset_bytes) == offset_bytes;
+
+    if (!written || fclose(file.release()) != 0) {
+      ESP_LOGE(kComponentTag, "Could not write '%s'", temp_path.c_str());
+      remove(temp_path.c_str());
+      return false;
+    }
+  }
+
+  // FAT rename does not replace an existing file
+  remove(path);
+  if (rename(temp_path.c_str(), path) != 0) {
+    ESP_LOGE(kComponentTag, "Could not replace '%s'", path);
+    return false;
+  }
+
+  return true;
+}
+
+std::optional<SeekTable::Point> SeekTable::find_frame(const std::uint32_t frame) const {
+  if (offsets_.empty()) {
+    return std::nullopt;
+  }
+
+  const std::size_t index = std::min<std::size_t>(frame / frames_per_entry_, offsets_.size() - 1);
+  return Point{static_cast<std::uint32_t>(index * frames_per_entry_), offsets_[index]};
+}
+
+std::optional<SeekTable::Point> SeekTable::find_time(const std::uint32_t position_ms) const {
+  if (sample_rate_ == 0 || samples_per_frame_ == 0) {
+    return std::nullopt;
+  }
+
+  const auto frame = static_cast<std::uint32_t>(
+    static_cast<std::uint64_t>(position_ms) * sample_rate_ / (1000ull * samples_per_frame_));
+  return find_frame(frame);
+}
+
+std::optional<SeekTable::Point> SeekTable::find_offset(const std::uint32_t offset) const {
+  const auto it = std::upper_bound(offsets_.begin(), offsets_.end(), offset);
+  if (it == offsets_.begin()) {
+    return std::nullopt;
+  }
+
+  const auto index = static_cast<std::uint32_t>(std::distance(offsets_.begin(), it) - 1);
+  return Point{index * frames_per_entry_, offsets_[index]};
+}
+
+std::uint32_t SeekTable::frame_to_ms(const std::uint32_t frame) const {
+  if (sample_rate_ == 0) {
+    return 0;
+  }
+
+  return static_cast<std::uint32_t>(static_cast<std::uint64_t>(frame) * samples_per_frame_ * 1000ull / sample_rate_);
+}
@@ -0,0 +1,407 @@
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include "include/tag_reader.hpp"
+#include "include/mp3_frame.hpp"
+
+namespace {
+
+constexpr std::size_t kId3HeaderSize = 10;
+constexpr std::uint8_t kId3Unsynchronised = 0x80;
+constexpr std::uint8_t kId3ExtendedHeader = 0x40;  // compression in v2.2
+constexpr std::uint8_t kId3Footer = 0x10;
+
+/// @brief v2.3 frame format flags
+constexpr std::uint8_t kV3Compressed = 0x80;
+constexpr std::uint8_t kV3Encrypted = 0x40;
+constexpr std::uint8_t kV3Grouped = 0x20;
+
+/// @brief v2.4 frame format flags
+constexpr std::uint8_t kV4Grouped = 0x40;
+constexpr std::uint8_t kV4Compressed = 0x08;
+constexpr std::uint8_t kV4Encrypted = 0x04;
+constexpr std::uint8_t kV4Unsynchronised = 0x02;
+constexpr std::uint8_t kV4DataLength = 0x01;
+
+/// @brief text read per frame; longer values are truncated to kMaxFieldLength anyway
+constexpr std::size_t kMaxTextBytes = 2 * TagReader::kMaxFieldLength + 3;
+
+/// @brief the VBRI header sits at a fixed distance from the frame header
+constexpr std::size_t kVbriOffset = 4 + 32;
+constexpr std::size_t kVbriFramesOffset = 14;
+
+/// @brief wanted text frames, v2.3/v2.4 and v2.2 identifiers
+enum Field : std::size_t { kTitle, kArtist, kAlbum, kTrack, kFieldCount };
+constexpr std::array<const char*, kFieldCount> kFrameIds = {"TIT2", "TPE1", "TALB", "TRCK"};
+constexpr std::array<const char*, kFieldCount> kFrameIdsV2 = {"TT2", "TP1", "TAL", "TRK"};
+
+/// @brief ID3 text encodings
+enum class Encoding : std::uint8_t { kLatin1, kUtf16, kUtf16Be, kUtf8 };
+
+struct FileGuard {
+  void operator()(FILE* file) const noexcept {
+    if (file) fclose(file);
+  }
+};
+
+std::uint32_t read_be(const std::uint8_t* data, const std::size_t bytes) {
+  std::uint32_t value = 0;
+  for (std::size_t i = 0; i < bytes; i++) {
+    value = (value << 8) | data[i];
+  }
+  return value;
+}
+
+/// @brief 28-bit integer stored 7 bits per byte
+std::uint32_t read_syncsafe(const std::uint8_t* data) {
+  return (static_cast<std::uint32_t>(data[0] & 0x7f) << 21) | (static_cast<std::uint32_t>(data[1] & 0x7f) << 14) |
+    (static_cast<std::uint32_t>(data[2] & 0x7f) << 7) | (data[3] & 0x7f);
+}
+
+bool read_at(FILE* file, const std::uint32_t offset, std::uint8_t* data, const std::size_t size) {
+  return fseek(file, static_cast<long>(offset), SEEK_SET) == 0 && fread(data, 1, size, file) == size;
+}
+
+/// @brief undo unsynchronisation (0xff 0x00 -> 0xff) in place
+std::size_t resynchronise(std::uint8_t* data, const std::size_t size) {
+  std::size_t out = 0;
+  for (std::size_t i = 0; i < size; i++) {
+    data[out++] = data[i];
+    if (data[i] == 0xff && i + 1 < size && data[i + 1] == 0x00) {
+      i++;
+    }
+  }
+  return out;
+}
+
+/// @brief appends code points to a field, dropping whatever does not fit whole
+class Utf8Writer {
+public:
+  explicit Utf8Writer(TagReader::Field& field) : field_(field) { field_[0] = '\0'; }
+
+  bool append(const std::uint32_t code_point) {
+    std::array<char, 4> bytes{};
+    std::size_t count = 0;
+    if (code_point < 0x80) {
+      bytes[count++] = static_cast<char>(code_point);
+    } else if (code_point < 0x800) {
+      bytes[count++] = static_cast<char>(0xc0 | (code_point >> 6));
+      bytes[count++] = static_cast<char>(0x80 | (code_point & 0x3f));
+    } else if (code_point < 0x10000) {
+      bytes[count++] = static_cast<char>(0xe0 | (code_point >> 12));
+      bytes[count++] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+      bytes[count++] = static_cast<char>(0x80 | (code_point & 0x3f));
+    } else {
+      bytes[count++] = static_cast<char>(0xf0 | (code_point >> 18));
+      bytes[count++] = static_cast<char>(0x80 | ((code_point >> 12) & 0x3f));
+      bytes[count++] = static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+      bytes[count++] = static_cast<char>(0x80 | (code_point & 0x3f));
+    }
+
+    if (length_ + count >= field_.size()) {
+      return false;
+    }
+
+    std::copy_n(bytes.begin(), count, field_.begin() + length_);
+    length_ += count;
+    field_[length_] = '\0';
+    return true;
+  }
+
+  /// @brief copy UTF-8 as is, cutting it on a character boundary
+  void append_utf8(const std::uint8_t* data, const std::size_t size) {
+    std::size_t end = std::min(size, field_.size() - 1 - length_);
+    if (end < size) {
+      while (end > 0 && (data[end] & 0xc0) == 0x80) {
+        end--;
+      }
+    }
+    std::copy_n(data, end, field_.begin() + length_);
+    length_ += end;
+    field_[length_] = '\0';
+  }
+
+private:
+  TagReader::Field& field_;
+  std::size_t length_{0};
+};
+
+/// @brief decode the first string of a text frame payload (encoding byte first)
+void decode_text(const std::uint8_t* data, const std::size_t size, TagReader::Field& field) {
+  Utf8Writer writer(field);
+  if (size < 2) {
+    return;
+  }
+
+  const auto encoding = static_cast<Encoding>(data[0]);
+  const std::uint8_t* text = data + 1;
+  std::size_t length = size - 1;
+
+  switch (encoding) {
+    case Encoding::kLatin1:
+      for (std::size_t i = 0; i < length && text[i] != 0 && writer.append(text[i]); i++) {}
+      break;
+
+    case Encoding::kUtf8:
+      writer.append_utf8(text, std::find(text, text + length, 0) - text);
+      break;
+
+    case Encoding::kUtf16:
+    case Encoding::kUtf16Be: {
+      // a byte order mark is mandatory for kUtf16, but rarely checked by writers
+      bool big_endian = encoding == Encoding::kUtf16Be;
+      if (length >= 2 && ((text[0] == 0xff && text[1] == 0xfe) || (text[0] == 0xfe && text[1] == 0xff))) {
+        big_endian = text[0] == 0xfe;
+        text += 2;
+        length -= 2;
+      }
+
+      const auto unit = [&](const std::size_t i) -> std::uint32_t {
+        return big_endian ? (text[i] << 8) | text[i + 1] : (text[i + 1] << 8) | text[i];
+      };
+
+      for (std::size_t i = 0; i + 1 < length; i += 2) {
+        std::uint32_t code_point = unit(i);
+        if (code_point == 0) {
+          break;
+        }
+        if (code_point >= 0xd800 && code_point < 0xdc00 && i + 3 < length) {
+          const std::uint32_t low = unit(i + 2);
+          if (low >= 0xdc00 && low < 0xe000) {
+            code_point = 0x10000 + ((code_point - 0xd800) << 10) + (low - 0xdc00);
+            i += 2;
+          }
+        }
+        if (!writer.append(code_point)) {
+          break;
+        }
+      }
+      break;
+    }
+
+    default:
+      break;
+  }
+}
+
+/// @brief track number from "3" or "3/12"
+std::uint16_t parse_track_number(const TagReader::Field& field) {
+  std::uint32_t value = 0;
+  for (const char c : field) {
+    if (c < '0' || c > '9' || value > 0xffff / 10) {
+      break;
+    }
+    value = value * 10 + (c - '0');
+  }
+  return static_cast<std::uint16_t>(value);
+}
+
+}
+
+std::optional<TagReader::Metadata> TagReader::read(const char* path) {
+  std::unique_ptr<FILE, FileGuard> file{fopen(path, "rb")};
+  if (!file) {
+    return std::nullopt;
+  }
+
+  // every read is small and then skips ahead; a stdio buffer would only fill
+  // itself with bytes about to be seeked past, FatFs keeps the sector anyway
+  setvbuf(file.get(), nullptr, _IONBF, 0);
+
+  if (fseek(file.get(), 0, SEEK_END) != 0) {
+    return std::nullopt;
+  }
+  const long size = ftell(file.get());
+  if (size <= 0) {
+    return std::nullopt;
+  }
+
+  return read(file.get(), static_cast<std::uint32_t>(size));
+}
+
+std::optional<TagReader::Metadata> TagReader::read(FILE* file, const std::uint32_t file_size) {
+  Metadata metadata{};
+  std::uint32_t audio_offset = 0;
+
+  // some taggers prepend a second tag instead of replacing the first
+  for (int tags = 0; tags < 2; tags++) {
+    const auto tag = read_tag_header(file, audio_offset);
+    if (!tag) {
+      break;
+    }
+
+    if (tags == 0) {
+      read_frames(file, *tag, metadata);
+    }
+    audio_offset = tag->end;
+  }
+
+  const auto duration = read_duration(file, audio_offset, file_size);
+  if (!duration) {
+    return std::nullopt;
+  }
+
+  metadata.duration_ms = *duration;
+  return metadata;
+}
+
+std::optional<TagReader::Tag> TagReader::read_tag_header(FILE* file, const std::uint32_t offset) {
+  std::array<std::uint8_t, kId3HeaderSize> header{};
+  if (!read_at(file, offset, header.data(), header.size()) || std::memcmp(header.data(), "ID3", 3) != 0 ||
+      header[3] < 2 || header[3] > 4) {
+    return std::nullopt;
+  }
+
+  const std::uint8_t flags = header[5];
+  const std::uint32_t frames_end = offset + kId3HeaderSize + read_syncsafe(header.data() + 6);
+
+  return Tag{
+    .version = header[3],
+    .flags = flags,
+    .frames_begin = offset + static_cast<std::uint32_t>(kId3HeaderSize),
+    .frames_end = frames_end,
+    .end = frames_end + ((flags & kId3Footer) ? static_cast<std::uint32_t>(kId3HeaderSize) : 0),
+  };
+}
+
+void TagReader::read_frames(FILE* file, const Tag& tag, Metadata& metadata) {
+  std::array<std::uint8_t, kId3HeaderSize> header{};
+  const std::uint32_t frames_end = tag.frames_end;
+  std::uint32_t position = tag.frames_begin;
+
+  if (tag.flags & kId3ExtendedHeader) {
+    // a v2.2 tag with this flag is compressed, and nothing defines how
+    if (tag.version == 2 || !read_at(file, position, header.data(), 4)) {
+      return;
+    }
+    position += tag.version == 4 ? read_syncsafe(header.data()) : 4 + read_be(header.data(), 4);
+  }
+
+  const std::size_t id_bytes = tag.version == 2 ? 3 : 4;
+  const std::size_t header_bytes = tag.version == 2 ? 6 : 10;
+  const auto& ids = tag.version == 2 ? kFrameIdsV2 : kFrameIds;
+  std::array<Field*, kFieldCount> fields = {&metadata.title, &metadata.artist, &metadata.album, nullptr};
+  Field track{};
+  unsigned found = 0;
+
+  while (position + header_bytes <= frames_end && found != (1u << kFieldCount) - 1) {
+    if (!read_at(file, position, header.data(), header_bytes)) {
+      return;
+    }
+
+    // padding
+    if (header[0] == 0) {
+      return;
+    }
+
+    const std::uint32_t size =
+      tag.version == 2 ? read_be(header.data() + 3, 3) :
+      tag.version == 3 ? read_be(header.data() + 4, 4) : read_syncsafe(header.data() + 4);
+    const std::uint32_t payload = position + header_bytes;
+    if (size == 0 || size > frames_end - payload) {
+      return;
+    }
+    position = payload + size;
+
+    std::size_t field = 0;
+    while (field < kFieldCount && std::memcmp(header.data(), ids[field], id_bytes) != 0) {
+      field++;
+    }
+    if (field == kFieldCount || (found & (1u << field))) {
+      continue;
+    }
+
+    // flags that put a prefix in front of the text, or make it unreadable
+    const std::uint8_t format = tag.version == 2 ? 0 : header[9];
+    std::uint32_t prefix = 0;
+    bool unsynchronised = (tag.flags & kId3Unsynchronised) != 0;
+    if (tag.version == 3) {
+      if (format & (kV3Compressed | kV3Encrypted)) {
+        continue;
+      }
+      prefix = (format & kV3Grouped) ? 1 : 0;
+    } else if (tag.version == 4) {
+      if (format & (kV4Compressed | kV4Encrypted)) {
+        continue;
+      }
+      prefix = ((format & kV4Grouped) ? 1 : 0) + ((format & kV4DataLength) ? 4 : 0);
+      unsynchronised = (format & kV4Unsynchronised) != 0;
+    }
+
+    if (prefix >= size) {
+      continue;
+    }
+
+    std::size_t length = std::min<std::size_t>(size - prefix, kMaxTextBytes);
+    if (!read_at(file, payload + prefix, buffer_.data(), length)) {
+      return;
+    }
+    if (unsynchronised) {
+      length = resynchronise(buffer_.data(), length);
+    }
+
+    decode_text(buffer_.data(), length, field == kTrack ? track : *fields[field]);
+    found |= 1u << field;
+  }
+
+  metadata.track_number = parse_track_number(track);
+}
+
+std::optional<std::uint32_t> TagReader::read_duration(FILE* file, const std::uint32_t offset, const std::uint32_t file_size) {
+  if (offset >= file_size || fseek(file, static_cast<long>(offset), SEEK_SET) != 0) {
+    return std::nullopt;
+  }
+
+  const std::size_t size = fread(buffer_.data(), 1, buffer_.size(), file);
+  const std::uint8_t* data = buffer_.data();
+
+  // skip junk between the tag and the audio, requiring a second header
+  // right behind the first one when it is in the buffer
+  std::size_t start = 0;
+  std::optional<Mp3FrameHeader> header;
+  for (; start + 4 <= size; start++) {
+    if (data[start] != 0xff || (data[start + 1] & 0xe0) != 0xe0) {
+      continue;
+    }
+
+    header = Mp3FrameHeader::parse(data + start, size - start);
+    if (!header) {
+      continue;
+    }
+
+    const std::size_t next = start + header->frame_bytes;
+    if (next + 4 > size || Mp3FrameHeader::parse(data + next, size - next)) {
+      break;
+    }
+    header.reset();
+  }
+
+  if (!header) {
+    return std::nullopt;
+  }
+
+  const auto to_ms = [&](const std::uint64_t samples) {
+    return static_cast<std::uint32_t>(samples * 1000 / header->sample_rate);
+  };
+
+  // Xing (VBR) or Info (CBR) tag, trimmed by the LAME delay/padding when present
+  const auto info = Mp3InfoTag::parse(data + start, size - start);
+  if (info && info->frames > 0) {
+    std::uint64_t samples = static_cast<std::uint64_t>(info->frames) * header->samples_per_frame;
+    if (info->has_lame) {
+      samples -= std::min<std::uint64_t>(samples, info->encoder_delay + info->encoder_padding);
+    }
+    return to_ms(samples);
+  }
+
+  // Fraunhofer VBRI tag
+  if (start + kVbriOffset + kVbriFramesOffset + 4 <= size && std::memcmp(data + start + kVbriOffset, "VBRI", 4) == 0) {
+    const std::uint32_t frames = read_be(data + start + kVbriOffset + kVbriFramesOffset, 4);
+    return to_ms(static_cast<std::uint64_t>(frames) * header->samples_per_frame);
+  }
+
+  // plain CBR: the bitrate of the first frame holds for the file
+  const std::uint64_t audio_bytes = file_size - offset - start;
+  return static_cast<std::uint32_t>(audio_bytes * 8 / header->bitrate_kbps);
+}
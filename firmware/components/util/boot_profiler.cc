@@ -0,0 +1,51 @@
+#include <cinttypes>
+
+#include "include/boot_profiler.hpp"
+
+extern "C" {
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+}
+
+namespace {
+
+constexpr const char* kComponentTag = "BootProfiler";
+
+std::uint32_t to_ms(const std::int64_t us) {
+  return static_cast<std::uint32_t>(us / 1000);
+}
+
+}
+
+void BootProfiler::mark(const char* name) {
+  if (phase_count_ < phases_.size()) {
+    phases_[phase_count_++] = Phase{name, esp_timer_get_time()};
+  }
+}
+
+void BootProfiler::report(const std::vector<std::shared_ptr<ActiveObject>>& components) const {
+  std::int64_t previous_us = 0;
+  for (std::size_t i = 0; i < phase_count_; i++) {
+    const auto& phase = phases_[i];
+    ESP_LOGI(kComponentTag, "%6" PRIu32 " ms (+%" PRIu32 " ms) %s",
+      to_ms(phase.time_us), to_ms(phase.time_us - previous_us), phase.name);
+    previous_us = phase.time_us;
+  }
+
+  for (const auto& component : components) {
+    if (!component->is_ready()) {
+      ESP_LOGI(kComponentTag, "%s: pending", component->get_name().data());
+      continue;
+    }
+
+    const auto& times = component->get_startup_times();
+    ESP_LOGI(kComponentTag, "%s: started %" PRIu32 " ms, waited %" PRIu32 " ms, initialize %" PRIu32 " ms, ready %" PRIu32 " ms",
+      component->get_name().data(),
+      to_ms(times.start_us),
+      to_ms(times.initialize_us - times.start_us),
+      to_ms(times.ready_us - times.initialize_us),
+      to_ms(times.ready_us));
+  }
+}
@@ -1,9 +1,17 @@
+#include <algorithm>
+#include <bit>
+#include <cinttypes>
+
 #include "include/component.hpp"
+#include "include/util.hpp"
 
 extern "C" {
 
+#include "esp_attr.h"
 #include "esp_log.h"
+#include "esp_memory_utils.h"
 #include "esp_task_wdt.h"
+#include "esp_timer.h"
 
 }
 
@@ -12,14 +20,31 @@ namespace {
 constexpr const char* kComponentTag = "ActiveObject";
 constexpr std::uint32_t kJoinWaitMs = 500;
 
+/// @brief state_group_ bit set once initialize() has returned
+constexpr EventBits_t kReadyBit = 1 << 0;
+
+/// @brief longest an event-driven task sleeps before petting the watchdog
+constexpr std::uint32_t kEventWaitMs = 1000;
+
+/// @brief how often each task logs its statistics line
+constexpr std::int64_t kStatsLogIntervalUs = 30 * 1000 * 1000;
+
+/// @brief histogram bin for an iteration time (log2 buckets)
+std::size_t histogram_bin(const std::uint32_t elapsed_us) {
+  using Stats = ActiveObject::Stats;
+  const auto bin = static_cast<std::size_t>(std::bit_width(elapsed_us / Stats::kHistogramBaseUs));
+  return std::min(bin, Stats::kHistogramBins - 1);
+}
+
 }
 
 ActiveObject::ActiveObject(const std::string_view name, 
                      const MemoryLoad load, 
                      const Priority priority,
                      const std::optional<std::uint32_t> thread_period_ms,
-                     const CorePreference core_pref) 
-  : load_(load), priority_(priority), thread_period_ms_(thread_period_ms), core_pref_(core_pref) {
+                     const CorePreference core_pref,
+                     const Trigger trigger) 
+  : load_(load), priority_(priority), thread_period_ms_(thread_period_ms), core_pref_(core_pref), trigger_(trigger) {
   // trim name if necessary
   const std::size_t copy_length = std::min(
     name.size(),
@@ -31,12 +56,27 @@ ActiveObject::ActiveObject(const std::string_view name,
   }
 
   name_[i] = '\0';
+
+  // created up front so events can be posted before start()
+  mailbox_ = xQueueCreateStatic(
+    kMailboxDepth,
+    sizeof(Event),
+    reinterpret_cast<std::uint8_t*>(mailbox_storage_.data()),
+    &mailbox_buffer_
+  );
+
+  state_group_ = xEventGroupCreateStatic(&state_group_buffer_);
 }
 
 ActiveObject::~ActiveObject() {
   ESP_LOGI(kComponentTag, "Ending task: '%s'", get_name().data());
   mark_as_done();
+
+  // wake the task if it is waiting on its mailbox
+  post(Event{Event::Type::kNone, 0, 0});
   join();
+
+  heap_caps_free(internal_tcb_);
 }
 
 bool ActiveObject::start() {
@@ -51,51 +91,121 @@ bool ActiveObject::start() {
     return false;
   }
 
+  startup_times_.start_us = esp_timer_get_time();
+
   // create the task
   const auto task_wrapper = [](void* self_arg) -> void {
     const auto self = static_cast<ActiveObject*>(self_arg);
     
     // add task to watchdog to track scheduling conflicts
     esp_task_wdt_add(nullptr);
-    
+
+    // everything is started at once; only wait for what we actually need
+    for (const auto* dependency : self->dependencies_) {
+      while (dependency && !self->done_.load() && !dependency->wait_until_ready(pdMS_TO_TICKS(kJoinWaitMs))) {}
+    }
+
     // single-run initialization routine
+    self->startup_times_.initialize_us = esp_timer_get_time();
     self->initialize();
+    self->startup_times_.ready_us = esp_timer_get_time();
+    xEventGroupSetBits(self->state_group_, kReadyBit);
     esp_task_wdt_reset();
     
     // initialize timing for drift-free periodic execution
-    TickType_t last_wake_time = xTaskGetTickCount();
+    TickType_t next_wake_time = xTaskGetTickCount();
+    std::int64_t last_log_us = esp_timer_get_time();
     
     // interior loop
     while (!self->done_.load()) {
-      // run the task and pet the watchdog
-      self->task();
-      esp_task_wdt_reset();
-      
-      // precise delay accounting for period and task iteration execution time
       if (self->thread_period_ms_) {
-        vTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(*self->thread_period_ms_));
+        // precise delay accounting for period and task iteration execution time,
+        // handling any events that arrive while waiting for the next period
+        const auto remaining = static_cast<std::int32_t>(next_wake_time - xTaskGetTickCount());
+        if (remaining > 0) {
+          self->dispatch(static_cast<TickType_t>(remaining));
+        } else {
+          const auto period = pdMS_TO_TICKS(*self->thread_period_ms_);
+          const bool late = -remaining >= static_cast<std::int32_t>(period);
+          next_wake_time += period;
+
+          const std::int64_t begin_us = esp_timer_get_time();
+          self->task();
+          self->record_iteration(begin_us, late);
+        }
+      } else if (self->trigger_ == Trigger::kEvent) {
+        // only wake when there is work
+        self->dispatch(pdMS_TO_TICKS(kEventWaitMs));
+      } else {
+        // drain pending events, then run the task back to back
+        while (self->dispatch(0)) {}
+
+        const std::int64_t begin_us = esp_timer_get_time();
+        self->task();
+        self->record_iteration(begin_us);
+      }
+
+      // pet the watchdog
+      esp_task_wdt_reset();
+
+      const std::int64_t now_us = esp_timer_get_time();
+      if (now_us - last_log_us >= kStatsLogIntervalUs) {
+        last_log_us = now_us;
+        self->log_stats();
       }
     }
 
+    esp_task_wdt_delete(nullptr);
+
     // release the binary join semaphore
     if (self->join_sem_handle_) {
       xSemaphoreGive(self->join_sem_handle_);
     }
 
-    esp_task_wdt_delete(nullptr);
-    vTaskDelete(nullptr);
+    // the joining task deletes us; a statically allocated TCB must not
+    // be left for the idle task to clean up after the object is gone
+    vTaskSuspend(nullptr);
   };
 
-  TaskHandle_t handle;
-  const BaseType_t result = xTaskCreatePinnedToCore(
-    task_wrapper,
-    name_.data(),
-    static_cast<configSTACK_DEPTH_TYPE>(load_),
-    static_cast<void*>(this),
-    static_cast<UBaseType_t>(priority_), 
-    &handle,
-    static_cast<BaseType_t>(core_pref_)
-  );
+  TaskHandle_t handle{nullptr};
+  BaseType_t result = pdFAIL;
+
+  if (static_stack_) {
+    StaticTask_t* tcb = static_tcb_;
+
+    // object placed in PSRAM; keep only the TCB in internal RAM
+    if (!esp_ptr_internal(tcb)) {
+      if (!internal_tcb_) {
+        internal_tcb_ = static_cast<StaticTask_t*>(
+          heap_caps_malloc(sizeof(StaticTask_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+      }
+      tcb = internal_tcb_;
+    }
+
+    if (tcb) {
+      handle = xTaskCreateStaticPinnedToCore(
+        task_wrapper,
+        name_.data(),
+        static_cast<std::uint32_t>(load_),
+        static_cast<void*>(this),
+        static_cast<UBaseType_t>(priority_),
+        static_stack_,
+        tcb,
+        static_cast<BaseType_t>(core_pref_)
+      );
+      result = handle ? pdPASS : pdFAIL;
+    }
+  } else {
+    result = xTaskCreatePinnedToCore(
+      task_wrapper,
+      name_.data(),
+      static_cast<configSTACK_DEPTH_TYPE>(load_),
+      static_cast<void*>(this),
+      static_cast<UBaseType_t>(priority_), 
+      &handle,
+      static_cast<BaseType_t>(core_pref_)
+    );
+  }
   
   if (handle && result == pdPASS) {
     task_handle_ = handle;
@@ -119,12 +229,181 @@ bool ActiveObject::join() {
     esp_task_wdt_reset();
   }
 
+  // the task suspends itself right after signalling; delete it from here
+  while (eTaskGetState(*task_handle_) != eSuspended) {
+    vTaskDelay(1);
+  }
+  vTaskDelete(*task_handle_);
+
   // clear the guards; should invalidate any other methods
   task_handle_ = std::nullopt;
   join_sem_handle_ = nullptr;
   return true;
 }
 
+bool ActiveObject::post(const Event& event, const TickType_t timeout) {
+  if (!mailbox_ || xQueueSend(mailbox_, &event, timeout) != pdTRUE) {
+    return false;
+  }
+
+  const BaseType_t core = current_core_.load();
+  if (core >= 0 && core != xPortGetCoreID()) {
+    cross_core_handoffs_.fetch_add(1);
+  }
+  return true;
+}
+
+bool IRAM_ATTR ActiveObject::post_from_isr(const Event& event) {
+  BaseType_t higher_priority_woken = pdFALSE;
+  const bool posted = mailbox_ && xQueueSendFromISR(mailbox_, &event, &higher_priority_woken) == pdTRUE;
+
+  // interrupts are allocated on the core that installed them
+  const BaseType_t core = current_core_.load();
+  if (posted && core >= 0 && core != xPortGetCoreID()) {
+    cross_core_handoffs_.fetch_add(1);
+  }
+
+  portYIELD_FROM_ISR(higher_priority_woken);
+  return posted;
+}
+
+void ActiveObject::record_handoff(const ActiveObject& producer) {
+  const BaseType_t core = producer.current_core_.load();
+  if (core >= 0 && core != xPortGetCoreID()) {
+    cross_core_handoffs_.fetch_add(1);
+  }
+}
+
+bool ActiveObject::dispatch(const TickType_t timeout) {
+  Event event;
+  if (xQueueReceive(mailbox_, &event, timeout) != pdTRUE) {
+    return false;
+  }
+
+  if (event.type != Event::Type::kNone) {
+    const std::int64_t begin_us = esp_timer_get_time();
+    on_event(event);
+    record_iteration(begin_us);
+  }
+
+  return true;
+}
+
+bool ActiveObject::depends_on(const ActiveObject& dependency) {
+  if (task_handle_ || &dependency == this) {
+    return false;
+  }
+
+  for (auto& slot : dependencies_) {
+    if (!slot || slot == &dependency) {
+      slot = &dependency;
+      return true;
+    }
+  }
+
+  ESP_LOGE(kComponentTag, "'%s' has too many dependencies", get_name().data());
+  return false;
+}
+
+bool ActiveObject::is_ready() const {
+  return xEventGroupGetBits(state_group_) & kReadyBit;
+}
+
+bool ActiveObject::wait_until_ready(const TickType_t timeout) const {
+  const TickType_t slice = pdMS_TO_TICKS(kJoinWaitMs);
+  TickType_t waited = 0;
+
+  while (true) {
+    const TickType_t wait = timeout == portMAX_DELAY ? slice : std::min(slice, timeout - waited);
+    if (xEventGroupWaitBits(state_group_, kReadyBit, pdFALSE, pdTRUE, wait) & kReadyBit) {
+      return true;
+    }
+
+    esp_task_wdt_reset();
+    waited += wait;
+
+    if (timeout != portMAX_DELAY && waited >= timeout) {
+      return false;
+    }
+  }
+}
+
+ActiveObject::Stats ActiveObject::get_stats() const {
+  portENTER_CRITICAL(&stats_lock_);
+  Stats stats = stats_;
+  const std::uint64_t total_us = total_us_;
+  portEXIT_CRITICAL(&stats_lock_);
+
+  stats.avg_us = stats.iterations ? static_cast<std::uint32_t>(total_us / stats.iterations) : 0;
+  stats.cross_core_handoffs = cross_core_handoffs_.load();
+
+  // task_handle_ is only safe to read from tasks other than our own
+  if (task_handle_) {
+    stats.stack_free_bytes = static_cast<std::uint32_t>(uxTaskGetStackHighWaterMark(*task_handle_));
+  }
+
+  return stats;
+}
+
+void ActiveObject::reset_stats() {
+  portENTER_CRITICAL(&stats_lock_);
+  const std::uint32_t stack_free_bytes = stats_.stack_free_bytes;
+  stats_ = Stats{};
+  stats_.stack_free_bytes = stack_free_bytes;
+  total_us_ = 0;
+  portEXIT_CRITICAL(&stats_lock_);
+  cross_core_handoffs_.store(0);
+}
+
+void ActiveObject::record_iteration(const std::int64_t begin_us, const bool deadline_missed) {
+  const auto elapsed_us = static_cast<std::uint32_t>(esp_timer_get_time() - begin_us);
+
+  // an unpinned task may have been moved by the scheduler
+  const BaseType_t core = xPortGetCoreID();
+  const BaseType_t previous_core = current_core_.exchange(core);
+
+  portENTER_CRITICAL(&stats_lock_);
+  stats_.core_switches += previous_core >= 0 && previous_core != core ? 1 : 0;
+  stats_.min_us = stats_.iterations ? std::min(stats_.min_us, elapsed_us) : elapsed_us;
+  stats_.max_us = std::max(stats_.max_us, elapsed_us);
+  stats_.iterations++;
+  stats_.deadline_misses += deadline_missed ? 1 : 0;
+  stats_.histogram[histogram_bin(elapsed_us)]++;
+  total_us_ += elapsed_us;
+  portEXIT_CRITICAL(&stats_lock_);
+}
+
+void ActiveObject::log_stats() {
+  // scanning the stack is slow-ish, so the task only samples it here
+  const auto stack_free_bytes = static_cast<std::uint32_t>(uxTaskGetStackHighWaterMark(nullptr));
+
+  portENTER_CRITICAL(&stats_lock_);
+  stats_.stack_free_bytes = stack_free_bytes;
+  const Stats stats = stats_;
+  const std::uint64_t total_us = total_us_;
+  portEXIT_CRITICAL(&stats_lock_);
+
+  // deferred, so printing never stalls the task being measured
+  static_assert(Stats::kHistogramBins == 10, "update the histogram format");
+  const auto& h = stats.histogram;
+  LOGI(kComponentTag, "%s: n=%" PRIu32 " us=%" PRIu32 "/%" PRIu32 "/%" PRIu32 " miss=%" PRIu32 " stack=%" PRIu32 "/%" PRIu32
+    " core=%d sw=%" PRIu32 " xc=%" PRIu32,
+    name_.data(),
+    stats.iterations,
+    stats.min_us,
+    stats.iterations ? static_cast<std::uint32_t>(total_us / stats.iterations) : 0,
+    stats.max_us,
+    stats.deadline_misses,
+    stack_free_bytes,
+    static_cast<std::uint32_t>(load_),
+    current_core_.load(),
+    stats.core_switches,
+    cross_core_handoffs_.load());
+  LOGI(kComponentTag, "%s: hist=%" PRIu32 "/%" PRIu32 "/%" PRIu32 "/%" PRIu32 "/%" PRIu32 "/%" PRIu32
+    "/%" PRIu32 "/%" PRIu32 "/%" PRIu32 "/%" PRIu32,
+    name_.data(), h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7], h[8], h[9]);
+}
+
 std::string_view ActiveObject::get_name() const {
   return std::string_view(name_.data());
 }
\ No newline at end of file
@@ -0,0 +1,163 @@
+#include <cinttypes>
+#include <cstdio>
+
+#include "include/deferred_log.hpp"
+#include "include/telemetry.hpp"
+
+extern "C" {
+
+#include "esp_timer.h"
+
+}
+
+namespace {
+
+constexpr const char* kComponentTag = "LogObject";
+
+static_assert((DeferredLog::kCapacity & (DeferredLog::kCapacity - 1)) == 0, "capacity must be a power of two");
+
+/**
+ * @brief Bounded multi-producer, single-consumer ring. Each slot carries a
+ * sequence number telling producers and the consumer whose turn it is, so
+ * producers only contend on one compare-and-swap and never wait on each other.
+ */
+class LogRing {
+public:
+  LogRing() {
+    for (std::uint32_t i = 0; i < slots_.size(); i++) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  bool push(const DeferredLog::Record& record) {
+    std::uint32_t position = enqueue_.load(std::memory_order_relaxed);
+    Slot* slot = nullptr;
+
+    while (true) {
+      slot = &slots_[position & kMask];
+      const std::uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+      const auto difference = static_cast<std::int32_t>(sequence - position);
+
+      if (difference == 0) {
+        if (enqueue_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (difference < 0) {
+        // the consumer has not freed this slot yet: full
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      } else {
+        position = enqueue_.load(std::memory_order_relaxed);
+      }
+    }
+
+    slot->record = record;
+    slot->sequence.store(position + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// @brief only called with draining_ held
+  bool pop(DeferredLog::Record& record) {
+    Slot& slot = slots_[dequeue_ & kMask];
+    if (slot.sequence.load(std::memory_order_acquire) != dequeue_ + 1) {
+      return false;
+    }
+
+    record = slot.record;
+    slot.sequence.store(dequeue_ + DeferredLog::kCapacity, std::memory_order_release);
+    dequeue_++;
+    return true;
+  }
+
+  bool try_lock() { return !draining_.exchange(true, std::memory_order_acquire); }
+  void unlock() { draining_.store(false, std::memory_order_release); }
+
+  std::uint32_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+  static constexpr std::uint32_t kMask = DeferredLog::kCapacity - 1;
+
+  struct Slot {
+    std::atomic<std::uint32_t> sequence;
+    DeferredLog::Record record;
+  };
+
+  std::array<Slot, DeferredLog::kCapacity> slots_{};
+  std::atomic<std::uint32_t> enqueue_{0};
+  std::uint32_t dequeue_{0};
+  std::atomic<bool> draining_{false};
+  std::atomic<std::uint32_t> dropped_{0};
+};
+
+LogRing ring;
+
+char level_letter(const DeferredLog::Level level) {
+  switch (level) {
+    case DeferredLog::Level::kError: return 'E';
+    case DeferredLog::Level::kWarn: return 'W';
+    case DeferredLog::Level::kInfo: return 'I';
+    case DeferredLog::Level::kDebug: return 'D';
+    default: return 'V';
+  }
+}
+
+}
+
+bool DeferredLog::push(Record& record) {
+  record.timestamp_ms = static_cast<std::uint32_t>(esp_timer_get_time() / 1000);
+  return ring.push(record);
+}
+
+std::size_t DeferredLog::drain() {
+  if (!ring.try_lock()) {
+    return 0;
+  }
+
+  std::size_t printed = 0;
+  Record record;
+  while (ring.pop(record)) {
+    const auto& a = record.arguments;
+    std::printf("%c (%" PRIu32 ") %s: ", level_letter(record.level), record.timestamp_ms, record.tag);
+    // unused trailing words are ignored by printf
+    std::printf(record.format, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9], a[10], a[11]);
+    std::putchar('\n');
+    printed++;
+  }
+
+  ring.unlock();
+  return printed;
+}
+
+std::uint32_t DeferredLog::get_dropped() {
+  return ring.dropped();
+}
+
+LogObject::LogObject()
+  : StaticActiveObject("LogObject", ActiveObject::Priority::kLow, kDrainPeriodMs, ActiveObject::Workload::kBackground) {}
+
+void LogObject::task() {
+  DeferredLog::drain();
+
+  const std::uint32_t dropped = DeferredLog::get_dropped();
+  if (dropped != reported_dropped_) {
+    std::printf("W %s: %" PRIu32 " log messages dropped\n", kComponentTag, dropped - reported_dropped_);
+    reported_dropped_ = dropped;
+  }
+
+  if constexpr (Telemetry::kEnabled) {
+    report_telemetry();
+  }
+}
+
+void LogObject::report_telemetry() {
+  const std::uint32_t underruns = Telemetry::get(Telemetry::Counter::kLinkUnderruns);
+  const auto now_ms = static_cast<std::uint32_t>(esp_timer_get_time() / 1000);
+  if (underruns == reported_underruns_ || now_ms - reported_telemetry_ms_ < kTelemetryReportMs) {
+    return;
+  }
+
+  std::printf("W %s: %" PRIu32 " Bluetooth underruns\n", kComponentTag, underruns - reported_underruns_);
+  Telemetry::print(Telemetry::snapshot());
+  reported_underruns_ = underruns;
+  reported_telemetry_ms_ = now_ms;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "component.hpp"
+
+/**
+ * @brief Timestamps the phases of app_main() and the startup of each
+ * ActiveObject, then logs the boot timeline in one report. All times are
+ * esp_timer microseconds, i.e. relative to early boot.
+ */
+class BootProfiler {
+public:
+  /// @brief number of app_main() phases that can be recorded
+  static constexpr std::size_t kMaxPhases = 16;
+
+  /// @brief record the end of a phase
+  /// @param name phase description; must be a string literal
+  void mark(const char* name);
+
+  /**
+   * @brief Log the recorded phases followed by each component's dependency
+   * wait and initialize() time. Components that are not ready yet are
+   * reported as pending.
+   */
+  void report(const std::vector<std::shared_ptr<ActiveObject>>& components) const;
+
+private:
+  struct Phase {
+    const char* name;
+    std::int64_t time_us;
+  };
+
+  std::array<Phase, kMaxPhases> phases_{};
+  std::size_t phase_count_{0};
+};
@@ -4,13 +4,19 @@
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <new>
 #include <optional>
 #include <string_view>
+#include <utility>
 
 extern "C" {
 
+#include "esp_heap_caps.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
 #include "freertos/semphr.h"
 
 }
@@ -35,19 +41,110 @@ public:
     kNone = tskNO_AFFINITY
   };
 
+  /// @brief what a task mostly does; decides its core through placement()
+  enum class Workload : std::uint8_t {
+    kRadio,       ///< drives the Bluetooth/WiFi stacks
+    kStorage,     ///< card I/O
+    kAudio,       ///< decoding and DSP, bound to the frame deadline
+    kBackground   ///< logging and housekeeping
+  };
+
+  /**
+   * @brief The placement policy. The radio controllers and their protocol
+   * stacks are pinned to core 0, so tasks that talk to them go there too
+   * and their handoffs stay on one core. The audio path from the card to
+   * the PCM ring gets core 1 to itself, where radio interrupts and stack
+   * tasks cannot preempt a frame decode. Background work may run anywhere.
+   */
+  static constexpr CorePreference placement(const Workload workload) {
+    switch (workload) {
+      case Workload::kRadio:
+        return CorePreference::kZero;
+      case Workload::kStorage:
+      case Workload::kAudio:
+        return CorePreference::kOne;
+      case Workload::kBackground:
+        break;
+    }
+    return CorePreference::kNone;
+  }
+
+  /// @brief what wakes the task when no thread period is set
+  enum class Trigger : std::uint8_t {
+    kContinuous,  ///< task() runs back to back and must block on its own
+    kEvent        ///< the task sleeps until a message arrives in its mailbox
+  };
+
+  /// @brief small, copyable message delivered through a mailbox
+  struct Event {
+    enum class Type : std::uint8_t {
+      kNone,        ///< no payload, only wakes the task
+      kButton,      ///< code: button id, value: press kind
+      kBufferReady, ///< code: buffer/stage id, value: fill level
+      kBluetooth,   ///< code: stack event id, value: event specific
+      kControl      ///< code: component specific command, value: argument
+    };
+
+    Type type;
+    std::uint16_t code;
+    std::uint32_t value;
+  };
+
+  /// @brief runtime statistics of the task loop (see get_stats)
+  struct Stats {
+    /// @brief histogram bin i counts iterations shorter than kHistogramBaseUs << i;
+    /// the last bin collects everything longer
+    static constexpr std::size_t kHistogramBins = 10;
+    static constexpr std::uint32_t kHistogramBaseUs = 128;
+
+    std::uint32_t iterations;       ///< task() runs and handled events
+    std::uint32_t min_us;           ///< shortest iteration
+    std::uint32_t avg_us;           ///< mean iteration
+    std::uint32_t max_us;           ///< longest iteration
+    std::uint32_t deadline_misses;  ///< periodic runs that started a period or more late
+    std::uint32_t stack_free_bytes; ///< lowest amount of unused stack ever seen
+    std::uint32_t core_switches;    ///< iterations that ran on another core than the one before
+    std::uint32_t cross_core_handoffs; ///< posts and record_handoff() calls from the other core
+    std::array<std::uint32_t, kHistogramBins> histogram;
+  };
+
+  /// @brief boot timeline of the task (esp_timer microseconds, 0 if not reached)
+  struct StartupTimes {
+    std::int64_t start_us;       ///< start() was called
+    std::int64_t initialize_us;  ///< dependencies were ready and initialize() began
+    std::int64_t ready_us;       ///< initialize() returned
+  };
+
   static constexpr std::size_t kMaxComponentNameLength = 32;
 
+  /// @brief number of objects one object can wait for at startup
+  static constexpr std::size_t kMaxDependencies = 4;
+
+  /// @brief number of events a mailbox can hold
+  static constexpr std::size_t kMailboxDepth = 8;
+
   /// @brief create a ActiveObject, which encapsulates the logic of an RTOS task
   /// @param name component identifier
   /// @param load memory/stack requirements
   /// @param priority task priority
   /// @param thread_period_ms how often the task function runs (milliseconds)
   /// @param core_pref core preference (0, 1, or none)
+  /// @param trigger what wakes the task when no period is given
   ActiveObject(const std::string_view name, 
             const MemoryLoad load, 
             const Priority priority, 
             const std::optional<std::uint32_t> thread_period_ms = std::nullopt,
-            const CorePreference core_pref = CorePreference::kNone);
+            const CorePreference core_pref = CorePreference::kNone,
+            const Trigger trigger = Trigger::kContinuous);
+
+  /// @brief see above; the core comes from the placement policy
+  ActiveObject(const std::string_view name, 
+            const MemoryLoad load, 
+            const Priority priority, 
+            const std::optional<std::uint32_t> thread_period_ms,
+            const Workload workload,
+            const Trigger trigger = Trigger::kContinuous)
+    : ActiveObject(name, load, priority, thread_period_ms, placement(workload), trigger) {}
 
   /// @brief ends the RTOS task
   ~ActiveObject();
@@ -59,6 +156,60 @@ public:
   /// @brief a name to identify this component
   std::string_view get_name() const;
 
+  /**
+   * @brief Delay initialize() until another object's initialize() has
+   * returned. Objects without a path between them initialize concurrently.
+   * Must be called before start(); the dependency must outlive startup.
+   * @return false if already started or out of dependency slots
+   */
+  bool depends_on(const ActiveObject& dependency);
+
+  /// @brief true once initialize() has returned (even if it marked the task done)
+  bool is_ready() const;
+
+  /**
+   * @brief Wait for initialize() to return, petting the caller's watchdog
+   * while waiting.
+   * @param timeout ticks to wait (portMAX_DELAY waits forever)
+   * @return false on timeout
+   */
+  bool wait_until_ready(const TickType_t timeout = portMAX_DELAY) const;
+
+  /// @brief startup timestamps; complete once is_ready() is true
+  const StartupTimes& get_startup_times() const { return startup_times_; }
+
+  /**
+   * @brief Deliver an event to this object's mailbox. Events are handled
+   * by on_event() in the object's own task, ahead of the next task() run.
+   * @param event message to deliver
+   * @param timeout ticks to wait if the mailbox is full
+   * @return false if the mailbox stayed full
+   */
+  bool post(const Event& event, const TickType_t timeout = 0);
+
+  /// @brief post() variant that is safe to call from an ISR (placed in IRAM)
+  bool post_from_isr(const Event& event);
+
+  /**
+   * @brief Snapshot of the loop statistics. Iteration times are wall-clock,
+   * so they include any blocking done inside task()/on_event().
+   */
+  Stats get_stats() const;
+
+  /// @brief clear the timing statistics (the stack high-water mark is kept)
+  void reset_stats();
+
+  /// @brief core the task last ran an iteration on (-1 before the first)
+  BaseType_t get_current_core() const { return current_core_.load(); }
+
+  /**
+   * @brief Count a handoff from another object, e.g. a buffer taken from its
+   * ring. Must be called from this object's task; handoffs where the
+   * producer last ran on the other core show up in the statistics.
+   * @param producer object that produced the data
+   */
+  void record_handoff(const ActiveObject& producer);
+
   /**
    * @brief Wait for the RTOS task to complete. It is the 
    * responsibility of the task that generated the ActiveObject 
@@ -70,6 +221,16 @@ protected:
   /// @brief mark this task as complete (see docs on done_)
   void mark_as_done() { done_.store(true); }
 
+  /**
+   * @brief Use caller-owned memory for the task instead of the heap
+   * (see StaticActiveObject). The stack must hold at least load bytes
+   * and both must outlive the task.
+   */
+  void set_static_storage(StackType_t* stack, StaticTask_t* tcb) {
+    static_stack_ = stack;
+    static_tcb_ = tcb;
+  }
+
 private:
   /// @brief perform any initializations necessary for the task function
   virtual void initialize() {}
@@ -77,8 +238,23 @@ private:
   /**
    * @brief Iteration of work to complete when this task occupies the CPU.
    * This function should never loop indefinitely and instead track state.
+   * Objects using Trigger::kEvent without a period never have it called.
    */
-  virtual void task() = 0;
+  virtual void task() {}
+
+  /// @brief handle a message from the mailbox (runs in this object's task)
+  virtual void on_event(const Event& /* event */) {}
+
+  /// @brief wait for and handle at most one message
+  /// @param timeout ticks to wait for a message
+  /// @return true if a message was handled
+  bool dispatch(const TickType_t timeout);
+
+  /// @brief account one iteration of work (runs in this object's task)
+  void record_iteration(const std::int64_t begin_us, const bool deadline_missed = false);
+
+  /// @brief emit the compact statistics line
+  void log_stats();
 
   /**
    * @brief The RTOS task handle. 
@@ -119,6 +295,19 @@ private:
   /// @brief core preference
   const CorePreference core_pref_{CorePreference::kNone};
 
+  /// @brief wake-up policy without a thread period
+  const Trigger trigger_{Trigger::kContinuous};
+
+  /// @brief objects whose initialize() must return before ours runs
+  std::array<const ActiveObject*, kMaxDependencies> dependencies_{};
+
+  /// @brief boot timeline, written before kReadyBit is set
+  StartupTimes startup_times_{};
+
+  /// @brief holds kReadyBit; an event group so several tasks can wait on it
+  StaticEventGroup_t state_group_buffer_{};
+  EventGroupHandle_t state_group_{nullptr};
+
   /// @brief Boolean indicating whether the task has completed or not.
   std::atomic<bool> done_{false};
 
@@ -127,4 +316,88 @@ private:
 
   /// @brief semaphore that releases on task completion
   SemaphoreHandle_t join_sem_handle_{nullptr};
-};
\ No newline at end of file
+
+  /// @brief caller-owned task memory (see set_static_storage)
+  StackType_t* static_stack_{nullptr};
+  StaticTask_t* static_tcb_{nullptr};
+
+  /**
+   * @brief FreeRTOS requires the TCB in internal RAM; if the object itself
+   * was placed in PSRAM, the TCB is moved to this internal block instead
+   */
+  StaticTask_t* internal_tcb_{nullptr};
+
+  /// @brief guards stats_ and total_us_ between the task and readers
+  mutable portMUX_TYPE stats_lock_ = portMUX_INITIALIZER_UNLOCKED;
+
+  /// @brief loop statistics, written by the task (and reset_stats) only
+  Stats stats_{};
+  std::uint64_t total_us_{0};
+
+  /// @brief core of the latest iteration, written by the task only
+  std::atomic<BaseType_t> current_core_{-1};
+
+  /// @brief counted by whichever task hands over to us, so kept out of stats_
+  std::atomic<std::uint32_t> cross_core_handoffs_{0};
+
+  /// @brief statically allocated mailbox
+  std::array<Event, kMailboxDepth> mailbox_storage_{};
+  StaticQueue_t mailbox_buffer_{};
+  QueueHandle_t mailbox_{nullptr};
+};
+
+/**
+ * @brief ActiveObject whose stack and TCB are embedded in the object, so
+ * that starting it never allocates. The stack size comes from the load.
+ */
+template <ActiveObject::MemoryLoad Load>
+class StaticActiveObject : public ActiveObject {
+public:
+  /// @brief see ActiveObject::ActiveObject (the load is a template argument)
+  StaticActiveObject(const std::string_view name, 
+                     const Priority priority, 
+                     const std::optional<std::uint32_t> thread_period_ms = std::nullopt,
+                     const CorePreference core_pref = CorePreference::kNone,
+                     const Trigger trigger = Trigger::kContinuous)
+    : ActiveObject(name, Load, priority, thread_period_ms, core_pref, trigger) {
+    set_static_storage(stack_.data(), &tcb_);
+  }
+
+  /// @brief see above; the core comes from the placement policy
+  StaticActiveObject(const std::string_view name, 
+                     const Priority priority, 
+                     const std::optional<std::uint32_t> thread_period_ms,
+                     const Workload workload,
+                     const Trigger trigger = Trigger::kContinuous)
+    : StaticActiveObject(name, priority, thread_period_ms, placement(workload), trigger) {}
+
+private:
+  /// @brief stack depth is given in bytes on ESP-IDF
+  static constexpr std::size_t kStackDepth = static_cast<std::size_t>(Load) / sizeof(StackType_t);
+
+  /// @brief task control block
+  StaticTask_t tcb_{};
+
+  /// @brief task stack
+  alignas(16) std::array<StackType_t, kStackDepth> stack_{};
+};
+
+/**
+ * @brief Construct an ActiveObject in memory with the given capabilities,
+ * e.g. MALLOC_CAP_SPIRAM for a StaticActiveObject whose stack may live in
+ * PSRAM (requires CONFIG_SPIRAM_ALLOW_STACK_EXTERNAL_MEMORY).
+ * @param caps heap capabilities for the whole object
+ * @return the object, or nullptr if the allocation failed
+ */
+template <typename T, typename... Args>
+std::shared_ptr<T> make_active_object(const std::uint32_t caps, Args&&... args) {
+  void* memory = heap_caps_aligned_alloc(alignof(T), sizeof(T), caps);
+  if (!memory) {
+    return nullptr;
+  }
+
+  return std::shared_ptr<T>(new (memory) T(std::forward<Args>(args)...), [](T* object) {
+    object->~T();
+    heap_caps_free(object);
+  });
+}
\ No newline at end of file
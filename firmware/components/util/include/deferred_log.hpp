@@ -0,0 +1,126 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "component.hpp"
+
+/**
+ * @brief Binary log ring. Writers store the address of the format string
+ * (its ID) and the raw argument words into a lock-free multi-producer ring;
+ * nothing is formatted until LogObject drains the ring from a low priority
+ * task, so logging never blocks on the UART.
+ *
+ * Because formatting is deferred, arguments must still be valid when the
+ * ring is drained: formats and %s arguments have to be string literals or
+ * other storage that outlives the message, never stack buffers. Arguments
+ * are 32-bit integers, enums or pointers (no floats or 64-bit values).
+ * Use the LOGE/LOGW/LOGI/LOGD/LOGV macros from util.hpp rather than calling
+ * this directly, so disabled levels compile away.
+ */
+class DeferredLog {
+public:
+  /// @brief severity, matching the LOG_LEVEL_* values in util.hpp
+  enum class Level : std::uint8_t {
+    kNone,
+    kError,
+    kWarn,
+    kInfo,
+    kDebug,
+    kVerbose
+  };
+
+  /// @brief most arguments a single message can carry
+  static constexpr std::size_t kMaxArguments = 12;
+
+  /// @brief messages the ring can hold before new ones are dropped
+  static constexpr std::size_t kCapacity = 64;
+
+  /// @brief one queued message
+  struct Record {
+    const char* tag;
+    const char* format;
+    std::uint32_t timestamp_ms;
+    Level level;
+    std::uint8_t count;
+    std::array<std::uintptr_t, kMaxArguments> arguments;
+  };
+
+  /**
+   * @brief Queue a message; never blocks. Safe to call from any task.
+   * @param format format string literal, also serves as the message ID
+   * @return false if the ring was full and the message was dropped
+   */
+  template <std::size_t N, typename... Args>
+  static bool write(const Level level, const char* tag, const char (&format)[N], const Args... args) {
+    static_assert(sizeof...(Args) <= kMaxArguments, "too many deferred log arguments");
+
+    Record record{
+      .tag = tag,
+      .format = format,
+      .timestamp_ms = 0,
+      .level = level,
+      .count = static_cast<std::uint8_t>(sizeof...(Args)),
+      .arguments = {to_word(args)...},
+    };
+    return push(record);
+  }
+
+  /**
+   * @brief Format and print everything queued so far. Only one caller
+   * drains at a time; concurrent calls return immediately.
+   * @return number of messages printed
+   */
+  static std::size_t drain();
+
+  /// @brief number of messages dropped because the ring was full
+  static std::uint32_t get_dropped();
+
+private:
+  /// @brief stamp and enqueue a record
+  static bool push(Record& record);
+
+  /// @brief store an argument as a machine word for printf
+  template <typename T>
+  static std::uintptr_t to_word(const T value) {
+    if constexpr (std::is_pointer_v<T>) {
+      return reinterpret_cast<std::uintptr_t>(value);
+    } else {
+      static_assert((std::is_integral_v<T> || std::is_enum_v<T>) && sizeof(T) <= sizeof(std::uint32_t),
+        "deferred log arguments must be 32-bit integers, enums or pointers");
+      return static_cast<std::uintptr_t>(value);
+    }
+  }
+};
+
+/**
+ * @brief Low priority task that drains the DeferredLog ring to the console.
+ * Start it before the components whose messages it should print.
+ */
+class LogObject : public StaticActiveObject<ActiveObject::MemoryLoad::kStandard> {
+public:
+  /// @brief how often the ring is drained
+  static constexpr std::uint32_t kDrainPeriodMs = 50;
+
+  /// @brief Bluetooth underruns get the telemetry printed, at most this often
+  static constexpr std::uint32_t kTelemetryReportMs = 10 * 1000;
+
+  LogObject();
+
+protected:
+  void task() override;
+
+private:
+  /// @brief print the telemetry if the link underran since the last report
+  void report_telemetry();
+
+  /// @brief dropped count already reported
+  std::uint32_t reported_dropped_{0};
+
+  /// @brief underrun count and time (ms) of the last telemetry report
+  std::uint32_t reported_underruns_{0};
+  std::uint32_t reported_telemetry_ms_{0};
+};
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+extern "C" {
+
+#include "freertos/FreeRTOS.h"
+
+}
+
+/**
+ * @brief Fixed-block allocator with one free list per size class. Blocks are
+ * carved out of slabs that are taken from the heap on demand and never given
+ * back, so once the pipeline has reached its working set every allocation
+ * is a free-list pop and the heap stops fragmenting.
+ *
+ * There is one pool per memory tier:
+ *  - kInternal: DMA-capable internal SRAM for hot buffers (card sectors,
+ *    PCM frames) that are recycled at audio rate,
+ *  - kExternal: PSRAM if available, internal SRAM otherwise, for cold data
+ *    such as the library index and seek tables.
+ * PSRAM is only there with CONFIG_SPIRAM, which the default configuration
+ * leaves off (the prototype board has none, and on the ESP32 it costs the
+ * cache workaround in all code), so as it stands both tiers live in
+ * internal SRAM. The first time kExternal falls back, a warning says so.
+ *
+ * Neither pool grows into the last kInternalReserveBytes of internal SRAM,
+ * which are left to the Bluetooth stack and the drivers. It is one reserve
+ * for both: a fallback is held to the same limit, not an extra one.
+ * Requests larger than the biggest size class go straight to the tier's
+ * heap, subject to the same reserve.
+ *
+ * Pools are safe to use from any task; the lock is only held for the list
+ * operation itself, never across a heap allocation.
+ */
+class MemoryPool {
+public:
+  /// @brief memory a pool draws its slabs from
+  enum class Tier : std::uint8_t {
+    kInternal,  ///< DMA-capable internal SRAM
+    kExternal   ///< PSRAM if available, internal SRAM otherwise
+  };
+
+  /// @brief block sizes, one free list each
+  static constexpr std::array<std::size_t, 8> kBlockSizes = {32, 64, 128, 256, 512, 1024, 2048, 4096};
+
+  /// @brief number of size classes
+  static constexpr std::size_t kClassCount = kBlockSizes.size();
+
+  /// @brief alignment of every block (a cache line, so DMA never shares one)
+  static constexpr std::size_t kAlignment = 32;
+
+  /// @brief bytes taken from the heap whenever a size class runs dry
+  static constexpr std::size_t kSlabBytes = 4096;
+
+  /// @brief internal SRAM that slab and large allocations never touch
+  static constexpr std::size_t kInternalReserveBytes = 48 * 1024;
+
+  /// @brief usage counters in bytes
+  struct Stats {
+    std::size_t slab_bytes;      ///< taken from the heap for slabs
+    std::size_t in_use_bytes;    ///< handed out in blocks right now
+    std::size_t large_bytes;     ///< handed out above the largest size class
+    std::uint32_t failures;      ///< requests that could not be served
+    bool external;               ///< true if any slab lives in PSRAM
+  };
+
+  /// @brief pool of a tier, created on first use
+  static MemoryPool& get(const Tier tier);
+
+  MemoryPool(const MemoryPool&) = delete;
+  MemoryPool& operator=(const MemoryPool&) = delete;
+
+  /// @brief allocate a block of at least size bytes
+  /// @return the block, or nullptr if the tier is exhausted
+  void* allocate(const std::size_t size);
+
+  /// @brief return a block obtained from allocate() with the same size
+  void deallocate(void* block, const std::size_t size);
+
+  /**
+   * @brief Pre-allocate blocks so a working set is in place before other
+   * components (e.g. the Bluetooth controller) claim internal SRAM.
+   * @param size block size as passed to allocate()
+   * @param count number of blocks that must be free afterwards
+   * @return false if the size is above the largest class or memory ran out
+   */
+  bool reserve(const std::size_t size, const std::size_t count);
+
+  /// @brief current usage
+  Stats get_stats() const;
+
+  /// @brief tier served by this pool
+  Tier tier() const { return tier_; }
+
+  /// @brief log usage of both pools
+  static void log_stats();
+
+  /// @brief abort with a message; used by allocators that cannot return null
+  [[noreturn]] static void out_of_memory(const Tier tier, const std::size_t size);
+
+private:
+  /// @brief free-list link stored in the first bytes of an unused block
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  explicit MemoryPool(const Tier tier);
+
+  /// @brief index of the smallest class holding size bytes
+  static std::optional<std::size_t> size_class(const std::size_t size);
+
+  /// @brief take bytes from the tier's heap, keeping the internal reserve
+  /// @param external set to true if the memory came from PSRAM
+  void* allocate_from_heap(const std::size_t bytes, bool& external);
+
+  /// @brief add a slab's worth of blocks to a size class
+  bool grow(const std::size_t index);
+
+  /// @brief warn, once, that the external tier is taking internal SRAM
+  void report_fallback();
+
+  /// @brief tier served by this pool
+  const Tier tier_;
+
+  /// @brief free blocks per size class, guarded by lock_
+  std::array<FreeBlock*, kClassCount> free_{};
+
+  /// @brief usage, guarded by lock_
+  Stats stats_{};
+
+  /// @brief report_fallback() has logged its warning
+  std::atomic<bool> fallback_reported_{false};
+
+  mutable portMUX_TYPE lock_ = portMUX_INITIALIZER_UNLOCKED;
+};
+
+/**
+ * @brief STL allocator backed by a MemoryPool tier. Allocation failure
+ * aborts, as std::allocator would without exceptions.
+ */
+template <typename T, MemoryPool::Tier kTier>
+class PoolAllocator {
+public:
+  static_assert(alignof(T) <= MemoryPool::kAlignment, "pool blocks are not aligned for this type");
+
+  using value_type = T;
+
+  template <typename U>
+  struct rebind {
+    using other = PoolAllocator<U, kTier>;
+  };
+
+  PoolAllocator() noexcept = default;
+
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U, kTier>&) noexcept {}
+
+  T* allocate(const std::size_t count) {
+    void* block = MemoryPool::get(kTier).allocate(count * sizeof(T));
+    if (!block) {
+      MemoryPool::out_of_memory(kTier, count * sizeof(T));
+    }
+    return static_cast<T*>(block);
+  }
+
+  void deallocate(T* block, const std::size_t count) noexcept {
+    MemoryPool::get(kTier).deallocate(block, count * sizeof(T));
+  }
+
+  template <typename U>
+  bool operator==(const PoolAllocator<U, kTier>&) const noexcept { return true; }
+};
+
+/// @brief vector in DMA-capable internal SRAM
+template <typename T>
+using InternalVector = std::vector<T, PoolAllocator<T, MemoryPool::Tier::kInternal>>;
+
+/// @brief vector in PSRAM (internal SRAM without it)
+template <typename T>
+using ExternalVector = std::vector<T, PoolAllocator<T, MemoryPool::Tier::kExternal>>;
+
+/// @brief string in PSRAM (internal SRAM without it)
+using ExternalString = std::basic_string<char, std::char_traits<char>, PoolAllocator<char, MemoryPool::Tier::kExternal>>;
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+/**
+ * @brief Fixed-point block kernels for interleaved PCM. Everything on the
+ * sample path is integer multiply-accumulate with 64-bit sums, which the
+ * ESP32 does in a MULL/MULSH pair without touching the FPU, so the cost per
+ * sample is fixed and independent of the signal. Floating point is only
+ * used to design coefficients when a setting changes.
+ */
+
+/// @brief maximum channels a kernel keeps state for
+constexpr std::size_t kPcmMaxChannels = 2;
+
+/// @brief widen 16-bit samples into a 32-bit work buffer
+inline void pcm_widen(const std::int16_t* input, std::int32_t* output, const std::size_t count) {
+  for (std::size_t i = 0; i < count; i++) {
+    output[i] = input[i];
+  }
+}
+
+/// @brief narrow a 32-bit work buffer to 16-bit samples, clipping
+inline void pcm_saturate(const std::int32_t* input, std::int16_t* output, const std::size_t count) {
+  for (std::size_t i = 0; i < count; i++) {
+    output[i] = static_cast<std::int16_t>(std::clamp<std::int32_t>(input[i],
+      std::numeric_limits<std::int16_t>::min(), std::numeric_limits<std::int16_t>::max()));
+  }
+}
+
+/**
+ * @brief Q15 gain that moves to a new value linearly across the next block
+ * instead of jumping, so volume changes do not produce zipper noise.
+ */
+class GainRamp {
+public:
+  /// @brief gain of 1.0
+  static constexpr std::int32_t kUnity = 1 << 15;
+
+  /// @brief upper bound accepted by set_target() (+12 dB)
+  static constexpr std::int32_t kMaxGain = 4 * kUnity;
+
+  /// @brief Q15 gain for a level in dB
+  static std::int32_t from_db(const float db);
+
+  /// @brief gain reached at the end of the next block
+  void set_target(const std::int32_t gain) { target_ = std::clamp<std::int32_t>(gain, 0, kMaxGain); }
+
+  /// @brief current and target gain
+  std::int32_t current() const { return current_; }
+  std::int32_t target() const { return target_; }
+
+  /// @brief true if process() would leave samples untouched
+  bool is_unity() const { return current_ == kUnity && target_ == kUnity; }
+
+  /// @brief apply the gain in place, clipping to 16 bits
+  void process(std::int16_t* samples, const std::size_t frames, const std::size_t channels);
+
+  /// @brief apply the gain in place to a work buffer
+  void process(std::int32_t* samples, const std::size_t frames, const std::size_t channels);
+
+private:
+  std::int32_t current_{kUnity};
+  std::int32_t target_{kUnity};
+};
+
+/**
+ * @brief Second-order IIR section (direct form I with first-order error
+ * feedback) with Q28 coefficients, designed from the RBJ cookbook shelf and
+ * peaking filters.
+ */
+class Biquad {
+public:
+  /// @brief fractional bits of the coefficients (range +-8)
+  static constexpr int kCoefficientBits = 28;
+
+  /// @brief filter shapes
+  enum class Shape : std::uint8_t {
+    kLowShelf,
+    kPeaking,
+    kHighShelf
+  };
+
+  /// @brief feed-forward and (negated) feedback coefficients
+  struct Coefficients {
+    std::int32_t b0;
+    std::int32_t b1;
+    std::int32_t b2;
+    std::int32_t a1;
+    std::int32_t a2;
+  };
+
+  /// @brief pass-through section
+  static constexpr Coefficients kFlat{1 << kCoefficientBits, 0, 0, 0, 0};
+
+  /// @brief design a section
+  /// @param gain_db boost (positive) or cut (negative) at the frequency
+  static Coefficients design(const Shape shape, const float frequency_hz, const float q,
+    const float gain_db, const std::uint32_t sample_rate);
+
+  /// @brief replace the coefficients, keeping the filter history
+  void set(const Coefficients& coefficients) { coefficients_ = coefficients; }
+
+  /// @brief forget the filter history, e.g. after a seek
+  void reset() { state_ = {}; }
+
+  /// @brief filter a work buffer in place
+  void process(std::int32_t* samples, const std::size_t frames, const std::size_t channels);
+
+private:
+  /// @brief two inputs and outputs of history per channel, plus the
+  /// truncation error of the last output (error feedback)
+  struct State {
+    std::int32_t x1;
+    std::int32_t x2;
+    std::int32_t y1;
+    std::int32_t y2;
+    std::int32_t error;
+  };
+
+  Coefficients coefficients_{kFlat};
+  std::array<State, kPcmMaxChannels> state_{};
+};
+
+/**
+ * @brief Sample rate converter by linear interpolation with a Q16 phase,
+ * for sinks that only take one rate. Good enough between the common MP3
+ * rates and 44.1 kHz: the encoder has already low-passed the audio well
+ * below the lower Nyquist frequency, so little aliases on the way down.
+ */
+class Resampler {
+public:
+  /// @brief fractional bits of the phase
+  static constexpr int kPhaseBits = 16;
+
+  /**
+   * @brief Set the conversion; a change starts over from silence.
+   * @return true if anything changed
+   */
+  bool configure(const std::uint32_t input_rate, const std::uint32_t output_rate, const std::size_t channels);
+
+  /// @brief true if the rates match and samples can be copied as they are
+  bool is_passthrough() const { return step_ == kOne; }
+
+  /// @brief input frames that are enough to produce the given output frames
+  std::size_t input_frames_for(const std::size_t output_frames) const {
+    return static_cast<std::size_t>((static_cast<std::uint64_t>(output_frames) * step_ + kOne - 1) >> kPhaseBits) + 1;
+  }
+
+  /**
+   * @brief Convert interleaved frames until the input or the output runs out.
+   * @param written set to the output frames produced
+   * @return input frames consumed; the caller keeps the rest for the next call
+   */
+  std::size_t process(const std::int16_t* input, const std::size_t frames, std::int16_t* output,
+    const std::size_t capacity, std::size_t& written);
+
+  /// @brief forget the last input frame
+  void reset();
+
+private:
+  static constexpr std::uint32_t kOne = 1u << kPhaseBits;
+
+  std::uint32_t input_rate_{0};
+  std::uint32_t output_rate_{0};
+  std::size_t channels_{1};
+
+  /// @brief input frames per output frame
+  std::uint32_t step_{kOne};
+
+  /// @brief position of the next output frame past last_, towards the next input frame
+  std::uint32_t phase_{kOne};
+  std::array<std::int16_t, kPcmMaxChannels> last_{};
+};
+
+/**
+ * @brief Peak limiter with instant attack and exponential release; channels
+ * share one gain so the stereo image does not shift while it works.
+ */
+class Limiter {
+public:
+  /// @brief ceiling, just below full scale
+  static constexpr std::int32_t kDefaultThreshold = 32000;
+
+  /// @brief release time constant as a power of two in frames (~46 ms)
+  static constexpr int kDefaultReleaseShift = 11;
+
+  explicit Limiter(const std::int32_t threshold = kDefaultThreshold, const int release_shift = kDefaultReleaseShift)
+    : threshold_(threshold), release_shift_(release_shift) {}
+
+  /// @brief limit a work buffer into 16-bit samples
+  void process(const std::int32_t* input, std::int16_t* output, const std::size_t frames, const std::size_t channels);
+
+  /// @brief current gain reduction (Q15, kUnity when idle)
+  std::int32_t get_gain() const { return gain_; }
+
+  /// @brief return to unity gain
+  void reset() { gain_ = GainRamp::kUnity; }
+
+private:
+  const std::int32_t threshold_;
+  const int release_shift_;
+  std::int32_t gain_{GainRamp::kUnity};
+};
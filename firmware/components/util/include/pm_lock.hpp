@@ -0,0 +1,67 @@
+#pragma once
+
+extern "C" {
+
+#include "esp_pm.h"
+
+}
+
+/**
+ * @brief Power management lock owned by a single task. Unlike the raw
+ * esp_pm locks, which count, acquire()/release() are idempotent, so the
+ * owner can simply state what it needs on every iteration. Without
+ * CONFIG_PM_ENABLE the lock cannot be created and every call is a no-op.
+ */
+class PmLock {
+public:
+  /// @brief create the lock
+  /// @param type what the lock holds (e.g. ESP_PM_CPU_FREQ_MAX)
+  /// @param name lock name shown by esp_pm_dump_locks(); must be a string literal
+  PmLock(const esp_pm_lock_type_t type, const char* name) {
+    if (esp_pm_lock_create(type, 0, name, &handle_) != ESP_OK) {
+      handle_ = nullptr;
+    }
+  }
+
+  /// @brief release and delete the lock on destruction
+  ~PmLock() {
+    if (handle_) {
+      release();
+      esp_pm_lock_delete(handle_);
+    }
+  }
+
+  PmLock(const PmLock&) = delete;
+  PmLock& operator=(const PmLock&) = delete;
+
+  /// @brief hold the lock if not held already
+  void acquire() {
+    if (handle_ && !held_) {
+      held_ = esp_pm_lock_acquire(handle_) == ESP_OK;
+    }
+  }
+
+  /// @brief let go of the lock if held
+  void release() {
+    if (handle_ && held_) {
+      esp_pm_lock_release(handle_);
+      held_ = false;
+    }
+  }
+
+  /// @brief acquire() or release()
+  void set(const bool held) {
+    if (held) {
+      acquire();
+    } else {
+      release();
+    }
+  }
+
+  /// @brief true while the lock is held
+  bool is_held() const { return held_; }
+
+private:
+  esp_pm_lock_handle_t handle_{nullptr};
+  bool held_{false};
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * @brief Lock-free single-producer/single-consumer ring buffer.
+ *
+ * Exactly one task may call the producer methods (reserve, commit, write,
+ * write_position) and exactly one task may call the consumer methods (peek,
+ * release, read, discard_until). Neither side ever blocks or takes a lock;
+ * callers that need to wait layer their own signalling on top, ideally only
+ * on the empty/full transitions.
+ *
+ * Positions are free-running counters, so the capacity must be a power of
+ * two. The two indices live on separate cache lines to avoid false sharing
+ * when the buffer is placed in cached (PSRAM) memory.
+ */
+template <typename T, std::size_t Capacity>
+class SpscRing {
+public:
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+  static_assert(std::is_trivially_copyable_v<T>, "elements are moved with memcpy");
+
+  /// @brief ESP32 cache line size
+  static constexpr std::size_t kCacheLineSize = 32;
+
+  /// @brief contiguous region of the ring
+  template <typename U>
+  struct Span {
+    U* data;
+    std::size_t size;
+  };
+
+  /// @brief capacity in elements
+  static constexpr std::size_t capacity() { return Capacity; }
+
+  /// @brief elements currently readable (approximate from the producer side)
+  std::size_t size() const {
+    return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+  }
+
+  /// @brief elements currently writable (approximate from the consumer side)
+  std::size_t available() const { return Capacity - size(); }
+
+  /// @brief true if there is nothing to read
+  bool empty() const { return size() == 0; }
+
+  /**
+   * @brief Producer: borrow the next contiguous writable region. It may be
+   * shorter than requested at the wrap point or when the ring is nearly full.
+   * @param max largest region wanted
+   */
+  Span<T> reserve(const std::size_t max = Capacity) {
+    const std::size_t head = head_.load(std::memory_order_relaxed);
+    const std::size_t tail = tail_.load(std::memory_order_acquire);
+    const std::size_t index = head & kMask;
+    const std::size_t count = std::min({max, Capacity - (head - tail), Capacity - index});
+    return Span<T>{storage_.data() + index, count};
+  }
+
+  /// @brief producer: publish elements written into the reserved region
+  void commit(const std::size_t count) {
+    head_.store(head_.load(std::memory_order_relaxed) + count, std::memory_order_release);
+  }
+
+  /// @brief producer: copy in as many elements as fit
+  /// @return number of elements written
+  std::size_t write(const T* data, const std::size_t count) {
+    std::size_t written = 0;
+
+    // at most two spans: up to the wrap point, then from the start
+    while (written < count) {
+      const auto span = reserve(count - written);
+      if (span.size == 0) {
+        break;
+      }
+
+      std::memcpy(span.data, data + written, span.size * sizeof(T));
+      commit(span.size);
+      written += span.size;
+    }
+
+    return written;
+  }
+
+  /// @brief producer: position just past the last committed element
+  std::size_t write_position() const { return head_.load(std::memory_order_relaxed); }
+
+  /// @brief consumer: borrow the next contiguous readable region
+  /// @param max largest region wanted
+  Span<const T> peek(const std::size_t max = Capacity) const {
+    const std::size_t tail = tail_.load(std::memory_order_relaxed);
+    const std::size_t head = head_.load(std::memory_order_acquire);
+    const std::size_t index = tail & kMask;
+    const std::size_t count = std::min({max, head - tail, Capacity - index});
+    return Span<const T>{storage_.data() + index, count};
+  }
+
+  /// @brief consumer: hand elements obtained from peek() back to the producer
+  void release(const std::size_t count) {
+    tail_.store(tail_.load(std::memory_order_relaxed) + count, std::memory_order_release);
+  }
+
+  /// @brief consumer: copy out as many elements as are available
+  /// @return number of elements read
+  std::size_t read(T* data, const std::size_t count) {
+    std::size_t consumed = 0;
+
+    while (consumed < count) {
+      const auto span = peek(count - consumed);
+      if (span.size == 0) {
+        break;
+      }
+
+      std::memcpy(data + consumed, span.data, span.size * sizeof(T));
+      release(span.size);
+      consumed += span.size;
+    }
+
+    return consumed;
+  }
+
+  /**
+   * @brief Consumer: drop everything written before a producer position
+   * (see write_position()), e.g. audio queued for a track that was skipped.
+   * Positions that were already consumed are ignored.
+   */
+  void discard_until(const std::size_t position) {
+    const std::size_t tail = tail_.load(std::memory_order_relaxed);
+    const std::size_t head = head_.load(std::memory_order_acquire);
+
+    if (position - tail <= head - tail) {
+      tail_.store(position, std::memory_order_release);
+    }
+  }
+
+private:
+  static constexpr std::size_t kMask = Capacity - 1;
+
+  /// @brief free-running write position, only stored by the producer
+  alignas(kCacheLineSize) std::atomic<std::size_t> head_{0};
+
+  /// @brief free-running read position, only stored by the consumer
+  alignas(kCacheLineSize) std::atomic<std::size_t> tail_{0};
+
+  /// @brief element storage
+  alignas(kCacheLineSize) std::array<T, Capacity> storage_{};
+};
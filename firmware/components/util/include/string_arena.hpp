@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+/**
+ * @brief Append-only table of packed, null-terminated strings held in a
+ * single heap block. Strings are referred to by 32-bit offsets rather than
+ * pointers, so the block can grow (and move) without invalidating them.
+ */
+class StringArena {
+public:
+  /// @brief position of a string inside the arena
+  using Offset = std::uint32_t;
+
+  /// @brief where the backing block should live
+  enum class Placement : std::uint8_t {
+    kInternal,        ///< internal SRAM only
+    kPreferExternal   ///< PSRAM if available, internal SRAM otherwise
+  };
+
+  /// @brief create an empty arena (no allocation until first use)
+  /// @param placement memory the arena should be placed in
+  explicit StringArena(const Placement placement = Placement::kInternal);
+
+  /// @brief release the backing block
+  ~StringArena();
+
+  StringArena(const StringArena&) = delete;
+  StringArena& operator=(const StringArena&) = delete;
+
+  StringArena(StringArena&& other) noexcept;
+  StringArena& operator=(StringArena&& other) noexcept;
+
+  /// @brief make room for at least capacity bytes in total
+  /// @return false if the allocation failed
+  bool reserve(const std::size_t capacity);
+
+  /// @brief append a string and its terminator
+  /// @return offset of the stored string, or nothing if out of memory
+  std::optional<Offset> add(const std::string_view value);
+
+  /**
+   * @brief Append uninitialized space, e.g. to read a serialized table
+   * straight into the arena.
+   * @return pointer to the new space, or nullptr if out of memory.
+   * Only valid until the next call that may grow the arena.
+   */
+  char* extend(const std::size_t bytes);
+
+  /// @brief string stored at an offset returned by add()
+  std::string_view get(const Offset offset) const { return std::string_view(data_ + offset); }
+
+  /// @brief forget all strings while keeping the backing block
+  void clear() { size_ = 0; }
+
+  /// @brief raw table contents
+  const char* data() const { return data_; }
+
+  /// @brief bytes in use
+  std::size_t size() const { return size_; }
+
+  /// @brief bytes allocated
+  std::size_t capacity() const { return capacity_; }
+
+  /// @brief requested placement
+  Placement placement() const { return placement_; }
+
+  /// @brief true if the backing block lives in external PSRAM
+  bool is_external() const { return external_; }
+
+private:
+  /// @brief grow the backing block to hold at least capacity bytes
+  bool grow(const std::size_t capacity);
+
+  /// @brief requested placement
+  Placement placement_{Placement::kInternal};
+
+  /// @brief backing block
+  char* data_{nullptr};
+
+  /// @brief bytes in use
+  std::size_t size_{0};
+
+  /// @brief bytes allocated
+  std::size_t capacity_{0};
+
+  /// @brief true if data_ was placed in PSRAM
+  bool external_{false};
+};
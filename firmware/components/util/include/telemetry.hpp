@@ -0,0 +1,169 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+extern "C" {
+
+#include "esp_timer.h"
+
+}
+
+/**
+ * Compile-time switch for the pipeline telemetry, defined for every user of
+ * util by components/util/CMakeLists.txt. Without it the TELEMETRY_* macros
+ * compile to nothing (their arguments are not even evaluated) and no
+ * counter storage is linked in.
+ */
+
+/**
+ * @brief Counters and histograms of the audio pipeline, for chasing
+ * stutters on units in the field.
+ *
+ * Every update is a relaxed atomic add on a fixed slot, so the macros can be
+ * used from any task, including the Bluetooth stack's audio callback, and
+ * never block or allocate. Nothing is ever reset: readers take a snapshot()
+ * and compare it with an earlier one to see what happened in between.
+ *
+ * Levels (ring fill, 0-100) and latencies (microseconds) are histograms
+ * rather than last values, so a brief dip between two reads still shows up
+ * in the low percentiles. Use the TELEMETRY_COUNT/LEVEL/LATENCY macros
+ * rather than calling this directly, so a build without ENABLE_TELEMETRY
+ * pays nothing.
+ */
+class Telemetry {
+public:
+#ifdef ENABLE_TELEMETRY
+  static constexpr bool kEnabled = true;
+#else
+  static constexpr bool kEnabled = false;
+#endif
+
+  /// @brief events counted since boot
+  enum class Counter : std::uint8_t {
+    kStreamUnderruns,   ///< decoder waited for card data in vain while playing
+    kPcmUnderruns,      ///< link producer found no PCM while playing
+    kLinkUnderruns,     ///< Bluetooth stack found the jitter buffer empty
+    kSilenceFrames,     ///< frames the sink got as silence instead of audio
+    kDecodeErrors,      ///< frames that did not decode (corrupt or false sync)
+    kLinkEventsDropped, ///< stack events lost to a full mailbox
+    kCount
+  };
+
+  /// @brief fill levels in percent, sampled by the side that drains them
+  enum class Level : std::uint8_t {
+    kStreamFill,  ///< card buffers ready for the decoder
+    kPcmFill,     ///< decoder PCM ring
+    kLinkFill,    ///< jitter buffer, relative to its target depth
+    kCount
+  };
+
+  /// @brief durations in microseconds
+  enum class Latency : std::uint8_t {
+    kDecodeFrame, ///< one MP3 frame
+    kCardRead,    ///< one stream buffer refill from the card
+    kCount
+  };
+
+  /// @brief level bin i counts samples in [10 i, 10 i + 10) percent; 100 goes to the last
+  static constexpr std::size_t kLevelBins = 10;
+
+  /// @brief latency bin i counts durations shorter than kLatencyBaseUs << i;
+  /// the last bin collects everything longer
+  static constexpr std::size_t kLatencyBins = 16;
+  static constexpr std::uint32_t kLatencyBaseUs = 16;
+
+  /// @brief copy of every counter at one point in time
+  struct Snapshot {
+    std::array<std::uint32_t, static_cast<std::size_t>(Counter::kCount)> counters;
+    std::array<std::uint32_t, static_cast<std::size_t>(Level::kCount)> level_now;
+    std::array<std::array<std::uint32_t, kLevelBins>, static_cast<std::size_t>(Level::kCount)> levels;
+    std::array<std::uint32_t, static_cast<std::size_t>(Latency::kCount)> latency_max_us;
+    std::array<std::array<std::uint32_t, kLatencyBins>, static_cast<std::size_t>(Latency::kCount)> latencies;
+  };
+
+  /// @brief add to a counter
+  static void count(const Counter counter, const std::uint32_t amount = 1) {
+    counters_[static_cast<std::size_t>(counter)].fetch_add(amount, std::memory_order_relaxed);
+  }
+
+  /// @brief record a fill level (clamped to 100)
+  static void level(const Level level, const std::uint32_t percent) {
+    const auto index = static_cast<std::size_t>(level);
+    const std::uint32_t clamped = percent < 100 ? percent : 100;
+    level_now_[index].store(clamped, std::memory_order_relaxed);
+    const std::size_t bin = clamped / 10 < kLevelBins ? clamped / 10 : kLevelBins - 1;
+    levels_[index][bin].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /// @brief record a duration
+  static void latency(const Latency latency, const std::uint32_t us) {
+    const auto index = static_cast<std::size_t>(latency);
+    std::size_t bin = 0;
+    while (bin + 1 < kLatencyBins && us >= (kLatencyBaseUs << bin)) {
+      bin++;
+    }
+    latencies_[index][bin].fetch_add(1, std::memory_order_relaxed);
+
+    std::uint32_t max = latency_max_us_[index].load(std::memory_order_relaxed);
+    while (us > max && !latency_max_us_[index].compare_exchange_weak(max, us, std::memory_order_relaxed)) {}
+  }
+
+  /// @brief current value of one counter
+  static std::uint32_t get(const Counter counter) {
+    return counters_[static_cast<std::size_t>(counter)].load(std::memory_order_relaxed);
+  }
+
+  /// @brief read every counter (each one atomically, not all of them at once)
+  static Snapshot snapshot();
+
+  /// @brief level below which the given share (0-100) of the samples lies, to 10 %
+  static std::uint32_t level_percentile(const std::array<std::uint32_t, kLevelBins>& bins, const std::uint32_t share);
+
+  /// @brief duration the given share (0-100) of the samples stays below, to a power of two
+  static std::uint32_t latency_percentile(const std::array<std::uint32_t, kLatencyBins>& bins, const std::uint32_t share);
+
+  /**
+   * @brief Format a snapshot as one JSON object, e.g. for the config page.
+   * @return length written (without the terminator), or 0 if it did not fit
+   */
+  static std::size_t format_json(const Snapshot& snapshot, char* buffer, const std::size_t size);
+
+  /// @brief print a snapshot to the console as a short table
+  static void print(const Snapshot& snapshot);
+
+private:
+  static inline std::array<std::atomic<std::uint32_t>, static_cast<std::size_t>(Counter::kCount)> counters_{};
+  static inline std::array<std::atomic<std::uint32_t>, static_cast<std::size_t>(Level::kCount)> level_now_{};
+  static inline std::array<std::array<std::atomic<std::uint32_t>, kLevelBins>,
+    static_cast<std::size_t>(Level::kCount)> levels_{};
+  static inline std::array<std::atomic<std::uint32_t>, static_cast<std::size_t>(Latency::kCount)> latency_max_us_{};
+  static inline std::array<std::array<std::atomic<std::uint32_t>, kLatencyBins>,
+    static_cast<std::size_t>(Latency::kCount)> latencies_{};
+};
+
+/// @brief count an event, e.g. TELEMETRY_COUNT(kLinkUnderruns) or TELEMETRY_COUNT(kSilenceFrames, frames)
+#define TELEMETRY_COUNT(name, ...) do {\
+  if constexpr (Telemetry::kEnabled) {\
+    Telemetry::count(Telemetry::Counter::name __VA_OPT__(,) __VA_ARGS__);\
+  }\
+} while (0)
+
+/// @brief sample a fill level in percent, e.g. TELEMETRY_LEVEL(kPcmFill, fill)
+#define TELEMETRY_LEVEL(name, percent) do {\
+  if constexpr (Telemetry::kEnabled) {\
+    Telemetry::level(Telemetry::Level::name, percent);\
+  }\
+} while (0)
+
+/// @brief record a duration in microseconds, e.g. TELEMETRY_LATENCY(kDecodeFrame, elapsed_us)
+#define TELEMETRY_LATENCY(name, us) do {\
+  if constexpr (Telemetry::kEnabled) {\
+    Telemetry::latency(Telemetry::Latency::name, us);\
+  }\
+} while (0)
+
+/// @brief esp_timer microseconds for a TELEMETRY_LATENCY() start, or 0 when compiled out
+#define TELEMETRY_NOW() (Telemetry::kEnabled ? esp_timer_get_time() : std::int64_t{0})
@@ -1,21 +1,56 @@
 #pragma once
 
+#include <cstdio>
+
+#include "deferred_log.hpp"
+
 #define APP_NAME "mp3-fw"
 
+/**
+ * Compile-time log levels. Messages above LOG_COMPONENT_LEVEL compile to
+ * nothing (their arguments are not even evaluated). A component can pick
+ * its own level in its CMakeLists.txt, e.g.
+ *   target_compile_definitions(${COMPONENT_LIB} PRIVATE LOG_COMPONENT_LEVEL=LOG_LEVEL_DEBUG)
+ */
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_VERBOSE 5
+
 #define ENABLE_LOGGING
-#ifdef ENABLE_LOGGING
-  #define LOG(...) do {\
-    fprintf(stderr, "[%s %s:%d] ", APP_NAME, __FILE__, __LINE__);\
-    fprintf(stderr, __VA_ARGS__);\
-    fprintf(stderr, "\n");\
-  } while (0)
-#else
-  #define LOG(...) ((void) 0)
+#ifndef LOG_COMPONENT_LEVEL
+  #ifdef ENABLE_LOGGING
+    #define LOG_COMPONENT_LEVEL LOG_LEVEL_INFO
+  #else
+    #define LOG_COMPONENT_LEVEL LOG_LEVEL_NONE
+  #endif
 #endif
 
+/// @brief queue a message in the deferred log ring (see DeferredLog for argument rules)
+#define LOG_AT(level, tag, format, ...) do {\
+  if constexpr ((level) <= LOG_COMPONENT_LEVEL) {\
+    DeferredLog::write(static_cast<DeferredLog::Level>(level), tag, format __VA_OPT__(,) __VA_ARGS__);\
+  }\
+} while (0)
+
+#define LOGE(tag, ...) LOG_AT(LOG_LEVEL_ERROR, tag, __VA_ARGS__)
+#define LOGW(tag, ...) LOG_AT(LOG_LEVEL_WARN, tag, __VA_ARGS__)
+#define LOGI(tag, ...) LOG_AT(LOG_LEVEL_INFO, tag, __VA_ARGS__)
+#define LOGD(tag, ...) LOG_AT(LOG_LEVEL_DEBUG, tag, __VA_ARGS__)
+#define LOGV(tag, ...) LOG_AT(LOG_LEVEL_VERBOSE, tag, __VA_ARGS__)
+
+#define LOG(...) LOGI(APP_NAME, __VA_ARGS__)
+
+/// @brief restart on failure; the message is printed synchronously so it
+/// is not lost with the queued ones, which are flushed first
 #define CHECK(val, ...) do {\
   if (!(val)) {\
-    LOG(__VA_ARGS__);\
+    DeferredLog::drain();\
+    fprintf(stderr, "[%s %s:%d] ", APP_NAME, __FILE__, __LINE__);\
+    fprintf(stderr, __VA_ARGS__);\
+    fprintf(stderr, "\n");\
     esp_restart();\
   }\
 } while (0)
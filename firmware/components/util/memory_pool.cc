@@ -0,0 +1,212 @@
+#include <cinttypes>
+#include <cstdlib>
+
+#include "include/memory_pool.hpp"
+
+extern "C" {
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+}
+
+namespace {
+
+constexpr const char* kComponentTag = "MemoryPool";
+constexpr std::uint32_t kInternalCaps = MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA | MALLOC_CAP_8BIT;
+constexpr std::uint32_t kExternalCaps = MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT;
+
+static_assert(MemoryPool::kSlabBytes % MemoryPool::kBlockSizes.back() == 0, "slabs must hold whole blocks");
+
+const char* tier_name(const MemoryPool::Tier tier) {
+  return tier == MemoryPool::Tier::kInternal ? "internal" : "external";
+}
+
+}
+
+MemoryPool& MemoryPool::get(const Tier tier) {
+  static MemoryPool internal_pool{Tier::kInternal};
+  static MemoryPool external_pool{Tier::kExternal};
+  return tier == Tier::kInternal ? internal_pool : external_pool;
+}
+
+MemoryPool::MemoryPool(const Tier tier) : tier_(tier) {}
+
+std::optional<std::size_t> MemoryPool::size_class(const std::size_t size) {
+  for (std::size_t index = 0; index < kClassCount; index++) {
+    if (size <= kBlockSizes[index]) {
+      return index;
+    }
+  }
+  return std::nullopt;
+}
+
+void* MemoryPool::allocate_from_heap(const std::size_t bytes, bool& external) {
+  if (tier_ == Tier::kExternal) {
+    void* memory = heap_caps_aligned_alloc(kAlignment, bytes, kExternalCaps);
+    if (memory) {
+      external = true;
+      return memory;
+    }
+    report_fallback();
+  }
+
+  // the reserve is what keeps the Bluetooth controller and drivers able to
+  // initialize after the pipeline has taken its working set; a fallback
+  // from the external tier is held to the same one
+  if (heap_caps_get_free_size(MALLOC_CAP_INTERNAL) < bytes + kInternalReserveBytes) {
+    return nullptr;
+  }
+
+  external = false;
+  return heap_caps_aligned_alloc(kAlignment, bytes, kInternalCaps);
+}
+
+void MemoryPool::report_fallback() {
+  if (fallback_reported_.exchange(true)) {
+    return;
+  }
+
+  if (heap_caps_get_total_size(MALLOC_CAP_SPIRAM) == 0) {
+    ESP_LOGW(kComponentTag, "No PSRAM (CONFIG_SPIRAM off or none found), external data goes to internal SRAM");
+  } else {
+    ESP_LOGW(kComponentTag, "PSRAM exhausted, external data spills into internal SRAM");
+  }
+}
+
+bool MemoryPool::grow(const std::size_t index) {
+  bool external = false;
+  auto* slab = static_cast<std::uint8_t*>(allocate_from_heap(kSlabBytes, external));
+  if (!slab) {
+    return false;
+  }
+
+  // chain the blocks before taking the lock, then splice the chain in
+  const std::size_t block_size = kBlockSizes[index];
+  const std::size_t count = kSlabBytes / block_size;
+  for (std::size_t i = 0; i + 1 < count; i++) {
+    reinterpret_cast<FreeBlock*>(slab + i * block_size)->next = reinterpret_cast<FreeBlock*>(slab + (i + 1) * block_size);
+  }
+
+  auto* last = reinterpret_cast<FreeBlock*>(slab + (count - 1) * block_size);
+
+  portENTER_CRITICAL(&lock_);
+  last->next = free_[index];
+  free_[index] = reinterpret_cast<FreeBlock*>(slab);
+  stats_.slab_bytes += kSlabBytes;
+  stats_.external = stats_.external || external;
+  portEXIT_CRITICAL(&lock_);
+  return true;
+}
+
+void* MemoryPool::allocate(const std::size_t size) {
+  const auto index = size_class(size);
+  if (!index) {
+    bool external = false;
+    void* memory = allocate_from_heap(size, external);
+
+    portENTER_CRITICAL(&lock_);
+    if (memory) {
+      stats_.large_bytes += size;
+    } else {
+      stats_.failures++;
+    }
+    portEXIT_CRITICAL(&lock_);
+    return memory;
+  }
+
+  // another task may take the fresh blocks before we get back to the list
+  for (;;) {
+    portENTER_CRITICAL(&lock_);
+    FreeBlock* block = free_[*index];
+    if (block) {
+      free_[*index] = block->next;
+      stats_.in_use_bytes += kBlockSizes[*index];
+    }
+    portEXIT_CRITICAL(&lock_);
+
+    if (block) {
+      return block;
+    }
+
+    if (!grow(*index)) {
+      portENTER_CRITICAL(&lock_);
+      stats_.failures++;
+      portEXIT_CRITICAL(&lock_);
+      return nullptr;
+    }
+  }
+}
+
+void MemoryPool::deallocate(void* block, const std::size_t size) {
+  if (!block) {
+    return;
+  }
+
+  const auto index = size_class(size);
+  if (!index) {
+    heap_caps_free(block);
+
+    portENTER_CRITICAL(&lock_);
+    stats_.large_bytes -= size;
+    portEXIT_CRITICAL(&lock_);
+    return;
+  }
+
+  auto* free_block = static_cast<FreeBlock*>(block);
+
+  portENTER_CRITICAL(&lock_);
+  free_block->next = free_[*index];
+  free_[*index] = free_block;
+  stats_.in_use_bytes -= kBlockSizes[*index];
+  portEXIT_CRITICAL(&lock_);
+}
+
+bool MemoryPool::reserve(const std::size_t size, const std::size_t count) {
+  const auto index = size_class(size);
+  if (!index) {
+    return false;
+  }
+
+  for (;;) {
+    std::size_t available = 0;
+
+    portENTER_CRITICAL(&lock_);
+    for (const FreeBlock* block = free_[*index]; block && available < count; block = block->next) {
+      available++;
+    }
+    portEXIT_CRITICAL(&lock_);
+
+    if (available >= count) {
+      return true;
+    }
+
+    if (!grow(*index)) {
+      ESP_LOGE(kComponentTag, "Could not reserve %zu x %zu bytes in %s memory", count, kBlockSizes[*index], tier_name(tier_));
+      return false;
+    }
+  }
+}
+
+MemoryPool::Stats MemoryPool::get_stats() const {
+  portENTER_CRITICAL(&lock_);
+  const Stats stats = stats_;
+  portEXIT_CRITICAL(&lock_);
+  return stats;
+}
+
+void MemoryPool::log_stats() {
+  for (const Tier tier : {Tier::kInternal, Tier::kExternal}) {
+    const Stats stats = get(tier).get_stats();
+    ESP_LOGI(kComponentTag, "%s%s: %zu of %zu slab bytes in use, %zu large bytes, %" PRIu32 " failures",
+      tier_name(tier), stats.external ? " (PSRAM)" : "", stats.in_use_bytes, stats.slab_bytes, stats.large_bytes, stats.failures);
+  }
+
+  ESP_LOGI(kComponentTag, "Internal SRAM free: %zu bytes (%zu reserved)",
+    heap_caps_get_free_size(MALLOC_CAP_INTERNAL), kInternalReserveBytes);
+}
+
+void MemoryPool::out_of_memory(const Tier tier, const std::size_t size) {
+  ESP_LOGE(kComponentTag, "Out of %s memory allocating %zu bytes", tier_name(tier), size);
+  abort();
+}
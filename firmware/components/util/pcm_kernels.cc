@@ -0,0 +1,228 @@
+#include <cmath>
+#include <cstdlib>
+
+#include "include/pcm_kernels.hpp"
+
+namespace {
+
+constexpr float kPi = 3.14159265f;
+
+/// @brief keep designed frequencies clear of Nyquist
+constexpr float kMaxRelativeFrequency = 0.45f;
+
+std::int32_t to_q28(const float value) {
+  return static_cast<std::int32_t>(std::lround(value * static_cast<float>(1 << Biquad::kCoefficientBits)));
+}
+
+template <typename Sample>
+Sample saturate(const std::int64_t value) {
+  return static_cast<Sample>(std::clamp<std::int64_t>(value, std::numeric_limits<Sample>::min(), std::numeric_limits<Sample>::max()));
+}
+
+template <typename Sample>
+void apply_ramp(Sample* samples, const std::size_t frames, const std::size_t channels,
+    const std::int32_t from, const std::int32_t to) {
+  // fixed gain: one multiply per sample
+  if (from == to) {
+    for (std::size_t i = 0; i < frames * channels; i++) {
+      samples[i] = saturate<Sample>((static_cast<std::int64_t>(samples[i]) * from) >> 15);
+    }
+    return;
+  }
+
+  // the step is rounded towards zero; the last frame lands on the target
+  const std::int32_t step = (to - from) / static_cast<std::int32_t>(frames);
+  std::int32_t gain = from;
+  for (std::size_t frame = 0; frame < frames; frame++) {
+    gain = frame + 1 == frames ? to : gain + step;
+    for (std::size_t channel = 0; channel < channels; channel++) {
+      Sample& sample = samples[frame * channels + channel];
+      sample = saturate<Sample>((static_cast<std::int64_t>(sample) * gain) >> 15);
+    }
+  }
+}
+
+}
+
+std::int32_t GainRamp::from_db(const float db) {
+  const float gain = std::pow(10.0f, db / 20.0f) * static_cast<float>(kUnity);
+  return std::clamp<std::int32_t>(static_cast<std::int32_t>(std::lround(gain)), 0, kMaxGain);
+}
+
+void GainRamp::process(std::int16_t* samples, const std::size_t frames, const std::size_t channels) {
+  if (frames == 0 || is_unity()) {
+    return;
+  }
+  apply_ramp(samples, frames, channels, current_, target_);
+  current_ = target_;
+}
+
+void GainRamp::process(std::int32_t* samples, const std::size_t frames, const std::size_t channels) {
+  if (frames == 0 || is_unity()) {
+    return;
+  }
+  apply_ramp(samples, frames, channels, current_, target_);
+  current_ = target_;
+}
+
+Biquad::Coefficients Biquad::design(const Shape shape, const float frequency_hz, const float q,
+    const float gain_db, const std::uint32_t sample_rate) {
+  if (sample_rate == 0 || q <= 0.0f || gain_db == 0.0f) {
+    return kFlat;
+  }
+
+  const float frequency = std::min(frequency_hz, kMaxRelativeFrequency * static_cast<float>(sample_rate));
+  const float a = std::pow(10.0f, gain_db / 40.0f);
+  const float w0 = 2.0f * kPi * frequency / static_cast<float>(sample_rate);
+  const float cos_w0 = std::cos(w0);
+  const float alpha = std::sin(w0) / (2.0f * q);
+  const float shelf = 2.0f * std::sqrt(a) * alpha;
+
+  float b0, b1, b2, a0, a1, a2;
+  switch (shape) {
+    case Shape::kLowShelf:
+      b0 = a * ((a + 1) - (a - 1) * cos_w0 + shelf);
+      b1 = 2 * a * ((a - 1) - (a + 1) * cos_w0);
+      b2 = a * ((a + 1) - (a - 1) * cos_w0 - shelf);
+      a0 = (a + 1) + (a - 1) * cos_w0 + shelf;
+      a1 = -2 * ((a - 1) + (a + 1) * cos_w0);
+      a2 = (a + 1) + (a - 1) * cos_w0 - shelf;
+      break;
+
+    case Shape::kHighShelf:
+      b0 = a * ((a + 1) + (a - 1) * cos_w0 + shelf);
+      b1 = -2 * a * ((a - 1) + (a + 1) * cos_w0);
+      b2 = a * ((a + 1) + (a - 1) * cos_w0 - shelf);
+      a0 = (a + 1) - (a - 1) * cos_w0 + shelf;
+      a1 = 2 * ((a - 1) - (a + 1) * cos_w0);
+      a2 = (a + 1) - (a - 1) * cos_w0 - shelf;
+      break;
+
+    case Shape::kPeaking:
+    default:
+      b0 = 1 + alpha * a;
+      b1 = -2 * cos_w0;
+      b2 = 1 - alpha * a;
+      a0 = 1 + alpha / a;
+      a1 = -2 * cos_w0;
+      a2 = 1 - alpha / a;
+      break;
+  }
+
+  // feedback terms are stored negated so process() only adds
+  return Coefficients{
+    .b0 = to_q28(b0 / a0),
+    .b1 = to_q28(b1 / a0),
+    .b2 = to_q28(b2 / a0),
+    .a1 = to_q28(-a1 / a0),
+    .a2 = to_q28(-a2 / a0),
+  };
+}
+
+void Biquad::process(std::int32_t* samples, const std::size_t frames, const std::size_t channels) {
+  // coefficients and history live in registers for the whole block
+  const std::int64_t b0 = coefficients_.b0;
+  const std::int64_t b1 = coefficients_.b1;
+  const std::int64_t b2 = coefficients_.b2;
+  const std::int64_t a1 = coefficients_.a1;
+  const std::int64_t a2 = coefficients_.a2;
+
+  for (std::size_t channel = 0; channel < std::min(channels, kPcmMaxChannels); channel++) {
+    State state = state_[channel];
+
+    for (std::size_t i = channel; i < frames * channels; i += channels) {
+      const std::int32_t x0 = samples[i];
+      const std::int64_t acc = state.error + b0 * x0 + b1 * state.x1 + b2 * state.x2 + a1 * state.y1 + a2 * state.y2;
+      const auto y0 = static_cast<std::int32_t>(acc >> kCoefficientBits);
+
+      // feed the truncated bits into the next sample; with poles this close
+      // to DC (bass shelf) plain rounding would settle far from the true output
+      state.error = static_cast<std::int32_t>(acc - (static_cast<std::int64_t>(y0) << kCoefficientBits));
+
+      state.x2 = state.x1;
+      state.x1 = x0;
+      state.y2 = state.y1;
+      state.y1 = y0;
+      samples[i] = y0;
+    }
+
+    state_[channel] = state;
+  }
+}
+
+void Limiter::process(const std::int32_t* input, std::int16_t* output, const std::size_t frames, const std::size_t channels) {
+  for (std::size_t frame = 0; frame < frames; frame++) {
+    const std::int32_t* const samples = input + frame * channels;
+
+    std::int32_t peak = 0;
+    for (std::size_t channel = 0; channel < channels; channel++) {
+      peak = std::max(peak, std::abs(samples[channel]));
+    }
+
+    // attack at once; the division only happens while over the ceiling
+    const std::int64_t limited = (static_cast<std::int64_t>(peak) * gain_) >> 15;
+    if (limited > threshold_) {
+      gain_ = static_cast<std::int32_t>((static_cast<std::int64_t>(threshold_) << 15) / peak);
+    } else if (gain_ < GainRamp::kUnity) {
+      gain_ = std::min(GainRamp::kUnity, gain_ + std::max(1, (GainRamp::kUnity - gain_) >> release_shift_));
+    }
+
+    for (std::size_t channel = 0; channel < channels; channel++) {
+      const std::int64_t value = (static_cast<std::int64_t>(samples[channel]) * gain_) >> 15;
+      output[frame * channels + channel] = saturate<std::int16_t>(value);
+    }
+  }
+}
+
+bool Resampler::configure(const std::uint32_t input_rate, const std::uint32_t output_rate, const std::size_t channels) {
+  const std::size_t clamped = std::clamp<std::size_t>(channels, 1, kPcmMaxChannels);
+  if (input_rate == input_rate_ && output_rate == output_rate_ && clamped == channels_) {
+    return false;
+  }
+
+  input_rate_ = input_rate;
+  output_rate_ = output_rate;
+  channels_ = clamped;
+  step_ = input_rate != 0 && output_rate != 0 ?
+    static_cast<std::uint32_t>((static_cast<std::uint64_t>(input_rate) << kPhaseBits) / output_rate) : kOne;
+  reset();
+  return true;
+}
+
+void Resampler::reset() {
+  phase_ = kOne;
+  last_ = {};
+}
+
+std::size_t Resampler::process(const std::int16_t* input, const std::size_t frames, std::int16_t* output,
+    const std::size_t capacity, std::size_t& written) {
+  std::size_t consumed = 0;
+  written = 0;
+
+  while (written < capacity) {
+    // step past the input frames the output has moved beyond
+    while (phase_ >= kOne && consumed < frames) {
+      for (std::size_t channel = 0; channel < channels_; channel++) {
+        last_[channel] = input[consumed * channels_ + channel];
+      }
+      consumed++;
+      phase_ -= kOne;
+    }
+
+    // the frame after last_ is needed to interpolate
+    if (phase_ >= kOne || consumed == frames) {
+      break;
+    }
+
+    const std::int16_t* const next = input + consumed * channels_;
+    for (std::size_t channel = 0; channel < channels_; channel++) {
+      const std::int32_t delta = static_cast<std::int32_t>(next[channel]) - last_[channel];
+      output[written * channels_ + channel] = static_cast<std::int16_t>(
+        last_[channel] + ((static_cast<std::int64_t>(delta) * phase_) >> kPhaseBits));
+    }
+    written++;
+    phase_ += step_;
+  }
+
+  return consumed;
+}
@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "include/string_arena.hpp"
+
+extern "C" {
+
+#include "esp_heap_caps.h"
+
+}
+
+namespace {
+
+constexpr std::size_t kMinimumCapacity = 256;
+constexpr std::uint32_t kInternalCaps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+constexpr std::uint32_t kExternalCaps = MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT;
+
+}
+
+StringArena::StringArena(const Placement placement) : placement_(placement) {}
+
+StringArena::~StringArena() {
+  heap_caps_free(data_);
+}
+
+StringArena::StringArena(StringArena&& other) noexcept
+  : placement_(other.placement_),
+    data_(std::exchange(other.data_, nullptr)),
+    size_(std::exchange(other.size_, 0)),
+    capacity_(std::exchange(other.capacity_, 0)),
+    external_(std::exchange(other.external_, false)) {}
+
+StringArena& StringArena::operator=(StringArena&& other) noexcept {
+  if (this != &other) {
+    heap_caps_free(data_);
+    placement_ = other.placement_;
+    data_ = std::exchange(other.data_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+    capacity_ = std::exchange(other.capacity_, 0);
+    external_ = std::exchange(other.external_, false);
+  }
+
+  return *this;
+}
+
+bool StringArena::reserve(const std::size_t capacity) {
+  return capacity <= capacity_ || grow(capacity);
+}
+
+std::optional<StringArena::Offset> StringArena::add(const std::string_view value) {
+  const auto offset = static_cast<Offset>(size_);
+  char* destination = extend(value.size() + 1);
+  if (!destination) {
+    return std::nullopt;
+  }
+
+  std::memcpy(destination, value.data(), value.size());
+  destination[value.size()] = '\0';
+  return offset;
+}
+
+char* StringArena::extend(const std::size_t bytes) {
+  if (size_ + bytes > capacity_) {
+    // grow geometrically so that appends stay amortized O(1)
+    if (!grow(std::max({size_ + bytes, capacity_ + capacity_ / 2, kMinimumCapacity}))) {
+      return nullptr;
+    }
+  }
+
+  char* destination = data_ + size_;
+  size_ += bytes;
+  return destination;
+}
+
+bool StringArena::grow(const std::size_t capacity) {
+  void* block = nullptr;
+  bool external = false;
+
+  if (placement_ == Placement::kPreferExternal) {
+    block = heap_caps_realloc(data_, capacity, kExternalCaps);
+    external = block != nullptr;
+  }
+
+  // no PSRAM (or it is full); realloc across capabilities copies for us
+  if (!block) {
+    block = heap_caps_realloc(data_, capacity, kInternalCaps);
+  }
+
+  if (!block) {
+    return false;
+  }
+
+  data_ = static_cast<char*>(block);
+  capacity_ = capacity;
+  external_ = external;
+  return true;
+}
@@ -0,0 +1,148 @@
+#include <cinttypes>
+#include <cstdio>
+#include <optional>
+
+#include "include/telemetry.hpp"
+
+namespace {
+
+constexpr std::array<const char*, static_cast<std::size_t>(Telemetry::Counter::kCount)> kCounterNames = {
+  "stream_underruns",
+  "pcm_underruns",
+  "link_underruns",
+  "silence_frames",
+  "decode_errors",
+  "link_events_dropped",
+};
+
+constexpr std::array<const char*, static_cast<std::size_t>(Telemetry::Level::kCount)> kLevelNames = {
+  "stream_fill",
+  "pcm_fill",
+  "link_fill",
+};
+
+constexpr std::array<const char*, static_cast<std::size_t>(Telemetry::Latency::kCount)> kLatencyNames = {
+  "decode_frame",
+  "card_read",
+};
+
+/// @brief bin holding the given share (0-100) of the samples, counted from the lowest
+template <std::size_t Bins>
+std::optional<std::size_t> percentile_bin(const std::array<std::uint32_t, Bins>& bins, const std::uint32_t share) {
+  std::uint64_t total = 0;
+  for (const auto count : bins) {
+    total += count;
+  }
+  if (total == 0) {
+    return std::nullopt;
+  }
+
+  const std::uint64_t wanted = (total * share + 99) / 100;
+  std::uint64_t seen = 0;
+  for (std::size_t bin = 0; bin < Bins; bin++) {
+    seen += bins[bin];
+    if (seen >= wanted && seen > 0) {
+      return bin;
+    }
+  }
+  return Bins - 1;
+}
+
+/// @brief snprintf that keeps track of the room left; false once it ran out
+template <typename... Args>
+bool append(char*& cursor, const char* end, const char* format, const Args... args) {
+  const int length = snprintf(cursor, end - cursor, format, args...);
+  if (length < 0 || length >= end - cursor) {
+    return false;
+  }
+  cursor += length;
+  return true;
+}
+
+}
+
+Telemetry::Snapshot Telemetry::snapshot() {
+  Snapshot snapshot{};
+  for (std::size_t i = 0; i < counters_.size(); i++) {
+    snapshot.counters[i] = counters_[i].load(std::memory_order_relaxed);
+  }
+  for (std::size_t i = 0; i < levels_.size(); i++) {
+    snapshot.level_now[i] = level_now_[i].load(std::memory_order_relaxed);
+    for (std::size_t bin = 0; bin < kLevelBins; bin++) {
+      snapshot.levels[i][bin] = levels_[i][bin].load(std::memory_order_relaxed);
+    }
+  }
+  for (std::size_t i = 0; i < latencies_.size(); i++) {
+    snapshot.latency_max_us[i] = latency_max_us_[i].load(std::memory_order_relaxed);
+    for (std::size_t bin = 0; bin < kLatencyBins; bin++) {
+      snapshot.latencies[i][bin] = latencies_[i][bin].load(std::memory_order_relaxed);
+    }
+  }
+  return snapshot;
+}
+
+std::uint32_t Telemetry::level_percentile(const std::array<std::uint32_t, kLevelBins>& bins, const std::uint32_t share) {
+  const auto bin = percentile_bin(bins, share);
+  return bin ? static_cast<std::uint32_t>(*bin * 10) : 0;
+}
+
+std::uint32_t Telemetry::latency_percentile(const std::array<std::uint32_t, kLatencyBins>& bins, const std::uint32_t share) {
+  // upper bound of the bin; the last one is open, so its lower bound is all we know
+  const auto bin = percentile_bin(bins, share);
+  if (!bin) {
+    return 0;
+  }
+  return *bin + 1 < kLatencyBins ? kLatencyBaseUs << *bin : kLatencyBaseUs << (kLatencyBins - 2);
+}
+
+std::size_t Telemetry::format_json(const Snapshot& snapshot, char* buffer, const std::size_t size) {
+  char* cursor = buffer;
+  const char* const end = buffer + size;
+
+  bool ok = append(cursor, end, "{\"counters\":{");
+  for (std::size_t i = 0; ok && i < kCounterNames.size(); i++) {
+    ok = append(cursor, end, "%s\"%s\":%" PRIu32, i > 0 ? "," : "", kCounterNames[i], snapshot.counters[i]);
+  }
+
+  ok = ok && append(cursor, end, "},\"levels\":{");
+  for (std::size_t i = 0; ok && i < kLevelNames.size(); i++) {
+    const auto& bins = snapshot.levels[i];
+    ok = append(cursor, end, "%s\"%s\":{\"now\":%" PRIu32 ",\"p1\":%" PRIu32 ",\"p5\":%" PRIu32 ",\"p50\":%" PRIu32 "}",
+      i > 0 ? "," : "", kLevelNames[i], snapshot.level_now[i],
+      level_percentile(bins, 1), level_percentile(bins, 5), level_percentile(bins, 50));
+  }
+
+  ok = ok && append(cursor, end, "},\"latency_us\":{");
+  for (std::size_t i = 0; ok && i < kLatencyNames.size(); i++) {
+    const auto& bins = snapshot.latencies[i];
+    ok = append(cursor, end, "%s\"%s\":{\"p50\":%" PRIu32 ",\"p95\":%" PRIu32 ",\"p99\":%" PRIu32 ",\"max\":%" PRIu32 "}",
+      i > 0 ? "," : "", kLatencyNames[i],
+      latency_percentile(bins, 50), latency_percentile(bins, 95), latency_percentile(bins, 99),
+      snapshot.latency_max_us[i]);
+  }
+
+  ok = ok && append(cursor, end, "}}");
+  return ok ? static_cast<std::size_t>(cursor - buffer) : 0;
+}
+
+void Telemetry::print(const Snapshot& snapshot) {
+  std::printf("Telemetry:\n");
+  for (std::size_t i = 0; i < kCounterNames.size(); i++) {
+    std::printf("  %-20s %10" PRIu32 "\n", kCounterNames[i], snapshot.counters[i]);
+  }
+
+  std::printf("  %-20s %5s %5s %5s %5s (%%)\n", "level", "now", "p1", "p5", "p50");
+  for (std::size_t i = 0; i < kLevelNames.size(); i++) {
+    const auto& bins = snapshot.levels[i];
+    std::printf("  %-20s %5" PRIu32 " %5" PRIu32 " %5" PRIu32 " %5" PRIu32 "\n", kLevelNames[i], snapshot.level_now[i],
+      level_percentile(bins, 1), level_percentile(bins, 5), level_percentile(bins, 50));
+  }
+
+  std::printf("  %-20s %7s %7s %7s %7s (us)\n", "latency", "p50", "p95", "p99", "max");
+  for (std::size_t i = 0; i < kLatencyNames.size(); i++) {
+    const auto& bins = snapshot.latencies[i];
+    std::printf("  %-20s %7" PRIu32 " %7" PRIu32 " %7" PRIu32 " %7" PRIu32 "\n", kLatencyNames[i],
+      latency_percentile(bins, 50), latency_percentile(bins, 95), latency_percentile(bins, 99),
+      snapshot.latency_max_us[i]);
+  }
+}
@@ -0,0 +1,523 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "component.hpp"
+#include "io_scheduler.hpp"
+#include "library_index.hpp"
+#include "library_scanner.hpp"
+#include "play_queue.hpp"
+#include "playback_order.hpp"
+#include "spsc_ring.hpp"
+#include "tag_reader.hpp"
+#include "util.hpp"
+
+extern "C" {
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "ff.h"
+
+}
+
+/**
+ * Host benchmark of the library and queue code: scans a directory-backed
+ * card, builds, saves and reloads the index, indexes and walks a playlist,
+ * and pushes PCM through an SpscRing between two ActiveObjects. Every stage
+ * checks its own result, so a run also serves as a smoke test, and
+ * --budget turns a stage that got slower than expected into a failure.
+ *
+ * Without --music it generates a library of small MP3 files with ID3 tags
+ * in a temporary directory, laid out as artist/album/track folders.
+ */
+
+namespace {
+
+constexpr const char* kComponentTag = "Benchmark";
+
+/// @brief generated layout
+constexpr std::size_t kTracksPerAlbum = 12;
+constexpr std::size_t kAlbumsPerArtist = 4;
+
+/// @brief generated audio: MPEG-1 layer III, 128 kbps, 44.1 kHz, joint stereo
+constexpr std::array<std::uint8_t, 4> kFrameHeader = {0xff, 0xfb, 0x90, 0x64};
+constexpr std::size_t kFrameBytes = 417;
+constexpr std::size_t kFramesPerTrack = 8;
+
+/// @brief directory entries read per scan step (SdCardObject::kScanEntriesPerStep)
+constexpr std::size_t kScanEntriesPerStep = 16;
+
+/// @brief the decoder's PCM ring (DecoderObject::kPcmRingSamples)
+constexpr std::size_t kRingSamples = 8192;
+
+/// @brief samples moved per ring access, one stereo MP3 frame
+constexpr std::size_t kRingBlockSamples = 1152 * 2;
+
+/// @brief every tenth playlist line names its track by path hash ("#<hex>")
+constexpr std::size_t kIdLineInterval = 10;
+
+struct Options {
+  std::size_t tracks{2000};
+  std::size_t ring_mb{64};
+  std::optional<std::filesystem::path> music{std::nullopt};
+  bool keep{false};
+
+  /// @brief (stage, milliseconds) limits from --budget
+  std::vector<std::pair<std::string, double>> budgets;
+};
+
+/// @brief one finished stage
+struct Stage {
+  const char* name;
+  double ms;
+  std::size_t items;
+  const char* unit;
+};
+
+class Report {
+public:
+  explicit Report(const Options& options) : options_(options) {}
+
+  void add(const char* name, const std::int64_t elapsed_us, const std::size_t items, const char* unit) {
+    const Stage stage{name, static_cast<double>(elapsed_us) / 1000.0, items, unit};
+    const double rate = stage.ms > 0 ? stage.items * 1000.0 / stage.ms : 0;
+    std::printf("%-16s %10.2f ms %10zu %-8s %12.0f %s/s\n", stage.name, stage.ms, stage.items, stage.unit, rate,
+      stage.unit);
+
+    for (const auto& [budget_name, budget_ms] : options_.budgets) {
+      if (budget_name == name && stage.ms > budget_ms) {
+        ESP_LOGE(kComponentTag, "%s took %.2f ms, over its budget of %.2f ms", name, stage.ms, budget_ms);
+        failed_ = true;
+      }
+    }
+  }
+
+  /// @brief record a failed self-check
+  void fail(const char* what) {
+    ESP_LOGE(kComponentTag, "Check failed: %s", what);
+    failed_ = true;
+  }
+
+  bool check(const bool condition, const char* what) {
+    if (!condition) {
+      fail(what);
+    }
+    return condition;
+  }
+
+  bool has_failed() const { return failed_; }
+
+private:
+  const Options& options_;
+  bool failed_{false};
+};
+
+std::int64_t now_us() {
+  return esp_timer_get_time();
+}
+
+void usage(const char* program) {
+  std::printf(
+    "usage: %s [--tracks N] [--ring-mb N] [--music DIR] [--budget STAGE=MS]... [--keep]\n"
+    "  --tracks N         tracks in the generated library (default 2000)\n"
+    "  --ring-mb N        MiB of PCM pushed through the ring (default 64)\n"
+    "  --music DIR        scan a copy of a card's music folder instead\n"
+    "  --budget STAGE=MS  fail if a stage takes longer than MS milliseconds\n"
+    "  --keep             leave the working directory behind\n", program);
+}
+
+std::optional<Options> parse_options(const int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    const std::string_view argument{argv[i]};
+    const bool has_value = i + 1 < argc;
+
+    if (argument == "--tracks" && has_value) {
+      options.tracks = std::strtoull(argv[++i], nullptr, 10);
+    } else if (argument == "--ring-mb" && has_value) {
+      options.ring_mb = std::strtoull(argv[++i], nullptr, 10);
+    } else if (argument == "--music" && has_value) {
+      options.music = argv[++i];
+    } else if (argument == "--budget" && has_value) {
+      const std::string_view budget{argv[++i]};
+      const auto separator = budget.find('=');
+      if (separator == std::string_view::npos) {
+        return std::nullopt;
+      }
+      options.budgets.emplace_back(std::string(budget.substr(0, separator)),
+        std::strtod(std::string(budget.substr(separator + 1)).c_str(), nullptr));
+    } else if (argument == "--keep") {
+      options.keep = true;
+    } else {
+      return std::nullopt;
+    }
+  }
+
+  if (options.tracks == 0 && !options.music) {
+    return std::nullopt;
+  }
+  return options;
+}
+
+/// @brief append an ID3v2.3 text frame (ISO-8859-1)
+void append_text_frame(std::vector<std::uint8_t>& tag, const char* id, const std::string& text) {
+  const std::uint32_t size = static_cast<std::uint32_t>(text.size() + 1);
+  tag.insert(tag.end(), id, id + 4);
+  for (const int shift : {24, 16, 8, 0}) {
+    tag.push_back(static_cast<std::uint8_t>(size >> shift));
+  }
+  tag.insert(tag.end(), {0, 0, 0});
+  tag.insert(tag.end(), text.begin(), text.end());
+}
+
+/// @brief write a short tagged CBR file the tag reader and scanner accept
+bool write_track(const std::filesystem::path& path, const std::string& title, const std::string& artist,
+  const std::string& album, const std::size_t number) {
+  std::vector<std::uint8_t> frames;
+  append_text_frame(frames, "TIT2", title);
+  append_text_frame(frames, "TPE1", artist);
+  append_text_frame(frames, "TALB", album);
+  append_text_frame(frames, "TRCK", std::to_string(number));
+
+  std::vector<std::uint8_t> file = {'I', 'D', '3', 3, 0, 0};
+  const std::uint32_t size = static_cast<std::uint32_t>(frames.size());
+  for (const int shift : {21, 14, 7, 0}) {
+    file.push_back(static_cast<std::uint8_t>((size >> shift) & 0x7f));
+  }
+  file.insert(file.end(), frames.begin(), frames.end());
+
+  for (std::size_t i = 0; i < kFramesPerTrack; i++) {
+    file.insert(file.end(), kFrameHeader.begin(), kFrameHeader.end());
+    file.resize(file.size() + kFrameBytes - kFrameHeader.size(), 0);
+  }
+
+  const std::unique_ptr<FILE, decltype(&fclose)> out{fopen(path.c_str(), "wb"), &fclose};
+  return out && fwrite(file.data(), 1, file.size(), out.get()) == file.size();
+}
+
+/// @brief fill a music folder with artist/album/track folders
+bool generate_library(const std::filesystem::path& music, const std::size_t tracks) {
+  std::error_code error;
+  for (std::size_t i = 0; i < tracks; i++) {
+    const std::size_t album = i / kTracksPerAlbum;
+    const std::size_t artist = album / kAlbumsPerArtist;
+    const auto artist_name = "Artist " + std::to_string(artist);
+    const auto album_name = "Album " + std::to_string(album);
+    const auto folder = music / artist_name / album_name;
+    const std::size_t number = i % kTracksPerAlbum + 1;
+
+    if ((number == 1 && !std::filesystem::create_directories(folder, error)) ||
+      !write_track(folder / (std::to_string(number) + " - Track " + std::to_string(i) + ".mp3"),
+        "Track " + std::to_string(i), artist_name, album_name, number)) {
+      ESP_LOGE(kComponentTag, "Could not generate '%s'", folder.c_str());
+      return false;
+    }
+  }
+
+  // files the scanner has to pass over
+  return write_track(music / "cover.jpg", "", "", "", 0) && write_track(music / "._hidden.mp3", "", "", "", 0);
+}
+
+/// @brief walk the music folder into a new index, the way a rescan does
+std::optional<LibraryIndex> scan(const LibraryIndex& previous, LibraryScanner::Result& result) {
+  const auto scanner = std::make_unique<LibraryScanner>(StringArena::Placement::kPreferExternal);
+  if (!scanner->begin("0:/music")) {
+    return std::nullopt;
+  }
+  while (scanner->step(previous, kScanEntriesPerStep)) {}
+
+  if (scanner->has_failed()) {
+    return std::nullopt;
+  }
+  result = scanner->get_result();
+  return scanner->take_index();
+}
+
+/// @brief producer end of the ring benchmark: writes a counting sequence
+class RingProducer : public StaticActiveObject<ActiveObject::MemoryLoad::kStandard> {
+public:
+  RingProducer(SpscRing<std::int16_t, kRingSamples>& ring, const std::size_t samples)
+    : StaticActiveObject("ring_producer", Priority::kHigh, std::nullopt, Workload::kStorage),
+      ring_(ring),
+      remaining_(samples) {}
+
+protected:
+  void task() override {
+    const auto span = ring_.reserve(std::min(remaining_, kRingBlockSamples));
+    if (span.size == 0) {
+      taskYIELD();
+      return;
+    }
+
+    for (std::size_t i = 0; i < span.size; i++) {
+      span.data[i] = static_cast<std::int16_t>(next_++);
+    }
+    ring_.commit(span.size);
+    remaining_ -= span.size;
+
+    if (remaining_ == 0) {
+      mark_as_done();
+    }
+  }
+
+private:
+  SpscRing<std::int16_t, kRingSamples>& ring_;
+  std::size_t remaining_;
+  std::uint16_t next_{0};
+};
+
+/// @brief consumer end: reads in decoder-sized blocks and checks the sequence
+class RingConsumer : public StaticActiveObject<ActiveObject::MemoryLoad::kStandard> {
+public:
+  RingConsumer(SpscRing<std::int16_t, kRingSamples>& ring, const std::size_t samples, const ActiveObject& producer)
+    : StaticActiveObject("ring_consumer", Priority::kHigh, std::nullopt, Workload::kAudio),
+      ring_(ring),
+      producer_(producer),
+      remaining_(samples) {}
+
+  /// @brief true if every sample arrived once and in order
+  bool is_intact() const { return intact_; }
+
+protected:
+  void task() override {
+    std::array<std::int16_t, kRingBlockSamples> block;
+    const std::size_t count = ring_.read(block.data(), std::min(remaining_, block.size()));
+    if (count == 0) {
+      taskYIELD();
+      return;
+    }
+    record_handoff(producer_);
+
+    for (std::size_t i = 0; i < count; i++) {
+      intact_ = intact_ && block[i] == static_cast<std::int16_t>(expected_++);
+    }
+    remaining_ -= count;
+
+    if (remaining_ == 0) {
+      mark_as_done();
+    }
+  }
+
+private:
+  SpscRing<std::int16_t, kRingSamples>& ring_;
+  const ActiveObject& producer_;
+  std::size_t remaining_;
+  std::uint16_t expected_{0};
+  bool intact_{true};
+};
+
+void benchmark_library(const Options& options, const std::filesystem::path& work, Report& report) {
+  const auto music = work / "music";
+  if (options.music) {
+    std::error_code error;
+    std::filesystem::copy(*options.music, music, std::filesystem::copy_options::recursive, error);
+    if (!report.check(!error, "copy the music folder")) {
+      return;
+    }
+  } else if (!report.check(generate_library(music, options.tracks), "generate the library")) {
+    return;
+  }
+  ff_host_mount(work.c_str());
+  const auto expected = [&](const std::size_t count) { return options.music || count == options.tracks; };
+
+  // first boot: no index to carry anything over from
+  std::int64_t start_us = now_us();
+  LibraryScanner::Result result{};
+  const LibraryIndex empty;
+  auto built = scan(empty, result);
+  if (!report.check(built.has_value(), "scan the music folder")) {
+    return;
+  }
+  report.add("scan", now_us() - start_us, built->size(), "tracks");
+  report.check(expected(built->size()) && result.added == built->size(), "scan finds every track");
+  LibraryIndex index = std::move(*built);
+
+  // the metadata pass the card task runs in the background after a scan
+  IoScheduler io;
+  TagReader reader;
+  std::size_t tagged = 0;
+  start_us = now_us();
+  for (LibraryIndex::TrackId id = 0; id < index.size(); id++) {
+    const auto path = music / index.path(id);
+    const auto metadata = reader.read(path.c_str());
+    tagged += metadata && index.set_metadata(id, *metadata) ? 1 : 0;
+  }
+  report.add("index_tags", now_us() - start_us, tagged, "tracks");
+  report.check(options.music || tagged == index.size(), "every generated track has tags");
+
+  const auto index_path = work / "library.idx";
+  start_us = now_us();
+  {
+    auto grant = io.acquire(IoScheduler::Class::kBackground);
+    report.check(index.save(index_path.c_str(), grant), "save the index");
+  }
+  report.add("index_save", now_us() - start_us, index.size(), "tracks");
+
+  // later boots: the persisted index is what the player starts from
+  LibraryIndex loaded{StringArena::Placement::kPreferExternal};
+  start_us = now_us();
+  const bool load_ok = loaded.load(index_path.c_str());
+  report.add("index_load", now_us() - start_us, loaded.size(), "tracks");
+  if (!report.check(load_ok && loaded.size() == index.size(), "reload the index")) {
+    return;
+  }
+
+  std::size_t found = 0;
+  start_us = now_us();
+  for (LibraryIndex::TrackId id = 0; id < loaded.size(); id++) {
+    found += loaded.find(loaded.path(id)) == id ? 1 : 0;
+  }
+  report.add("index_find", now_us() - start_us, found, "lookups");
+  report.check(found == loaded.size(), "find every track by path");
+
+  // nothing changed on the card, so everything carries over
+  start_us = now_us();
+  auto rescanned = scan(loaded, result);
+  report.add("rescan", now_us() - start_us, rescanned ? rescanned->size() : 0, "tracks");
+  report.check(rescanned && result.added == 0 && result.changed == 0 && result.removed == 0 &&
+    rescanned->size() == loaded.size(), "rescan keeps every track");
+
+  // a playlist naming every track, newest first, some of them by path hash
+  const auto playlist_path = work / "playlist.m3u";
+  {
+    const std::unique_ptr<FILE, decltype(&fclose)> out{fopen(playlist_path.c_str(), "w"), &fclose};
+    if (!report.check(out != nullptr, "write the playlist")) {
+      return;
+    }
+    for (std::size_t i = loaded.size(); i-- > 0;) {
+      const auto id = static_cast<LibraryIndex::TrackId>(i);
+      if (i % kIdLineInterval == 0) {
+        std::fprintf(out.get(), "%c%08" PRIx32 "\n", PlaybackOrder::kIdPrefix, loaded.path_hash(id));
+      } else {
+        const auto path = loaded.path(id);
+        std::fprintf(out.get(), "%.*s\r\n", static_cast<int>(path.size()), path.data());
+      }
+    }
+    std::fputs("\nnot/in/the/library.mp3\n", out.get());
+  }
+
+  const auto order = std::make_unique<PlaybackOrder>();
+  start_us = now_us();
+  const bool open_ok = order->open(playlist_path.c_str(), loaded);
+  report.add("playlist_load", now_us() - start_us, order->size(), "entries");
+  if (!report.check(open_ok && order->size() == loaded.size(), "index every playlist entry")) {
+    return;
+  }
+
+  // in order, the way playback reads it
+  std::size_t resolved = 0;
+  start_us = now_us();
+  for (std::size_t position = 0; position < order->size(); position++) {
+    resolved += order->resolve(position, loaded) == loaded.size() - 1 - position ? 1 : 0;
+  }
+  report.add("playlist_walk", now_us() - start_us, resolved, "entries");
+  report.check(resolved == order->size(), "resolve the playlist in order");
+
+  // shuffled, the way PlayQueue jumps around it
+  PlayQueue queue;
+  queue.resize(order->size());
+  queue.set_shuffle(0x2545f491);
+  std::vector<bool> seen(order->size(), false);
+  resolved = 0;
+  start_us = now_us();
+  do {
+    const std::size_t position = queue.current();
+    const auto id = order->resolve(position, loaded);
+    if (id == loaded.size() - 1 - position && !seen[position]) {
+      seen[position] = true;
+      resolved++;
+    }
+  } while (queue.next());
+  report.add("playlist_shuffle", now_us() - start_us, resolved, "entries");
+  report.check(resolved == order->size(), "a shuffled walk visits every entry once");
+}
+
+void benchmark_queue(Report& report) {
+  // the queue engine alone, over a library far larger than a card holds
+  constexpr std::size_t kQueueSize = 1 << 20;
+  PlayQueue queue;
+  queue.resize(kQueueSize);
+  queue.set_shuffle(0x9e3779b9);
+
+  std::vector<bool> seen(kQueueSize, false);
+  std::size_t steps = 0;
+  bool unique = true;
+  const std::int64_t start_us = now_us();
+  do {
+    unique = unique && !seen[queue.current()];
+    seen[queue.current()] = true;
+    steps++;
+  } while (queue.next());
+  report.add("queue_shuffle", now_us() - start_us, steps, "steps");
+  report.check(unique && steps == kQueueSize, "the shuffle is a permutation");
+
+  std::size_t back = 0;
+  const std::int64_t previous_us = now_us();
+  while (back < PlayQueue::kHistoryDepth && queue.previous()) {
+    back++;
+  }
+  report.add("queue_previous", now_us() - previous_us, back, "steps");
+  report.check(back == PlayQueue::kHistoryDepth, "previous retraces the history");
+}
+
+void benchmark_ring(const Options& options, Report& report) {
+  const std::size_t samples = options.ring_mb * 1024 * 1024 / sizeof(std::int16_t);
+  auto ring = std::make_unique<SpscRing<std::int16_t, kRingSamples>>();
+  auto producer = std::make_unique<RingProducer>(*ring, samples);
+  auto consumer = std::make_unique<RingConsumer>(*ring, samples, *producer);
+
+  const std::int64_t start_us = now_us();
+  if (!report.check(consumer->start() && producer->start(), "start the ring tasks")) {
+    return;
+  }
+  producer->join();
+  consumer->join();
+  const std::int64_t elapsed_us = now_us() - start_us;
+
+  report.add("ring", elapsed_us, samples * sizeof(std::int16_t) / 1024, "KiB");
+  report.check(consumer->is_intact(), "every sample crosses the ring once, in order");
+
+  const auto stats = consumer->get_stats();
+  std::printf("%-16s %10" PRIu32 " iterations, %" PRIu32 "/%" PRIu32 "/%" PRIu32 " us min/avg/max\n", "ring_consumer",
+    stats.iterations, stats.min_us, stats.avg_us, stats.max_us);
+}
+
+}
+
+int main(int argc, char** argv) {
+  const auto options = parse_options(argc, argv);
+  if (!options) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  std::string pattern = (std::filesystem::temp_directory_path() / "mp3-bench-XXXXXX").string();
+  if (!mkdtemp(pattern.data())) {
+    ESP_LOGE(kComponentTag, "Could not create a working directory");
+    return 1;
+  }
+  const std::filesystem::path work{pattern};
+
+  Report report{*options};
+  benchmark_library(*options, work, report);
+  benchmark_queue(report);
+  benchmark_ring(*options, report);
+  DeferredLog::drain();
+
+  if (options->keep) {
+    ESP_LOGI(kComponentTag, "Working directory kept at '%s'", work.c_str());
+  } else {
+    std::error_code error;
+    std::filesystem::remove_all(work, error);
+  }
+
+  return report.has_failed() ? 1 : 0;
+}
@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+extern "C" {
+
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+}
+
+namespace {
+
+const auto kStartTime = std::chrono::steady_clock::now();
+
+/// @brief what the host heap reports as free; large enough that no reserve check trips
+constexpr std::size_t kReportedFreeBytes = 256 * 1024 * 1024;
+
+bool wants_psram(const std::uint32_t caps) {
+  return caps & MALLOC_CAP_SPIRAM;
+}
+
+}
+
+extern "C" {
+
+int64_t esp_timer_get_time(void) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - kStartTime).count();
+}
+
+uint32_t esp_log_timestamp(void) {
+  return static_cast<uint32_t>(esp_timer_get_time() / 1000);
+}
+
+void esp_restart(void) {
+  std::fflush(stdout);
+  std::abort();
+}
+
+const char* esp_err_to_name(esp_err_t code) {
+  switch (code) {
+    case ESP_OK:
+      return "ESP_OK";
+    case ESP_FAIL:
+      return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+      return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+      return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+      return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_NOT_FOUND:
+      return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_TIMEOUT:
+      return "ESP_ERR_TIMEOUT";
+    default:
+      return "UNKNOWN ERROR";
+  }
+}
+
+void* heap_caps_malloc(size_t size, uint32_t caps) {
+  return wants_psram(caps) ? nullptr : std::malloc(size);
+}
+
+void* heap_caps_calloc(size_t count, size_t size, uint32_t caps) {
+  return wants_psram(caps) ? nullptr : std::calloc(count, size);
+}
+
+void* heap_caps_realloc(void* ptr, size_t size, uint32_t caps) {
+  return wants_psram(caps) ? nullptr : std::realloc(ptr, size);
+}
+
+void* heap_caps_aligned_alloc(size_t alignment, size_t size, uint32_t caps) {
+  void* memory = nullptr;
+  if (wants_psram(caps) || posix_memalign(&memory, std::max(alignment, sizeof(void*)), size) != 0) {
+    return nullptr;
+  }
+  return memory;
+}
+
+void heap_caps_free(void* ptr) {
+  std::free(ptr);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+  return wants_psram(caps) ? 0 : kReportedFreeBytes;
+}
+
+size_t heap_caps_get_total_size(uint32_t caps) {
+  return wants_psram(caps) ? 0 : kReportedFreeBytes;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+  return heap_caps_get_free_size(caps);
+}
+
+}
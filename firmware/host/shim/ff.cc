@@ -0,0 +1,114 @@
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <string>
+#include <system_error>
+
+#include <sys/stat.h>
+
+extern "C" {
+
+#include "ff.h"
+
+}
+
+namespace {
+
+/// @brief host directory standing in for the volume
+std::filesystem::path volume_root;
+
+/// @brief host path of a FatFs path ("0:/music" -> <root>/music)
+std::filesystem::path host_path(const TCHAR* path) {
+  std::string_view relative{path};
+  const auto drive = relative.find(':');
+  if (drive != std::string_view::npos) {
+    relative.remove_prefix(drive + 1);
+  }
+  while (!relative.empty() && relative.front() == '/') {
+    relative.remove_prefix(1);
+  }
+  return volume_root / relative;
+}
+
+/// @brief fill in a directory entry the way FatFs reports it
+FRESULT describe(const std::filesystem::path& path, FILINFO* fno) {
+  struct stat status{};
+  if (stat(path.c_str(), &status) != 0) {
+    return FR_NO_FILE;
+  }
+
+  const std::string name = path.filename().string();
+  if (name.size() >= sizeof(fno->fname)) {
+    return FR_INVALID_NAME;
+  }
+
+  std::memcpy(fno->fname, name.c_str(), name.size() + 1);
+  fno->altname[0] = '\0';
+  fno->fsize = S_ISDIR(status.st_mode) ? 0 : static_cast<FSIZE_t>(status.st_size);
+  fno->fattrib = (S_ISDIR(status.st_mode) ? AM_DIR : AM_ARC) | (name.front() == '.' ? AM_HID : 0);
+
+  // FAT timestamps are local time in two-second steps, from 1980
+  std::tm local{};
+  localtime_r(&status.st_mtime, &local);
+  const int year = local.tm_year + 1900 < 1980 ? 0 : local.tm_year + 1900 - 1980;
+  fno->fdate = static_cast<WORD>((year << 9) | ((local.tm_mon + 1) << 5) | local.tm_mday);
+  fno->ftime = static_cast<WORD>((local.tm_hour << 11) | (local.tm_min << 5) | (local.tm_sec / 2));
+  return FR_OK;
+}
+
+}
+
+extern "C" {
+
+void ff_host_mount(const char* directory) {
+  volume_root = directory;
+}
+
+FRESULT f_opendir(DIR* dp, const TCHAR* path) {
+  std::error_code error;
+  auto* const iterator = new std::filesystem::directory_iterator(host_path(path), error);
+  if (error) {
+    delete iterator;
+    dp->iterator = nullptr;
+    return FR_NO_PATH;
+  }
+
+  dp->iterator = iterator;
+  return FR_OK;
+}
+
+FRESULT f_readdir(DIR* dp, FILINFO* fno) {
+  auto* const iterator = static_cast<std::filesystem::directory_iterator*>(dp->iterator);
+  if (!iterator) {
+    return FR_INVALID_OBJECT;
+  }
+
+  // past the last entry FatFs returns an empty name; entries that vanish
+  // or do not fit are passed over
+  std::error_code error;
+  for (; *iterator != std::filesystem::directory_iterator(); iterator->increment(error)) {
+    if (error) {
+      return FR_DISK_ERR;
+    }
+    const auto path = (*iterator)->path();
+    if (describe(path, fno) == FR_OK) {
+      iterator->increment(error);
+      return FR_OK;
+    }
+  }
+
+  fno->fname[0] = '\0';
+  return FR_OK;
+}
+
+FRESULT f_closedir(DIR* dp) {
+  delete static_cast<std::filesystem::directory_iterator*>(dp->iterator);
+  dp->iterator = nullptr;
+  return FR_OK;
+}
+
+FRESULT f_stat(const TCHAR* path, FILINFO* fno) {
+  return describe(host_path(path), fno);
+}
+
+}
@@ -0,0 +1,345 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#include <pthread.h>
+#include <sched.h>
+
+extern "C" {
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const Clock::time_point kStartTime = Clock::now();
+
+/// @brief absolute deadline of a wait, or nothing for portMAX_DELAY
+struct Deadline {
+  explicit Deadline(const TickType_t timeout)
+    : forever(timeout == portMAX_DELAY),
+      at(Clock::now() + std::chrono::milliseconds(static_cast<std::uint64_t>(timeout) * 1000 / configTICK_RATE_HZ)) {}
+
+  /// @brief wait on a condition until it holds or the deadline passes
+  template <typename Predicate>
+  bool wait(std::condition_variable& condition, std::unique_lock<std::mutex>& lock, Predicate predicate) const {
+    if (forever) {
+      condition.wait(lock, predicate);
+      return true;
+    }
+    return condition.wait_until(lock, at, predicate);
+  }
+
+  const bool forever;
+  const Clock::time_point at;
+};
+
+/// @brief construct a host object in a caller-provided static buffer
+template <typename T, typename Buffer, typename... Args>
+T* emplace(Buffer* buffer, Args&&... args) {
+  static_assert(sizeof(T) <= sizeof(Buffer) && alignof(T) <= alignof(Buffer), "static buffer too small");
+  return new (buffer) T(std::forward<Args>(args)...);
+}
+
+}
+
+struct ShimTask {
+  ShimTask(TaskFunction_t task_function, void* task_argument, const std::uint32_t task_depth, const BaseType_t task_core,
+    const bool caller_owned)
+    : function(task_function), argument(task_argument), depth(task_depth), core(task_core), is_static(caller_owned) {}
+
+  TaskFunction_t function;
+  void* argument;
+  const std::uint32_t depth;
+  const BaseType_t core;
+  const bool is_static;
+
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable changed;
+  eTaskState state{eReady};
+};
+
+namespace {
+
+thread_local ShimTask* current_task = nullptr;
+
+/// @brief create the host thread of a task
+ShimTask* launch(ShimTask* task) {
+  task->thread = std::thread([task] {
+    current_task = task;
+    {
+      std::lock_guard lock(task->mutex);
+      task->state = eRunning;
+    }
+    task->function(task->argument);
+  });
+  return task;
+}
+
+}
+
+struct ShimQueue {
+  ShimQueue(const UBaseType_t queue_length, const UBaseType_t queue_item_size, std::uint8_t* queue_storage)
+    : length(queue_length), item_size(queue_item_size), storage(queue_storage) {}
+
+  const UBaseType_t length;
+  const UBaseType_t item_size;
+  std::uint8_t* const storage;
+
+  std::mutex mutex;
+  std::condition_variable not_empty;
+  std::condition_variable not_full;
+  UBaseType_t head{0};
+  UBaseType_t count{0};
+};
+
+struct ShimSemaphore {
+  ShimSemaphore(const UBaseType_t max, const UBaseType_t initial) : max_count(max), count(initial) {}
+
+  const UBaseType_t max_count;
+
+  std::mutex mutex;
+  std::condition_variable given;
+  UBaseType_t count;
+};
+
+struct ShimEventGroup {
+  std::mutex mutex;
+  std::condition_variable changed;
+  EventBits_t bits{0};
+};
+
+extern "C" {
+
+void vPortEnterCritical(portMUX_TYPE* mux) {
+  while (__atomic_exchange_n(&mux->locked, 1, __ATOMIC_ACQUIRE)) {
+    sched_yield();
+  }
+}
+
+void vPortExitCritical(portMUX_TYPE* mux) {
+  __atomic_store_n(&mux->locked, 0, __ATOMIC_RELEASE);
+}
+
+BaseType_t xPortGetCoreID(void) {
+  // where the placement policy put the task; the host scheduler may disagree
+  return current_task && current_task->core != tskNO_AFFINITY ? current_task->core : 0;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* /* name */,
+  const configSTACK_DEPTH_TYPE stack_depth, void* argument, UBaseType_t /* priority */, TaskHandle_t* created,
+  const BaseType_t core) {
+  auto* const task = launch(new ShimTask(function, argument, stack_depth, core, false));
+  if (created) {
+    *created = task;
+  }
+  return pdPASS;
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t function, const char* /* name */,
+  const std::uint32_t stack_depth, void* argument, UBaseType_t /* priority */, StackType_t* /* stack */,
+  StaticTask_t* tcb, const BaseType_t core) {
+  return launch(emplace<ShimTask>(tcb, function, argument, stack_depth, core, true));
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  if (!task || task == current_task) {
+    // a task ending itself has no one to join it
+    current_task->thread.detach();
+    pthread_exit(nullptr);
+  }
+
+  {
+    std::lock_guard lock(task->mutex);
+    task->state = eDeleted;
+  }
+  task->changed.notify_all();
+  task->thread.join();
+
+  if (task->is_static) {
+    task->~ShimTask();
+  } else {
+    delete task;
+  }
+}
+
+void vTaskSuspend(TaskHandle_t task) {
+  // only self-suspension is used: the task parks until it is deleted
+  task = task ? task : current_task;
+  std::unique_lock lock(task->mutex);
+  task->state = eSuspended;
+  task->changed.wait(lock, [task] { return task->state == eDeleted; });
+}
+
+eTaskState eTaskGetState(TaskHandle_t task) {
+  std::lock_guard lock(task->mutex);
+  return task->state;
+}
+
+void vTaskDelay(const TickType_t ticks) {
+  if (ticks == 0) {
+    std::this_thread::yield();
+    return;
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<std::uint64_t>(ticks) * 1000 / configTICK_RATE_HZ));
+}
+
+void vTaskYield(void) {
+  std::this_thread::yield();
+}
+
+TickType_t xTaskGetTickCount(void) {
+  const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - kStartTime);
+  return static_cast<TickType_t>(static_cast<std::uint64_t>(elapsed.count()) * configTICK_RATE_HZ / 1000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+  return current_task;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+  task = task ? task : current_task;
+  return task ? task->depth : 0;
+}
+
+QueueHandle_t xQueueCreateStatic(const UBaseType_t length, const UBaseType_t item_size, std::uint8_t* storage,
+  StaticQueue_t* buffer) {
+  return emplace<ShimQueue>(buffer, length, item_size, storage);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t timeout) {
+  std::unique_lock lock(queue->mutex);
+  if (!Deadline(timeout).wait(queue->not_full, lock, [queue] { return queue->count < queue->length; })) {
+    return pdFALSE;
+  }
+
+  const UBaseType_t index = (queue->head + queue->count) % queue->length;
+  std::memcpy(queue->storage + index * queue->item_size, item, queue->item_size);
+  queue->count++;
+  lock.unlock();
+  queue->not_empty.notify_one();
+  return pdTRUE;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* higher_priority_woken) {
+  if (higher_priority_woken) {
+    *higher_priority_woken = pdFALSE;
+  }
+  return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t timeout) {
+  std::unique_lock lock(queue->mutex);
+  if (!Deadline(timeout).wait(queue->not_empty, lock, [queue] { return queue->count > 0; })) {
+    return pdFALSE;
+  }
+
+  std::memcpy(item, queue->storage + queue->head * queue->item_size, queue->item_size);
+  queue->head = (queue->head + 1) % queue->length;
+  queue->count--;
+  lock.unlock();
+  queue->not_full.notify_one();
+  return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  std::lock_guard lock(queue->mutex);
+  return queue->count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t* buffer) {
+  return emplace<ShimSemaphore>(buffer, 1u, 0u);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t* buffer) {
+  return emplace<ShimSemaphore>(buffer, 1u, 1u);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCountingStatic(const UBaseType_t max_count, const UBaseType_t initial_count,
+  StaticSemaphore_t* buffer) {
+  return emplace<ShimSemaphore>(buffer, max_count, initial_count);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t timeout) {
+  std::unique_lock lock(semaphore->mutex);
+  if (!Deadline(timeout).wait(semaphore->given, lock, [semaphore] { return semaphore->count > 0; })) {
+    return pdFALSE;
+  }
+  semaphore->count--;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  std::unique_lock lock(semaphore->mutex);
+  if (semaphore->count >= semaphore->max_count) {
+    return pdFALSE;
+  }
+  semaphore->count++;
+  lock.unlock();
+  semaphore->given.notify_one();
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t* higher_priority_woken) {
+  if (higher_priority_woken) {
+    *higher_priority_woken = pdFALSE;
+  }
+  return xSemaphoreGive(semaphore);
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t semaphore) {
+  std::lock_guard lock(semaphore->mutex);
+  return semaphore->count;
+}
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t* buffer) {
+  return emplace<ShimEventGroup>(buffer);
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, const EventBits_t bits) {
+  std::unique_lock lock(group->mutex);
+  group->bits |= bits;
+  const EventBits_t result = group->bits;
+  lock.unlock();
+  group->changed.notify_all();
+  return result;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, const EventBits_t bits) {
+  std::lock_guard lock(group->mutex);
+  const EventBits_t result = group->bits;
+  group->bits &= ~bits;
+  return result;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+  std::lock_guard lock(group->mutex);
+  return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, const EventBits_t bits, const BaseType_t clear_on_exit,
+  const BaseType_t wait_for_all, TickType_t timeout) {
+  std::unique_lock lock(group->mutex);
+  const auto satisfied = [&] { return wait_for_all ? (group->bits & bits) == bits : (group->bits & bits) != 0; };
+  const bool met = Deadline(timeout).wait(group->changed, lock, satisfied);
+
+  const EventBits_t result = group->bits;
+  if (met && clear_on_exit) {
+    group->bits &= ~bits;
+  }
+  return result;
+}
+
+}
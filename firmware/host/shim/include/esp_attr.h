@@ -0,0 +1,8 @@
+#pragma once
+
+/* there is no IRAM or PSRAM on the host; placement attributes are dropped */
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define EXT_RAM_BSS_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
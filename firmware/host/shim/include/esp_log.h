@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* synchronous console logging in the ESP-IDF format */
+uint32_t esp_log_timestamp(void);
+
+#define ESP_LOG_AT(letter, tag, format, ...) \
+  printf(letter " (%u) %s: " format "\n", (unsigned)esp_log_timestamp(), tag __VA_OPT__(,) __VA_ARGS__)
+
+#define ESP_LOGE(tag, format, ...) ESP_LOG_AT("E", tag, format __VA_OPT__(,) __VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_AT("W", tag, format __VA_OPT__(,) __VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_AT("I", tag, format __VA_OPT__(,) __VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) do {} while (0)
+#define ESP_LOGV(tag, format, ...) do {} while (0)
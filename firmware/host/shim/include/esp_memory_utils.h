@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdbool.h>
+
+/* all host memory counts as internal RAM */
+static inline bool esp_ptr_internal(const void* ptr) { return ptr != 0; }
+static inline bool esp_ptr_external_ram(const void* ptr) { (void)ptr; return false; }
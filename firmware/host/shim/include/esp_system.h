@@ -0,0 +1,6 @@
+#pragma once
+
+#include "esp_err.h"
+
+/** @brief ends the process: a host "restart" has nothing to come back to */
+void esp_restart(void) __attribute__((noreturn));
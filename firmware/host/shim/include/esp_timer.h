@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+/** @brief microseconds since the process started, from the monotonic clock */
+int64_t esp_timer_get_time(void);
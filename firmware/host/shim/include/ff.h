@@ -0,0 +1,73 @@
+#pragma once
+
+/**
+ * Host stand-in for the FatFs directory API, backed by a host directory
+ * (see ff_host_mount()). Paths keep the FatFs form "<drive>:/<path>"; the
+ * drive number is ignored. Names starting with a dot are reported hidden,
+ * the way FAT volumes written by desktop systems usually mark them.
+ */
+
+#include <stdint.h>
+
+/* CONFIG_FATFS_SECTOR_4096 (see sdkconfig.defaults) */
+#define FF_MAX_SS 4096
+#define FF_LFN_BUF 255
+#define FF_SFN_BUF 12
+
+typedef unsigned int UINT;
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef uint64_t FSIZE_t;
+typedef char TCHAR;
+
+typedef enum {
+  FR_OK = 0,
+  FR_DISK_ERR,
+  FR_INT_ERR,
+  FR_NOT_READY,
+  FR_NO_FILE,
+  FR_NO_PATH,
+  FR_INVALID_NAME,
+  FR_DENIED,
+  FR_EXIST,
+  FR_INVALID_OBJECT,
+  FR_WRITE_PROTECTED,
+  FR_INVALID_DRIVE,
+  FR_NOT_ENABLED,
+  FR_NO_FILESYSTEM,
+  FR_MKFS_ABORTED,
+  FR_TIMEOUT,
+  FR_LOCKED,
+  FR_NOT_ENOUGH_CORE,
+  FR_TOO_MANY_OPEN_FILES,
+  FR_INVALID_PARAMETER
+} FRESULT;
+
+#define AM_RDO 0x01
+#define AM_HID 0x02
+#define AM_SYS 0x04
+#define AM_DIR 0x10
+#define AM_ARC 0x20
+
+/** @brief open directory; the host iterator lives behind the pointer */
+typedef struct {
+  void* iterator;
+} DIR;
+
+typedef struct {
+  FSIZE_t fsize;
+  WORD fdate;
+  WORD ftime;
+  BYTE fattrib;
+  TCHAR altname[FF_SFN_BUF + 1];
+  TCHAR fname[FF_LFN_BUF + 1];
+} FILINFO;
+
+FRESULT f_opendir(DIR* dp, const TCHAR* path);
+FRESULT f_readdir(DIR* dp, FILINFO* fno);
+FRESULT f_closedir(DIR* dp);
+FRESULT f_stat(const TCHAR* path, FILINFO* fno);
+
+/** @brief make a host directory the volume every drive number refers to */
+void ff_host_mount(const char* directory);
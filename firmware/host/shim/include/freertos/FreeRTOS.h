@@ -0,0 +1,62 @@
+#pragma once
+
+/**
+ * Host stand-in for the FreeRTOS kernel API the components use, implemented
+ * on std::thread in ../freertos.cc. Only the calls the host build needs are
+ * declared; the static object buffers are large enough to hold the host
+ * objects in place, so creating one never allocates, as on the target.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+
+#define configSTACK_DEPTH_TYPE uint32_t
+
+/* ESP-IDF default tick (CONFIG_FREERTOS_HZ) */
+#define configTICK_RATE_HZ 100
+
+#define portMAX_DELAY ((TickType_t)0xffffffffu)
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+
+#define tskNO_AFFINITY ((BaseType_t)0x7fffffff)
+
+/* storage for one host object, aligned for any member it may have */
+#define SHIM_STATIC_BUFFER(bytes) struct { union { long double align_ld; void* align_ptr; uint64_t align_u64; } align; \
+  unsigned char bytes_[bytes]; }
+
+typedef SHIM_STATIC_BUFFER(256) StaticTask_t;
+typedef SHIM_STATIC_BUFFER(192) StaticQueue_t;
+typedef SHIM_STATIC_BUFFER(192) StaticSemaphore_t;
+typedef SHIM_STATIC_BUFFER(192) StaticEventGroup_t;
+
+/* critical sections are a plain spinlock; the host has no interrupts to mask */
+typedef struct {
+  volatile int locked;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0}
+
+void vPortEnterCritical(portMUX_TYPE* mux);
+void vPortExitCritical(portMUX_TYPE* mux);
+
+#define portENTER_CRITICAL(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) vPortExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux) vPortExitCritical(mux)
+
+/* "ISRs" run on ordinary threads, so there is never a deferred switch to make */
+#define portYIELD_FROM_ISR(woken) ((void)(woken))
+
+/** @brief core the calling task was pinned to (0 when unpinned) */
+BaseType_t xPortGetCoreID(void);
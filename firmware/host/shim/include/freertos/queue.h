@@ -0,0 +1,14 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef struct ShimQueue* QueueHandle_t;
+
+QueueHandle_t xQueueCreateStatic(const UBaseType_t length, const UBaseType_t item_size, uint8_t* storage,
+  StaticQueue_t* buffer);
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t timeout);
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* higher_priority_woken);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t timeout);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+#define xQueueSendToBack xQueueSend
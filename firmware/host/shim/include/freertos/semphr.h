@@ -0,0 +1,16 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+/* counting semaphores; a mutex is one that starts out given (no priority
+   inheritance, no recursion) */
+typedef struct ShimSemaphore* SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t* buffer);
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t* buffer);
+SemaphoreHandle_t xSemaphoreCreateCountingStatic(const UBaseType_t max_count, const UBaseType_t initial_count,
+  StaticSemaphore_t* buffer);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t timeout);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t* higher_priority_woken);
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t semaphore);
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef struct ShimTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+typedef enum {
+  eRunning = 0,
+  eReady,
+  eBlocked,
+  eSuspended,
+  eDeleted,
+  eInvalid
+} eTaskState;
+
+/* the stack arguments are accepted for compatibility; every task runs on a
+   host thread with the default stack size */
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, const configSTACK_DEPTH_TYPE stack_depth,
+  void* argument, UBaseType_t priority, TaskHandle_t* created, const BaseType_t core);
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t function, const char* name, const uint32_t stack_depth,
+  void* argument, UBaseType_t priority, StackType_t* stack, StaticTask_t* tcb, const BaseType_t core);
+
+void vTaskDelete(TaskHandle_t task);
+void vTaskSuspend(TaskHandle_t task);
+eTaskState eTaskGetState(TaskHandle_t task);
+void vTaskDelay(const TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+/** @brief not measured on the host: always the full stack depth the task was created with */
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+void vTaskYield(void);
+#define taskYIELD() vTaskYield()
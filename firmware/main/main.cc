@@ -1,14 +1,29 @@
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstdio>
 #include <cstring>
 #include <memory>
+#include <utility>
 
+#include "a2dp_source.hpp"
+#include "boot_profiler.hpp"
+#include "button_input.hpp"
+#include "config_server.hpp"
+#include "decoder.hpp"
+#include "dsp.hpp"
+#include "memory_pool.hpp"
+#include "player.hpp"
+#include "power.hpp"
 #include "sd_card.hpp"
+#include "sd_stream.hpp"
+#include "state_store.hpp"
 
 extern "C" {
 
 #include "esp_log.h"
 #include "esp_task_wdt.h"
+#include "nvs_flash.h"
 
 }
 
@@ -16,6 +31,7 @@ namespace {
 
 constexpr const char* kComponentTag = "AppMain";
 constexpr std::uint32_t kWatchdogTimeoutMs = 10 * 1000;
+constexpr std::uint32_t kInternalCaps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
 
 const SdCardObject::Config kSdConfig = {
   .interface = SdCardObject::Interface::SPI,
@@ -23,9 +39,62 @@ const SdCardObject::Config kSdConfig = {
   .mosi = GPIO_NUM_23,
   .sck = GPIO_NUM_18,
   .cs = GPIO_NUM_5,
-  .max_frequency_khz = 400,
-  .max_open_files = 3,
+  .max_frequency_khz = SDMMC_FREQ_DEFAULT,
+  .max_open_files = 5,  // 3 cached track handles + config/index files
   .format_if_mount_failed = false,
+  .run_benchmark = false,
+};
+
+const DspObject::Config kDspConfig = {
+  .volume = 70,
+  .eq_enabled = false,
+  .band_gains_db = {},
+  .limiter = true,
+};
+
+const ButtonInput::Timing kButtonTiming = {
+  .debounce_ms = 15,
+  .long_press_ms = 600,
+  .repeat_ms = 150,
+};
+
+/// @brief buttons wired to ground, using the internal pull-ups
+constexpr std::array<std::pair<gpio_num_t, PlayerObject::Button>, 5> kButtonPins = {{
+  {GPIO_NUM_32, PlayerObject::Button::kPlayPause},
+  {GPIO_NUM_33, PlayerObject::Button::kNext},
+  {GPIO_NUM_25, PlayerObject::Button::kPrevious},
+  {GPIO_NUM_26, PlayerObject::Button::kVolumeUp},
+  {GPIO_NUM_27, PlayerObject::Button::kVolumeDown},
+}};
+
+/// @brief config mode button: a press starts or leaves config mode
+constexpr gpio_num_t kConfigButtonPin = GPIO_NUM_21;
+
+const A2dpSourceObject::Config kA2dpConfig = {
+  .device_name = APP_NAME,
+  .peer = {},
+  .reconnect_interval_ms = 5000,
+};
+
+const StateStore::Config kStateConfig = {
+  .flush_interval_ms = 60 * 1000,
+};
+
+const ConfigServerObject::Config kConfigServerConfig = {
+  .ssid = APP_NAME "-setup",
+  .password = "",
+  .channel = 1,
+  .idle_timeout_ms = 5 * 60 * 1000,
+  .link_release_timeout_ms = 5000,
+};
+
+const PowerObject::Config kPowerConfig = {
+  .max_freq_mhz = 240,
+  .min_freq_mhz = 80,
+  .light_sleep = true,
+  .low_fill_percent = 25,
+  .high_fill_percent = 75,
+  .high_bitrate_kbps = 256,
 };
 
 }
@@ -35,16 +104,22 @@ const SdCardObject::Config kSdConfig = {
 /// @param name name of the RTOS task
 extern "C" void vApplicationStackOverflowHook(TaskHandle_t handle, char *name) {
   constexpr const char* const fmt_str = "error: stack overflow in %s, triggering software restart";
-  /// TODO: log crash report to NVS
+  // filed in NVS by the next boot; no flash access from here
+  StateStore::record_crash(name);
   CHECK(false, fmt_str, name);
 }
 
 /// @brief firmware entrypoint
 extern "C" void app_main() {
+  BootProfiler profiler;
+  profiler.mark("app_main");
+
   /**
    * LOGGING CONFIGURATION
    */
-  esp_log_level_set("*", ESP_LOG_VERBOSE);
+  // verbose console output changes timing enough to cause dropouts; hot
+  // paths use the deferred LOG* macros instead
+  esp_log_level_set("*", ESP_LOG_INFO);
 
   /**
    * WATCHDOG CONFIGURATION
@@ -64,12 +139,75 @@ extern "C" void app_main() {
       esp_task_wdt_add(nullptr);
       break;
   }
+  profiler.mark("watchdog configured");
+
+  /**
+   * NVS CONFIGURATION
+   */
+  // the Bluetooth stack keeps its bonding keys here
+  esp_err_t nvs_status = nvs_flash_init();
+  if (nvs_status == ESP_ERR_NVS_NO_FREE_PAGES || nvs_status == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+    ESP_ERROR_CHECK(nvs_flash_erase());
+    nvs_status = nvs_flash_init();
+  }
+  ESP_ERROR_CHECK(nvs_status);
+  profiler.mark("nvs initialized");
+
+  /**
+   * PERSISTENT STATE
+   */
+  // restored before the components are built, since it changes their config
+  const auto state = make_active_object<StateStore>(kInternalCaps, kStateConfig);
+  CHECK(state, "error: could not allocate state store");
+  const bool restored = state->load();
+  const StateStore::State saved = state->get_state();
+
+  DspObject::Config dsp_config = kDspConfig;
+  A2dpSourceObject::Config a2dp_config = kA2dpConfig;
+  if (restored) {
+    dsp_config.volume = saved.volume;
+
+    // a peer set at build time wins over the one seen last
+    const auto& peer = a2dp_config.peer;
+    if (std::all_of(peer.begin(), peer.end(), [](const std::uint8_t byte) { return byte == 0; })) {
+      a2dp_config.peer = saved.peer;
+    }
+  }
+  profiler.mark("state restored");
 
   /**
    * COMPONENT INITIALIZATION
    */
+  // stacks are embedded in the objects, so these are the only allocations;
+  // each object picks its core from ActiveObject::placement()
+  const auto log = make_active_object<LogObject>(kInternalCaps);
+  const auto sd_card = make_active_object<SdCardObject>(kInternalCaps, kSdConfig);
+  const auto stream = make_active_object<SdStreamObject>(kInternalCaps, *sd_card);
+  const auto decoder = make_active_object<DecoderObject>(kInternalCaps, *sd_card, *stream);
+  const auto dsp = make_active_object<DspObject>(kInternalCaps, *decoder, dsp_config);
+  const auto a2dp = make_active_object<A2dpSourceObject>(kInternalCaps, *dsp, *state, a2dp_config);
+  const auto power = make_active_object<PowerObject>(kInternalCaps, *decoder, *a2dp, kPowerConfig);
+  const auto player = make_active_object<PlayerObject>(kInternalCaps, *sd_card, *decoder, *dsp, *state);
+  const auto config = make_active_object<ConfigServerObject>(kInternalCaps, *player, *a2dp, *dsp, *state, kConfigServerConfig);
+  CHECK(log && sd_card && stream && decoder && dsp && a2dp && power && player && config, "error: could not allocate components");
+  profiler.mark("components allocated");
+
+  // everything starts at once; only real dependencies are serialized, so the
+  // decoder and Bluetooth stack initialize while the card is still mounting
+  stream->depends_on(*sd_card);
+  player->depends_on(*sd_card);
+
   std::vector<std::shared_ptr<ActiveObject>> components;
-  components.push_back(std::make_shared<SdCardObject>(kSdConfig));
+  components.push_back(log);
+  components.push_back(state);
+  components.push_back(sd_card);
+  components.push_back(stream);
+  components.push_back(decoder);
+  components.push_back(dsp);
+  components.push_back(a2dp);
+  components.push_back(power);
+  components.push_back(player);
+  components.push_back(config);
 
   // start all components
   for (auto component : components) {
@@ -79,6 +217,33 @@ extern "C" void app_main() {
       assert(false);
     }
   }
+  profiler.mark("components started");
+
+  /**
+   * BUTTONS
+   */
+  // interrupt driven; events go straight to the player's (or config server's) mailbox
+  ButtonInput buttons{kButtonTiming};
+  for (const auto& [pin, button] : kButtonPins) {
+    buttons.add({.pin = pin, .code = static_cast<std::uint16_t>(button), .target = player.get()});
+  }
+  buttons.add({.pin = kConfigButtonPin, .code = 0, .target = config.get()});
+  if (!buttons.start()) {
+    ESP_LOGE(kComponentTag, "Buttons unavailable");
+  }
+  profiler.mark("buttons armed");
+
+  /**
+   * PLAYBACK
+   */
+  // the player takes over the queue once the card has initialized
+  sd_card->wait_until_ready();
+  profiler.mark("library ready");
+  player->wait_until_ready();
+  profiler.mark("playback requested");
+
+  profiler.report(components);
+  MemoryPool::log_stats();
 
   // join all components
   for (auto component : components) {